@@ -0,0 +1,15 @@
+#ifndef MESSAGE_QUEUE_EXECUTOR_H
+#define MESSAGE_QUEUE_EXECUTOR_H
+
+#include <functional>
+
+// Runs a task, e.g. by posting it to the application's event loop. Coroutines awaiting
+// a client call are resumed through it, so they never run on the client's own threads.
+using Executor = std::function<void(std::function<void()>)>;
+
+// Runs the task at once on the calling thread
+inline void InlineExecutor(std::function<void()> task) {
+    task();
+}
+
+#endif // MESSAGE_QUEUE_EXECUTOR_H
@@ -0,0 +1,298 @@
+#include "record_batch.h"
+#include <algorithm>
+#include <array>
+
+namespace {
+constexpr size_t kBaseOffsetPos = 1;
+constexpr size_t kCrcPos = 9;
+constexpr size_t kBaseTimestampPos = 13;
+constexpr size_t kRecordCountPos = 21;
+constexpr size_t kLastOffsetDeltaPos = 25;
+constexpr size_t kFixedHeaderBytes = 29;
+
+// Table for the Castagnoli polynomial (reflected), matching java.util.zip.CRC32C
+std::array<uint32_t, 256> MakeCrc32cTable() {
+    std::array<uint32_t, 256> table{};
+    for (uint32_t i = 0; i < 256; ++i) {
+        uint32_t crc = i;
+        for (int bit = 0; bit < 8; ++bit) {
+            crc = (crc & 1) ? (crc >> 1) ^ 0x82F63B78u : crc >> 1;
+        }
+        table[i] = crc;
+    }
+    return table;
+}
+
+uint32_t Crc32c(const char* data, size_t size) {
+    static const std::array<uint32_t, 256> table = MakeCrc32cTable();
+    uint32_t crc = 0xFFFFFFFFu;
+    for (size_t i = 0; i < size; ++i) {
+        crc = table[(crc ^ static_cast<uint8_t>(data[i])) & 0xFF] ^ (crc >> 8);
+    }
+    return crc ^ 0xFFFFFFFFu;
+}
+
+void PutFixed(char* dest, uint64_t value, int bytes) {
+    for (int i = bytes - 1; i >= 0; --i) {
+        dest[i] = static_cast<char>(value & 0xFF);
+        value >>= 8;
+    }
+}
+
+uint64_t GetFixed(const char* src, int bytes) {
+    uint64_t value = 0;
+    for (int i = 0; i < bytes; ++i) {
+        value = (value << 8) | static_cast<uint8_t>(src[i]);
+    }
+    return value;
+}
+
+void PutVarint(std::string* dest, uint64_t value) {
+    while (value >= 0x80) {
+        dest->push_back(static_cast<char>((value & 0x7F) | 0x80));
+        value >>= 7;
+    }
+    dest->push_back(static_cast<char>(value));
+}
+
+size_t VarintSize(uint64_t value) {
+    size_t size = 1;
+    while (value >= 0x80) {
+        value >>= 7;
+        ++size;
+    }
+    return size;
+}
+
+void PutBytes(std::string* dest, std::string_view bytes) {
+    PutVarint(dest, bytes.size());
+    dest->append(bytes.data(), bytes.size());
+}
+
+uint64_t ZigZag(int64_t value) {
+    return (static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> 63);
+}
+
+int64_t UnZigZag(uint64_t value) {
+    return static_cast<int64_t>(value >> 1) ^ -static_cast<int64_t>(value & 1);
+}
+
+// Bounds-checked cursor over an encoded batch
+class Reader {
+public:
+    Reader(std::string_view data, size_t pos) : data_(data), pos_(pos) {}
+
+    bool Varint(uint64_t* value) {
+        *value = 0;
+        for (int shift = 0; shift < 64; shift += 7) {
+            if (pos_ >= data_.size()) {
+                return false;
+            }
+            uint8_t byte = data_[pos_++];
+            *value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+            if ((byte & 0x80) == 0) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    bool Bytes(std::string* value) {
+        std::string_view view;
+        if (!Bytes(&view)) {
+            return false;
+        }
+        value->assign(view.data(), view.size());
+        return true;
+    }
+
+    bool Bytes(std::string_view* value) {
+        uint64_t size;
+        if (!Varint(&size) || size > data_.size() - pos_) {
+            return false;
+        }
+        *value = data_.substr(pos_, size);
+        pos_ += size;
+        return true;
+    }
+
+private:
+    std::string_view data_;
+    size_t pos_;
+};
+
+bool ParseHeader(std::string_view data, RecordBatchHeader* header, Reader* reader) {
+    if (data.size() < kFixedHeaderBytes || static_cast<uint8_t>(data[0]) != kRecordBatchMagic) {
+        return false;
+    }
+    header->base_offset = GetFixed(data.data() + kBaseOffsetPos, 8);
+    header->base_timestamp = GetFixed(data.data() + kBaseTimestampPos, 8);
+    header->record_count = GetFixed(data.data() + kRecordCountPos, 4);
+    header->last_offset_delta = GetFixed(data.data() + kLastOffsetDeltaPos, 4);
+
+    uint64_t partition;
+    if (!reader->Bytes(&header->topic) || !reader->Varint(&partition) || header->record_count < 0
+        || header->last_offset_delta < header->record_count - 1) {
+        return false;
+    }
+    header->partition = partition;
+    return true;
+}
+
+// Verifies the CRC and decodes every record of the batch. RecordType is Record, which copies keys,
+// values and headers out of data, or RecordView, which points into it; Reader::Bytes serves both.
+template <typename RecordType>
+bool DecodeRecords(std::string_view data, RecordBatchHeader* header, std::vector<RecordType>* records) {
+    Reader reader(data, kFixedHeaderBytes);
+    if (!ParseHeader(data, header, &reader)) {
+        return false;
+    }
+    if (GetFixed(data.data() + kCrcPos, 4) != Crc32c(data.data() + kBaseTimestampPos, data.size() - kBaseTimestampPos)) {
+        return false;
+    }
+
+    records->reserve(records->size() + std::min<size_t>(header->record_count, data.size()));
+    for (int32_t i = 0; i < header->record_count; ++i) {
+        RecordType record;
+        uint64_t offset_delta, timestamp_delta, header_count;
+        if (!reader.Varint(&offset_delta) || !reader.Varint(&timestamp_delta)
+            || !reader.Bytes(&record.key) || !reader.Bytes(&record.value) || !reader.Varint(&header_count)) {
+            return false;
+        }
+        record.offset = header->base_offset + offset_delta;
+        record.timestamp = header->base_timestamp + UnZigZag(timestamp_delta);
+        for (uint64_t h = 0; h < header_count; ++h) {
+            typename decltype(record.headers)::value_type record_header;
+            if (!reader.Bytes(&record_header.key) || !reader.Bytes(&record_header.value)) {
+                return false;
+            }
+            record.headers.push_back(std::move(record_header));
+        }
+        records->push_back(std::move(record));
+    }
+    return true;
+}
+}
+
+RecordBatchBuilder::RecordBatchBuilder(const std::string& topic, int partition, bool conflate)
+    : topic_(topic), partition_(partition), base_timestamp_(0), record_count_(0), conflate_(conflate), conflated_count_(0) {}
+
+void RecordBatchBuilder::Append(std::string_view key, std::string_view value, int64_t timestamp, const std::vector<RecordHeader>& headers) {
+    size_t start = records_.size();
+    int32_t index = BeginRecord(key, timestamp);
+    PutBytes(&records_, value);
+    AppendHeaders(headers);
+    FinishRecord(key, index, start);
+}
+
+void RecordBatchBuilder::Append(std::string_view key, size_t value_size, const std::function<void(char*)>& write_value, int64_t timestamp,
+                                const std::vector<RecordHeader>& headers) {
+    size_t start = records_.size();
+    int32_t index = BeginRecord(key, timestamp);
+    PutVarint(&records_, value_size);
+    size_t value_pos = records_.size();
+    records_.resize(value_pos + value_size);
+    write_value(&records_[value_pos]);
+    AppendHeaders(headers);
+    FinishRecord(key, index, start);
+}
+
+int32_t RecordBatchBuilder::NextIndex(std::string_view key) const {
+    if (conflate_ && !key.empty()) {
+        auto slot = key_index_.find(key);
+        if (slot != key_index_.end()) {
+            return slot->second;
+        }
+    }
+    return record_count_;
+}
+
+int32_t RecordBatchBuilder::BeginRecord(std::string_view key, int64_t timestamp) {
+    if (record_count_ == 0) {
+        base_timestamp_ = timestamp;
+    }
+
+    int32_t index = NextIndex(key);
+    PutVarint(&records_, index);
+    PutVarint(&records_, ZigZag(timestamp - base_timestamp_));
+    PutBytes(&records_, key);
+    return index;
+}
+
+void RecordBatchBuilder::FinishRecord(std::string_view key, int32_t index, size_t start) {
+    if (!conflate_) {
+        ++record_count_;
+        return;
+    }
+    if (index == record_count_) {
+        record_starts_.push_back(start);
+        if (!key.empty()) {
+            key_index_.emplace(key, index);
+        }
+        ++record_count_;
+        return;
+    }
+
+    // Splice the new encoding over the record it replaces. The slot keeps its offset delta, so
+    // the later records only shift position.
+    size_t old_start = record_starts_[index];
+    size_t old_end = index + 1 < record_count_ ? record_starts_[index + 1] : start;
+    std::string record = records_.substr(start);
+    records_.resize(start);
+    records_.replace(old_start, old_end - old_start, record);
+    for (int32_t i = index + 1; i < record_count_; ++i) {
+        record_starts_[i] += record.size();
+        record_starts_[i] -= old_end - old_start;
+    }
+    ++conflated_count_;
+}
+
+void RecordBatchBuilder::AppendHeaders(const std::vector<RecordHeader>& headers) {
+    PutVarint(&records_, headers.size());
+    for (const auto& header : headers) {
+        PutBytes(&records_, header.key);
+        PutBytes(&records_, header.value);
+    }
+}
+
+size_t RecordBatchBuilder::size_bytes() const {
+    return kFixedHeaderBytes + VarintSize(topic_.size()) + topic_.size() + VarintSize(partition_) + records_.size();
+}
+
+std::string RecordBatchBuilder::Build() const {
+    std::string batch(kFixedHeaderBytes, '\0');
+    batch.reserve(size_bytes());
+    batch[0] = static_cast<char>(kRecordBatchMagic);
+    PutFixed(&batch[kBaseTimestampPos], base_timestamp_, 8);
+    PutFixed(&batch[kRecordCountPos], record_count_, 4);
+    // Offset deltas are slot indexes, also when conflating
+    PutFixed(&batch[kLastOffsetDeltaPos], static_cast<uint32_t>(record_count_ - 1), 4);
+    PutBytes(&batch, topic_);
+    PutVarint(&batch, partition_);
+    batch.append(records_);
+
+    PutFixed(&batch[kCrcPos], Crc32c(batch.data() + kBaseTimestampPos, batch.size() - kBaseTimestampPos), 4);
+    return batch;
+}
+
+void RecordBatchBuilder::Clear() {
+    records_.clear();
+    record_count_ = 0;
+    base_timestamp_ = 0;
+    conflated_count_ = 0;
+    record_starts_.clear();
+    key_index_.clear();
+}
+
+bool ReadRecordBatchHeader(std::string_view data, RecordBatchHeader* header) {
+    Reader reader(data, kFixedHeaderBytes);
+    return ParseHeader(data, header, &reader);
+}
+
+bool DecodeRecordBatch(std::string_view data, RecordBatchHeader* header, std::vector<Record>* records) {
+    return DecodeRecords(data, header, records);
+}
+
+bool DecodeRecordBatchViews(std::string_view data, RecordBatchHeader* header, std::vector<RecordView>* records) {
+    return DecodeRecords(data, header, records);
+}
@@ -0,0 +1,137 @@
+#ifndef MESSAGE_QUEUE_RECORD_BATCH_H
+#define MESSAGE_QUEUE_RECORD_BATCH_H
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include "record_header.h"
+
+// Compact encoding of the records of one topic-partition, carried on the wire and
+// stored by the broker as a single ledger entry. Layout (fixed-width fields big-endian):
+//
+//   magic             int8    kRecordBatchMagic
+//   base_offset       int64   offset of the first record, assigned by the broker
+//   crc               uint32  CRC-32C of every byte after this field
+//   base_timestamp    int64   timestamp of the first record, in milliseconds since the epoch
+//   record_count      int32
+//   last_offset_delta int32   offset delta of the last record, -1 if there is none
+//   topic             varint length + bytes
+//   partition         varint
+//   records           record_count x {
+//                         offset_delta    varint
+//                         timestamp_delta zigzag varint
+//                         key             varint length + bytes
+//                         value           varint length + bytes
+//                         header_count    varint, then header_count x {key, value} as length + bytes
+//                     }
+//
+// The base offset sits outside the CRC so the broker can stamp it without re-checksumming.
+// The last offset delta states where the batch ends even when its records are not
+// contiguous, as in a batch the broker filtered.
+
+constexpr uint8_t kRecordBatchMagic = 2;
+
+struct RecordBatchHeader {
+    int64_t base_offset;
+    int64_t base_timestamp;
+    int32_t record_count;
+    int32_t last_offset_delta;
+    std::string topic;
+    int partition;
+};
+
+struct Record {
+    int64_t offset;
+    int64_t timestamp;
+    std::string key;
+    std::string value;
+    std::vector<RecordHeader> headers;
+};
+
+struct RecordHeaderView {
+    std::string_view key;
+    std::string_view value;
+};
+
+// A record decoded in place; every view points into the encoded batch
+struct RecordView {
+    int64_t offset;
+    int64_t timestamp;
+    std::string_view key;
+    std::string_view value;
+    std::vector<RecordHeaderView> headers;
+};
+
+// Accumulates records for one topic-partition and encodes them as a RecordBatch.
+// A conflating builder keeps only the latest record per non-empty key: appending a key
+// already in the batch replaces that record in its slot instead of adding one.
+class RecordBatchBuilder {
+public:
+    RecordBatchBuilder(const std::string& topic, int partition, bool conflate = false);
+
+    void Append(std::string_view key, std::string_view value, int64_t timestamp, const std::vector<RecordHeader>& headers);
+
+    // Appends a record whose value write_value writes straight into the batch buffer. It must fill
+    // exactly value_size bytes.
+    void Append(std::string_view key, size_t value_size, const std::function<void(char*)>& write_value, int64_t timestamp,
+                const std::vector<RecordHeader>& headers);
+
+    // Index within the batch the next record with this key is written to: the slot of the record it
+    // replaces when conflating, otherwise record_count()
+    int32_t NextIndex(std::string_view key) const;
+
+    const std::string& topic() const { return topic_; }
+    int partition() const { return partition_; }
+    int record_count() const { return record_count_; }
+    // Timestamp of the first appended record
+    int64_t base_timestamp() const { return base_timestamp_; }
+    // Records replaced by a later record with the same key since the last Clear
+    int conflated_count() const { return conflated_count_; }
+
+    // Encoded size of the batch built from the records appended so far
+    size_t size_bytes() const;
+
+    // Encodes the appended records. The base offset is left as 0 for the broker to assign.
+    std::string Build() const;
+
+    // Drops all appended records, keeping the topic-partition
+    void Clear();
+
+private:
+    std::string topic_;
+    int partition_;
+    int64_t base_timestamp_;
+    int32_t record_count_;
+    std::string records_; // Encoded records
+
+    // Conflation state: where each record starts in records_, and the slot of each key
+    bool conflate_;
+    int conflated_count_;
+    std::vector<size_t> record_starts_;
+    struct KeyHash {
+        using is_transparent = void;
+        size_t operator()(std::string_view key) const { return std::hash<std::string_view>{}(key); }
+    };
+    std::unordered_map<std::string, int32_t, KeyHash, std::equal_to<>> key_index_;
+
+    // Starts encoding a record for key at the end of records_, returning its slot
+    int32_t BeginRecord(std::string_view key, int64_t timestamp);
+    // Moves the record encoded from start into its slot and counts it
+    void FinishRecord(std::string_view key, int32_t index, size_t start);
+    void AppendHeaders(const std::vector<RecordHeader>& headers);
+};
+
+// Reads the batch header. Returns false if the data is not a well-formed RecordBatch.
+bool ReadRecordBatchHeader(std::string_view data, RecordBatchHeader* header);
+
+// Verifies the CRC and decodes every record of the batch
+bool DecodeRecordBatch(std::string_view data, RecordBatchHeader* header, std::vector<Record>* records);
+
+// Like DecodeRecordBatch, without copying keys, values or headers out of data
+bool DecodeRecordBatchViews(std::string_view data, RecordBatchHeader* header, std::vector<RecordView>* records);
+
+#endif // MESSAGE_QUEUE_RECORD_BATCH_H
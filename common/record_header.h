@@ -0,0 +1,12 @@
+#ifndef MESSAGE_QUEUE_RECORD_HEADER_H
+#define MESSAGE_QUEUE_RECORD_HEADER_H
+
+#include <string>
+
+// Application-defined header attached to a message. Values are raw bytes.
+struct RecordHeader {
+    std::string key;
+    std::string value;
+};
+
+#endif // MESSAGE_QUEUE_RECORD_HEADER_H
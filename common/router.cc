@@ -13,9 +13,11 @@ Router::Router(const std::vector<std::string>& bootstrap_servers)
 }
 
 std::string Router::GetBrokerIP(const std::string& topic, int partition) {
-    std::lock_guard<std::mutex> lock(mutex_);
-    if (routing_table_.count(topic) && routing_table_[topic].count(partition)) {
-        return routing_table_[topic][partition];
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (routing_table_.count(topic) && routing_table_[topic].count(partition)) {
+            return routing_table_[topic][partition];
+        }
     }
 
     // If partition leader is not found for a paritcular topic then fetch metadata for that topic
@@ -23,6 +25,7 @@ std::string Router::GetBrokerIP(const std::string& topic, int partition) {
               << ". Refreshing metadata..." << std::endl;
 
     FetchMetadata(topic);
+    std::lock_guard<std::mutex> lock(mutex_);
     if (routing_table_.count(topic) && routing_table_[topic].count(partition)) {
         return routing_table_[topic][partition];
     }
@@ -36,7 +39,9 @@ std::string Router::GetBrokerIP(const std::string& broker_id) {
 
     message_queue::BrokerAddressResponse response;
     grpc::ClientContext context;
+    std::unique_lock<std::mutex> stub_lock(stub_mutex_);
     grpc::Status status = stub_->GetBrokerAddress(&context, request, &response);
+    stub_lock.unlock();
 
     if (status.ok() && response.success()) {
         return response.broker_address();
@@ -47,6 +52,26 @@ std::string Router::GetBrokerIP(const std::string& broker_id) {
     return "";
 }
 
+std::unordered_map<std::string, std::string> Router::ListBrokers() {
+    message_queue::ListBrokersRequest request;
+    message_queue::ListBrokersResponse response;
+    grpc::ClientContext context;
+    std::unique_lock<std::mutex> stub_lock(stub_mutex_);
+    grpc::Status status = stub_->ListBrokers(&context, request, &response);
+    stub_lock.unlock();
+
+    std::unordered_map<std::string, std::string> brokers;
+    if (status.ok() && response.success()) {
+        for (const auto& broker : response.brokers()) {
+            brokers[broker.broker_id()] = broker.broker_address();
+        }
+        return brokers;
+    }
+
+    std::cerr << "Failed to list brokers - " << (status.ok() ? response.error_message() : status.error_message()) << std::endl;
+    return brokers;
+}
+
 bool Router::ConnectToBootstrapServer() {
     std::cout << "Attempting to connect to a random bootstrap server..." << std::endl;
 
@@ -74,23 +99,82 @@ bool Router::ConnectToBootstrapServer() {
     return false;
 }
 
+void Router::RefreshMetadata(const std::string& topic) {
+    FetchMetadata(topic);
+}
+
+int Router::GetPartitionCount(const std::string& topic) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto partitions = topic_partitions_.find(topic);
+        if (partitions != topic_partitions_.end() && partitions->second > 0) {
+            return partitions->second;
+        }
+    }
+
+    FetchMetadata(topic);
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (topic_partitions_[topic] <= 0) {
+        throw std::runtime_error("Topic has no partitions: " + topic);
+    }
+    return topic_partitions_[topic];
+}
+
+void Router::RefreshStaleMetadata(int max_age_ms) {
+    std::vector<std::string> stale;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto now = std::chrono::steady_clock::now();
+        for (const auto& entry : metadata_fetched_at_) {
+            if (now - entry.second >= std::chrono::milliseconds(max_age_ms)) {
+                stale.push_back(entry.first);
+            }
+        }
+    }
+
+    for (const auto& topic : stale) {
+        try {
+            FetchMetadata(topic);
+        } catch (const std::exception& e) {
+            // Retry once the known metadata has aged again rather than on every call
+            std::lock_guard<std::mutex> lock(mutex_);
+            metadata_fetched_at_[topic] = std::chrono::steady_clock::now();
+            std::cerr << "Keeping known metadata for topic: " << topic << " - " << e.what() << std::endl;
+        }
+    }
+}
+
+void Router::UpdateLeader(const std::string& topic, int partition, const std::string& broker_address) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::cout << "Leader of topic: " << topic << ", partition: " << partition << " moved to " << broker_address << std::endl;
+    routing_table_[topic][partition] = broker_address;
+}
+
 void Router::FetchMetadata(const std::string& topic) {
     message_queue::MetadataRequest request;
     request.set_topic(topic);
 
-    message_queue::MetadataResponse response;
-    grpc::ClientContext context;
-
-    grpc::Status status = stub_->GetMetadata(&context, request, &response);
-
-    if (status.ok() && response.success()) {
-        std::cout << "Metadata fetched successfully for topic: " << topic << std::endl;
-        routing_table_[topic].clear();
-        topic_partitions_[topic] = response.partitions_size();
-        for (const auto& partition : response.partitions()) {
-            routing_table_[topic][partition.partition_id()] = partition.broker_address();
+    // Try each bootstrap server at most once so an unreachable cluster surfaces as an error
+    std::unique_lock<std::mutex> stub_lock(stub_mutex_);
+    for (size_t attempt = 0; attempt <= bootstrap_servers_.size(); ++attempt) {
+        message_queue::MetadataResponse response;
+        grpc::ClientContext context;
+
+        grpc::Status status = stub_->GetMetadata(&context, request, &response);
+
+        if (status.ok() && response.success()) {
+            stub_lock.unlock();
+            std::lock_guard<std::mutex> lock(mutex_);
+            std::cout << "Metadata fetched successfully for topic: " << topic << std::endl;
+            routing_table_[topic].clear();
+            topic_partitions_[topic] = response.partitions_size();
+            metadata_fetched_at_[topic] = std::chrono::steady_clock::now();
+            for (const auto& partition : response.partitions()) {
+                routing_table_[topic][partition.partition_id()] = partition.broker_address();
+            }
+            return;
         }
-    } else {
+
         std::cerr << "Failed to fetch metadata: " << (status.ok() ? response.error_message() : status.error_message()) << std::endl;
 
         // Attempt to reconnect to a different bootstrap server
@@ -100,20 +184,28 @@ void Router::FetchMetadata(const std::string& topic) {
 
         // Retry fetching metadata after reconnecting
         std::cerr << "Retrying metadata fetch for topic: " << topic << std::endl;
-        FetchMetadata(topic);
     }
+
+    throw std::runtime_error("Metadata fetch failed for topic: " + topic);
 }
 
 
 void Router::StartPeriodicMetadataRefresh(int interval_ms) {
     std::thread([this, interval_ms]() {
         while (true) {
+            std::vector<std::string> topics;
             {
                 std::lock_guard<std::mutex> lock(mutex_);
                 for (const auto& entry : routing_table_) {
-                    const std::string& topic = entry.first;
-                    std::cout << "Periodically refreshing metadata for topic: " << topic << std::endl;
+                    topics.push_back(entry.first);
+                }
+            }
+            for (const auto& topic : topics) {
+                std::cout << "Periodically refreshing metadata for topic: " << topic << std::endl;
+                try {
                     FetchMetadata(topic);
+                } catch (const std::exception& e) {
+                    std::cerr << "Periodic metadata refresh failed: " << e.what() << std::endl;
                 }
             }
             std::this_thread::sleep_for(std::chrono::milliseconds(interval_ms));
@@ -1,6 +1,7 @@
 #ifndef MESSAGE_QUEUE_ROUTER_H
 #define MESSAGE_QUEUE_ROUTER_H
 
+#include <chrono>
 #include <string>
 #include <vector>
 #include <unordered_map>
@@ -17,6 +18,23 @@ public:
 
     // Gets the broker for a given broker id
     std::string GetBrokerIP(const std::string& broker_id);
+
+    // Address of every registered broker by broker id. Empty if the lookup failed.
+    std::unordered_map<std::string, std::string> ListBrokers();
+
+    // Re-fetches the routing table for a topic, e.g. after its leader stopped responding
+    void RefreshMetadata(const std::string& topic);
+
+    // Number of partitions of a topic as last fetched. Only a topic not seen before is fetched here;
+    // RefreshStaleMetadata keeps known counts current.
+    int GetPartitionCount(const std::string& topic);
+
+    // Re-fetches the metadata of every known topic fetched more than max_age_ms ago, so partitions
+    // added to a topic are picked up. A topic whose fetch fails keeps its metadata until it ages again.
+    void RefreshStaleMetadata(int max_age_ms);
+
+    // Records the leader a broker redirected a request to, without fetching metadata
+    void UpdateLeader(const std::string& topic, int partition, const std::string& broker_address);
     
      // Fetch routing table for a given topic periodically
     void StartPeriodicMetadataRefresh(int interval_ms); // Optional Feature. Call when router is initialized.
@@ -24,11 +42,14 @@ public:
 private:
     std::unordered_map<std::string, std::unordered_map<int, std::string>> routing_table_;
     std::unordered_map<std::string, int> topic_partitions_;
-    std::mutex mutex_;
+    std::unordered_map<std::string, std::chrono::steady_clock::time_point> metadata_fetched_at_;
+    std::mutex mutex_; // Guards the tables above; never held across an RPC
+    std::mutex stub_mutex_; // Guards stub_ while a metadata fetch may replace it
     std::unique_ptr<message_queue::MessageQueue::Stub> stub_;
     std::vector<std::string> bootstrap_servers_; // Store bootstrap servers
     
-    // Internal method to fetch metadata for a topic
+    // Internal method to fetch metadata for a topic. Throws once every bootstrap server has been tried.
+    // Must be called without mutex_ held, so lookups of other topics are not held up by the RPC.
     void FetchMetadata(const std::string& topic);
     // Internal method to restablish stub for router if connection is lost
     bool ConnectToBootstrapServer();
@@ -0,0 +1,87 @@
+#ifndef MESSAGE_QUEUE_SERDE_H
+#define MESSAGE_QUEUE_SERDE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <google/protobuf/message_lite.h>
+
+// Serialisers used by TypedProducer and TypedConsumer. A serde for T provides
+//
+//   static size_t Size(const T& value);             // Encoded size, asked before writing
+//   static void Write(const T& value, char* dest);  // Writes exactly Size(value) bytes
+//   using View = ...;                               // What a fetched value decodes to
+//   static bool Read(std::string_view bytes, View* view);
+//
+// Write encodes straight into the producer's batch buffer and Read decodes from the
+// fetched buffer, so no intermediate string is built on either side.
+
+template <typename T>
+concept ProtobufMessage = std::is_base_of_v<google::protobuf::MessageLite, T>;
+
+// Chosen at compile time from the type. Types not covered here need their own serde.
+template <typename T>
+struct DefaultSerde;
+
+// Strings are written as their bytes and read back as views into the fetched buffer
+template <>
+struct DefaultSerde<std::string> {
+    using View = std::string_view;
+
+    static size_t Size(const std::string& value) { return value.size(); }
+    static void Write(const std::string& value, char* dest) { std::memcpy(dest, value.data(), value.size()); }
+    static bool Read(std::string_view bytes, View* view) {
+        *view = bytes;
+        return true;
+    }
+};
+
+template <>
+struct DefaultSerde<std::string_view> {
+    using View = std::string_view;
+
+    static size_t Size(std::string_view value) { return value.size(); }
+    static void Write(std::string_view value, char* dest) { std::memcpy(dest, value.data(), value.size()); }
+    static bool Read(std::string_view bytes, View* view) {
+        *view = bytes;
+        return true;
+    }
+};
+
+// Protobuf messages use their wire format, serialised with the size computed by Size
+template <ProtobufMessage T>
+struct DefaultSerde<T> {
+    using View = T;
+
+    static size_t Size(const T& value) { return value.ByteSizeLong(); }
+    static void Write(const T& value, char* dest) {
+        value.SerializeWithCachedSizesToArray(reinterpret_cast<uint8_t*>(dest));
+    }
+    static bool Read(std::string_view bytes, View* view) {
+        return view->ParseFromArray(bytes.data(), static_cast<int>(bytes.size()));
+    }
+};
+
+// Trivially copyable structs are copied as their in-memory representation, so producer
+// and consumer must agree on layout and byte order. Fetched bytes carry no alignment
+// guarantee, so a value is copied out rather than viewed in place.
+template <typename T>
+    requires(std::is_trivially_copyable_v<T> && !ProtobufMessage<T>)
+struct DefaultSerde<T> {
+    using View = T;
+
+    static size_t Size(const T&) { return sizeof(T); }
+    static void Write(const T& value, char* dest) { std::memcpy(dest, &value, sizeof(T)); }
+    static bool Read(std::string_view bytes, View* view) {
+        if (bytes.size() != sizeof(T)) {
+            return false;
+        }
+        std::memcpy(view, bytes.data(), sizeof(T));
+        return true;
+    }
+};
+
+#endif // MESSAGE_QUEUE_SERDE_H
@@ -0,0 +1,135 @@
+#include "tracer.h"
+#include <algorithm>
+#include <bit>
+#include <chrono>
+#include <iostream>
+#include <random>
+
+namespace {
+constexpr const char* kStageNames[kTraceStageCount] = {
+    "linger", "produce_request", "ledger_append", "produce_ack", "fetch_serve", "consumer_delivery", "end_to_end",
+};
+
+std::mt19937_64& Random() {
+    thread_local std::mt19937_64 random(std::random_device{}());
+    return random;
+}
+}
+
+const char* TraceStageName(TraceStage stage) {
+    return kStageNames[static_cast<int>(stage)];
+}
+
+Tracer& Tracer::Instance() {
+    static Tracer tracer;
+    return tracer;
+}
+
+void Tracer::Configure(const TraceOptions& options) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (span_file_.is_open()) {
+        span_file_.close();
+    }
+    if (!options.span_file.empty()) {
+        span_file_.open(options.span_file, std::ios::app);
+        if (!span_file_) {
+            std::cerr << "Failed to open trace span file: " << options.span_file << std::endl;
+        }
+    }
+    // Trace ids of different processes must not collide, so they start at a random point
+    next_trace_id_ = Random()() | 1;
+    sample_rate_ = std::clamp(options.sample_rate, 0.0, 1.0);
+}
+
+bool Tracer::ShouldSample() {
+    double rate = sample_rate_.load(std::memory_order_relaxed);
+    if (rate <= 0) {
+        return false;
+    }
+    return std::uniform_real_distribution<double>(0, 1)(Random()) < rate;
+}
+
+std::vector<RecordHeader> Tracer::StartTrace(const std::vector<RecordHeader>& headers, uint64_t* trace_id, int64_t* enqueue_us) {
+    *trace_id = next_trace_id_.fetch_add(1, std::memory_order_relaxed);
+    *enqueue_us = NowMicros();
+
+    std::vector<RecordHeader> traced = headers;
+    traced.push_back({std::string(kTraceHeader), std::to_string(*trace_id) + ":" + std::to_string(*enqueue_us)});
+    return traced;
+}
+
+bool Tracer::ParseTrace(const std::vector<RecordHeader>& headers, uint64_t* trace_id, int64_t* enqueue_us) {
+    for (const auto& header : headers) {
+        if (header.key != kTraceHeader) {
+            continue;
+        }
+        size_t separator = header.value.find(':');
+        if (separator == std::string::npos) {
+            return false;
+        }
+        try {
+            *trace_id = std::stoull(header.value.substr(0, separator));
+            *enqueue_us = std::stoll(header.value.substr(separator + 1));
+        } catch (const std::exception&) {
+            return false;
+        }
+        return true;
+    }
+    return false;
+}
+
+void Tracer::Record(TraceStage stage, uint64_t trace_id, const std::string& topic, int partition, int64_t start_us, int64_t end_us) {
+    int64_t duration_us = std::max<int64_t>(end_us - start_us, 0);
+    int bucket = std::min(static_cast<int>(std::bit_width(static_cast<uint64_t>(duration_us))), kBuckets - 1);
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    Histogram& histogram = histograms_[static_cast<int>(stage)];
+    ++histogram.buckets[bucket];
+    ++histogram.count;
+    histogram.max_us = std::max(histogram.max_us, duration_us);
+
+    if (span_file_.is_open()) {
+        span_file_ << "{\"trace_id\":" << trace_id << ",\"stage\":\"" << TraceStageName(stage) << "\",\"topic\":\"" << topic
+                   << "\",\"partition\":" << partition << ",\"start_us\":" << start_us << ",\"duration_us\":" << duration_us
+                   << "}\n";
+    }
+}
+
+std::vector<StageLatency> Tracer::Snapshot() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::vector<StageLatency> latencies;
+    for (int stage = 0; stage < kTraceStageCount; ++stage) {
+        const Histogram& histogram = histograms_[stage];
+        latencies.push_back({static_cast<TraceStage>(stage), histogram.count, Percentile(histogram, 0.5),
+                             Percentile(histogram, 0.99), histogram.max_us});
+    }
+    if (span_file_.is_open()) {
+        span_file_.flush();
+    }
+    return latencies;
+}
+
+void Tracer::Reset() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    histograms_ = {};
+}
+
+int64_t Tracer::NowMicros() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+int64_t Tracer::Percentile(const Histogram& histogram, double quantile) {
+    if (histogram.count == 0) {
+        return 0;
+    }
+    uint64_t rank = static_cast<uint64_t>(quantile * (histogram.count - 1)) + 1;
+    uint64_t seen = 0;
+    for (int bucket = 0; bucket < kBuckets; ++bucket) {
+        seen += histogram.buckets[bucket];
+        if (seen >= rank) {
+            // Bucket 0 only holds zero durations
+            return bucket == 0 ? 0 : std::min<int64_t>((int64_t{1} << bucket) - 1, histogram.max_us);
+        }
+    }
+    return histogram.max_us;
+}
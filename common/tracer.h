@@ -0,0 +1,101 @@
+#ifndef MESSAGE_QUEUE_TRACER_H
+#define MESSAGE_QUEUE_TRACER_H
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "record_header.h"
+
+// Sampled end-to-end tracing. A sampled record carries a kTraceHeader with its trace id and
+// enqueue time; producers and consumers combine it with the times brokers report to break
+// its latency into stages. Stages that span two hosts assume their clocks are synchronised.
+//
+// The tracer is shared by every producer and consumer in the process and is off until
+// Configure sets a sample rate.
+
+// Header of a sampled record: "<trace id>:<enqueue time in microseconds since the epoch>"
+constexpr std::string_view kTraceHeader = "mq-trace";
+
+enum class TraceStage {
+    kLinger,           // Enqueued in the producer until its batch was sent
+    kProduceRequest,   // Batch sent until the broker received it
+    kLedgerAppend,     // Broker received the batch until BookKeeper confirmed it
+    kProduceAck,       // Confirmed until the producer had the acknowledgement
+    kFetchServe,       // Enqueued until a broker served the record to a consumer
+    kConsumerDelivery, // Served until the consumer handed the record to the application
+    kEndToEnd,         // Enqueued until handed to the application
+};
+
+constexpr int kTraceStageCount = 7;
+
+const char* TraceStageName(TraceStage stage);
+
+struct TraceOptions {
+    double sample_rate = 0;  // Fraction of produced records traced; 0 disables tracing, also of fetched records
+    std::string span_file;   // Appends one JSON line per stage of each sampled record, if set
+};
+
+// Latency distribution of one stage, in microseconds. Percentiles are bucket upper bounds.
+struct StageLatency {
+    TraceStage stage;
+    uint64_t count;
+    int64_t p50_us;
+    int64_t p99_us;
+    int64_t max_us;
+};
+
+class Tracer {
+public:
+    static Tracer& Instance();
+
+    void Configure(const TraceOptions& options);
+
+    // Whether the next produced record should be traced. Cheap when tracing is off.
+    bool ShouldSample();
+
+    // Returns headers plus a trace header for a record enqueued now, setting trace_id and enqueue_us
+    std::vector<RecordHeader> StartTrace(const std::vector<RecordHeader>& headers, uint64_t* trace_id, int64_t* enqueue_us);
+
+    // Reads the trace header of a fetched record. Returns false if the record is not sampled.
+    static bool ParseTrace(const std::vector<RecordHeader>& headers, uint64_t* trace_id, int64_t* enqueue_us);
+
+    // Adds a stage measurement. Negative durations, from clock skew between hosts, count as 0.
+    void Record(TraceStage stage, uint64_t trace_id, const std::string& topic, int partition, int64_t start_us, int64_t end_us);
+
+    // Whether any tracing is configured, so consumers can skip looking for trace headers
+    bool enabled() const { return sample_rate_.load(std::memory_order_relaxed) > 0; }
+
+    std::vector<StageLatency> Snapshot();
+
+    // Clears the histograms
+    void Reset();
+
+    static int64_t NowMicros();
+
+private:
+    // Bucket i holds durations below 2^i microseconds
+    static constexpr int kBuckets = 40;
+
+    struct Histogram {
+        std::array<uint64_t, kBuckets> buckets{};
+        uint64_t count = 0;
+        int64_t max_us = 0;
+    };
+
+    Tracer() = default;
+
+    static int64_t Percentile(const Histogram& histogram, double quantile);
+
+    std::atomic<double> sample_rate_{0};
+    std::atomic<uint64_t> next_trace_id_{1};
+    std::mutex mutex_;
+    std::array<Histogram, kTraceStageCount> histograms_;
+    std::ofstream span_file_;
+};
+
+#endif // MESSAGE_QUEUE_TRACER_H
@@ -1,11 +1,21 @@
 #include "consumer.h"
+#include "fetch_cache.h"
+#include "record_batch.h"
 #include "router.h"
+#include "tracer.h"
 
 #include "message_queue.grpc.pb.h"
 #include <grpcpp/grpcpp.h>
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
 #include <iostream>
+#include <mutex>
+#include <thread>
 #include <vector>
 #include <string>
+#include <unordered_map>
+#include <unordered_set>
 
 class Consumer::Impl {
 public:
@@ -13,16 +23,36 @@ public:
         router_ = std::make_unique<Router>(bootstrap_servers);
     }
 
-    std::vector<MessageResponse> ConsumeMessage(std::string group_id, std::string topic, int partition, int offset, int max_messages) {
-        // Get broker ip for partition
-        std::string broker_ip = router_->GetBrokerIP(topic, partition);
+    ~Impl() {
+        {
+            std::lock_guard<std::mutex> lock(commits_mutex_);
+            committing_ = false;
+        }
+        commits_cv_.notify_all();
+        if (committer_.joinable()) {
+            committer_.join();
+        }
+        // Positions served from the cache since the last round are not lost with the consumer
+        FlushCommits();
+    }
 
-        std::cout << "Routing message to broker_ip: " << broker_ip << " for topic: " << topic
-                  << ", partition: " << partition << std::endl;
-        
-        // Create gRPC stub for the broker_ip
-        auto channel = grpc::CreateChannel(broker_ip, grpc::InsecureChannelCredentials());
-        auto stub_ = message_queue::MessageQueue::NewStub(channel);
+    FetchResult Fetch(std::string group_id, std::string topic, int partition, int64_t offset, int max_messages, const RecordFilter& filter) {
+        FetchResult result;
+        std::string key = topic + "-" + std::to_string(partition);
+
+        // Serve ranges another consumer in this process fetched recently without reading them again.
+        // The cache holds contiguous ranges, so filtered fetches bypass it.
+        CachedFetch cached;
+        if (filter.empty() && FetchCache::Instance().Lookup(topic, partition, offset, max_messages, 0, &cached)) {
+            DecodeBatches(cached.record_batches, offset, max_messages, &result.messages);
+            TraceDelivery(result.messages, 0, 0);
+            result.next_offsets[key] = cached.next_offset;
+            result.high_watermarks[key] = cached.high_watermark;
+            if (!group_id.empty()) {
+                QueueCommit(group_id, topic, partition, cached.next_offset);
+            }
+            return result;
+        }
 
         message_queue::ConsumeMessagesRequest request;
         request.set_group_id(group_id);
@@ -30,36 +60,620 @@ public:
         request.set_partition(partition);
         request.set_start_offset(offset);
         request.set_max_messages(max_messages);
+        if (!filter.empty()) {
+            SetFilter(filter, request.mutable_filter());
+        }
 
         message_queue::ConsumeMessagesResponse response;
+        // A broker that no longer leads the partition names the new leader; follow it once
+        for (int attempt = 0; ; ++attempt) {
+            // Get broker ip for partition
+            std::string broker_ip = router_->GetBrokerIP(topic, partition);
+
+            std::cout << "Routing message to broker_ip: " << broker_ip << " for topic: " << topic
+                      << ", partition: " << partition << std::endl;
+
+            // Create gRPC stub for the broker_ip
+            auto channel = grpc::CreateChannel(broker_ip, grpc::InsecureChannelCredentials());
+            auto stub_ = message_queue::MessageQueue::NewStub(channel);
+
+            grpc::ClientContext context;
+            response.Clear();
+            grpc::Status status = stub_->ConsumeMessages(&context, request, &response);
+
+            if (!status.ok()) {
+                std::cerr << "gRPC error: " << status.error_code() << ": " << status.error_message() << std::endl;
+                return result;
+            }
+            if (response.success()) {
+                break;
+            }
+            if (attempt == 0 && !response.leader_address().empty()) {
+                router_->UpdateLeader(topic, partition, response.leader_address());
+                continue;
+            }
+
+            std::cerr << "ConsumeMessage failed: " << response.error_message() << std::endl;
+            return result;
+        }
+
+        DecodeBatches(response.record_batches(), offset, max_messages, &result.messages);
+        TraceDelivery(result.messages, 0, response.serve_time_us());
+        result.high_watermarks[key] = response.high_watermark();
+        // Brokers that predate filtering leave next_offset unset
+        if (response.next_offset() >= offset) {
+            result.next_offsets[key] = response.next_offset();
+        }
+        // The broker committed the group's position with the fetch
+        DropCommit(group_id, topic, partition);
+
+        if (filter.empty()) {
+            std::vector<std::string> batches(response.record_batches().begin(), response.record_batches().end());
+            FetchCache::Instance().Insert(topic, partition, batches, response.high_watermark());
+        }
+        return result;
+    }
+
+    FetchResult FetchMultiple(const std::string& group_id, const std::vector<FetchPosition>& positions, int max_messages) {
+        return Decode(FetchMultipleRaw(group_id, positions, max_messages));
+    }
+
+    RawFetchResult FetchMultipleRaw(const std::string& group_id, const std::vector<FetchPosition>& positions, int max_messages) {
+        RawFetchResult result;
+        std::vector<FetchPosition> served;
+        std::vector<FetchPosition> uncached = ServeFromCache(group_id, positions, max_messages, &result, &served);
+        for (const auto& broker : GroupByBroker(uncached, served)) {
+            FetchFromBroker(group_id, broker.first, broker.second, max_messages, &result);
+        }
+        return result;
+    }
+
+    void FetchMultipleAsync(const std::string& group_id, const std::vector<FetchPosition>& positions, int max_messages,
+                            std::function<void(FetchResult)> done) {
+        RawFetchResult cached;
+        std::vector<FetchPosition> served;
+        std::vector<FetchPosition> uncached = ServeFromCache(group_id, positions, max_messages, &cached, &served);
+        auto by_broker = GroupByBroker(uncached, served);
+        if (by_broker.empty()) {
+            done(Decode(std::move(cached)));
+            return;
+        }
+
+        auto fetch = std::make_shared<AsyncFetch>();
+        fetch->result = std::move(cached);
+        fetch->outstanding = by_broker.size();
+        fetch->done = std::move(done);
+        for (const auto& broker : by_broker) {
+            auto call = std::make_unique<AsyncFetchCall>();
+            call->fetch = fetch;
+            call->group_id = group_id;
+            call->broker_ip = broker.first;
+            call->max_messages = max_messages;
+            for (const auto& position : broker.second) {
+                call->wanted[position.topic + "-" + std::to_string(position.partition)] = position;
+            }
+            StartAsyncFetch(std::move(call), 0);
+        }
+    }
+
+    std::vector<int64_t> OffsetsForTimes(const std::vector<TimestampQuery>& queries) {
+        std::vector<int64_t> offsets(queries.size(), -1);
+
+        // One request per leader broker; remember where each query's answer goes
+        std::unordered_map<std::string, std::vector<size_t>> by_broker;
+        for (size_t i = 0; i < queries.size(); ++i) {
+            try {
+                by_broker[router_->GetBrokerIP(queries[i].topic, queries[i].partition)].push_back(i);
+            } catch (const std::exception& e) {
+                std::cerr << "Failed to route offset lookup for topic: " << queries[i].topic << " - " << e.what() << std::endl;
+            }
+        }
+
+        for (const auto& broker : by_broker) {
+            message_queue::OffsetsForTimesRequest request;
+            for (size_t i : broker.second) {
+                auto* query = request.add_partitions();
+                query->set_topic(queries[i].topic);
+                query->set_partition(queries[i].partition);
+                query->set_timestamp(queries[i].timestamp_ms);
+            }
+
+            auto channel = grpc::CreateChannel(broker.first, grpc::InsecureChannelCredentials());
+            auto stub = message_queue::MessageQueue::NewStub(channel);
+            message_queue::OffsetsForTimesResponse response;
+            grpc::ClientContext context;
+            grpc::Status status = stub->OffsetsForTimes(&context, request, &response);
+            if (!status.ok()) {
+                std::cerr << "gRPC error: " << status.error_code() << ": " << status.error_message() << std::endl;
+                continue;
+            }
+
+            for (int j = 0; j < response.partitions_size() && j < static_cast<int>(broker.second.size()); ++j) {
+                const auto& result = response.partitions(j);
+                if (result.success()) {
+                    offsets[broker.second[j]] = result.offset();
+                } else {
+                    std::cerr << "Offset lookup failed for topic: " << result.topic() << ", partition: " << result.partition()
+                              << " - " << result.error_message() << std::endl;
+                }
+            }
+        }
+        return offsets;
+    }
+
+private:
+    // Client side of an incremental fetch session: the partition positions the broker holds
+    struct FetchSession {
+        int64_t id = 0;
+        int32_t epoch = 0;
+        std::unordered_map<std::string, FetchPosition> positions; // By "topic-partition"
+    };
+
+    static void SetFilter(const RecordFilter& filter, message_queue::RecordFilter* proto) {
+        proto->set_key_prefix(filter.key_prefix);
+        for (const auto& key : filter.keys) {
+            proto->add_keys(key);
+        }
+        for (const auto& header : filter.headers) {
+            auto* proto_header = proto->add_headers();
+            proto_header->set_key(header.key);
+            proto_header->set_value(header.value);
+        }
+        if (filter.min_timestamp_ms >= 0) {
+            proto->set_min_timestamp(filter.min_timestamp_ms);
+        }
+        if (filter.max_timestamp_ms >= 0) {
+            proto->set_max_timestamp(filter.max_timestamp_ms);
+        }
+    }
+
+    // A FetchMultipleAsync call, completed once every broker answered
+    struct AsyncFetch {
+        std::mutex mutex;
+        size_t outstanding;
+        RawFetchResult result;
+        std::function<void(FetchResult)> done;
+    };
+
+    // One broker's request of an AsyncFetch. Owned by the in-flight gRPC call.
+    struct AsyncFetchCall {
+        std::shared_ptr<AsyncFetch> fetch;
+        std::string group_id;
+        std::string broker_ip;
+        std::unordered_map<std::string, FetchPosition> wanted; // By "topic-partition"
+        int max_messages;
+        std::unique_ptr<message_queue::MessageQueue::Stub> stub;
         grpc::ClientContext context;
+        message_queue::FetchMultipleRequest request;
+        message_queue::FetchMultipleResponse response;
+    };
+
+    // Serves the positions whose next records are cached into result and returns the rest. Each served
+    // position is added to served, moved past the cached records. The broker does not see these records,
+    // so the group's position is queued for commit.
+    std::vector<FetchPosition> ServeFromCache(const std::string& group_id, const std::vector<FetchPosition>& positions,
+                                              int max_messages, RawFetchResult* result, std::vector<FetchPosition>* served) {
+        std::vector<FetchPosition> uncached;
+        for (const auto& position : positions) {
+            int limit = position.max_messages > 0 ? position.max_messages : max_messages;
+            CachedFetch cached;
+            if (!FetchCache::Instance().Lookup(position.topic, position.partition, position.offset, limit,
+                                               std::max(position.max_bytes, 0), &cached)) {
+                uncached.push_back(position);
+                continue;
+            }
+
+            std::string key = position.topic + "-" + std::to_string(position.partition);
+            FetchedPartition fetched;
+            fetched.topic = position.topic;
+            fetched.partition = position.partition;
+            fetched.fetch_offset = position.offset;
+            fetched.max_messages = limit;
+            fetched.record_batches = std::move(cached.record_batches);
+            result->partitions.push_back(std::move(fetched));
+            result->next_offsets[key] = cached.next_offset;
+            result->high_watermarks[key] = cached.high_watermark;
+            if (!group_id.empty()) {
+                QueueCommit(group_id, position.topic, position.partition, cached.next_offset);
+            }
+            served->push_back(position);
+            served->back().offset = cached.next_offset;
+        }
+        return uncached;
+    }
+
+    // Leader broker of every uncached position, plus brokers whose session holds partitions to drop. Metadata
+    // of topics whose fetch failed is refreshed first, so partitions that moved are routed to their new leader.
+    // A served position stays in its broker's session: a broker that is not fetched from keeps it as is, one
+    // that is fetched from moves it past the cached records and may return the records that follow them.
+    std::unordered_map<std::string, std::vector<FetchPosition>> GroupByBroker(const std::vector<FetchPosition>& positions,
+                                                                              const std::vector<FetchPosition>& served) {
+        std::unordered_set<std::string> stale_topics;
+        {
+            std::lock_guard<std::mutex> lock(sessions_mutex_);
+            stale_topics.swap(stale_topics_);
+        }
+        for (const auto& topic : stale_topics) {
+            try {
+                router_->RefreshMetadata(topic);
+            } catch (const std::exception& e) {
+                std::cerr << "Could not refresh metadata: " << e.what() << std::endl;
+            }
+        }
+
+        std::unordered_map<std::string, std::vector<FetchPosition>> by_broker;
+        for (const auto& position : positions) {
+            try {
+                by_broker[router_->GetBrokerIP(position.topic, position.partition)].push_back(position);
+            } catch (const std::exception& e) {
+                std::cerr << "Failed to route fetch for topic: " << position.topic << ", partition: " << position.partition
+                          << " - " << e.what() << std::endl;
+            }
+        }
+
+        std::unordered_map<std::string, std::vector<FetchPosition>> served_by_broker;
+        for (const auto& position : served) {
+            try {
+                served_by_broker[router_->GetBrokerIP(position.topic, position.partition)].push_back(position);
+            } catch (const std::exception& e) {
+                std::cerr << "Failed to route fetch for topic: " << position.topic << ", partition: " << position.partition
+                          << " - " << e.what() << std::endl;
+            }
+        }
+
+        // Partitions that moved to another broker or are no longer fetched are dropped from the old broker's session
+        std::lock_guard<std::mutex> lock(sessions_mutex_);
+        for (auto& session : fetch_sessions_) {
+            if (session.second.id == 0) {
+                continue;
+            }
+            std::vector<FetchPosition> kept;
+            for (const auto& position : served_by_broker[session.first]) {
+                if (session.second.positions.count(position.topic + "-" + std::to_string(position.partition)) > 0) {
+                    kept.push_back(position);
+                }
+            }
+            // A broker whose session holds only served partitions has nothing to fetch or drop
+            if (by_broker.find(session.first) == by_broker.end() && kept.size() == session.second.positions.size()) {
+                continue;
+            }
+            auto& wanted = by_broker[session.first];
+            wanted.insert(wanted.end(), kept.begin(), kept.end());
+        }
+        return by_broker;
+    }
 
-        grpc::Status status = stub_->ConsumeMessages(&context, request, &response);
+    void FetchFromBroker(const std::string& group_id, const std::string& broker_ip, const std::vector<FetchPosition>& wanted,
+                         int max_messages, RawFetchResult* result) {
+        std::unordered_map<std::string, FetchPosition> wanted_by_key;
+        for (const auto& position : wanted) {
+            wanted_by_key[position.topic + "-" + std::to_string(position.partition)] = position;
+        }
+
+        auto channel = grpc::CreateChannel(broker_ip, grpc::InsecureChannelCredentials());
+        auto stub = message_queue::MessageQueue::NewStub(channel);
 
+        // A second attempt opens a new session if the broker no longer knows ours
+        for (int attempt = 0; attempt < 2; ++attempt) {
+            message_queue::FetchMultipleRequest request = BuildFetchRequest(group_id, broker_ip, wanted_by_key, max_messages);
+            message_queue::FetchMultipleResponse response;
+            grpc::ClientContext context;
+            grpc::Status status = stub->FetchMultiple(&context, request, &response);
+            if (HandleFetchResponse(group_id, broker_ip, wanted_by_key, max_messages, status, response, result) || !status.ok()) {
+                return;
+            }
+        }
+    }
+
+    // Sends one broker's part of an asynchronous fetch. The call owns itself until gRPC completes it.
+    void StartAsyncFetch(std::unique_ptr<AsyncFetchCall> call, int attempt) {
+        call->request = BuildFetchRequest(call->group_id, call->broker_ip, call->wanted, call->max_messages);
+        call->stub = message_queue::MessageQueue::NewStub(grpc::CreateChannel(call->broker_ip, grpc::InsecureChannelCredentials()));
+
+        AsyncFetchCall* pending = call.release();
+        pending->stub->async()->FetchMultiple(&pending->context, &pending->request, &pending->response,
+                                              [this, pending, attempt](grpc::Status status) {
+            std::unique_ptr<AsyncFetchCall> call(pending);
+            RawFetchResult result;
+            if (!HandleFetchResponse(call->group_id, call->broker_ip, call->wanted, call->max_messages, status, call->response, &result)
+                && status.ok() && attempt == 0) {
+                // The broker no longer knows the session; a fresh call context opens a new one
+                auto retry = std::make_unique<AsyncFetchCall>();
+                retry->fetch = call->fetch;
+                retry->group_id = call->group_id;
+                retry->broker_ip = call->broker_ip;
+                retry->wanted = std::move(call->wanted);
+                retry->max_messages = call->max_messages;
+                StartAsyncFetch(std::move(retry), attempt + 1);
+                return;
+            }
+            FinishAsyncFetch(call->fetch, std::move(result));
+        });
+    }
+
+    void FinishAsyncFetch(const std::shared_ptr<AsyncFetch>& fetch, RawFetchResult result) {
+        {
+            std::lock_guard<std::mutex> lock(fetch->mutex);
+            auto& combined = fetch->result;
+            combined.partitions.insert(combined.partitions.end(), std::make_move_iterator(result.partitions.begin()),
+                                       std::make_move_iterator(result.partitions.end()));
+            // A broker may continue a partition the cache served; its offsets are the later ones
+            for (const auto& high_watermark : result.high_watermarks) {
+                combined.high_watermarks[high_watermark.first] = high_watermark.second;
+            }
+            for (const auto& next_offset : result.next_offsets) {
+                combined.next_offsets[next_offset.first] = next_offset.second;
+            }
+            if (--fetch->outstanding > 0) {
+                return;
+            }
+        }
+        fetch->done(Decode(std::move(fetch->result)));
+    }
+
+    FetchResult Decode(RawFetchResult raw) {
+        FetchResult result;
+        for (const auto& partition : raw.partitions) {
+            size_t first = result.messages.size();
+            DecodeBatches(partition.record_batches, partition.fetch_offset, partition.max_messages, &result.messages);
+            TraceDelivery(result.messages, first, partition.serve_time_us);
+        }
+        result.high_watermarks = std::move(raw.high_watermarks);
+        result.next_offsets = std::move(raw.next_offsets);
+        return result;
+    }
+
+    // The next request of the broker's session: a new session lists every partition, a
+    // follow-up only what changed since the broker last saw it
+    message_queue::FetchMultipleRequest BuildFetchRequest(const std::string& group_id, const std::string& broker_ip,
+                                                          const std::unordered_map<std::string, FetchPosition>& wanted_by_key,
+                                                          int max_messages) {
+        std::lock_guard<std::mutex> lock(sessions_mutex_);
+        FetchSession& session = fetch_sessions_[broker_ip];
+
+        message_queue::FetchMultipleRequest request;
+        request.set_group_id(group_id);
+        request.set_max_messages(max_messages);
+        request.set_session_id(session.id);
+        request.set_session_epoch(session.id == 0 ? 0 : session.epoch + 1);
+
+        for (const auto& entry : wanted_by_key) {
+            auto known = session.positions.find(entry.first);
+            if (session.id != 0 && known != session.positions.end() && known->second.offset == entry.second.offset
+                && known->second.max_bytes == entry.second.max_bytes && known->second.max_messages == entry.second.max_messages) {
+                continue;
+            }
+            auto* partition = request.add_partitions();
+            partition->set_topic(entry.second.topic);
+            partition->set_partition(entry.second.partition);
+            partition->set_fetch_offset(entry.second.offset);
+            partition->set_max_bytes(entry.second.max_bytes);
+            partition->set_max_messages(entry.second.max_messages);
+        }
+        if (session.id != 0) {
+            for (const auto& entry : session.positions) {
+                if (wanted_by_key.find(entry.first) == wanted_by_key.end()) {
+                    auto* partition = request.add_partitions();
+                    partition->set_topic(entry.second.topic);
+                    partition->set_partition(entry.second.partition);
+                    partition->set_remove(true);
+                }
+            }
+        }
+        return request;
+    }
+
+    // Updates the broker's session from a response and moves its record batches into result.
+    // Returns false if the session was dropped and the fetch should be retried with a new one.
+    bool HandleFetchResponse(const std::string& group_id, const std::string& broker_ip,
+                             const std::unordered_map<std::string, FetchPosition>& wanted_by_key,
+                             int max_messages, const grpc::Status& status, message_queue::FetchMultipleResponse& response,
+                             RawFetchResult* result) {
+        std::lock_guard<std::mutex> lock(sessions_mutex_);
+        FetchSession& session = fetch_sessions_[broker_ip];
         if (!status.ok()) {
             std::cerr << "gRPC error: " << status.error_code() << ": " << status.error_message() << std::endl;
-            return {};
+            session = FetchSession();
+            return false;
         }
-
         if (!response.success()) {
-            std::cerr << "ConsumeMessage failed: " << response.error_message() << std::endl;
-            return {};
+            std::cerr << "FetchMultiple failed: " << response.error_message() << std::endl;
+            session = FetchSession();
+            return false;
         }
 
-        std::vector<MessageResponse> messages;
-        for(const auto& message : response.messages()) {
-            MessageResponse msg;
-            msg.key = message.key();
-            msg.value = message.value();
-            msg.topic = message.topic();
-            msg.timestamp = message.timestamp();
-            messages.push_back(msg);
+        session.id = response.session_id();
+        session.epoch = response.session_epoch();
+        session.positions = wanted_by_key;
+        for (auto& data : *response.mutable_partitions()) {
+            std::string key = data.topic() + "-" + std::to_string(data.partition());
+            auto position = session.positions.find(key);
+            if (position == session.positions.end()) {
+                continue;
+            }
+            if (!data.success()) {
+                std::cerr << "Fetch failed for topic: " << data.topic() << ", partition: " << data.partition()
+                          << " - " << data.error_message() << std::endl;
+                // The leader may have moved; the next fetch goes to the leader the broker named,
+                // or routes with fresh metadata
+                if (!data.leader_address().empty()) {
+                    router_->UpdateLeader(data.topic(), data.partition(), data.leader_address());
+                } else {
+                    stale_topics_.insert(data.topic());
+                }
+                continue;
+            }
+
+            FetchedPartition fetched;
+            fetched.topic = data.topic();
+            fetched.partition = data.partition();
+            fetched.fetch_offset = position->second.offset;
+            fetched.max_messages = position->second.max_messages > 0 ? position->second.max_messages : max_messages;
+            fetched.serve_time_us = data.serve_time_us();
+            fetched.record_batches.reserve(data.record_batches_size());
+            for (auto& batch : *data.mutable_record_batches()) {
+                fetched.record_batches.push_back(std::move(batch));
+            }
+            FetchCache::Instance().Insert(fetched.topic, fetched.partition, fetched.record_batches, data.high_watermark());
+            result->partitions.push_back(std::move(fetched));
+            // The broker commits the group's position when it delivers records
+            if (data.next_offset() > position->second.offset) {
+                DropCommit(group_id, data.topic(), data.partition());
+            }
+            position->second.offset = data.next_offset();
+            result->next_offsets[key] = data.next_offset();
+            result->high_watermarks[key] = data.high_watermark();
         }
-        return messages;
+        return true;
     }
 
-private:
+    // Appends the records at or after offset, up to max_messages, from encoded batches of one partition
+    template <typename Batches>
+    void DecodeBatches(const Batches& batches, int64_t offset, int max_messages, std::vector<MessageResponse>* messages) {
+        int decoded = 0;
+        for (const auto& batch : batches) {
+            RecordBatchHeader header;
+            std::vector<Record> records;
+            if (!DecodeRecordBatch(batch, &header, &records)) {
+                std::cerr << "Discarding corrupt record batch" << std::endl;
+                break;
+            }
+
+            // The first batch may begin before the requested offset
+            for (auto& record : records) {
+                if (record.offset < offset || decoded >= max_messages) {
+                    continue;
+                }
+                MessageResponse msg;
+                msg.key = std::move(record.key);
+                msg.value = std::move(record.value);
+                msg.topic = header.topic;
+                msg.timestamp = record.timestamp;
+                msg.headers = std::move(record.headers);
+                msg.partition = header.partition;
+                msg.offset = record.offset;
+                messages->push_back(std::move(msg));
+                ++decoded;
+            }
+        }
+    }
+
+    // Records the consumer-side stages of the sampled records among messages[first:], which a broker
+    // served at serve_us, or 0 if the broker did not report it
+    void TraceDelivery(const std::vector<MessageResponse>& messages, size_t first, int64_t serve_us) {
+        Tracer& tracer = Tracer::Instance();
+        if (!tracer.enabled()) {
+            return;
+        }
+        int64_t delivered_us = Tracer::NowMicros();
+        for (size_t i = first; i < messages.size(); ++i) {
+            uint64_t trace_id;
+            int64_t enqueue_us;
+            if (!Tracer::ParseTrace(messages[i].headers, &trace_id, &enqueue_us)) {
+                continue;
+            }
+            const MessageResponse& msg = messages[i];
+            if (serve_us != 0) {
+                tracer.Record(TraceStage::kFetchServe, trace_id, msg.topic, msg.partition, enqueue_us, serve_us);
+                tracer.Record(TraceStage::kConsumerDelivery, trace_id, msg.topic, msg.partition, serve_us, delivered_us);
+            }
+            tracer.Record(TraceStage::kEndToEnd, trace_id, msg.topic, msg.partition, enqueue_us, delivered_us);
+        }
+    }
+
+    // Group position advanced without a broker fetch, awaiting the next commit round
+    struct PendingCommit {
+        std::string group_id;
+        std::string topic;
+        int partition;
+        int64_t offset;
+    };
+
+    static std::string CommitKey(const std::string& group_id, const std::string& topic, int partition) {
+        return group_id + "/" + topic + "-" + std::to_string(partition);
+    }
+
+    // Records the group's position for the committer, which sends it with the others of its round.
+    // A later position of the same partition replaces it.
+    void QueueCommit(const std::string& group_id, const std::string& topic, int partition, int64_t offset) {
+        std::lock_guard<std::mutex> lock(commits_mutex_);
+        pending_commits_[CommitKey(group_id, topic, partition)] = {group_id, topic, partition, offset};
+        if (!committer_.joinable()) {
+            committer_ = std::thread(&Impl::RunCommitter, this);
+        }
+    }
+
+    // Forgets a queued position a broker fetch has moved past, so a late commit round cannot move the group back
+    void DropCommit(const std::string& group_id, const std::string& topic, int partition) {
+        if (group_id.empty()) {
+            return;
+        }
+        std::lock_guard<std::mutex> lock(commits_mutex_);
+        pending_commits_.erase(CommitKey(group_id, topic, partition));
+    }
+
+    void RunCommitter() {
+        std::unique_lock<std::mutex> lock(commits_mutex_);
+        while (committing_) {
+            commits_cv_.wait_for(lock, std::chrono::milliseconds(kCommitIntervalMs), [this]() { return !committing_; });
+            if (!committing_) {
+                break;
+            }
+            lock.unlock();
+            FlushCommits();
+            lock.lock();
+        }
+    }
+
+    // Sends the queued positions in one CommitOffsets request per leader broker
+    void FlushCommits() {
+        std::unordered_map<std::string, PendingCommit> pending;
+        {
+            std::lock_guard<std::mutex> lock(commits_mutex_);
+            pending.swap(pending_commits_);
+        }
+
+        std::unordered_map<std::string, message_queue::CommitOffsetsRequest> by_broker;
+        for (const auto& entry : pending) {
+            const PendingCommit& commit = entry.second;
+            try {
+                auto* offset = by_broker[router_->GetBrokerIP(commit.topic, commit.partition)].add_offsets();
+                offset->set_group_id(commit.group_id);
+                offset->set_topic(commit.topic);
+                offset->set_partition(commit.partition);
+                offset->set_offset(commit.offset);
+            } catch (const std::exception& e) {
+                std::cerr << "Failed to route offset commit for topic: " << commit.topic << ", partition: " << commit.partition
+                          << " - " << e.what() << std::endl;
+            }
+        }
+
+        for (const auto& broker : by_broker) {
+            auto channel = grpc::CreateChannel(broker.first, grpc::InsecureChannelCredentials());
+            auto stub = message_queue::MessageQueue::NewStub(channel);
+            message_queue::CommitOffsetsResponse response;
+            grpc::ClientContext context;
+            grpc::Status status = stub->CommitOffsets(&context, broker.second, &response);
+            if (!status.ok()) {
+                std::cerr << "gRPC error: " << status.error_code() << ": " << status.error_message() << std::endl;
+            } else if (!response.success()) {
+                std::cerr << "Failed to commit offsets: " << response.error_message() << std::endl;
+            }
+        }
+    }
+
+    static constexpr int kCommitIntervalMs = 1000; // Between commit rounds of cache-served positions
+
     std::unique_ptr<Router> router_;
+    std::unordered_map<std::string, FetchSession> fetch_sessions_; // By broker
+    std::unordered_set<std::string> stale_topics_;                  // Topics to refresh before the next fetch
+    std::mutex sessions_mutex_;                                     // Guards the two above
+
+    std::unordered_map<std::string, PendingCommit> pending_commits_; // By CommitKey
+    bool committing_ = true;                                         // Cleared to stop the committer
+    std::thread committer_;                                          // Started by the first queued commit
+    std::condition_variable commits_cv_;
+    std::mutex commits_mutex_;                                       // Guards the four above
 };
 
 Consumer::Consumer(const std::vector<std::string>& bootstrap_servers, std::string consumer_id) : impl_(std::make_unique<Impl>(bootstrap_servers)), consumer_id(consumer_id) {}
@@ -67,7 +681,32 @@ Consumer::Consumer(const std::vector<std::string>& bootstrap_servers, std::strin
 Consumer::~Consumer() = default;
 
 std::vector<MessageResponse> Consumer::ConsumeMessage(std::string group_id, std::string topic, int partition, int offset, int max_messages) {
-    return impl_->ConsumeMessage(group_id, topic, partition, offset, max_messages);
+    return impl_->Fetch(group_id, topic, partition, offset, max_messages, RecordFilter()).messages;
+}
+
+FetchResult Consumer::Fetch(std::string group_id, std::string topic, int partition, int64_t offset, int max_messages) {
+    return impl_->Fetch(group_id, topic, partition, offset, max_messages, RecordFilter());
+}
+
+FetchResult Consumer::Fetch(std::string group_id, std::string topic, int partition, int64_t offset, int max_messages, const RecordFilter& filter) {
+    return impl_->Fetch(group_id, topic, partition, offset, max_messages, filter);
+}
+
+FetchResult Consumer::FetchMultiple(const std::string& group_id, const std::vector<FetchPosition>& positions, int max_messages) {
+    return impl_->FetchMultiple(group_id, positions, max_messages);
+}
+
+RawFetchResult Consumer::FetchMultipleRaw(const std::string& group_id, const std::vector<FetchPosition>& positions, int max_messages) {
+    return impl_->FetchMultipleRaw(group_id, positions, max_messages);
+}
+
+void Consumer::FetchMultipleAsync(const std::string& group_id, const std::vector<FetchPosition>& positions, int max_messages,
+                                  std::function<void(FetchResult)> done) {
+    impl_->FetchMultipleAsync(group_id, positions, max_messages, std::move(done));
+}
+
+std::vector<int64_t> Consumer::OffsetsForTimes(const std::vector<TimestampQuery>& queries) {
+    return impl_->OffsetsForTimes(queries);
 }
 
 std::string Consumer::get_consumer_id() {
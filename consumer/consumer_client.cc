@@ -52,7 +52,7 @@ std::unordered_map<std::string, std::unique_ptr<ConsumerGroup>> readConsumerGrou
         for (const auto& ctp : consumer_topic_partition) {
             std::vector<std::string> topics;
             std::vector<int> partitions;
-            std::vector<int> offsets;
+            std::vector<int64_t> offsets;
 
             for (const auto& tp : ctp.second) {
                 topics.push_back(tp[0]);
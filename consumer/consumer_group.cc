@@ -1,6 +1,31 @@
 #include "consumer_group.h"
 #include <iostream>
 #include <algorithm>
+#include <mutex>
+
+namespace {
+// Smallest fetch sent for a partition that has caught up
+constexpr int kMinFetchMessages = 16;
+
+// Messages to request given a partition's lag: the whole backlog up to the caller's limit
+int FetchSize(const topic_state& state, int max_messages) {
+    if (state.high_watermark < 0) {
+        return max_messages;
+    }
+    int64_t lag = std::max<int64_t>(state.high_watermark - state.offset, 0);
+    return static_cast<int>(std::clamp<int64_t>(lag, std::min(kMinFetchMessages, max_messages), max_messages));
+}
+
+// Rounds a fetch size up to a power of two, capped at max_messages, so that small changes
+// in lag do not alter the size and force a fetch session update
+int QuantizeFetchSize(int size, int max_messages) {
+    int quantized = 1;
+    while (quantized < size) {
+        quantized <<= 1;
+    }
+    return std::min(quantized, max_messages);
+}
+}
 
 ConsumerGroup::ConsumerGroup(std::string tag, std::string group_id) : tag(tag), group_id(group_id) {}
 
@@ -18,7 +43,7 @@ bool ConsumerGroup::AddConsumer(const std::vector<std::string>& bootstrap_server
                                  std::string consumer_id, 
                                  std::vector<std::string> topics, 
                                  std::vector<int> partitions, 
-                                 std::vector<int> offsets) {
+                                 std::vector<int64_t> offsets) {
     // Check if the consumer is already present in the group
     for (const auto& consumer : consumers_) {
         if (consumer->get_consumer_id() == consumer_id) {
@@ -45,7 +70,7 @@ bool ConsumerGroup::AddConsumer(const std::vector<std::string>& bootstrap_server
     for (size_t i = 0; i < topics.size(); ++i) {
         std::string topic = topics[i];
         int partition = partitions[i];
-        int offset = offsets[i];
+        int64_t offset = offsets[i];
 
         // Add topic state
         topic_state state = {topic, partition, offset};
@@ -85,6 +110,10 @@ bool ConsumerGroup::RemoveConsumer(std::string consumer_id) {
 
 // Pull messages from the message queue
 std::vector <MessageResponse> ConsumerGroup::ConsumeMessage(std::string topic, int partition, int max_messages) {
+    return ConsumeMessage(topic, partition, max_messages, RecordFilter());
+}
+
+std::vector <MessageResponse> ConsumerGroup::ConsumeMessage(std::string topic, int partition, int max_messages, const RecordFilter& filter) {
     std::vector <MessageResponse> messages;
     // Check if the topic-partition is being consumed by any consumer
     if(topic_partition_consumer_.find(topic + "-" + std::to_string(partition)) == topic_partition_consumer_.end()) {
@@ -94,10 +123,12 @@ std::vector <MessageResponse> ConsumerGroup::ConsumeMessage(std::string topic, i
 
     std::string consumer_id = topic_partition_consumer_[topic + "-" + std::to_string(partition)];
 
-    int offset = -1;
+    int64_t offset = -1;
+    int fetch_size = max_messages;
     for(const auto& state : consumer_topic_state_[consumer_id][topic]) {
         if(state.partition == partition) {
             offset = state.offset;
+            fetch_size = FetchSize(state, max_messages);
             break;
         }
     }
@@ -116,18 +147,206 @@ std::vector <MessageResponse> ConsumerGroup::ConsumeMessage(std::string topic, i
         }
     }
 
-    messages = consumer->ConsumeMessage(this->group_id, topic, partition, offset, max_messages);
+    FetchResult result = consumer->Fetch(this->group_id, topic, partition, offset, fetch_size, filter);
+    UpdateHighWatermarks(consumer_id, result);
 
+    // A filtered fetch moves past the records the broker skipped, not just the ones returned
+    auto next_offset = result.next_offsets.find(topic + "-" + std::to_string(partition));
     for(auto& state : consumer_topic_state_[consumer_id][topic]) {
         if(state.partition == partition) {
-            state.offset += messages.size();
+            if(next_offset != result.next_offsets.end()) {
+                state.offset = next_offset->second;
+            } else {
+                state.offset += result.messages.size();
+            }
             break;
         }
     }
 
+    return std::move(result.messages);
+}
+
+std::vector<MessageResponse> ConsumerGroup::ConsumeAll(int max_messages) {
+    std::vector<MessageResponse> messages;
+    for(const auto& consumer : consumers_) {
+        std::vector<FetchPosition> positions = FetchPositions(consumer->get_consumer_id(), max_messages);
+        if(positions.empty()) {
+            continue;
+        }
+
+        FetchResult result = consumer->FetchMultiple(this->group_id, positions, max_messages);
+        ApplyFetch(consumer->get_consumer_id(), result);
+        messages.insert(messages.end(), std::make_move_iterator(result.messages.begin()), std::make_move_iterator(result.messages.end()));
+    }
     return messages;
 }
 
+void ConsumerGroup::PollAsync(int max_messages, std::function<void(std::vector<MessageResponse>)> done) {
+    // Shared by the consumers' fetches; the last one to finish hands over the batch
+    struct Poll {
+        std::mutex mutex;
+        size_t outstanding = 0;
+        std::vector<MessageResponse> messages;
+        std::function<void(std::vector<MessageResponse>)> done;
+    };
+    auto poll = std::make_shared<Poll>();
+    poll->done = std::move(done);
+
+    std::vector<std::pair<Consumer*, std::vector<FetchPosition>>> fetches;
+    for(const auto& consumer : consumers_) {
+        std::vector<FetchPosition> positions = FetchPositions(consumer->get_consumer_id(), max_messages);
+        if(!positions.empty()) {
+            fetches.emplace_back(consumer.get(), std::move(positions));
+        }
+    }
+    if(fetches.empty()) {
+        poll->done({});
+        return;
+    }
+
+    poll->outstanding = fetches.size();
+    for(auto& fetch : fetches) {
+        std::string consumer_id = fetch.first->get_consumer_id();
+        fetch.first->FetchMultipleAsync(this->group_id, fetch.second, max_messages, [this, poll, consumer_id](FetchResult result) {
+            {
+                std::lock_guard<std::mutex> lock(poll->mutex);
+                ApplyFetch(consumer_id, result);
+                poll->messages.insert(poll->messages.end(), std::make_move_iterator(result.messages.begin()),
+                                      std::make_move_iterator(result.messages.end()));
+                if(--poll->outstanding > 0) {
+                    return;
+                }
+            }
+            poll->done(std::move(poll->messages));
+        });
+    }
+}
+
+PollAwaitable ConsumerGroup::Poll(int max_messages) {
+    return PollAwaitable(this, max_messages);
+}
+
+void ConsumerGroup::SetExecutor(Executor executor) {
+    executor_ = executor ? std::move(executor) : Executor(InlineExecutor);
+}
+
+const Executor& ConsumerGroup::executor() const {
+    return executor_;
+}
+
+void PollAwaitable::await_suspend(std::coroutine_handle<> handle) {
+    // The poll may complete on another thread at any point, so nothing here runs after PollAsync
+    Executor executor = group_->executor();
+    group_->PollAsync(max_messages_, [this, handle, executor](std::vector<MessageResponse> messages) {
+        messages_ = std::move(messages);
+        executor([handle]() { handle.resume(); });
+    });
+}
+
+std::vector<FetchPosition> ConsumerGroup::FetchPositions(const std::string& consumer_id, int max_messages) {
+    std::vector<FetchPosition> positions;
+    for(const auto& topic : consumer_topic_state_[consumer_id]) {
+        for(const auto& state : topic.second) {
+            FetchPosition position = {state.topic, state.partition, state.offset};
+            position.max_messages = QuantizeFetchSize(FetchSize(state, max_messages), max_messages);
+            positions.push_back(position);
+        }
+    }
+    return positions;
+}
+
+void ConsumerGroup::ApplyFetch(const std::string& consumer_id, const FetchResult& result) {
+    UpdateHighWatermarks(consumer_id, result);
+    auto& topics = consumer_topic_state_[consumer_id];
+    for(const auto& msg : result.messages) {
+        for(auto& state : topics[msg.topic]) {
+            if(state.partition == msg.partition && msg.offset >= state.offset) {
+                state.offset = msg.offset + 1;
+            }
+        }
+    }
+}
+
+int64_t ConsumerGroup::GetLag(std::string topic, int partition) {
+    auto owner = topic_partition_consumer_.find(topic + "-" + std::to_string(partition));
+    if(owner == topic_partition_consumer_.end()) {
+        return -1;
+    }
+    for(const auto& state : consumer_topic_state_[owner->second][topic]) {
+        if(state.partition == partition) {
+            return state.high_watermark < 0 ? -1 : std::max<int64_t>(state.high_watermark - state.offset, 0);
+        }
+    }
+    return -1;
+}
+
+void ConsumerGroup::UpdateHighWatermarks(const std::string& consumer_id, const FetchResult& result) {
+    for(auto& topic : consumer_topic_state_[consumer_id]) {
+        for(auto& state : topic.second) {
+            auto high_watermark = result.high_watermarks.find(state.topic + "-" + std::to_string(state.partition));
+            if(high_watermark != result.high_watermarks.end()) {
+                state.high_watermark = high_watermark->second;
+            }
+        }
+    }
+}
+
+bool ConsumerGroup::SeekToTime(std::string topic, int partition, int64_t timestamp_ms) {
+    auto owner = topic_partition_consumer_.find(topic + "-" + std::to_string(partition));
+    if(owner == topic_partition_consumer_.end()) {
+        std::cerr << "Topic " << topic << " partition " << partition << " is not being consumed by any consumer" << std::endl;
+        return false;
+    }
+
+    for(const auto& consumer : consumers_) {
+        if(consumer->get_consumer_id() != owner->second) {
+            continue;
+        }
+        int64_t offset = consumer->OffsetsForTimes({{topic, partition, timestamp_ms}})[0];
+        if(offset < 0) {
+            return false;
+        }
+        for(auto& state : consumer_topic_state_[owner->second][topic]) {
+            if(state.partition == partition) {
+                state.offset = offset;
+            }
+        }
+        return true;
+    }
+    return false;
+}
+
+bool ConsumerGroup::SeekAllToTime(int64_t timestamp_ms) {
+    bool all_found = true;
+    for(const auto& consumer : consumers_) {
+        auto& topics = consumer_topic_state_[consumer->get_consumer_id()];
+
+        std::vector<TimestampQuery> queries;
+        std::vector<topic_state*> states;
+        for(auto& topic : topics) {
+            for(auto& state : topic.second) {
+                queries.push_back({state.topic, state.partition, timestamp_ms});
+                states.push_back(&state);
+            }
+        }
+        if(queries.empty()) {
+            continue;
+        }
+
+        // One lookup per consumer and leader broker
+        std::vector<int64_t> offsets = consumer->OffsetsForTimes(queries);
+        for(size_t i = 0; i < states.size(); ++i) {
+            if(offsets[i] < 0) {
+                std::cerr << "Could not seek topic " << states[i]->topic << " partition " << states[i]->partition << std::endl;
+                all_found = false;
+                continue;
+            }
+            states[i]->offset = offsets[i];
+        }
+    }
+    return all_found;
+}
+
 void ConsumerGroup::PrintConsumerGroup() {
     std::cout << "Consumer Group: " << tag << " - " << group_id << std::endl;
     for(const auto& consumer : consumers_) {
@@ -0,0 +1,152 @@
+#include "fetch_cache.h"
+#include "record_batch.h"
+#include <algorithm>
+
+namespace {
+constexpr size_t kDefaultCapacityBytes = 64 * 1024 * 1024;
+}
+
+FetchCache& FetchCache::Instance() {
+    static FetchCache cache;
+    return cache;
+}
+
+FetchCache::FetchCache() : capacity_bytes_(kDefaultCapacityBytes), used_bytes_(0) {}
+
+void FetchCache::SetCapacity(size_t capacity_bytes) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    capacity_bytes_ = capacity_bytes;
+    EvictToCapacity();
+}
+
+bool FetchCache::Lookup(const std::string& topic, int partition, int64_t offset, int max_messages, size_t max_bytes,
+                        CachedFetch* fetch) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto entries = index_.find(topic + "-" + std::to_string(partition));
+    if (entries == index_.end() || max_messages <= 0) {
+        return false;
+    }
+
+    // Find the range with the greatest start offset not after the requested one
+    auto& ranges = entries->second.ranges;
+    auto it = ranges.upper_bound(offset);
+    if (it == ranges.begin()) {
+        return false;
+    }
+    --it;
+
+    auto entry = it->second;
+    if (offset >= entry->end_offset()) {
+        return false;
+    }
+
+    lru_.splice(lru_.begin(), lru_, entry);
+
+    // Start at the batch holding offset, as the broker would
+    auto batch = std::upper_bound(entry->batches.begin(), entry->batches.end(), offset,
+                                  [](int64_t value, const Batch& b) { return value < b.base_offset; }) - 1;
+    fetch->record_batches.clear();
+    int64_t delivered = 0;
+    size_t bytes = 0;
+    for (; batch != entry->batches.end() && delivered < max_messages; ++batch) {
+        if (max_bytes > 0 && bytes >= max_bytes) {
+            break;
+        }
+        fetch->record_batches.push_back(batch->data);
+        bytes += batch->data.size();
+        delivered += batch->end_offset - std::max(offset, batch->base_offset);
+    }
+    fetch->next_offset = offset + std::min<int64_t>(delivered, max_messages);
+    fetch->high_watermark = entries->second.high_watermark;
+    return true;
+}
+
+void FetchCache::Insert(const std::string& topic, int partition, const std::vector<std::string>& record_batches,
+                        int64_t high_watermark) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (capacity_bytes_ == 0 || record_batches.empty()) {
+        return;
+    }
+
+    std::vector<Batch> batches;
+    for (const auto& data : record_batches) {
+        RecordBatchHeader header;
+        if (!ReadRecordBatchHeader(data, &header) || header.record_count <= 0
+            || (!batches.empty() && header.base_offset != batches.back().end_offset)) {
+            break;
+        }
+        batches.push_back(Batch{header.base_offset, header.base_offset + header.last_offset_delta + 1, data});
+    }
+    if (batches.empty()) {
+        return;
+    }
+
+    std::string topic_partition = topic + "-" + std::to_string(partition);
+    auto& entries = index_[topic_partition];
+    entries.high_watermark = std::max(entries.high_watermark, high_watermark);
+    auto& ranges = entries.ranges;
+
+    // Skip the batches the preceding range already covers
+    auto first = batches.begin();
+    auto it = ranges.upper_bound(first->base_offset);
+    if (it != ranges.begin()) {
+        int64_t covered = std::prev(it)->second->end_offset();
+        while (first != batches.end() && first->base_offset < covered) {
+            ++first;
+        }
+    }
+
+    // Drop ranges the new one fully covers and stop short of the next overlapping one
+    auto last = batches.end();
+    while (first != last && it != ranges.end() && it->first < std::prev(last)->end_offset) {
+        auto next = std::next(it);
+        if (it->second->end_offset() <= std::prev(last)->end_offset) {
+            Erase(it->second);
+        } else {
+            int64_t limit = it->first;
+            while (last != first && std::prev(last)->end_offset > limit) {
+                --last;
+            }
+            break;
+        }
+        it = next;
+    }
+
+    if (first == last) {
+        if (ranges.empty()) {
+            index_.erase(topic_partition);
+        }
+        return;
+    }
+
+    Entry entry;
+    entry.topic_partition = topic_partition;
+    entry.batches.assign(std::make_move_iterator(first), std::make_move_iterator(last));
+    entry.bytes = sizeof(Entry);
+    for (const auto& batch : entry.batches) {
+        entry.bytes += sizeof(Batch) + batch.data.size();
+    }
+
+    used_bytes_ += entry.bytes;
+    lru_.push_front(std::move(entry));
+    ranges[lru_.front().start_offset()] = lru_.begin();
+    EvictToCapacity();
+}
+
+void FetchCache::Erase(std::list<Entry>::iterator entry) {
+    index_[entry->topic_partition].ranges.erase(entry->start_offset());
+    used_bytes_ -= entry->bytes;
+    lru_.erase(entry);
+}
+
+void FetchCache::EvictToCapacity() {
+    while (used_bytes_ > capacity_bytes_ && !lru_.empty()) {
+        auto entry = std::prev(lru_.end());
+        auto entries = index_.find(entry->topic_partition);
+        Erase(entry);
+        // The partition's high watermark only matters while some range of it can be served
+        if (entries->second.ranges.empty()) {
+            index_.erase(entries);
+        }
+    }
+}
@@ -0,0 +1,78 @@
+#ifndef FETCH_CACHE_H
+#define FETCH_CACHE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <map>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Record batches served from the cache for one partition of a fetch
+struct CachedFetch {
+    std::vector<std::string> record_batches; // The first may begin before the requested offset
+    int64_t next_offset;                     // Offset the next fetch of the partition continues from
+    int64_t high_watermark;                  // Latest high watermark a broker reported for the partition
+};
+
+// Process-wide, byte-bounded LRU cache of fetched record batch ranges keyed by
+// topic, partition and offset range. It is shared by every Consumer in the
+// process, so consumer groups reading the same partition only fetch each
+// range from the broker once. Batches stay encoded, so single and
+// multi-partition fetches serve hits the same way they serve broker responses.
+class FetchCache {
+public:
+    static FetchCache& Instance();
+
+    // Sets the byte budget and evicts down to it. A capacity of 0 disables the cache.
+    void SetCapacity(size_t capacity_bytes);
+
+    // Serves up to max_messages records from offset on, stopping after the batch that reaches
+    // max_bytes (0 for no cap). Returns false on a miss, when no cached range holds offset.
+    bool Lookup(const std::string& topic, int partition, int64_t offset, int max_messages, size_t max_bytes,
+                CachedFetch* fetch);
+
+    // Caches record batches a broker returned for one partition, in offset order, along with the
+    // partition's high watermark at the time. Batches after a gap or an undecodable one are not cached.
+    void Insert(const std::string& topic, int partition, const std::vector<std::string>& record_batches,
+                int64_t high_watermark);
+
+private:
+    struct Batch {
+        int64_t base_offset;
+        int64_t end_offset; // Offset after the last record
+        std::string data;
+    };
+
+    // A contiguous run of batches
+    struct Entry {
+        std::string topic_partition;
+        std::vector<Batch> batches;
+        size_t bytes;
+
+        int64_t start_offset() const { return batches.front().base_offset; }
+        int64_t end_offset() const { return batches.back().end_offset; }
+    };
+
+    struct PartitionEntries {
+        // Start offset -> entry. Ranges never overlap.
+        std::map<int64_t, std::list<Entry>::iterator> ranges;
+        int64_t high_watermark = -1;
+    };
+
+    FetchCache();
+
+    // Most recently used entry first
+    std::list<Entry> lru_;
+    std::unordered_map<std::string, PartitionEntries> index_; // By "topic-partition"
+    size_t capacity_bytes_;
+    size_t used_bytes_;
+    std::mutex mutex_;
+
+    void Erase(std::list<Entry>::iterator entry);
+    void EvictToCapacity();
+};
+
+#endif // FETCH_CACHE_H
@@ -0,0 +1,100 @@
+#include "table_snapshot.h"
+#include <cstring>
+
+namespace {
+constexpr char kSnapshotMagic[8] = {'D', 'M', 'Q', 'T', 'V', 'S', 'N', '1'};
+
+struct SnapshotHeader {
+    char magic[8];
+    uint32_t topic_size;
+    uint32_t partition_count;
+    uint64_t entry_count;
+};
+
+size_t Align8(size_t size) {
+    return (size + 7) & ~size_t(7);
+}
+
+size_t EntryBytes(uint32_t key_size, uint32_t value_size) {
+    return Align8(2 * sizeof(uint32_t) + size_t(key_size) + value_size);
+}
+}
+
+TableSnapshotWriter::TableSnapshotWriter(const std::string& topic, const std::vector<SnapshotPartition>& partitions)
+    : data_(sizeof(SnapshotHeader), '\0'), entry_count_(0) {
+    SnapshotHeader header;
+    std::memcpy(header.magic, kSnapshotMagic, sizeof(header.magic));
+    header.topic_size = topic.size();
+    header.partition_count = partitions.size();
+    header.entry_count = 0;
+    std::memcpy(&data_[0], &header, sizeof(header));
+
+    data_.append(topic);
+    data_.resize(Align8(data_.size()), '\0');
+    data_.append(reinterpret_cast<const char*>(partitions.data()), partitions.size() * sizeof(SnapshotPartition));
+}
+
+void TableSnapshotWriter::Add(std::string_view key, std::string_view value) {
+    uint32_t sizes[2] = {static_cast<uint32_t>(key.size()), static_cast<uint32_t>(value.size())};
+    data_.append(reinterpret_cast<const char*>(sizes), sizeof(sizes));
+    data_.append(key);
+    data_.append(value);
+    data_.resize(Align8(data_.size()), '\0');
+    ++entry_count_;
+}
+
+std::string TableSnapshotWriter::Finish() {
+    std::memcpy(&data_[offsetof(SnapshotHeader, entry_count)], &entry_count_, sizeof(entry_count_));
+    return std::move(data_);
+}
+
+bool ReadTableSnapshot(std::string_view data, const std::string& topic, std::vector<SnapshotPartition>* partitions,
+                       const std::function<void(std::string_view key, std::string_view value)>& apply) {
+    SnapshotHeader header;
+    if (data.size() < sizeof(header)) {
+        return false;
+    }
+    std::memcpy(&header, data.data(), sizeof(header));
+    if (std::memcmp(header.magic, kSnapshotMagic, sizeof(header.magic)) != 0) {
+        return false;
+    }
+    size_t pos = sizeof(SnapshotHeader);
+    if (header.topic_size > data.size() - pos || data.substr(pos, header.topic_size) != topic) {
+        return false;
+    }
+    pos = Align8(pos + header.topic_size);
+
+    // Validate everything before applying anything
+    if (pos > data.size() || header.partition_count > (data.size() - pos) / sizeof(SnapshotPartition)) {
+        return false;
+    }
+    std::vector<SnapshotPartition> covered(header.partition_count);
+    std::memcpy(covered.data(), data.data() + pos, header.partition_count * sizeof(SnapshotPartition));
+    pos += header.partition_count * sizeof(SnapshotPartition);
+
+    size_t entries_pos = pos;
+    for (uint64_t i = 0; i < header.entry_count; ++i) {
+        uint32_t sizes[2];
+        if (data.size() - pos < sizeof(sizes)) {
+            return false;
+        }
+        std::memcpy(sizes, data.data() + pos, sizeof(sizes));
+        size_t entry_size = EntryBytes(sizes[0], sizes[1]);
+        if (entry_size > data.size() - pos) {
+            return false;
+        }
+        pos += entry_size;
+    }
+
+    pos = entries_pos;
+    for (uint64_t i = 0; i < header.entry_count; ++i) {
+        uint32_t sizes[2];
+        std::memcpy(sizes, data.data() + pos, sizeof(sizes));
+        std::string_view key = data.substr(pos + sizeof(sizes), sizes[0]);
+        std::string_view value = data.substr(pos + sizeof(sizes) + sizes[0], sizes[1]);
+        apply(key, value);
+        pos += EntryBytes(sizes[0], sizes[1]);
+    }
+    *partitions = std::move(covered);
+    return true;
+}
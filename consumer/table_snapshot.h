@@ -0,0 +1,49 @@
+#ifndef TABLE_SNAPSHOT_H
+#define TABLE_SNAPSHOT_H
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Snapshot file of a TableView. Layout, all fields native-endian and 8-byte aligned so the file
+// is read in place:
+//   SnapshotHeader
+//   topic bytes, padded to 8
+//   partition_count x SnapshotPartition
+//   entry_count x { uint32 key size, uint32 value size, key, value, padded to 8 }
+
+// Next offset to apply from a partition the snapshot covers
+struct SnapshotPartition {
+    int32_t partition;
+    int32_t reserved;
+    int64_t next_offset;
+};
+
+// Encodes the snapshot of one topic
+class TableSnapshotWriter {
+public:
+    TableSnapshotWriter(const std::string& topic, const std::vector<SnapshotPartition>& partitions);
+
+    void Add(std::string_view key, std::string_view value);
+
+    uint64_t entry_count() const { return entry_count_; }
+
+    // Returns the encoded snapshot. The writer must not be used afterwards.
+    std::string Finish();
+
+private:
+    std::string data_;
+    uint64_t entry_count_;
+};
+
+// Reads a snapshot of topic. The whole snapshot is validated before anything is applied: for a
+// snapshot of another topic or a torn file it returns false without calling apply. Otherwise
+// partitions receives the offsets the snapshot covers and apply is called with every entry; the
+// views point into data.
+bool ReadTableSnapshot(std::string_view data, const std::string& topic, std::vector<SnapshotPartition>* partitions,
+                       const std::function<void(std::string_view key, std::string_view value)>& apply);
+
+#endif // TABLE_SNAPSHOT_H
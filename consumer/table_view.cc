@@ -0,0 +1,390 @@
+#include "table_view.h"
+#include "consumer.h"
+#include "table_snapshot.h"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <filesystem>
+#include <functional>
+#include <iostream>
+#include <mutex>
+#include <thread>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+constexpr size_t kInitialCapacity = 1024;   // Slots; always a power of two
+constexpr size_t kReclaimBatch = 1024;      // Replaced entries freed per grace period
+
+// Immutable once published; an update publishes a new entry and retires the old one
+struct TableEntry {
+    size_t hash;
+    std::string key;
+    std::string value;
+};
+
+struct Table {
+    explicit Table(size_t capacity) : mask(capacity - 1), slots(new std::atomic<TableEntry*>[capacity]) {
+        for (size_t i = 0; i < capacity; ++i) {
+            slots[i].store(nullptr, std::memory_order_relaxed);
+        }
+    }
+
+    size_t capacity() const { return mask + 1; }
+
+    size_t mask;
+    std::unique_ptr<std::atomic<TableEntry*>[]> slots;
+};
+}
+
+class TableView::Impl {
+public:
+    Impl(const std::vector<std::string>& bootstrap_servers, const std::string& topic, const std::vector<int>& partitions, const TableViewOptions& options)
+        : consumer_(bootstrap_servers, "table-view-" + topic),
+          topic_(topic),
+          partitions_(partitions),
+          offsets_(partitions.size()),
+          options_(options),
+          table_(new Table(kInitialCapacity)) {
+        for (auto& offset : offsets_) {
+            offset.store(0);
+        }
+        if (!options_.snapshot_path.empty()) {
+            LoadSnapshot();
+        }
+        worker_ = std::thread(&Impl::Run, this);
+    }
+
+    ~Impl() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            running_ = false;
+        }
+        cv_.notify_all();
+        worker_.join();
+
+        if (!options_.snapshot_path.empty() && dirty_) {
+            WriteSnapshot();
+        }
+
+        // No reader can outlive the view, so everything is freed directly
+        Table* table = table_.load();
+        for (size_t i = 0; i < table->capacity(); ++i) {
+            delete table->slots[i].load();
+        }
+        delete table;
+        for (TableEntry* entry : retired_entries_) {
+            delete entry;
+        }
+        for (Table* retired : retired_tables_) {
+            delete retired;
+        }
+    }
+
+    bool Get(std::string_view key, std::string* value) const {
+        ReadGuard guard(this);
+        const Table* table = table_.load(std::memory_order_acquire);
+        size_t hash = std::hash<std::string_view>{}(key);
+        for (size_t i = hash & table->mask;; i = (i + 1) & table->mask) {
+            const TableEntry* entry = table->slots[i].load(std::memory_order_acquire);
+            if (entry == nullptr) {
+                return false;
+            }
+            if (entry->hash == hash && entry->key == key) {
+                value->assign(entry->value);
+                return true;
+            }
+        }
+    }
+
+    size_t Size() const {
+        return size_.load(std::memory_order_relaxed);
+    }
+
+    int64_t Offset(int partition) const {
+        for (size_t i = 0; i < partitions_.size(); ++i) {
+            if (partitions_[i] == partition) {
+                return offsets_[i].load();
+            }
+        }
+        return -1;
+    }
+
+private:
+    // Marks a reader as active in the current epoch for the lifetime of the guard
+    class ReadGuard {
+    public:
+        explicit ReadGuard(const Impl* view) : view_(view) {
+            while (true) {
+                epoch_ = view_->epoch_.load();
+                view_->readers_[epoch_ & 1].fetch_add(1);
+                // If the writer moved on meanwhile it may not wait for us, so join the new epoch
+                if (view_->epoch_.load() == epoch_) {
+                    break;
+                }
+                view_->readers_[epoch_ & 1].fetch_sub(1);
+            }
+        }
+
+        ~ReadGuard() {
+            view_->readers_[epoch_ & 1].fetch_sub(1);
+        }
+
+    private:
+        const Impl* view_;
+        uint64_t epoch_;
+    };
+
+    void Run() {
+        auto last_snapshot = std::chrono::steady_clock::now();
+        while (true) {
+            std::vector<FetchPosition> positions;
+            for (size_t i = 0; i < partitions_.size(); ++i) {
+                positions.push_back({topic_, partitions_[i], offsets_[i].load()});
+            }
+
+            // No group, so fetching does not move any committed offset
+            std::vector<MessageResponse> messages = consumer_.FetchMultiple("", positions, options_.max_messages).messages;
+            for (const auto& message : messages) {
+                Apply(message);
+            }
+
+            if (!options_.snapshot_path.empty() && dirty_
+                && std::chrono::steady_clock::now() - last_snapshot >= std::chrono::milliseconds(options_.snapshot_interval_ms)) {
+                WriteSnapshot();
+                last_snapshot = std::chrono::steady_clock::now();
+            }
+
+            std::unique_lock<std::mutex> lock(mutex_);
+            if (!running_) {
+                break;
+            }
+            if (messages.empty()) {
+                cv_.wait_for(lock, std::chrono::milliseconds(options_.poll_interval_ms), [this]() { return !running_; });
+            }
+        }
+    }
+
+    void Apply(const MessageResponse& message) {
+        for (size_t i = 0; i < partitions_.size(); ++i) {
+            if (partitions_[i] == message.partition) {
+                if (message.offset < offsets_[i].load()) {
+                    return; // Already applied
+                }
+                Put(message.key, message.value);
+                offsets_[i].store(message.offset + 1);
+                dirty_ = true;
+                return;
+            }
+        }
+    }
+
+    // Publishes the new value of a key. Only the worker thread writes.
+    void Put(const std::string& key, const std::string& value) {
+        Table* table = table_.load(std::memory_order_relaxed);
+        size_t hash = std::hash<std::string_view>{}(key);
+        TableEntry* entry = new TableEntry{hash, key, value};
+
+        for (size_t i = hash & table->mask;; i = (i + 1) & table->mask) {
+            TableEntry* current = table->slots[i].load(std::memory_order_relaxed);
+            if (current == nullptr) {
+                table->slots[i].store(entry, std::memory_order_release);
+                if (size_.fetch_add(1, std::memory_order_relaxed) + 1 > table->capacity() / 2) {
+                    Grow();
+                }
+                return;
+            }
+            if (current->hash == hash && current->key == key) {
+                table->slots[i].store(entry, std::memory_order_release);
+                Retire(current);
+                return;
+            }
+        }
+    }
+
+    // Doubles the table. Entries are shared between the old and new table, so only the slot array is retired.
+    void Grow() {
+        Table* old_table = table_.load(std::memory_order_relaxed);
+        Table* new_table = new Table(old_table->capacity() * 2);
+        for (size_t i = 0; i < old_table->capacity(); ++i) {
+            TableEntry* entry = old_table->slots[i].load(std::memory_order_relaxed);
+            if (entry == nullptr) {
+                continue;
+            }
+            size_t slot = entry->hash & new_table->mask;
+            while (new_table->slots[slot].load(std::memory_order_relaxed) != nullptr) {
+                slot = (slot + 1) & new_table->mask;
+            }
+            new_table->slots[slot].store(entry, std::memory_order_relaxed);
+        }
+        table_.store(new_table, std::memory_order_release);
+
+        retired_tables_.push_back(old_table);
+        Reclaim();
+    }
+
+    void Retire(TableEntry* entry) {
+        retired_entries_.push_back(entry);
+        if (retired_entries_.size() >= kReclaimBatch) {
+            Reclaim();
+        }
+    }
+
+    // Starts a new epoch and waits for readers of the previous one, after which nothing retired before is reachable
+    void Reclaim() {
+        uint64_t epoch = epoch_.load();
+        epoch_.store(epoch + 1);
+        while (readers_[epoch & 1].load() != 0) {
+            std::this_thread::yield();
+        }
+
+        for (TableEntry* entry : retired_entries_) {
+            delete entry;
+        }
+        retired_entries_.clear();
+        for (Table* table : retired_tables_) {
+            delete table;
+        }
+        retired_tables_.clear();
+    }
+
+    // Written to a temporary file and renamed into place, so a crash leaves the previous snapshot intact
+    void WriteSnapshot() {
+        const Table* table = table_.load(std::memory_order_relaxed);
+
+        std::vector<SnapshotPartition> covered;
+        for (size_t i = 0; i < partitions_.size(); ++i) {
+            covered.push_back({partitions_[i], 0, offsets_[i].load()});
+        }
+        TableSnapshotWriter writer(topic_, covered);
+        for (size_t i = 0; i < table->capacity(); ++i) {
+            const TableEntry* entry = table->slots[i].load(std::memory_order_relaxed);
+            if (entry != nullptr) {
+                writer.Add(entry->key, entry->value);
+            }
+        }
+        uint64_t entry_count = writer.entry_count();
+        std::string data = writer.Finish();
+
+        std::string tmp_path = options_.snapshot_path + ".tmp";
+        int fd = ::open(tmp_path.c_str(), O_CREAT | O_TRUNC | O_WRONLY, 0644);
+        if (fd < 0) {
+            std::cerr << "Failed to open table view snapshot " << tmp_path << ": " << std::strerror(errno) << std::endl;
+            return;
+        }
+        size_t written = 0;
+        while (written < data.size()) {
+            ssize_t n = ::write(fd, data.data() + written, data.size() - written);
+            if (n <= 0) {
+                std::cerr << "Failed to write table view snapshot: " << std::strerror(errno) << std::endl;
+                ::close(fd);
+                return;
+            }
+            written += n;
+        }
+        ::fsync(fd);
+        ::close(fd);
+
+        std::error_code ec;
+        std::filesystem::rename(tmp_path, options_.snapshot_path, ec);
+        if (ec) {
+            std::cerr << "Failed to install table view snapshot: " << ec.message() << std::endl;
+            return;
+        }
+        dirty_ = false;
+        std::cout << "Wrote table view snapshot of " << entry_count << " keys for topic: " << topic_ << std::endl;
+    }
+
+    // Maps the snapshot and loads it. A snapshot of another topic or a torn file is ignored.
+    void LoadSnapshot() {
+        int fd = ::open(options_.snapshot_path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            return;
+        }
+        struct stat st;
+        if (::fstat(fd, &st) != 0 || st.st_size == 0) {
+            ::close(fd);
+            return;
+        }
+        size_t size = st.st_size;
+        void* mapped = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+        if (mapped == MAP_FAILED) {
+            std::cerr << "Failed to map table view snapshot: " << std::strerror(errno) << std::endl;
+            return;
+        }
+
+        if (!ParseSnapshot(static_cast<const char*>(mapped), size)) {
+            std::cerr << "Ignoring unreadable table view snapshot " << options_.snapshot_path << std::endl;
+        }
+        ::munmap(mapped, size);
+    }
+
+    bool ParseSnapshot(const char* data, size_t size) {
+        std::vector<SnapshotPartition> covered;
+        uint64_t entry_count = 0;
+        bool parsed = ReadTableSnapshot(std::string_view(data, size), topic_, &covered, [&](std::string_view key, std::string_view value) {
+            Put(std::string(key), std::string(value));
+            ++entry_count;
+        });
+        if (!parsed) {
+            return false;
+        }
+
+        // Partitions the snapshot does not cover are replayed from the start
+        for (const auto& partition : covered) {
+            for (size_t i = 0; i < partitions_.size(); ++i) {
+                if (partitions_[i] == partition.partition) {
+                    offsets_[i].store(partition.next_offset);
+                }
+            }
+        }
+        std::cout << "Loaded table view snapshot of " << entry_count << " keys for topic: " << topic_ << std::endl;
+        return true;
+    }
+
+    Consumer consumer_;
+    std::string topic_;
+    std::vector<int> partitions_;
+    std::vector<std::atomic<int64_t>> offsets_; // Next offset to apply, per partition
+    TableViewOptions options_;
+
+    std::atomic<Table*> table_;
+    std::atomic<size_t> size_{0};
+
+    // Epoch-based reclamation: readers count themselves in the parity slot of the epoch they entered
+    mutable std::atomic<uint64_t> epoch_{0};
+    mutable std::atomic<int64_t> readers_[2] = {};
+    std::vector<TableEntry*> retired_entries_; // Worker thread only
+    std::vector<Table*> retired_tables_;       // Worker thread only
+
+    bool dirty_ = false; // Records applied since the last snapshot; worker thread only
+    bool running_ = true;
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    std::thread worker_;
+};
+
+TableView::TableView(const std::vector<std::string>& bootstrap_servers, const std::string& topic, const std::vector<int>& partitions)
+    : TableView(bootstrap_servers, topic, partitions, TableViewOptions()) {}
+
+TableView::TableView(const std::vector<std::string>& bootstrap_servers, const std::string& topic, const std::vector<int>& partitions, const TableViewOptions& options)
+    : impl_(std::make_unique<Impl>(bootstrap_servers, topic, partitions, options)) {}
+
+TableView::~TableView() = default;
+
+bool TableView::Get(std::string_view key, std::string* value) const {
+    return impl_->Get(key, value);
+}
+
+size_t TableView::Size() const {
+    return impl_->Size();
+}
+
+int64_t TableView::Offset(int partition) const {
+    return impl_->Offset(partition);
+}
@@ -0,0 +1,54 @@
+#ifndef TABLE_VIEW_H
+#define TABLE_VIEW_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Optional table view settings
+struct TableViewOptions {
+    // File holding the latest snapshot. On start the view loads it and only replays
+    // records after the offsets it covers. Empty disables snapshots.
+    std::string snapshot_path;
+
+    // How often a snapshot is written while new records are being applied
+    int snapshot_interval_ms = 60 * 1000;
+
+    // Wait between fetches once the view has caught up
+    int poll_interval_ms = 100;
+
+    // Maximum records fetched per partition and request
+    int max_messages = 500;
+};
+
+// Materialised latest-value-per-key view of a topic. A background thread consumes
+// the given partitions and keeps the newest value of every key in a concurrent
+// open-addressing hash map. Reads never take a lock; memory replaced by the writer
+// is reclaimed once no reader can still see it.
+class TableView {
+public:
+    TableView(const std::vector<std::string>& bootstrap_servers, const std::string& topic, const std::vector<int>& partitions);
+
+    TableView(const std::vector<std::string>& bootstrap_servers, const std::string& topic, const std::vector<int>& partitions, const TableViewOptions& options);
+
+    // Stops consuming and writes a final snapshot
+    ~TableView();
+
+    // Copies the latest value of key into value. Returns false if the key has not been seen.
+    bool Get(std::string_view key, std::string* value) const;
+
+    // Number of distinct keys
+    size_t Size() const;
+
+    // Offset of the next record the view will apply from a partition, or -1 if it does not consume it
+    int64_t Offset(int partition) const;
+
+private:
+    class Impl;
+    std::unique_ptr<Impl> impl_;
+};
+
+#endif // TABLE_VIEW_H
@@ -0,0 +1,117 @@
+#ifndef TYPED_CONSUMER_H
+#define TYPED_CONSUMER_H
+
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include "consumer.h"
+#include "record_batch.h"
+#include "serde.h"
+
+// Fetches through a Consumer and decodes keys of type K and values of type V with Serde<K>
+// and Serde<V> chosen at compile time (see serde.h). Records are decoded in place from the
+// fetched buffers, which the returned Batch keeps alive.
+template <typename K, typename V, template <typename> class Serde = DefaultSerde>
+class TypedConsumer {
+public:
+    using KeyView = typename Serde<K>::View;
+    using ValueView = typename Serde<V>::View;
+
+    // Views into the Batch that holds the message
+    struct Message {
+        std::string_view topic;
+        int partition;
+        int64_t offset;
+        int64_t timestamp; // Milliseconds since the epoch
+        KeyView key;
+        ValueView value;
+        std::vector<RecordHeaderView> headers;
+    };
+
+    // Decoded messages of a fetch together with the buffers they point into. Moving a batch
+    // keeps the views valid; it cannot be copied.
+    class Batch {
+    public:
+        Batch() = default;
+        Batch(Batch&&) = default;
+        Batch& operator=(Batch&&) = default;
+        Batch(const Batch&) = delete;
+        Batch& operator=(const Batch&) = delete;
+
+        const std::vector<Message>& messages() const { return messages_; }
+        typename std::vector<Message>::const_iterator begin() const { return messages_.begin(); }
+        typename std::vector<Message>::const_iterator end() const { return messages_.end(); }
+        size_t size() const { return messages_.size(); }
+        bool empty() const { return messages_.empty(); }
+
+        // Offset after the last confirmed record, by "topic-partition"
+        const std::unordered_map<std::string, int64_t>& high_watermarks() const { return raw_.high_watermarks; }
+
+        // Fetched records left out because Serde could not decode their key or value
+        size_t undecodable_count() const { return undecodable_count_; }
+
+    private:
+        friend class TypedConsumer;
+
+        RawFetchResult raw_;
+        std::vector<Message> messages_;
+        size_t undecodable_count_ = 0;
+    };
+
+    TypedConsumer(Consumer& consumer, std::string group_id) : consumer_(consumer), group_id_(std::move(group_id)) {}
+
+    Batch Fetch(const std::string& topic, int partition, int64_t offset, int max_messages) {
+        return Fetch({{topic, partition, offset}}, max_messages);
+    }
+
+    // Fetches like Consumer::FetchMultiple. Undecodable records are skipped and counted in the
+    // Batch; they do not count against max_messages.
+    Batch Fetch(const std::vector<FetchPosition>& positions, int max_messages) {
+        Batch batch;
+        batch.raw_ = consumer_.FetchMultipleRaw(group_id_, positions, max_messages);
+
+        std::vector<RecordView> records;
+        for (const auto& partition : batch.raw_.partitions) {
+            int delivered = 0;
+            for (const auto& encoded : partition.record_batches) {
+                RecordBatchHeader header;
+                records.clear();
+                if (!DecodeRecordBatchViews(encoded, &header, &records)) {
+                    std::cerr << "Discarding corrupt record batch" << std::endl;
+                    break;
+                }
+
+                // The first batch may begin before the fetch offset
+                for (auto& record : records) {
+                    if (record.offset < partition.fetch_offset || delivered >= partition.max_messages) {
+                        continue;
+                    }
+
+                    Message message;
+                    message.topic = partition.topic;
+                    message.partition = partition.partition;
+                    message.offset = record.offset;
+                    message.timestamp = record.timestamp;
+                    if (!Serde<K>::Read(record.key, &message.key) || !Serde<V>::Read(record.value, &message.value)) {
+                        std::cerr << "Skipping undecodable record at offset " << record.offset << " of topic: " << partition.topic
+                                  << ", partition: " << partition.partition << std::endl;
+                        ++batch.undecodable_count_;
+                        continue;
+                    }
+                    message.headers = std::move(record.headers);
+                    batch.messages_.push_back(std::move(message));
+                    ++delivered;
+                }
+            }
+        }
+        return batch;
+    }
+
+private:
+    Consumer& consumer_;
+    std::string group_id_;
+};
+
+#endif // TYPED_CONSUMER_H
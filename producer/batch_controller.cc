@@ -0,0 +1,97 @@
+#include "batch_controller.h"
+#include <algorithm>
+
+namespace {
+constexpr double kLatencySmoothing = 0.2;    // Weight of a new latency sample
+constexpr double kRateSmoothing = 0.3;       // Weight of a new arrival rate sample
+constexpr int kMinSampleIntervalMs = 100;    // Shorter windows make the rate too noisy
+constexpr int kIncreaseSteps = 32;           // Additive increases from the lower to the upper batch bound
+}
+
+BatchController::BatchController(int initial_batch_records, int initial_linger_ms, const ProducerOptions& options)
+    : target_latency_ms_(options.target_latency_ms),
+      min_batch_records_(std::max(options.min_batch_records, 1)),
+      max_batch_records_(std::max(options.max_batch_records, std::max(options.min_batch_records, 1))),
+      min_linger_ms_(std::max(options.min_linger_ms, 0)),
+      max_linger_ms_(std::max(options.max_linger_ms, std::max(options.min_linger_ms, 0))),
+      last_sample_(std::chrono::steady_clock::now()) {
+    initial_batch_records_ = std::clamp(initial_batch_records, min_batch_records_, max_batch_records_);
+    initial_linger_ms_ = std::clamp(initial_linger_ms, min_linger_ms_, max_linger_ms_);
+    increase_step_ = std::max((max_batch_records_ - min_batch_records_) / kIncreaseSteps, 1);
+}
+
+void BatchController::OnAppend(const std::string& key, const std::string& topic, int partition) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = partitions_.find(key);
+    if (it == partitions_.end()) {
+        it = partitions_.emplace(key, PartitionState{topic, partition, initial_batch_records_, initial_linger_ms_}).first;
+    }
+    it->second.arrivals++;
+}
+
+void BatchController::OnSendCompleted(const std::string& key, int64_t latency_ms) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = partitions_.find(key);
+    if (it == partitions_.end()) {
+        return;
+    }
+    PartitionState& state = it->second;
+    state.latency_ms = state.latency_ms < 0 ? latency_ms : (1 - kLatencySmoothing) * state.latency_ms + kLatencySmoothing * latency_ms;
+
+    // Grow slowly while within the target, back off quickly once over it
+    if (state.latency_ms + state.linger_ms <= target_latency_ms_) {
+        state.batch_records = std::min(state.batch_records + increase_step_, max_batch_records_);
+    } else {
+        state.batch_records = std::max(state.batch_records / 2, min_batch_records_);
+    }
+    UpdateLinger(state);
+}
+
+void BatchController::SampleArrivalRates() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto now = std::chrono::steady_clock::now();
+    int64_t elapsed_ms = std::chrono::duration_cast<std::chrono::milliseconds>(now - last_sample_).count();
+    if (elapsed_ms < kMinSampleIntervalMs) {
+        return;
+    }
+    last_sample_ = now;
+
+    for (auto& entry : partitions_) {
+        PartitionState& state = entry.second;
+        double rate = state.arrivals * 1000.0 / elapsed_ms;
+        state.arrival_rate = state.arrival_rate == 0 ? rate : (1 - kRateSmoothing) * state.arrival_rate + kRateSmoothing * rate;
+        state.arrivals = 0;
+        UpdateLinger(state);
+    }
+}
+
+int BatchController::BatchRecords(const std::string& key) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = partitions_.find(key);
+    return it != partitions_.end() ? it->second.batch_records : initial_batch_records_;
+}
+
+int BatchController::LingerMs(const std::string& key) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = partitions_.find(key);
+    return it != partitions_.end() ? it->second.linger_ms : initial_linger_ms_;
+}
+
+std::vector<PartitionBatchingMetrics> BatchController::Metrics() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::vector<PartitionBatchingMetrics> metrics;
+    for (const auto& entry : partitions_) {
+        const PartitionState& state = entry.second;
+        metrics.push_back({state.topic, state.partition, state.batch_records, state.linger_ms, state.arrival_rate, state.latency_ms});
+    }
+    return metrics;
+}
+
+// Waits as long as filling the batch takes at the current rate, but no longer than the
+// latency target leaves after the produce round trip. Must hold mutex_.
+void BatchController::UpdateLinger(PartitionState& state) {
+    double budget_ms = target_latency_ms_ - std::max(state.latency_ms, 0.0);
+    double fill_ms = state.arrival_rate > 0 ? state.batch_records * 1000.0 / state.arrival_rate : max_linger_ms_;
+    double linger_ms = std::min(fill_ms, budget_ms);
+    state.linger_ms = std::clamp(static_cast<int>(linger_ms), min_linger_ms_, max_linger_ms_);
+}
@@ -0,0 +1,66 @@
+#ifndef MESSAGE_QUEUE_BATCH_CONTROLLER_H
+#define MESSAGE_QUEUE_BATCH_CONTROLLER_H
+
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "producer.h"
+
+// Tunes the batch size and linger of every topic-partition the producer writes to.
+// The batch size follows AIMD on the observed ProduceMessages latency: it grows by a
+// small step while linger plus latency stays within the target and halves once it does
+// not. The linger is the time the measured arrival rate needs to fill a batch, bounded
+// by what is left of the latency target, so slow partitions are sent almost at once and
+// busy ones accumulate large batches.
+class BatchController {
+public:
+    BatchController(int initial_batch_records, int initial_linger_ms, const ProducerOptions& options);
+
+    // Counts a record appended to a partition's open batch
+    void OnAppend(const std::string& key, const std::string& topic, int partition);
+
+    // Feeds the round trip of a produce request that carried a batch of the partition
+    void OnSendCompleted(const std::string& key, int64_t latency_ms);
+
+    // Folds the arrivals counted since the previous sample into the smoothed rates
+    void SampleArrivalRates();
+
+    // Records at which the partition's batch is sent
+    int BatchRecords(const std::string& key);
+
+    // Age at which the partition's partly filled batch is sent
+    int LingerMs(const std::string& key);
+
+    std::vector<PartitionBatchingMetrics> Metrics();
+
+private:
+    struct PartitionState {
+        std::string topic;
+        int partition;
+        int batch_records;
+        int linger_ms;
+        int64_t arrivals = 0;      // Since the last sample
+        double arrival_rate = 0;   // Records per second, smoothed
+        double latency_ms = -1;    // Smoothed produce latency, -1 until the first response
+    };
+
+    void UpdateLinger(PartitionState& state);
+
+    int initial_batch_records_;
+    int initial_linger_ms_;
+    int target_latency_ms_;
+    int min_batch_records_;
+    int max_batch_records_;
+    int min_linger_ms_;
+    int max_linger_ms_;
+    int increase_step_;
+
+    std::unordered_map<std::string, PartitionState> partitions_; // By topic-partition
+    std::chrono::steady_clock::time_point last_sample_;
+    std::mutex mutex_;
+};
+
+#endif // MESSAGE_QUEUE_BATCH_CONTROLLER_H
@@ -1,61 +1,184 @@
 #include "producer.h"
+#include "batch_controller.h"
+#include "producer_spool.h"
+#include "record_batch.h"
 #include "router.h"
+#include "tracer.h"
+#include <atomic>
 #include <vector>
 #include <thread>
 #include <mutex>
 #include <condition_variable>
 #include <chrono>
 #include <unordered_map>
-#include <future>
+#include <unordered_set>
+#include <map>
+#include <deque>
+#include <algorithm>
+#include <latch>
 #include <iostream>
 #include <grpcpp/grpcpp.h>
 #include "message_queue.grpc.pb.h"
 
-int total_partitions = 3;
+namespace {
+// Times a batch follows a broker's redirect to a new leader before it is treated as failed
+constexpr int kMaxRedirects = 2;
+}
 
 // Define the implementation class that was forward-declared in the header
 class Producer::Impl {
 public:
-    Impl(const std::vector<std::string>& bootstrap_servers, int flush_threshold, int flush_interval_ms, const std::string& producer_id)
+    Impl(const std::vector<std::string>& bootstrap_servers, int flush_threshold, int flush_interval_ms, const std::string& producer_id, const ProducerOptions& options)
         : router_(std::make_unique<Router>(bootstrap_servers)),
           flush_threshold_(flush_threshold),
           flush_interval_ms_(flush_interval_ms),
-          producer_id(producer_id) {}
+          producer_id(producer_id),
+          options_(options),
+          executor_(options.executor ? options.executor : Executor(InlineExecutor)) {
+        if (options_.adaptive_batching) {
+            batch_controller_ = std::make_unique<BatchController>(flush_threshold, flush_interval_ms, options_);
+        }
+        if (!options_.spool_dir.empty()) {
+            spool_ = std::make_unique<ProducerSpool>(options_.spool_dir, options_.spool_segment_bytes);
+            spool_replayer_ = std::thread(&Impl::ReplaySpool, this);
+        }
+        sender_ = std::thread(&Impl::RunSender, this);
+    }
     
     ~Impl() {
+        std::unordered_map<std::string, std::vector<PendingSend>> unsent;
         {
             std::lock_guard<std::mutex> lock(mutex_);
             run_timers_ = false;
-            for(auto &timer: topic_partition_timers_) {
-                timer.second.join();
+        }
+        sender_cv_.notify_all();
+        spool_cv_.notify_all();
+
+        // The sender takes the mutex, so join it without holding it
+        sender_.join();
+
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+
+            // Keep unsent batches in the spool so they are replayed after a restart
+            if (spool_) {
+                for (auto &entry: message_map_) {
+                    if (entry.second.record_count() > 0) {
+                        SpoolBatch(BuildRequest(entry.second), &pending_sends_[entry.first]);
+                    }
+                }
+                message_map_.clear();
+            }
+
+            unsent.swap(pending_sends_);
+        }
+
+        // Nothing is acknowledged after this, so pending sends fail. Callbacks may resume
+        // coroutines inline, so they run without the mutex held.
+        for (auto &entry : unsent) {
+            for (auto &send : entry.second) {
+                send.done({false, -1, "Producer closed before the batch was sent"});
             }
         }
+        if (spool_replayer_.joinable()) {
+            spool_replayer_.join();
+        }
+
+        // Spooled batches not replayed yet are delivered by the next producer to open the spool
+        for (auto &spooled : spooled_batches_) {
+            for (auto &send : spooled.sends) {
+                send.done({false, -1, "Producer closed; the batch stays spooled for delivery after a restart", true});
+            }
+        }
+
+        // Unacknowledged sends may still be redirected, which needs the router
+        std::unique_lock<std::mutex> lock(unacked_mutex_);
+        unacked_cv_.wait(lock, [this]() { return unacked_calls_ == 0; });
     }
 
-    bool ProduceMessage(const std::string& key, const std::string& value, const std::string& topic) {
+    bool ProduceMessage(std::string_view key, std::string_view value, const std::string& topic, const std::vector<RecordHeader>& headers,
+                        SendCallback done = nullptr) {
+        return Produce(key, topic, headers, std::move(done), [&](RecordBatchBuilder &builder, const std::vector<RecordHeader> &record_headers) {
+            builder.Append(key, value, NowMillis(), record_headers);
+        });
+    }
+
+    bool ProduceMessage(std::string_view key, size_t value_size, const ValueWriter& write_value, const std::string& topic,
+                        const std::vector<RecordHeader>& headers, SendCallback done) {
+        return Produce(key, topic, headers, std::move(done), [&](RecordBatchBuilder &builder, const std::vector<RecordHeader> &record_headers) {
+            builder.Append(key, value_size, write_value, NowMillis(), record_headers);
+        });
+    }
+
+    const Executor& executor() const {
+        return executor_;
+    }
+
+    std::vector<PartitionBatchingMetrics> GetBatchingMetrics() const {
+        return batch_controller_ ? batch_controller_->Metrics() : std::vector<PartitionBatchingMetrics>();
+    }
+
+    uint64_t GetConflatedRecordCount() const {
+        return conflated_records_;
+    }
+
+private:
+    // Encodes a message into the open batch of the key's partition through append, which is given
+    // the headers to write: those of the message, plus a trace header if the message is sampled
+    template <typename AppendFn>
+    bool Produce(std::string_view key, const std::string& topic, const std::vector<RecordHeader>& headers, SendCallback done,
+                 AppendFn&& append) {
         try {
-            // Compute the target partition using key. total_partition is fixed to be 3.
-            int partition = std::hash<std::string>{}(key) % total_partitions;
-
-            // Prepare the message
-            message_queue::Message message;
-            message.set_key(key);
-            message.set_value(value);
-            message.set_topic(topic);
-            message.set_partition(partition);
-            message.set_timestamp(time(nullptr));
-            
+            // Compute the target partition using key, over the topic's known partition count. The sender
+            // thread refreshes it, so only the first message to a topic waits for metadata.
+            int partition = std::hash<std::string_view>{}(key) % router_->GetPartitionCount(topic);
+
+            PendingTrace trace;
+            std::vector<RecordHeader> traced_headers;
+            if (Tracer::Instance().ShouldSample()) {
+                traced_headers = Tracer::Instance().StartTrace(headers, &trace.trace_id, &trace.enqueue_us);
+            }
+            const std::vector<RecordHeader>& record_headers = trace.trace_id != 0 ? traced_headers : headers;
+
             {
                 std::lock_guard<std::mutex> lock(mutex_);
                 std::string topic_partition = topic + "-" + std::to_string(partition);
-                message_map_[topic_partition].push_back(message);
-                if (message_map_[topic_partition].size() >= flush_threshold_) {
-                    FlushMessages(topic_partition);
-                    message_map_[topic_partition].clear();
+
+                // Without a spool to spill to, a full buffer rejects the message
+                if (!spool_ && options_.buffer_bytes > 0 && buffered_bytes_ >= static_cast<int64_t>(options_.buffer_bytes)) {
+                    std::cerr << "Producer buffer is full; dropping message for topic: " << topic << std::endl;
+                    return false;
+                }
+
+                // Encode the message straight into the open batch for its partition
+                auto batch = message_map_.find(topic_partition);
+                if (batch == message_map_.end()) {
+                    batch = message_map_.emplace(topic_partition, RecordBatchBuilder(topic, partition, ConflateKeysFor(topic))).first;
+                }
+                // A conflated record takes the slot, and so the offset, of the record it replaces
+                int index = batch->second.NextIndex(key);
+                int64_t size_before = batch->second.size_bytes();
+                append(batch->second, record_headers);
+                buffered_bytes_ += static_cast<int64_t>(batch->second.size_bytes()) - size_before;
+                if (done) {
+                    pending_sends_[topic_partition].push_back({index, std::move(done)});
+                }
+                if (trace.trace_id != 0) {
+                    pending_traces_[topic_partition].push_back(trace);
+                }
+                if (batch_controller_) {
+                    batch_controller_->OnAppend(topic_partition, topic, partition);
                 }
 
-                if(topic_partition_timers_.find(topic_partition) == topic_partition_timers_.end() && message_map_[topic_partition].size() > 0) {
-                    topic_partition_timers_[topic_partition] = std::thread(&Impl::FlushMessagesPeriodically, this, topic_partition);
+                // Over the buffer limit the batch spills to the spool, which replays it in order
+                if (spool_ && options_.buffer_bytes > 0 && buffered_bytes_ > static_cast<int64_t>(options_.buffer_bytes)) {
+                    SpillBatch(topic_partition, batch->second);
+                    return true;
+                }
+
+                // A full batch wakes the sender, which drains every ready batch at once
+                if (batch->second.record_count() >= BatchThreshold(topic_partition)) {
+                    sender_cv_.notify_one();
                 }
             }
             return true;
@@ -66,70 +189,638 @@ public:
         return false;
     }
 
-private:
-    void FlushMessages(const std::string &topic_partition) {
-        auto it = message_map_.find(topic_partition);
-        if(it != message_map_.end()) {
-            std::vector<message_queue::Message> messages = it->second;
+    static int64_t NowMillis() {
+        return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+    }
 
-            if(messages.empty()) {
-                return;
+    // Moves an open batch to the spool, with its sends. The batch stays open if spooling fails. Must hold mutex_.
+    void SpillBatch(const std::string &topic_partition, RecordBatchBuilder &builder) {
+        if (!SpoolBatch(BuildRequest(builder), &pending_sends_[topic_partition])) {
+            return;
+        }
+        buffered_bytes_ -= builder.size_bytes();
+        conflated_records_ += builder.conflated_count();
+        builder.Clear();
+        pending_sends_.erase(topic_partition);
+        pending_traces_.erase(topic_partition);
+    }
+
+    // A send waiting for the acknowledgement of the record at index in its partition's open batch
+    struct PendingSend {
+        int index;
+        SendCallback done;
+    };
+
+    // A sampled record in an open batch
+    struct PendingTrace {
+        uint64_t trace_id = 0;
+        int64_t enqueue_us = 0;
+    };
+
+    // An encoded batch taken from the accumulator, waiting to be sent
+    struct ReadyBatch {
+        std::string topic;
+        int partition;
+        std::string encoded;
+        message_queue::AckMode acks;
+        std::vector<PendingSend> sends;
+        int redirects = 0; // Times a broker sent the batch on to the partition's new leader
+        std::vector<PendingTrace> traces;
+    };
+
+    // A produce request to one broker, in flight on the gRPC callback API
+    struct BrokerCall {
+        std::string broker_ip;
+        std::vector<ReadyBatch> batches;
+        std::unique_ptr<message_queue::MessageQueue::Stub> stub;
+        grpc::ClientContext context;
+        message_queue::ProduceMessagesRequest request;
+        message_queue::ProduceMessagesResponse response;
+        grpc::Status status;
+        std::chrono::steady_clock::time_point sent_at;
+        int64_t sent_us = 0; // Wall-clock send time, for tracing
+        int64_t latency_ms = 0;
+    };
+
+    // Wakes every flush interval, or early once a batch is full, and sends what has accumulated.
+    // With adaptive batching it wakes when the oldest open batch reaches its partition's linger
+    // and only sends the batches that are full or old enough.
+    void RunSender() {
+        while (run_timers_) {
+            std::vector<ReadyBatch> ready;
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                sender_cv_.wait_for(lock, std::chrono::milliseconds(NextSendDelayMs()), [this]() {
+                    return !run_timers_ || HasFullBatch();
+                });
+                if (!run_timers_) {
+                    break;
+                }
+                ready = DrainBatches(batch_controller_ != nullptr);
             }
-            
-            std::string topic = topic_partition.substr(0, topic_partition.find("-"));
-            int partition = std::stoi(topic_partition.substr(topic_partition.find("-") + 1));
-            std::string broker_ip = router_->GetBrokerIP(topic, partition);
-            auto channel = grpc::CreateChannel(broker_ip, grpc::InsecureChannelCredentials());
-            auto stub = message_queue::MessageQueue::NewStub(channel);
+            if (batch_controller_) {
+                batch_controller_->SampleArrivalRates();
+            }
+            SendBatches(std::move(ready));
+            RefreshFailedTopics();
+            router_->RefreshStaleMetadata(options_.metadata_max_age_ms);
+        }
+    }
 
-            message_queue::ProduceMessagesRequest request;
-            for(const auto &message: messages) {
-                *request.add_messages() = message;
+    int BatchThreshold(const std::string &topic_partition) const {
+        return batch_controller_ ? batch_controller_->BatchRecords(topic_partition) : flush_threshold_;
+    }
+
+    // Whether an open batch has been waiting for its linger. Must hold mutex_.
+    bool IsBatchDue(const std::string &topic_partition, const RecordBatchBuilder &builder, int64_t now_ms) const {
+        return builder.record_count() >= BatchThreshold(topic_partition)
+            || now_ms - builder.base_timestamp() >= batch_controller_->LingerMs(topic_partition);
+    }
+
+    // Time until the sender should next drain the accumulator. Must hold mutex_.
+    int NextSendDelayMs() const {
+        if (!batch_controller_) {
+            return flush_interval_ms_;
+        }
+        int64_t now_ms = NowMillis();
+        int64_t delay_ms = std::max(options_.max_linger_ms, 1);
+        for (const auto &entry : message_map_) {
+            if (entry.second.record_count() > 0) {
+                int64_t due_ms = entry.second.base_timestamp() + batch_controller_->LingerMs(entry.first);
+                delay_ms = std::min(delay_ms, due_ms - now_ms);
+            }
+        }
+        return static_cast<int>(std::max<int64_t>(delay_ms, 1));
+    }
+
+    bool HasFullBatch() const {
+        for (const auto &entry : message_map_) {
+            if (entry.second.record_count() >= BatchThreshold(entry.first)) {
+                return true;
             }
-            request.set_producer_id(producer_id);
+        }
+        return false;
+    }
 
-            message_queue::ProduceMessagesResponse response;
-            grpc::ClientContext context;
-            grpc::Status status = stub->ProduceMessages(&context, request, &response);
-            if(status.ok() && response.success()) {
-                std::cout << "Successfully produced " << messages.size() << " messages to broker at: " << broker_ip << std::endl;
-            } else {
-                std::cerr << "Failed to produce messages to broker at: " << broker_ip << std::endl;
+    // Takes the non-empty batches out of the accumulator, or only the due ones. Must hold mutex_.
+    std::vector<ReadyBatch> DrainBatches(bool only_due = false) {
+        std::vector<ReadyBatch> ready;
+        int64_t now_ms = NowMillis();
+        for (auto &entry : message_map_) {
+            RecordBatchBuilder &builder = entry.second;
+            if (builder.record_count() == 0 || (only_due && !IsBatchDue(entry.first, builder, now_ms))) {
+                continue;
+            }
+            ready.push_back({builder.topic(), builder.partition(), builder.Build(), ToProtoAckMode(AckModeFor(builder.topic()))});
+            buffered_bytes_ -= builder.size_bytes();
+            conflated_records_ += builder.conflated_count();
+            builder.Clear();
+
+            auto sends = pending_sends_.find(entry.first);
+            if (sends != pending_sends_.end()) {
+                ready.back().sends = std::move(sends->second);
+                pending_sends_.erase(sends);
+            }
+            auto traces = pending_traces_.find(entry.first);
+            if (traces != pending_traces_.end()) {
+                ready.back().traces = std::move(traces->second);
+                pending_traces_.erase(traces);
             }
         }
+        return ready;
     }
 
-    void FlushMessagesPeriodically(const std::string &topic_partition) {
-        while(run_timers_) {
-            std::this_thread::sleep_for(std::chrono::milliseconds(flush_interval_ms_));
-            {
-                std::lock_guard<std::mutex> lock(mutex_);
-                if(!message_map_[topic_partition].empty()) {
-                    FlushMessages(topic_partition);
-                    message_map_[topic_partition].clear();
+    // Sends one request per leader broker and acknowledgement mode, carrying every batch bound for it
+    void SendBatches(std::vector<ReadyBatch> ready) {
+        if (ready.empty()) {
+            return;
+        }
+
+        // While older batches are waiting in the spool, append behind them to preserve ordering
+        if (spool_ && !spool_->Empty()) {
+            for (auto &batch : ready) {
+                if (!SpoolBatch(BuildRequest(batch), &batch.sends)) {
+                    CompleteBatch(batch, false, -1, "Failed to spool behind earlier undelivered batches");
                 }
             }
+            return;
+        }
+
+        std::map<std::pair<std::string, int>, std::vector<ReadyBatch>> by_broker;
+        for (auto &batch : ready) {
+            try {
+                std::string broker_ip = router_->GetBrokerIP(batch.topic, batch.partition);
+                by_broker[{broker_ip, batch.acks}].push_back(std::move(batch));
+            } catch (const std::exception& e) {
+                std::cerr << "Failed to route messages for topic: " << batch.topic << " - " << e.what() << std::endl;
+                OnBatchFailed(batch, e.what());
+            }
+        }
+
+        std::vector<std::unique_ptr<BrokerCall>> calls;
+        for (auto &entry : by_broker) {
+            auto call = std::make_unique<BrokerCall>();
+            call->broker_ip = entry.first.first;
+            call->batches = std::move(entry.second);
+            call->request.set_producer_id(producer_id);
+            call->request.set_acks(call->batches.front().acks);
+            for (const auto &batch : call->batches) {
+                call->request.add_record_batches(batch.encoded);
+            }
+
+            auto channel = grpc::CreateChannel(call->broker_ip, grpc::InsecureChannelCredentials());
+            if (call->request.acks() == message_queue::ACKS_NONE) {
+                int64_t sent_us = Tracer::NowMicros();
+                SendWithoutAck(channel, call->request);
+                for (const auto &batch : call->batches) {
+                    TraceBatch(batch, sent_us, nullptr);
+                    CompleteBatch(batch, true, -1, "");
+                }
+                continue;
+            }
+            call->stub = message_queue::MessageQueue::NewStub(channel);
+            calls.push_back(std::move(call));
+        }
+
+        // Brokers are independent, so every request is in flight at once
+        std::latch finished(calls.size());
+        for (auto &call : calls) {
+            BrokerCall *pending = call.get();
+            if (options_.send_timeout_ms > 0) {
+                pending->context.set_deadline(std::chrono::system_clock::now() + std::chrono::milliseconds(options_.send_timeout_ms));
+            }
+            pending->sent_at = std::chrono::steady_clock::now();
+            pending->sent_us = Tracer::NowMicros();
+            pending->stub->async()->ProduceMessages(&pending->context, &pending->request, &pending->response,
+                                                    [pending, &finished](grpc::Status status) {
+                pending->status = std::move(status);
+                pending->latency_ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - pending->sent_at).count();
+                finished.count_down();
+            });
+        }
+        finished.wait();
+
+        // Failure handling may refresh metadata, so responses are processed here rather than on gRPC's threads
+        std::vector<ReadyBatch> redirected;
+        for (auto &call : calls) {
+            HandleProduceResponse(*call, &redirected);
+        }
+
+        // Batches for partitions that moved go straight to the leader the broker named
+        if (!redirected.empty()) {
+            SendBatches(std::move(redirected));
+        }
+    }
+
+    // Completes the batches of a response, moving those whose partition moved into redirected
+    void HandleProduceResponse(BrokerCall &call, std::vector<ReadyBatch> *redirected) {
+        if (!call.status.ok()) {
+            std::cerr << "Failed to produce messages to broker at: " << call.broker_ip << std::endl;
+            for (auto &batch : call.batches) {
+                OnBatchFailed(batch, call.status.error_message());
+            }
+            return;
+        }
+
+        if (batch_controller_) {
+            for (const auto &batch : call.batches) {
+                batch_controller_->OnSendCompleted(batch.topic + "-" + std::to_string(batch.partition), call.latency_ms);
+            }
+        }
+
+        // Results are in request order
+        const auto &response = call.response;
+        for (size_t i = 0; i < call.batches.size(); ++i) {
+            ReadyBatch &batch = call.batches[i];
+            bool has_result = i < static_cast<size_t>(response.results_size());
+            bool ok = has_result ? response.results(i).success() : response.success();
+            if (ok) {
+                std::cout << "Successfully produced batch to topic: " << batch.topic << ", partition: "
+                          << batch.partition << " at broker: " << call.broker_ip << std::endl;
+                TraceBatch(batch, call.sent_us, has_result ? &response.results(i) : nullptr);
+                CompleteBatch(batch, true, has_result ? response.results(i).base_offset() : -1, "");
+            } else if (has_result && !response.results(i).leader_address().empty() && batch.redirects < kMaxRedirects) {
+                router_->UpdateLeader(batch.topic, batch.partition, response.results(i).leader_address());
+                ++batch.redirects;
+                redirected->push_back(std::move(batch));
+            } else {
+                const std::string &error = has_result ? response.results(i).error_message() : response.error_message();
+                std::cerr << "Failed to produce batch to topic: " << batch.topic << ", partition: " << batch.partition
+                          << " - " << error << std::endl;
+                OnBatchFailed(batch, error, has_result && response.results(i).outcome_unknown());
+            }
+        }
+    }
+
+    // Records the producer-side stages of the sampled records of an acknowledged batch
+    void TraceBatch(const ReadyBatch &batch, int64_t sent_us, const message_queue::PartitionProduceResult *result) {
+        if (batch.traces.empty()) {
+            return;
+        }
+        Tracer &tracer = Tracer::Instance();
+        int64_t acked_us = Tracer::NowMicros();
+        for (const auto &trace : batch.traces) {
+            tracer.Record(TraceStage::kLinger, trace.trace_id, batch.topic, batch.partition, trace.enqueue_us, sent_us);
+            if (!result || result->receive_time_us() == 0) {
+                continue;
+            }
+            tracer.Record(TraceStage::kProduceRequest, trace.trace_id, batch.topic, batch.partition, sent_us, result->receive_time_us());
+            // Only quorum acks wait for BookKeeper
+            if (result->confirm_time_us() != 0) {
+                tracer.Record(TraceStage::kLedgerAppend, trace.trace_id, batch.topic, batch.partition, result->receive_time_us(),
+                              result->confirm_time_us());
+                tracer.Record(TraceStage::kProduceAck, trace.trace_id, batch.topic, batch.partition, result->confirm_time_us(), acked_us);
+            }
+        }
+    }
+
+    // Tells every send waiting on the batch how it went
+    void CompleteBatch(const ReadyBatch &batch, bool success, int64_t base_offset, const std::string &error_message,
+                       bool outcome_unknown = false) {
+        for (const auto &send : batch.sends) {
+            send.done({success, success && base_offset >= 0 ? base_offset + send.index : -1, error_message, outcome_unknown});
+        }
+    }
+
+    // Keeps a failed batch for replay, if spooling is enabled, and marks its route for a refresh. The
+    // sends of a spooled batch complete once its replay is acknowledged. A batch whose outcome is
+    // unknown is replayed too, so it is delivered at least once and possibly twice.
+    void OnBatchFailed(ReadyBatch &batch, const std::string &error_message, bool outcome_unknown = false) {
+        if (!spool_ || !SpoolBatch(BuildRequest(batch), &batch.sends)) {
+            CompleteBatch(batch, false, -1, error_message, outcome_unknown);
+        }
+        stale_topics_.insert(batch.topic);
+    }
+
+    // Refreshes the metadata of every topic a batch failed for, once per topic rather than once per
+    // batch, so a broker going down costs one metadata request per topic on the sender thread
+    void RefreshFailedTopics() {
+        std::unordered_set<std::string> stale_topics;
+        stale_topics.swap(stale_topics_);
+        for (const auto &topic : stale_topics) {
+            try {
+                router_->RefreshMetadata(topic);
+            } catch (const std::exception& e) {
+                std::cerr << "Could not refresh metadata for topic: " << topic << " - " << e.what() << std::endl;
+            }
+        }
+    }
+
+    message_queue::ProduceMessagesRequest BuildRequest(const ReadyBatch &batch) {
+        message_queue::ProduceMessagesRequest request;
+        request.add_record_batches(batch.encoded);
+        request.set_producer_id(producer_id);
+        request.set_acks(batch.acks);
+        return request;
+    }
+
+    message_queue::ProduceMessagesRequest BuildRequest(const RecordBatchBuilder &batch) {
+        message_queue::ProduceMessagesRequest request;
+        request.add_record_batches(batch.Build());
+        request.set_producer_id(producer_id);
+        request.set_acks(ToProtoAckMode(AckModeFor(batch.topic())));
+        return request;
+    }
+
+    AckMode AckModeFor(const std::string &topic) const {
+        auto it = options_.topic_acks.find(topic);
+        return it != options_.topic_acks.end() ? it->second : options_.acks;
+    }
+
+    bool ConflateKeysFor(const std::string &topic) const {
+        auto it = options_.topic_conflate_keys.find(topic);
+        return it != options_.topic_conflate_keys.end() ? it->second : options_.conflate_keys;
+    }
+
+    static message_queue::AckMode ToProtoAckMode(AckMode acks) {
+        switch (acks) {
+            case AckMode::kNone:
+                return message_queue::ACKS_NONE;
+            case AckMode::kLeader:
+                return message_queue::ACKS_LEADER;
+            default:
+                return message_queue::ACKS_QUORUM;
+        }
+    }
+
+    // Sends without waiting for the response. The call state lives until gRPC completes it. Batches
+    // of partitions that moved are sent on to the leader the broker named, so a handoff loses nothing.
+    void SendWithoutAck(const std::shared_ptr<grpc::Channel> &channel, const message_queue::ProduceMessagesRequest &request,
+                        int redirects = 0) {
+        struct Call {
+            std::shared_ptr<grpc::Channel> channel;
+            std::unique_ptr<message_queue::MessageQueue::Stub> stub;
+            grpc::ClientContext context;
+            message_queue::ProduceMessagesRequest request;
+            message_queue::ProduceMessagesResponse response;
+        };
+
+        auto *call = new Call;
+        call->channel = channel;
+        call->stub = message_queue::MessageQueue::NewStub(channel);
+        call->request = request;
+        if (options_.send_timeout_ms > 0) {
+            call->context.set_deadline(std::chrono::system_clock::now() + std::chrono::milliseconds(options_.send_timeout_ms));
+        }
+        {
+            std::lock_guard<std::mutex> lock(unacked_mutex_);
+            ++unacked_calls_;
+        }
+        call->stub->async()->ProduceMessages(&call->context, &call->request, &call->response,
+                                             [this, call, redirects](grpc::Status status) {
+            if (status.ok()) {
+                RedirectUnacked(call->request, call->response, redirects);
+            }
+            delete call;
+            std::lock_guard<std::mutex> lock(unacked_mutex_);
+            if (--unacked_calls_ == 0) {
+                unacked_cv_.notify_all();
+            }
+        });
+    }
+
+    // Resends the batches of an unacknowledged request that the broker redirected to a new leader
+    void RedirectUnacked(const message_queue::ProduceMessagesRequest &request, const message_queue::ProduceMessagesResponse &response,
+                         int redirects) {
+        // Results are in request order
+        std::map<std::string, message_queue::ProduceMessagesRequest> by_leader;
+        for (int i = 0; i < response.results_size() && i < request.record_batches_size(); ++i) {
+            const auto &result = response.results(i);
+            if (result.success() || result.leader_address().empty()) {
+                continue;
+            }
+            router_->UpdateLeader(result.topic(), result.partition(), result.leader_address());
+            if (redirects >= kMaxRedirects) {
+                std::cerr << "Dropping unacknowledged batch for topic: " << result.topic() << ", partition: "
+                          << result.partition() << " after " << redirects << " redirects" << std::endl;
+                continue;
+            }
+            auto &redirected = by_leader[result.leader_address()];
+            redirected.set_producer_id(request.producer_id());
+            redirected.set_acks(request.acks());
+            redirected.add_record_batches(request.record_batches(i));
+        }
+        for (const auto &entry : by_leader) {
+            SendWithoutAck(grpc::CreateChannel(entry.first, grpc::InsecureChannelCredentials()), entry.second, redirects + 1);
+        }
+    }
+
+    // Sends a single topic-partition batch to the partition leader, setting base_offset to the offset
+    // of its first record, or -1 if the broker did not report one
+    bool SendRequest(const message_queue::ProduceMessagesRequest &request, int64_t *base_offset) {
+        *base_offset = -1;
+        RecordBatchHeader batch;
+        if (request.record_batches_size() == 0 || !ReadRecordBatchHeader(request.record_batches(0), &batch)) {
+            std::cerr << "Produce request has no readable record batch" << std::endl;
+            return false;
+        }
+
+        std::string broker_ip;
+        try {
+            broker_ip = router_->GetBrokerIP(batch.topic, batch.partition);
+        } catch (const std::exception& e) {
+            std::cerr << "Failed to route messages for topic: " << batch.topic << " - " << e.what() << std::endl;
+            return false;
+        }
+
+        auto channel = grpc::CreateChannel(broker_ip, grpc::InsecureChannelCredentials());
+        if (request.acks() == message_queue::ACKS_NONE) {
+            SendWithoutAck(channel, request);
+            return true;
+        }
+        auto stub = message_queue::MessageQueue::NewStub(channel);
+
+        message_queue::ProduceMessagesResponse response;
+        grpc::ClientContext context;
+        if (options_.send_timeout_ms > 0) {
+            context.set_deadline(std::chrono::system_clock::now() + std::chrono::milliseconds(options_.send_timeout_ms));
+        }
+        grpc::Status status = stub->ProduceMessages(&context, request, &response);
+        if(status.ok() && response.success()) {
+            std::cout << "Successfully produced " << batch.record_count << " messages to broker at: " << broker_ip << std::endl;
+            if (response.results_size() > 0) {
+                *base_offset = response.results(0).base_offset();
+            }
+            return true;
+        }
+
+        std::cerr << "Failed to produce messages to broker at: " << broker_ip << std::endl;
+        return false;
+    }
+
+    // Appends a batch to the spool and takes its sends, which complete once the replay is acknowledged.
+    // Returns false, leaving the sends, if the batch could not be spooled.
+    bool SpoolBatch(const message_queue::ProduceMessagesRequest &request, std::vector<PendingSend> *sends) {
+        // Held across the append so the replayer never acknowledges the record before its sends are listed
+        std::lock_guard<std::mutex> lock(spooled_mutex_);
+        uint64_t spool_id;
+        if (!spool_->Append(request.SerializeAsString(), &spool_id)) {
+            std::cerr << "Failed to spool produce request" << std::endl;
+            return false;
+        }
+        std::cout << "Spooled produce request for later delivery" << std::endl;
+        if (!sends->empty()) {
+            spooled_batches_.push_back({spool_id, std::move(*sends)});
+            sends->clear();
+        }
+        spool_cv_.notify_one();
+        return true;
+    }
+
+    // Completes the sends of the spool record that was just replayed or dropped, if this producer spooled it
+    void CompleteSpooled(uint64_t spool_id, bool success, int64_t base_offset, const std::string &error_message) {
+        std::vector<PendingSend> sends;
+        {
+            std::lock_guard<std::mutex> lock(spooled_mutex_);
+            // Records recovered from an earlier run come first and have no sends
+            if (spooled_batches_.empty() || spooled_batches_.front().spool_id != spool_id) {
+                return;
+            }
+            sends = std::move(spooled_batches_.front().sends);
+            spooled_batches_.pop_front();
+        }
+        for (const auto &send : sends) {
+            send.done({success, success && base_offset >= 0 ? base_offset + send.index : -1, error_message});
+        }
+    }
+
+    // Drains the spool in order, backing off while the partition leader is unreachable
+    void ReplaySpool() {
+        const int max_backoff_ms = 10000;
+        int backoff_ms = std::max(flush_interval_ms_, 10);
+
+        while (run_timers_) {
+            std::string record;
+            uint64_t spool_id;
+            if (!spool_->Peek(&record, &spool_id)) {
+                std::unique_lock<std::mutex> lock(spool_mutex_);
+                spool_cv_.wait_for(lock, std::chrono::milliseconds(flush_interval_ms_), [this]() {
+                    return !run_timers_ || !spool_->Empty();
+                });
+                continue;
+            }
+
+            message_queue::ProduceMessagesRequest request;
+            RecordBatchHeader batch;
+            if (!request.ParseFromString(record) || request.record_batches_size() == 0
+                || !ReadRecordBatchHeader(request.record_batches(0), &batch)) {
+                std::cerr << "Dropping unreadable spool record" << std::endl;
+                spool_->Pop();
+                CompleteSpooled(spool_id, false, -1, "Spooled batch was unreadable");
+                continue;
+            }
+
+            int64_t base_offset;
+            if (SendRequest(request, &base_offset)) {
+                spool_->Pop();
+                CompleteSpooled(spool_id, true, base_offset, "");
+                backoff_ms = std::max(flush_interval_ms_, 10);
+                continue;
+            }
+
+            // The leader may have moved, so refresh routing before the next attempt
+            try {
+                router_->RefreshMetadata(batch.topic);
+            } catch (const std::exception& e) {
+                std::cerr << "Spool replay could not refresh metadata: " << e.what() << std::endl;
+            }
+
+            std::unique_lock<std::mutex> lock(spool_mutex_);
+            spool_cv_.wait_for(lock, std::chrono::milliseconds(backoff_ms), [this]() { return !run_timers_.load(); });
+            backoff_ms = std::min(backoff_ms * 2, max_backoff_ms);
         }
     }
 
     std::unique_ptr<Router> router_;
-    std::unordered_map<std::string, std::vector<message_queue::Message>> message_map_;
-    std::unordered_map<std::string, std::thread> topic_partition_timers_;
+    std::unordered_map<std::string, RecordBatchBuilder> message_map_; // Open batch per topic-partition
+    std::unordered_map<std::string, std::vector<PendingSend>> pending_sends_; // Sends awaiting each open batch
+    std::unordered_map<std::string, std::vector<PendingTrace>> pending_traces_; // Sampled records of each open batch
+    std::unordered_set<std::string> stale_topics_; // Topics a batch failed for since the last refresh; sender thread only
+    std::atomic<uint64_t> conflated_records_{0}; // Records replaced within batches already drained
+    int64_t buffered_bytes_ = 0; // Encoded bytes of the open batches; guarded by mutex_
     std::mutex mutex_;
-    bool run_timers_ = true;
+    std::thread sender_;
+    std::condition_variable sender_cv_;
+    std::atomic<bool> run_timers_{true};
     int flush_threshold_;
     int flush_interval_ms_;
     std::string producer_id;
+    ProducerOptions options_;
+    std::unique_ptr<BatchController> batch_controller_; // Set when adaptive batching is enabled
+    Executor executor_;
+
+    // Unacknowledged sends still in flight
+    std::mutex unacked_mutex_;
+    std::condition_variable unacked_cv_;
+    int unacked_calls_ = 0;
+
+    // Local write-ahead spool for undeliverable batches
+    std::unique_ptr<ProducerSpool> spool_;
+    std::thread spool_replayer_;
+    std::mutex spool_mutex_;
+    std::condition_variable spool_cv_;
+
+    // A spooled batch whose sends complete once its replay is acknowledged
+    struct SpooledBatch {
+        uint64_t spool_id;
+        std::vector<PendingSend> sends;
+    };
+    std::deque<SpooledBatch> spooled_batches_; // In spool order
+    std::mutex spooled_mutex_;
 };
 
 // Producer constructor
 Producer::Producer(const std::vector<std::string>& bootstrap_servers, int flush_threshold, int flush_interval_ms, const std::string& producer_id)
-    : impl_(std::make_unique<Impl>(bootstrap_servers, flush_threshold, flush_interval_ms, producer_id)) {}
+    : Producer(bootstrap_servers, flush_threshold, flush_interval_ms, producer_id, ProducerOptions()) {}
+
+Producer::Producer(const std::vector<std::string>& bootstrap_servers, int flush_threshold, int flush_interval_ms, const std::string& producer_id, const ProducerOptions& options)
+    : impl_(std::make_unique<Impl>(bootstrap_servers, flush_threshold, flush_interval_ms, producer_id, options)) {}
 
 Producer::~Producer() = default; // Defaulted destructor
 
-bool Producer::ProduceMessage(const std::string& key, 
-                              const std::string& value,
-                              const std::string& topic) {
-    return impl_->ProduceMessage(key, value, topic);
+bool Producer::ProduceMessage(std::string_view key, 
+                              std::string_view value,
+                              const std::string& topic,
+                              const std::vector<RecordHeader>& headers) {
+    return impl_->ProduceMessage(key, value, topic, headers);
+}
+
+bool Producer::ProduceMessageAsync(std::string_view key, std::string_view value, const std::string& topic,
+                                   const std::vector<RecordHeader>& headers, SendCallback done) {
+    return impl_->ProduceMessage(key, value, topic, headers, std::move(done));
+}
+
+bool Producer::ProduceMessageInPlace(std::string_view key, size_t value_size, const ValueWriter& write_value, const std::string& topic,
+                                     const std::vector<RecordHeader>& headers, SendCallback done) {
+    return impl_->ProduceMessage(key, value_size, write_value, topic, headers, std::move(done));
+}
+
+SendAwaitable Producer::Send(std::string_view key, std::string_view value, const std::string& topic, const std::vector<RecordHeader>& headers) {
+    return SendAwaitable(this, key, value, topic, headers);
+}
+
+bool SendAwaitable::await_suspend(std::coroutine_handle<> handle) {
+    // Once queued the send may complete and resume the coroutine on another thread, so this
+    // awaiter must not be touched after a successful ProduceMessageAsync
+    Executor executor = producer_->executor();
+    bool queued = producer_->ProduceMessageAsync(key_, value_, topic_, headers_, [this, handle, executor](const SendResult& result) {
+        result_ = result;
+        executor([handle]() { handle.resume(); });
+    });
+    if (!queued) {
+        result_ = {false, -1, "Message could not be queued"};
+    }
+    return queued;
+}
+
+const Executor& Producer::executor() const {
+    return impl_->executor();
+}
+
+std::vector<PartitionBatchingMetrics> Producer::GetBatchingMetrics() const {
+    return impl_->GetBatchingMetrics();
+}
+
+uint64_t Producer::GetConflatedRecordCount() const {
+    return impl_->GetConflatedRecordCount();
 }
\ No newline at end of file
@@ -0,0 +1,241 @@
+#include "producer_spool.h"
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+namespace {
+constexpr uint32_t kSpoolMagic = 0x534d5144; // "DQMS"
+constexpr uint32_t kSpoolVersion = 1;
+constexpr size_t kHeaderBytes = 64;        // Header is padded so records start on a cache line
+constexpr size_t kLengthBytes = sizeof(uint32_t);
+
+// Record id: the segment sequence number above the record's position in the segment
+constexpr int kRecordIdPositionBits = 40;
+
+uint64_t RecordId(uint64_t seq, uint64_t pos) {
+    return (seq << kRecordIdPositionBits) | pos;
+}
+
+std::string SegmentPath(const std::string& dir, uint64_t seq) {
+    std::ostringstream name;
+    name << dir << "/spool-" << std::setw(20) << std::setfill('0') << seq << ".log";
+    return name.str();
+}
+}
+
+char* ProducerSpool::Segment::data() const {
+    return base + kHeaderBytes;
+}
+
+size_t ProducerSpool::Segment::capacity() const {
+    return size - kHeaderBytes;
+}
+
+ProducerSpool::ProducerSpool(const std::string& dir, size_t segment_bytes)
+    : dir_(dir), segment_bytes_(std::max(segment_bytes, kHeaderBytes + kLengthBytes)) {
+    std::error_code ec;
+    std::filesystem::create_directories(dir_, ec);
+    if (ec) {
+        throw std::runtime_error("Failed to create spool directory " + dir_ + ": " + ec.message());
+    }
+
+    // Recover existing segments in sequence order
+    std::vector<std::pair<uint64_t, std::string>> existing;
+    for (const auto& entry : std::filesystem::directory_iterator(dir_)) {
+        std::string name = entry.path().filename().string();
+        if (name.rfind("spool-", 0) != 0 || entry.path().extension() != ".log") {
+            continue;
+        }
+        try {
+            existing.emplace_back(std::stoull(name.substr(6)), entry.path().string());
+        } catch (const std::exception&) {
+            std::cerr << "Ignoring unrecognised spool file: " << name << std::endl;
+        }
+    }
+    std::sort(existing.begin(), existing.end());
+
+    for (const auto& file : existing) {
+        Segment segment;
+        if (!OpenSegment(file.second, file.first, 0, false, &segment)) {
+            throw std::runtime_error("Failed to open spool segment " + file.second);
+        }
+        segments_.push_back(segment);
+    }
+
+    if (!segments_.empty()) {
+        std::cout << "Recovered " << segments_.size() << " spool segments from " << dir_ << std::endl;
+    }
+}
+
+ProducerSpool::~ProducerSpool() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto& segment : segments_) {
+        CloseSegment(segment, false);
+    }
+    segments_.clear();
+}
+
+bool ProducerSpool::OpenSegment(const std::string& path, uint64_t seq, size_t size, bool create, Segment* segment) {
+    int fd = open(path.c_str(), create ? (O_RDWR | O_CREAT | O_EXCL) : O_RDWR, 0644);
+    if (fd < 0) {
+        std::cerr << "Failed to open spool segment " << path << ": " << strerror(errno) << std::endl;
+        return false;
+    }
+
+    if (create) {
+        if (ftruncate(fd, size) != 0) {
+            std::cerr << "Failed to size spool segment " << path << ": " << strerror(errno) << std::endl;
+            close(fd);
+            return false;
+        }
+    } else {
+        off_t length = lseek(fd, 0, SEEK_END);
+        if (length < static_cast<off_t>(kHeaderBytes)) {
+            std::cerr << "Spool segment is truncated: " << path << std::endl;
+            close(fd);
+            return false;
+        }
+        size = length;
+    }
+
+    void* base = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (base == MAP_FAILED) {
+        std::cerr << "Failed to map spool segment " << path << ": " << strerror(errno) << std::endl;
+        close(fd);
+        return false;
+    }
+
+    segment->seq = seq;
+    segment->path = path;
+    segment->fd = fd;
+    segment->base = static_cast<char*>(base);
+    segment->size = size;
+    segment->header = reinterpret_cast<SegmentHeader*>(base);
+
+    if (create) {
+        segment->header->magic = kSpoolMagic;
+        segment->header->version = kSpoolVersion;
+        segment->header->write_pos = 0;
+        segment->header->read_pos = 0;
+    } else if (segment->header->magic != kSpoolMagic || segment->header->version != kSpoolVersion
+               || segment->header->write_pos > segment->capacity()
+               || segment->header->read_pos > segment->header->write_pos) {
+        std::cerr << "Spool segment has an invalid header: " << path << std::endl;
+        CloseSegment(*segment, false);
+        return false;
+    }
+    return true;
+}
+
+void ProducerSpool::CloseSegment(Segment& segment, bool remove) {
+    msync(segment.base, segment.size, MS_SYNC);
+    munmap(segment.base, segment.size);
+    close(segment.fd);
+    if (remove) {
+        unlink(segment.path.c_str());
+    }
+}
+
+bool ProducerSpool::RollSegment(size_t min_record_bytes) {
+    uint64_t seq = segments_.empty() ? 0 : segments_.back().seq + 1;
+    if (!segments_.empty()) {
+        // Start writing back the sealed segment without blocking the caller
+        msync(segments_.back().base, segments_.back().size, MS_ASYNC);
+    }
+
+    Segment segment;
+    size_t size = std::max(segment_bytes_, kHeaderBytes + min_record_bytes);
+    if (!OpenSegment(SegmentPath(dir_, seq), seq, size, true, &segment)) {
+        return false;
+    }
+    segments_.push_back(segment);
+    return true;
+}
+
+bool ProducerSpool::Append(const std::string& record, uint64_t* id) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    size_t record_bytes = kLengthBytes + record.size();
+
+    if (segments_.empty() || segments_.back().capacity() - segments_.back().header->write_pos < record_bytes) {
+        if (!RollSegment(record_bytes)) {
+            return false;
+        }
+    }
+
+    Segment& segment = segments_.back();
+    char* dest = segment.data() + segment.header->write_pos;
+    uint32_t length = record.size();
+    std::memcpy(dest, &length, kLengthBytes);
+    std::memcpy(dest + kLengthBytes, record.data(), record.size());
+    if (id) {
+        *id = RecordId(segment.seq, segment.header->write_pos);
+    }
+
+    // Publish the record only after its bytes are in place so a crash never exposes a partial record
+    segment.header->write_pos += record_bytes;
+    return true;
+}
+
+bool ProducerSpool::Peek(std::string* record, uint64_t* id) {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    // Drop segments that have been fully replayed
+    while (!segments_.empty() && segments_.front().header->read_pos == segments_.front().header->write_pos) {
+        if (segments_.size() == 1) {
+            // Reuse the active segment from the start instead of creating a new file
+            segments_.front().header->read_pos = 0;
+            segments_.front().header->write_pos = 0;
+            return false;
+        }
+        CloseSegment(segments_.front(), true);
+        segments_.pop_front();
+    }
+
+    if (segments_.empty()) {
+        return false;
+    }
+
+    const Segment& segment = segments_.front();
+    const char* src = segment.data() + segment.header->read_pos;
+    uint32_t length;
+    std::memcpy(&length, src, kLengthBytes);
+    record->assign(src + kLengthBytes, length);
+    if (id) {
+        *id = RecordId(segment.seq, segment.header->read_pos);
+    }
+    return true;
+}
+
+void ProducerSpool::Pop() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (segments_.empty()) {
+        return;
+    }
+
+    Segment& segment = segments_.front();
+    if (segment.header->read_pos == segment.header->write_pos) {
+        return;
+    }
+
+    uint32_t length;
+    std::memcpy(&length, segment.data() + segment.header->read_pos, kLengthBytes);
+    segment.header->read_pos += kLengthBytes + length;
+}
+
+bool ProducerSpool::Empty() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (const auto& segment : segments_) {
+        if (segment.header->read_pos != segment.header->write_pos) {
+            return false;
+        }
+    }
+    return true;
+}
@@ -0,0 +1,65 @@
+#ifndef MESSAGE_QUEUE_PRODUCER_SPOOL_H
+#define MESSAGE_QUEUE_PRODUCER_SPOOL_H
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+
+// Segmented, memory-mapped write-ahead log used by the producer to hold
+// batches that could not be delivered to a broker. Records are replayed in
+// the order they were appended and survive producer restarts.
+class ProducerSpool {
+public:
+    // Opens (or creates) the spool in the given directory. Existing segments
+    // are recovered so that undelivered records are replayed after a restart.
+    ProducerSpool(const std::string& dir, size_t segment_bytes);
+
+    ~ProducerSpool();
+
+    // Appends a record to the tail of the spool. If id is set it receives the record's id, which
+    // is unique among the undelivered records.
+    bool Append(const std::string& record, uint64_t* id = nullptr);
+
+    // Copies the oldest undelivered record into record, and its id into id if set. Returns false
+    // if the spool is empty.
+    bool Peek(std::string* record, uint64_t* id = nullptr);
+
+    // Marks the oldest undelivered record as delivered
+    void Pop();
+
+    // Returns true if there are no undelivered records
+    bool Empty();
+
+private:
+    struct SegmentHeader {
+        uint32_t magic;
+        uint32_t version;
+        uint64_t write_pos; // End of the last appended record, relative to the data area
+        uint64_t read_pos;  // Start of the oldest undelivered record, relative to the data area
+    };
+
+    struct Segment {
+        uint64_t seq;
+        std::string path;
+        int fd;
+        char* base;
+        size_t size;
+        SegmentHeader* header;
+
+        char* data() const;
+        size_t capacity() const;
+    };
+
+    std::string dir_;
+    size_t segment_bytes_;
+    std::deque<Segment> segments_; // Oldest segment first, the last one receives appends
+    std::mutex mutex_;
+
+    bool OpenSegment(const std::string& path, uint64_t seq, size_t size, bool create, Segment* segment);
+    void CloseSegment(Segment& segment, bool remove);
+    bool RollSegment(size_t min_record_bytes);
+};
+
+#endif // MESSAGE_QUEUE_PRODUCER_SPOOL_H
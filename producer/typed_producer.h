@@ -0,0 +1,38 @@
+#ifndef MESSAGE_QUEUE_TYPED_PRODUCER_H
+#define MESSAGE_QUEUE_TYPED_PRODUCER_H
+
+#include <string>
+#include <vector>
+#include "producer.h"
+#include "serde.h"
+
+// Produces keys of type K and values of type V through a Producer, encoding them with
+// Serde<K> and Serde<V> chosen at compile time (see serde.h). Values are written straight
+// into the batch buffer. The key is encoded into a per-thread scratch buffer first, since
+// its bytes pick the partition and so the batch.
+template <typename K, typename V, template <typename> class Serde = DefaultSerde>
+class TypedProducer {
+public:
+    explicit TypedProducer(Producer& producer) : producer_(producer) {}
+
+    bool ProduceMessage(const K& key, const V& value, const std::string& topic, const std::vector<RecordHeader>& headers = {}) {
+        return ProduceMessageAsync(key, value, topic, headers, nullptr);
+    }
+
+    // Like Producer::ProduceMessageAsync; done is called with the record's acknowledged offset
+    bool ProduceMessageAsync(const K& key, const V& value, const std::string& topic, const std::vector<RecordHeader>& headers,
+                             SendCallback done) {
+        thread_local std::string key_bytes;
+        key_bytes.resize(Serde<K>::Size(key));
+        Serde<K>::Write(key, key_bytes.data());
+
+        return producer_.ProduceMessageInPlace(key_bytes, Serde<V>::Size(value),
+                                               [&value](char* dest) { Serde<V>::Write(value, dest); },
+                                               topic, headers, std::move(done));
+    }
+
+private:
+    Producer& producer_;
+};
+
+#endif // MESSAGE_QUEUE_TYPED_PRODUCER_H
@@ -3,18 +3,29 @@ package com.clustercrew.messagequeue;
 import org.apache.bookkeeper.client.*;
 import org.apache.bookkeeper.client.BKException.BKLedgerClosedException;
 import org.apache.bookkeeper.conf.ClientConfiguration;
+import com.clustercrew.messagequeue.MessageQueueOuterClass.Message;
+import com.google.protobuf.InvalidProtocolBufferException;
 
 import java.nio.charset.StandardCharsets;
 import java.util.ArrayList;
 import java.util.Enumeration;
+import java.util.LinkedHashMap;
 import java.util.List;
 import java.util.Map;
+import java.util.concurrent.CompletableFuture;
 import java.util.concurrent.ConcurrentHashMap;
 import java.util.concurrent.locks.ReentrantLock;
 
-import com.clustercrew.messagequeue.MessageQueueOuterClass.Message;
-
 public class BookKeeperClient {
+    // Number of entries requested per readEntries call while indexing a sealed ledger
+    private static final int INDEX_SCAN_ENTRIES = 256;
+
+    // Most points of a sealed ledger's entry index persisted to ZooKeeper, about 35 bytes each
+    private static final int PERSISTED_INDEX_POINTS = 4096;
+
+    // Maximum number of sealed ledgers kept open for reading
+    private static final int READ_HANDLE_CACHE_SIZE = 64;
+
     private final BookKeeper bookKeeper;
     private final ZooKeeperClient zkClient;
 
@@ -24,6 +35,12 @@ public class BookKeeperClient {
     // Lock map to synchronize ledger creation for a topic partition
     private final ConcurrentHashMap<String, ConcurrentHashMap<Integer, ReentrantLock>> ledgerLocks;
 
+    // Offset index map: topic -> partition -> ledger index
+    private final ConcurrentHashMap<String, ConcurrentHashMap<Integer, PartitionLedgerIndex>> ledgerIndexes;
+
+    // Read handles of sealed ledgers by ledger ID, least recently used first
+    private final LinkedHashMap<Long, ReadHandle> readHandles;
+
     public BookKeeperClient(String servers, ZooKeeperClient zkClient) throws Exception {
         ClientConfiguration config = new ClientConfiguration();
         config.setMetadataServiceUri("zk+null://127.0.0.1:2181/ledgers");
@@ -31,6 +48,17 @@ public class BookKeeperClient {
         this.zkClient = zkClient;
         this.activeLedgers = new ConcurrentHashMap<>();
         this.ledgerLocks = new ConcurrentHashMap<>();
+        this.ledgerIndexes = new ConcurrentHashMap<>();
+        this.readHandles = new LinkedHashMap<>(16, 0.75f, true) {
+            @Override
+            protected boolean removeEldestEntry(Map.Entry<Long, ReadHandle> eldest) {
+                if (size() > READ_HANDLE_CACHE_SIZE) {
+                    eldest.getValue().evict();
+                    return true;
+                }
+                return false;
+            }
+        };
         System.out.println("Connected to BookKeeper!");
     }
 
@@ -38,19 +66,36 @@ public class BookKeeperClient {
      * Creates a new ledger for a topic partition and updates the mapping in
      * ZooKeeper.
      *
-     * @param topic     The topic name.
-     * @param partition The partition number.
+     * @param topic      The topic name.
+     * @param partition  The partition number.
+     * @param baseOffset The logical offset of the first record the ledger will hold.
      * @return The newly created ledger handle.
      * @throws Exception If an error occurs while creating the ledger.
      */
-    private LedgerHandle createNewLedger(String topic, int partition) throws Exception {
-        LedgerHandle ledger = bookKeeper.createLedger(
-                BookKeeper.DigestType.CRC32,
-                "password".getBytes(StandardCharsets.UTF_8));
+    private LedgerHandle createNewLedger(String topic, int partition, long baseOffset) throws Exception {
+        // Honour the topic's quorum settings, if it has any
+        Map<String, String> config = zkClient.getTopicConfig(topic);
+        LedgerHandle ledger;
+        if (config.containsKey("writeQuorum") && config.containsKey("ackQuorum")) {
+            int writeQuorum = Integer.parseInt(config.get("writeQuorum"));
+            int ackQuorum = Integer.parseInt(config.get("ackQuorum"));
+            int ensembleSize = Math.max(writeQuorum, Integer.parseInt(config.getOrDefault("replicas", "0")));
+            ledger = bookKeeper.createLedger(ensembleSize, writeQuorum, ackQuorum,
+                    BookKeeper.DigestType.CRC32,
+                    "password".getBytes(StandardCharsets.UTF_8));
+        } else {
+            ledger = bookKeeper.createLedger(
+                    BookKeeper.DigestType.CRC32,
+                    "password".getBytes(StandardCharsets.UTF_8));
+        }
 
         long ledgerId = ledger.getId();
         // Update ledger mapping in ZooKeeper
-        zkClient.addLedgerToPartition(topic, partition, ledgerId);
+        zkClient.addLedgerToPartition(topic, partition, ledgerId, baseOffset);
+
+        PartitionLedgerIndex index = getLedgerIndex(topic, partition);
+        index.addLedger(ledgerId, baseOffset);
+        index.putEntryIndexIfAbsent(ledgerId, new PartitionLedgerIndex.EntryIndex());
 
         System.out.println("Ledger created for topic: " + topic + ", partition: " + partition + ", ID: " + ledgerId);
         return ledger;
@@ -60,12 +105,13 @@ public class BookKeeperClient {
      * Ensures there is an active ledger for the given topic partition.
      * If no ledger exists or the current ledger is closed, a new ledger is created.
      *
-     * @param topic     The topic name.
-     * @param partition The partition number.
+     * @param topic      The topic name.
+     * @param partition  The partition number.
+     * @param nextOffset The logical offset of the next record to be written.
      * @return The active ledger handle for the partition.
      * @throws Exception If an error occurs while creating or fetching the ledger.
      */
-    public LedgerHandle getOrCreateActiveLedger(String topic, int partition) throws Exception {
+    public LedgerHandle getOrCreateActiveLedger(String topic, int partition, long nextOffset) throws Exception {
         activeLedgers.putIfAbsent(topic, new ConcurrentHashMap<>());
         ledgerLocks.putIfAbsent(topic, new ConcurrentHashMap<>());
         ledgerLocks.get(topic).putIfAbsent(partition, new ReentrantLock());
@@ -78,7 +124,11 @@ public class BookKeeperClient {
 
             // If no ledger exists or it is closed, create a new ledger
             if (ledger == null || ledger.isClosed()) {
-                ledger = createNewLedger(topic, partition);
+                if (ledger != null) {
+                    PartitionLedgerIndex index = getLedgerIndex(topic, partition);
+                    persistSealedLedger(topic, partition, index, ledger, index.getEntryIndex(ledger.getId()));
+                }
+                ledger = createNewLedger(topic, partition, nextOffset);
                 activeLedgers.get(topic).put(partition, ledger);
             }
             return ledger;
@@ -88,121 +138,529 @@ public class BookKeeperClient {
     }
 
     /**
-     * Writes a message to the current active ledger of the topic partition.
-     * If the ledger reaches its max entries, it is closed, and a new ledger is
-     * created.
+     * Appends an entry to the active ledger of the topic partition without waiting
+     * for the bookies. Entries of a ledger are confirmed in the order they were
+     * added, so a caller may keep several in flight. A failed add leaves the
+     * ledger unusable; the caller must release it and recover the partition.
+     *
+     * @param topic        The topic name.
+     * @param partition    The partition number.
+     * @param entry        The ledger entry holding one or more record batches (see RecordBatch.toEntry).
+     * @param baseOffset   The base offset of the first batch in the entry.
+     * @param maxTimestamp The highest base timestamp of the batches in the entry.
+     * @return A future completed once the entry is confirmed.
+     */
+    public CompletableFuture<Void> appendEntryAsync(String topic, int partition, byte[] entry, long baseOffset,
+                                                    long maxTimestamp) {
+        CompletableFuture<Void> confirmed = new CompletableFuture<>();
+        try {
+            LedgerHandle ledger = getOrCreateActiveLedger(topic, partition, baseOffset);
+            PartitionLedgerIndex.EntryIndex entryIndex = getEntryIndex(topic, partition, getLedgerIndex(topic, partition), ledger);
+
+            ledger.asyncAddEntry(entry, (rc, handle, entryId, ctx) -> {
+                if (rc == BKException.Code.OK) {
+                    entryIndex.append(entryId, baseOffset, maxTimestamp);
+                    confirmed.complete(null);
+                } else {
+                    System.out.println("Failed to write entry to topic: " + topic + ", partition: " + partition
+                            + ": " + BKException.getMessage(rc));
+                    confirmed.completeExceptionally(BKException.create(rc));
+                }
+            }, null);
+        } catch (Exception e) {
+            confirmed.completeExceptionally(e);
+        }
+        return confirmed;
+    }
+
+    /**
+     * Drops the active ledger and offset index of a topic partition this broker
+     * no longer owns. The handle is closed asynchronously so the caller never blocks;
+     * once it is sealed its entry index is persisted for the next owner.
      *
      * @param topic     The topic name.
      * @param partition The partition number.
-     * @param message   The message to write.
-     * @throws Exception If an error occurs while writing the message.
      */
-    public void writeMessage(String topic, int partition, Message message) throws Exception {
-        LedgerHandle ledger;
+    public void releaseActiveLedger(String topic, int partition) {
+        Map<Integer, PartitionLedgerIndex> partitionIndexes = ledgerIndexes.get(topic);
+        PartitionLedgerIndex index = partitionIndexes == null ? null : partitionIndexes.remove(partition);
+
+        Map<Integer, LedgerHandle> partitionLedgers = activeLedgers.get(topic);
+        LedgerHandle ledger = partitionLedgers == null ? null : partitionLedgers.remove(partition);
+        if (ledger != null && !ledger.isClosed()) {
+            PartitionLedgerIndex.EntryIndex entryIndex = index == null ? null : index.getEntryIndex(ledger.getId());
+            ledger.asyncClose((rc, handle, ctx) -> {
+                if (rc != BKException.Code.OK) {
+                    System.out.println("Failed to close ledger " + handle.getId() + ": " + BKException.getMessage(rc));
+                    return;
+                }
+                // Off the BookKeeper callback thread, which must not block on ZooKeeper
+                CompletableFuture.runAsync(() -> persistSealedLedger(topic, partition, null, handle, entryIndex));
+            }, null);
+        }
+    }
+
+    /**
+     * Reads record batches from a topic partition starting from the batch that
+     * contains the specified logical offset. The first batch may begin before
+     * startOffset; callers skip the records they did not ask for. The offset index
+     * locates the first entry, so each ledger touched costs one readEntries call.
+     * In a sealed ledger indexed from its persisted sparse index, the read starts
+     * and ends on block boundaries, up to a block of entries more than needed.
+     *
+     * @param topic       The topic name.
+     * @param partition   The partition number.
+     * @param startOffset The logical offset to start reading from.
+     * @param maxMessages The maximum number of messages at or after startOffset to fetch.
+     * @return A list of encoded record batches in offset order.
+     * @throws Exception If an error occurs while reading the batches.
+     */
+    public List<byte[]> readRecordBatches(String topic, int partition, long startOffset, int maxMessages) throws Exception {
+        List<byte[]> batches = new ArrayList<>();
+        PartitionLedgerIndex index = getLedgerIndex(topic, partition);
+        long lastWantedOffset = startOffset + maxMessages - 1;
+
+        int fetched = 0;
+        for (long ledgerId : index.ledgersFrom(startOffset)) {
+            if (fetched >= maxMessages) {
+                break;
+            }
 
-        while (true) {
-            ledger = getOrCreateActiveLedger(topic, partition);
+            try (ReadHandle handle = getReadHandle(topic, partition, ledgerId)) {
+                LedgerHandle ledger = handle.ledger;
+                long lastEntry = ledger.getLastAddConfirmed();
+                if (lastEntry < 0) {
+                    continue;
+                }
 
-            byte[] serializedMessage = message.toByteArray();
-            try {
-                ledger.addEntry(serializedMessage);
-                System.out.println("Message written to topic: " + topic + ", partition: " + partition);
-                break; // Successful write, exit loop
+                PartitionLedgerIndex.EntryIndex entryIndex = getEntryIndex(topic, partition, index, ledger);
+                if (entryIndex.size() == 0) {
+                    continue;
+                }
+                long firstEntry = entryIndex.floorEntry(startOffset);
+                long lastEntryWanted = Math.min(Math.min(lastEntry, entryIndex.size() - 1),
+                        entryIndex.blockEnd(entryIndex.floorEntry(lastWantedOffset)));
+
+                Enumeration<LedgerEntry> entries = ledger.readEntries(firstEntry, lastEntryWanted);
+                while (entries.hasMoreElements() && fetched < maxMessages) {
+                    for (byte[] batch : toBatches(topic, partition, index, ledgerId, entries.nextElement())) {
+                        long endOffset = RecordBatch.getEndOffset(batch);
+                        if (endOffset <= startOffset || fetched >= maxMessages) {
+                            continue;
+                        }
+                        batches.add(batch);
+                        fetched += endOffset - Math.max(startOffset, RecordBatch.getBaseOffset(batch));
+                    }
+                }
             } catch (BKLedgerClosedException e) {
-                System.out.println("Ledger closed for topic: " + topic + ", partition: " + partition);
-                // Remove the closed ledger from active map and retry
-                activeLedgers.get(topic).remove(partition);
+                System.out.println("Ledger closed unexpectedly while reading: " + ledgerId);
+                throw new Exception("Error reading ledger " + ledgerId, e);
             }
         }
+
+        System.out.println("Read " + batches.size() + " batches from topic: " + topic + ", partition: " + partition);
+        return batches;
     }
 
-    public void writeMessagesBatch(String topic, int partition, List<Message> messages) throws Exception {
-        LedgerHandle ledger;
+    /**
+     * Recovers the end offset of a topic partition from BookKeeper: the offset
+     * after the last record of the last confirmed entry. Opening a ledger another
+     * broker was writing recovers and fences it, so the result is final. A
+     * partition whose last ledger predates record batches ends at that ledger's
+     * entry count; new records go to a ledger of their own.
+     *
+     * @param topic     The topic name.
+     * @param partition The partition number.
+     * @return The next offset to assign, or 0 if the partition holds no records.
+     * @throws Exception If an error occurs while reading the ledgers, or the last
+     *                   entry does not hold record batches.
+     */
+    public long recoverEndOffset(String topic, int partition) throws Exception {
+        PartitionLedgerIndex index = getLedgerIndex(topic, partition);
+        for (long ledgerId : index.ledgersDescending()) {
+            try (ReadHandle handle = getReadHandle(topic, partition, ledgerId)) {
+                LedgerHandle ledger = handle.ledger;
+                long lastEntry = ledger.getLastAddConfirmed();
+                long legacyBaseOffset = index.getLegacyBaseOffset(ledgerId);
+                if (lastEntry >= 0 && legacyBaseOffset >= 0) {
+                    return legacyBaseOffset + lastEntry + 1;
+                }
+                if (lastEntry >= 0) {
+                    List<byte[]> batches = toRecordBatches(readEntry(ledger, lastEntry));
+                    if (batches == null) {
+                        throw new IllegalStateException("Entry " + lastEntry + " of ledger " + ledgerId + " of topic " + topic
+                                + ", partition " + partition + " does not hold record batches.");
+                    }
+                    return RecordBatch.getEndOffset(batches.get(batches.size() - 1));
+                }
+            }
+        }
+        return 0;
+    }
 
-        while (true) {
-            ledger = getOrCreateActiveLedger(topic, partition);
+    /**
+     * Finds the earliest offset whose record timestamp is at or after the given
+     * time. A binary search over the timestamps stored for sealed ledgers picks the
+     * first ledger whose entries reach the time, and only that ledger is indexed:
+     * its entry index narrows the search to the entry, or block of entries in a
+     * sparse index, where batch timestamps first reach the time. Those entries and
+     * the one before are decoded to find the record. Ledgers without stored
+     * timestamps, such as the active one, may reach any time and are indexed when
+     * the search gets to them.
+     *
+     * @param topic     The topic name.
+     * @param partition The partition number.
+     * @param timestamp The time in milliseconds since the epoch.
+     * @return The offset, or -1 if no record is that recent.
+     * @throws Exception If an error occurs while reading the ledgers.
+     */
+    public long findOffsetForTime(String topic, int partition, long timestamp) throws Exception {
+        PartitionLedgerIndex index = getLedgerIndex(topic, partition);
+        List<Long> ledgers = index.ledgersAscending();
 
-            // Serialize all messages into a single byte array for batching
-            List<byte[]> serializedMessages = new ArrayList<>();
-            for (Message message : messages) {
-                serializedMessages.add(message.toByteArray());
+        // The previous ledger is read after moving on from it, so every handle stays pinned until the search ends
+        List<ReadHandle> pinned = new ArrayList<>();
+        try {
+            // Entries are indexed by the base timestamps of their batches, so the last entry of the
+            // ledger before may hold records at or after the time despite an earlier base timestamp
+            LedgerHandle previous = null;
+            for (int i = Math.max(index.firstLedgerReaching(timestamp) - 1, 0); i < ledgers.size(); i++) {
+                long ledgerId = ledgers.get(i);
+                ReadHandle handle = getReadHandle(topic, partition, ledgerId);
+                pinned.add(handle);
+                LedgerHandle ledger = handle.ledger;
+                long lastEntry = ledger.getLastAddConfirmed();
+                if (lastEntry < 0) {
+                    continue;
+                }
+                if (index.getMaxTimestamp(ledgerId) < timestamp) {
+                    previous = ledger;
+                    continue;
+                }
+
+                long reaching = 0;
+                long blockEnd = 0;
+                // A ledger whose first entry already reaches the time needs no entry index
+                if (index.getMinTimestamp(ledgerId) < timestamp) {
+                    PartitionLedgerIndex.EntryIndex entryIndex = getEntryIndex(topic, partition, index, ledger);
+                    long lastIndexed = Math.min(lastEntry, entryIndex.size() - 1);
+                    reaching = entryIndex.firstEntryReaching(timestamp);
+                    if (reaching > lastIndexed) {
+                        previous = ledger;
+                        continue;
+                    }
+                    blockEnd = Math.min(lastIndexed, entryIndex.blockEnd(reaching));
+                }
+
+                List<byte[]> candidates = new ArrayList<>();
+                if (reaching > 0) {
+                    candidates.addAll(readBatches(topic, partition, index, ledger, reaching - 1));
+                } else if (previous != null) {
+                    candidates.addAll(readBatches(topic, partition, index, previous, previous.getLastAddConfirmed()));
+                }
+                Enumeration<LedgerEntry> block = ledger.readEntries(reaching, blockEnd);
+                while (block.hasMoreElements()) {
+                    candidates.addAll(toBatches(topic, partition, index, ledgerId, block.nextElement()));
+                }
+
+                long offset = firstOffsetReaching(candidates, timestamp);
+                return offset >= 0 ? offset : RecordBatch.getEndOffset(candidates.get(candidates.size() - 1));
             }
 
-            try {
-                for (byte[] serializedMessage : serializedMessages) {
-                    ledger.addEntry(serializedMessage);
+            // Only the last entry's batches can still hold a record that recent
+            if (previous != null) {
+                return firstOffsetReaching(readBatches(topic, partition, index, previous, previous.getLastAddConfirmed()), timestamp);
+            }
+            return -1;
+        } finally {
+            pinned.forEach(ReadHandle::close);
+        }
+    }
+
+    /**
+     * Returns the offset of the first record of the batches whose timestamp is at
+     * or after the given time, or -1 if there is none.
+     */
+    private static long firstOffsetReaching(List<byte[]> batches, long timestamp) {
+        for (byte[] batch : batches) {
+            for (Message message : RecordBatch.toMessages(batch)) {
+                if (message.getTimestamp() >= timestamp) {
+                    return message.getOffset();
                 }
-                System.out.println("Batch of messages written to topic: " + topic + ", partition: " + partition);
-                break; // Successful write, exit loop
-            } catch (BKLedgerClosedException e) {
-                System.out.println("Ledger closed for topic: " + topic + ", partition: " + partition);
-                // Remove the closed ledger from active map and retry
-                activeLedgers.get(topic).remove(partition);
             }
         }
+        return -1;
     }
 
     /**
-     * Reads messages from a topic partition ledger starting from the specified
-     * logical offset.
-     *
-     * @param topic       The topic name.
-     * @param partition   The partition number.
-     * @param startOffset The logical offset to start reading from.
-     * @param maxMessages The maximum number of messages to fetch.
-     * @return A list of messages.
-     * @throws Exception If an error occurs while reading the messages.
-     */
-    public List<Message> readMessages(String topic, int partition, long startOffset, int maxMessages) throws Exception {
-        List<Message> messages = new ArrayList<>();
-
-        List<Long> ledgerIds = zkClient.getPartitionLedgers(topic, partition);
-        long currentOffset = 0;
-
-        for (int i = 0; i < ledgerIds.size(); i++) {
-            long ledgerId = ledgerIds.get(i);
-            boolean isActiveLedger = (i == ledgerIds.size() - 1)
-                    && !activeLedgers.get(topic).get(partition).isClosed(); // The last ledger is the active one
-
-            try (LedgerHandle ledger = isActiveLedger
-                    ? getOrCreateActiveLedger(topic, partition)
-                    : bookKeeper.openLedger(
-                            ledgerId,
-                            BookKeeper.DigestType.CRC32,
-                            "password".getBytes(StandardCharsets.UTF_8))) {
-
-                long ledgerStart = currentOffset;
-                long ledgerEnd = currentOffset + ledger.getLastAddConfirmed() + 1;
-
-                if (startOffset < ledgerEnd) {
-                    long offsetInLedger = Math.max(0, startOffset - ledgerStart);
-                    long endOffsetInLedger = Math.min(ledger.getLastAddConfirmed(), offsetInLedger + maxMessages - 1);
-
-                    Enumeration<LedgerEntry> entries = ledger.readEntries(offsetInLedger, endOffsetInLedger);
-                    while (entries.hasMoreElements()) {
-                        LedgerEntry entry = entries.nextElement();
-                        Message message = Message.parseFrom(entry.getEntry());
-                        messages.add(message);
-
-                        if (messages.size() >= maxMessages) {
-                            break;
+     * Returns the offset index of a topic partition, loading it from the ledger
+     * metadata in ZooKeeper on first use.
+     */
+    private PartitionLedgerIndex getLedgerIndex(String topic, int partition) throws Exception {
+        ledgerIndexes.putIfAbsent(topic, new ConcurrentHashMap<>());
+        PartitionLedgerIndex index = ledgerIndexes.get(topic).get(partition);
+        if (index != null) {
+            return index;
+        }
+
+        synchronized (ledgerIndexes) {
+            index = ledgerIndexes.get(topic).get(partition);
+            if (index == null) {
+                index = new PartitionLedgerIndex();
+                // Ledgers written with one Message per entry hold consecutive offsets across ledgers
+                long legacyEndOffset = 0;
+                for (Map.Entry<Long, Long> ledger : zkClient.getPartitionLedgerBaseOffsets(topic, partition).entrySet()) {
+                    long baseOffset = ledger.getValue();
+                    if (baseOffset < 0) {
+                        // Ledger recorded without a base offset: take it from its first entry
+                        try (ReadHandle handle = getReadHandle(topic, partition, ledger.getKey())) {
+                            long lastEntry = handle.ledger.getLastAddConfirmed();
+                            if (lastEntry < 0) {
+                                continue;
+                            }
+                            List<byte[]> batches = toRecordBatches(readEntry(handle.ledger, 0));
+                            if (batches == null) {
+                                // Written before record batches: served read-only, offsets continue from the previous one
+                                System.out.println("Ledger " + ledger.getKey() + " of topic: " + topic + ", partition: "
+                                        + partition + " predates record batches; reading it from offset " + legacyEndOffset);
+                                index.addLegacyLedger(ledger.getKey(), legacyEndOffset);
+                                legacyEndOffset += lastEntry + 1;
+                                continue;
+                            }
+                            baseOffset = RecordBatch.getBaseOffset(batches.get(0));
                         }
                     }
+                    index.addLedger(ledger.getKey(), baseOffset);
                 }
+                for (Map.Entry<Long, long[]> ledger : zkClient.getPartitionLedgerTimestamps(topic, partition).entrySet()) {
+                    index.setLedgerTimestamps(ledger.getKey(), ledger.getValue()[0], ledger.getValue()[1]);
+                }
+                ledgerIndexes.get(topic).put(partition, index);
+            }
+            return index;
+        }
+    }
+
+    /**
+     * Returns the entry index of a ledger. Ledgers written by this broker are
+     * indexed as they are written. Other sealed ledgers load the sparse index
+     * persisted when they were sealed; a ledger without one, such as one whose
+     * writer crashed, is indexed by scanning its entries and the result persisted,
+     * so the scan happens once per ledger rather than once per broker start.
+     */
+    private PartitionLedgerIndex.EntryIndex getEntryIndex(String topic, int partition, PartitionLedgerIndex index,
+                                                          LedgerHandle ledger) throws Exception {
+        PartitionLedgerIndex.EntryIndex entryIndex = index.getEntryIndex(ledger.getId());
+        if (entryIndex != null) {
+            return entryIndex;
+        }
 
-                currentOffset = ledgerEnd;
-                if (messages.size() >= maxMessages) {
-                    break;
+        long lastEntry = ledger.getLastAddConfirmed();
+        String persisted = zkClient.getLedgerEntryIndex(topic, partition, ledger.getId());
+        if (persisted != null) {
+            entryIndex = PartitionLedgerIndex.EntryIndex.decode(persisted);
+            if (entryIndex != null && entryIndex.size() == lastEntry + 1) {
+                return index.putEntryIndexIfAbsent(ledger.getId(), entryIndex);
+            }
+            System.out.println("Ignoring stale entry index of ledger " + ledger.getId() + " of topic: " + topic
+                    + ", partition: " + partition);
+        }
+
+        entryIndex = new PartitionLedgerIndex.EntryIndex();
+        for (long first = 0; first <= lastEntry; first += INDEX_SCAN_ENTRIES) {
+            Enumeration<LedgerEntry> entries = ledger.readEntries(first, Math.min(lastEntry, first + INDEX_SCAN_ENTRIES - 1));
+            while (entries.hasMoreElements()) {
+                LedgerEntry entry = entries.nextElement();
+                List<byte[]> batches = toBatches(topic, partition, index, ledger.getId(), entry);
+                entryIndex.append(entry.getEntryId(), RecordBatch.getBaseOffset(batches.get(0)),
+                        RecordBatch.getMaxBaseTimestamp(batches));
+            }
+        }
+        persistSealedLedger(topic, partition, index, ledger, entryIndex);
+        return index.putEntryIndexIfAbsent(ledger.getId(), entryIndex);
+    }
+
+    /**
+     * Persists the entry index of a sealed ledger to ZooKeeper, thinned to at
+     * most PERSISTED_INDEX_POINTS points, and records the ledger's timestamps in
+     * the partition's ledger list and in index, if given. An index missing
+     * confirmed entries is not persisted; the next broker to read the ledger scans
+     * it instead. Failures are logged, since both can be rebuilt from the ledger.
+     */
+    private void persistSealedLedger(String topic, int partition, PartitionLedgerIndex index, LedgerHandle ledger,
+                                     PartitionLedgerIndex.EntryIndex entryIndex) {
+        if (entryIndex == null || entryIndex.size() != ledger.getLastAddConfirmed() + 1) {
+            return;
+        }
+        try {
+            zkClient.setLedgerEntryIndex(topic, partition, ledger.getId(),
+                    entryIndex.toSparse(PERSISTED_INDEX_POINTS).encode());
+            if (entryIndex.size() > 0) {
+                zkClient.setLedgerTimestamps(topic, partition, ledger.getId(), entryIndex.minTimestamp(),
+                        entryIndex.maxTimestamp());
+                if (index != null) {
+                    index.setLedgerTimestamps(ledger.getId(), entryIndex.minTimestamp(), entryIndex.maxTimestamp());
                 }
+            }
+        } catch (Exception e) {
+            System.out.println("Failed to persist the entry index of ledger " + ledger.getId() + " of topic: " + topic
+                    + ", partition: " + partition + ": " + e.getMessage());
+        }
+    }
 
-            } catch (BKLedgerClosedException e) {
-                System.out.println("Ledger closed unexpectedly while reading: " + ledgerId);
-                throw new Exception("Error reading ledger " + ledgerId, e);
+    /**
+     * Unpacks a ledger entry, checking every batch.
+     *
+     * @return The encoded batches, or null if the entry does not hold valid record batches.
+     */
+    static List<byte[]> toRecordBatches(byte[] entry) {
+        List<byte[]> batches;
+        try {
+            batches = RecordBatch.fromEntry(entry);
+        } catch (IllegalArgumentException e) {
+            return null;
+        }
+        if (batches.isEmpty()) {
+            return null;
+        }
+        for (byte[] batch : batches) {
+            if (!RecordBatch.isValid(batch)) {
+                return null;
+            }
+        }
+        return batches;
+    }
+
+    /**
+     * Decodes a legacy ledger entry, one serialized Message, as a single-record batch.
+     *
+     * @param offset The offset the entry's position in the partition implies.
+     * @return The encoded batch.
+     * @throws IllegalArgumentException If the entry is not a Message.
+     */
+    static byte[] fromLegacyEntry(String topic, int partition, byte[] entry, long offset) {
+        Message message;
+        try {
+            message = Message.parseFrom(entry);
+        } catch (InvalidProtocolBufferException e) {
+            throw new IllegalArgumentException("Ledger entry is neither record batches nor a message", e);
+        }
+        byte[] batch = RecordBatch.fromMessages(topic, partition, List.of(message));
+        RecordBatch.setBaseOffset(batch, offset);
+        return batch;
+    }
+
+    /**
+     * Returns the record batches of a ledger entry, converting the entries of
+     * ledgers written before record batches (see fromLegacyEntry).
+     */
+    private List<byte[]> toBatches(String topic, int partition, PartitionLedgerIndex index, long ledgerId,
+                                   LedgerEntry entry) {
+        long legacyBaseOffset = index.getLegacyBaseOffset(ledgerId);
+        if (legacyBaseOffset < 0) {
+            return RecordBatch.fromEntry(entry.getEntry());
+        }
+        return List.of(fromLegacyEntry(topic, partition, entry.getEntry(), legacyBaseOffset + entry.getEntryId()));
+    }
+
+    private List<byte[]> readBatches(String topic, int partition, PartitionLedgerIndex index, LedgerHandle ledger,
+                                     long entryId) throws Exception {
+        return toBatches(topic, partition, index, ledger.getId(), ledger.readEntries(entryId, entryId).nextElement());
+    }
+
+    private byte[] readEntry(LedgerHandle ledger, long entryId) throws Exception {
+        return ledger.readEntries(entryId, entryId).nextElement().getEntry();
+    }
+
+    /**
+     * A ledger handle pinned for reading. A cached read handle evicted while
+     * pinned stays open until its last reader closes it.
+     */
+    private final class ReadHandle implements AutoCloseable {
+        final LedgerHandle ledger;
+        private final boolean cached;
+        private int pins;         // Guarded by readHandles
+        private boolean evicted;  // Guarded by readHandles
+
+        ReadHandle(LedgerHandle ledger, boolean cached) {
+            this.ledger = ledger;
+            this.cached = cached;
+        }
+
+        // Called with readHandles held
+        ReadHandle pin() {
+            pins++;
+            return this;
+        }
+
+        // Called with readHandles held
+        void evict() {
+            evicted = true;
+            if (pins == 0) {
+                closeAsync(ledger);
             }
         }
 
-        System.out.println("Read " + messages.size() + " messages from topic: " + topic + ", partition: " + partition);
-        return messages;
+        @Override
+        public void close() {
+            if (!cached) {
+                return;
+            }
+            synchronized (readHandles) {
+                if (--pins == 0 && evicted) {
+                    closeAsync(ledger);
+                }
+            }
+        }
+    }
+
+    /**
+     * Returns the active write handle if the ledger is this partition's active
+     * ledger, otherwise a cached read handle, opening the ledger on a miss. The
+     * handle must be closed once read; eviction does not close it before then.
+     */
+    private ReadHandle getReadHandle(String topic, int partition, long ledgerId) throws Exception {
+        LedgerHandle active = getActiveLedger(topic, partition);
+        if (active != null && active.getId() == ledgerId && !active.isClosed()) {
+            return new ReadHandle(active, false);
+        }
+
+        synchronized (readHandles) {
+            ReadHandle cached = readHandles.get(ledgerId);
+            if (cached != null) {
+                return cached.pin();
+            }
+        }
+
+        LedgerHandle opened = bookKeeper.openLedger(
+                ledgerId,
+                BookKeeper.DigestType.CRC32,
+                "password".getBytes(StandardCharsets.UTF_8));
+
+        synchronized (readHandles) {
+            ReadHandle cached = readHandles.get(ledgerId);
+            if (cached != null) {
+                // Another reader opened it concurrently
+                closeAsync(opened);
+                return cached.pin();
+            }
+            ReadHandle handle = new ReadHandle(opened, true).pin();
+            readHandles.put(ledgerId, handle);
+            return handle;
+        }
+    }
+
+    private LedgerHandle getActiveLedger(String topic, int partition) {
+        Map<Integer, LedgerHandle> partitionLedgers = activeLedgers.get(topic);
+        return partitionLedgers == null ? null : partitionLedgers.get(partition);
+    }
+
+    private void closeAsync(LedgerHandle ledger) {
+        ledger.asyncClose((rc, handle, ctx) -> {
+            if (rc != BKException.Code.OK) {
+                System.out.println("Failed to close ledger " + handle.getId() + ": " + BKException.getMessage(rc));
+            }
+        }, null);
     }
 
     /**
@@ -211,14 +669,27 @@ public class BookKeeperClient {
      * @throws Exception If an error occurs while closing the client or ledgers.
      */
     public void close() throws Exception {
-        for (Map<Integer, LedgerHandle> partitionMap : activeLedgers.values()) {
-            for (LedgerHandle ledger : partitionMap.values()) {
+        for (Map.Entry<String, ConcurrentHashMap<Integer, LedgerHandle>> topicLedgers : activeLedgers.entrySet()) {
+            for (Map.Entry<Integer, LedgerHandle> partitionLedger : topicLedgers.getValue().entrySet()) {
+                LedgerHandle ledger = partitionLedger.getValue();
                 if (ledger != null && !ledger.isClosed()) {
                     ledger.close();
+                    PartitionLedgerIndex index = ledgerIndexes.getOrDefault(topicLedgers.getKey(), new ConcurrentHashMap<>())
+                            .get(partitionLedger.getKey());
+                    if (index != null) {
+                        persistSealedLedger(topicLedgers.getKey(), partitionLedger.getKey(), index, ledger,
+                                index.getEntryIndex(ledger.getId()));
+                    }
                 }
             }
         }
+        synchronized (readHandles) {
+            for (ReadHandle handle : readHandles.values()) {
+                handle.ledger.close();
+            }
+            readHandles.clear();
+        }
         bookKeeper.close();
         System.out.println("BookKeeper client connection closed.");
     }
-}
\ No newline at end of file
+}
@@ -0,0 +1,167 @@
+package com.clustercrew.messagequeue;
+
+import java.util.ArrayList;
+import java.util.Iterator;
+import java.util.LinkedHashMap;
+import java.util.List;
+import java.util.Map;
+import java.util.concurrent.atomic.AtomicLong;
+import java.util.function.LongSupplier;
+
+/**
+ * Incremental fetch sessions. A session remembers the partitions a consumer
+ * fetches with their fetch offsets, and advances those offsets as data is
+ * served, so later requests only name the partitions whose position changed.
+ */
+public class FetchSessionCache {
+    // Sessions unused for this long are dropped
+    private static final long SESSION_IDLE_MS = 2 * 60 * 1000;
+    private static final int MAX_SESSIONS = 1000;
+
+    private final AtomicLong nextSessionId = new AtomicLong(1);
+    // Least recently used first; guarded by this
+    private final LinkedHashMap<Long, FetchSession> sessions = new LinkedHashMap<>(16, 0.75f, true);
+    private final LongSupplier clock;
+    private final long sessionIdleMs;
+    private final int maxSessions;
+
+    public FetchSessionCache() {
+        this(System::currentTimeMillis, SESSION_IDLE_MS, MAX_SESSIONS);
+    }
+
+    FetchSessionCache(LongSupplier clock, long sessionIdleMs, int maxSessions) {
+        this.clock = clock;
+        this.sessionIdleMs = sessionIdleMs;
+        this.maxSessions = maxSessions;
+    }
+
+    /**
+     * Opens a new session, making room by evicting idle or least recently used sessions.
+     */
+    public synchronized FetchSession create() {
+        long now = clock.getAsLong();
+        Iterator<FetchSession> it = sessions.values().iterator();
+        while (it.hasNext()) {
+            FetchSession session = it.next();
+            if (sessions.size() >= maxSessions || now - session.lastUsedMs > sessionIdleMs) {
+                it.remove();
+            } else {
+                break;
+            }
+        }
+
+        FetchSession session = new FetchSession(nextSessionId.getAndIncrement(), now);
+        sessions.put(session.id, session);
+        return session;
+    }
+
+    /**
+     * Returns the session for a follow-up request, or null if it is unknown.
+     */
+    public synchronized FetchSession get(long sessionId) {
+        FetchSession session = sessions.get(sessionId);
+        if (session != null) {
+            session.lastUsedMs = clock.getAsLong();
+        }
+        return session;
+    }
+
+    public static class FetchSession {
+        private final long id;
+        private int epoch = 0;
+        private volatile long lastUsedMs;
+        // "topic-partition" -> fetch state, in the order partitions were added
+        private final Map<String, PartitionState> partitions = new LinkedHashMap<>();
+
+        private FetchSession(long id, long createdMs) {
+            this.id = id;
+            this.lastUsedMs = createdMs;
+        }
+
+        public long getId() {
+            return id;
+        }
+
+        public synchronized int getEpoch() {
+            return epoch;
+        }
+
+        /**
+         * Moves to the epoch of a follow-up request.
+         *
+         * @return False if the request is not the next one in sequence.
+         */
+        public synchronized boolean advanceEpoch(int requestEpoch) {
+            if (requestEpoch != epoch + 1) {
+                return false;
+            }
+            epoch = requestEpoch;
+            return true;
+        }
+
+        /**
+         * Applies a partition change from a request.
+         */
+        public synchronized void update(String topic, int partition, long fetchOffset, int maxBytes, int maxMessages,
+                                        boolean remove) {
+            String key = topic + "-" + partition;
+            if (remove) {
+                partitions.remove(key);
+            } else {
+                partitions.put(key, new PartitionState(topic, partition, fetchOffset, maxBytes, maxMessages));
+            }
+        }
+
+        public synchronized List<PartitionState> getPartitions() {
+            return new ArrayList<>(partitions.values());
+        }
+    }
+
+    public static class PartitionState {
+        final String topic;
+        final int partition;
+        final int maxBytes;
+        // 0 uses the request's limit
+        final int maxMessages;
+        // Advanced by the broker as records are served
+        volatile long fetchOffset;
+
+        PartitionState(String topic, int partition, long fetchOffset, int maxBytes, int maxMessages) {
+            this.topic = topic;
+            this.partition = partition;
+            this.fetchOffset = fetchOffset;
+            this.maxBytes = maxBytes;
+            this.maxMessages = maxMessages;
+        }
+
+        /**
+         * Picks the fetched batches to serve within the partition's byte limit and
+         * advances the fetch offset past the records they deliver. The first batch
+         * is always served so an oversized batch cannot stall the partition.
+         *
+         * @param batches     Batches read from startOffset on; the first may begin before it.
+         * @param startOffset The fetch offset the batches were read from.
+         * @param maxMessages The most records to deliver.
+         * @return The batches to serve.
+         */
+        List<byte[]> serve(List<byte[]> batches, long startOffset, int maxMessages) {
+            long bytes = 0;
+            long delivered = 0;
+            List<byte[]> kept = new ArrayList<>();
+            for (byte[] batch : batches) {
+                if (!kept.isEmpty() && maxBytes > 0 && bytes + batch.length > maxBytes) {
+                    break;
+                }
+                kept.add(batch);
+                bytes += batch.length;
+                delivered += RecordBatch.getEndOffset(batch) - Math.max(startOffset, RecordBatch.getBaseOffset(batch));
+            }
+
+            delivered = Math.min(delivered, maxMessages);
+            if (delivered > 0) {
+                fetchOffset = startOffset + delivered;
+            }
+            return kept;
+        }
+    }
+}
@@ -3,21 +3,54 @@ package com.clustercrew.messagequeue;
 import io.grpc.Server;
 import io.grpc.ServerBuilder;
 import io.grpc.stub.StreamObserver;
+import com.google.protobuf.ByteString;
+import com.google.protobuf.UnsafeByteOperations;
 import com.clustercrew.messagequeue.MessageQueueOuterClass.*;
 
 import java.io.IOException;
+import java.time.Instant;
 import java.util.ArrayList;
 import java.util.HashMap;
 import java.util.List;
 import java.util.Map;
+import java.util.concurrent.CompletableFuture;
+import java.util.concurrent.CompletionException;
+import java.util.concurrent.Executors;
+import java.util.concurrent.ScheduledExecutorService;
+import java.util.concurrent.TimeUnit;
 
 public class MessageQueueServer extends MessageQueueGrpc.MessageQueueImplBase {
 
+    // How often partition high watermarks are checkpointed to ZooKeeper
+    private static final long OFFSET_CHECKPOINT_INTERVAL_MS = 5000;
+
+    // Messages per partition for a multi-partition fetch that does not set a limit
+    private static final int DEFAULT_FETCH_MAX_MESSAGES = 500;
+
+    // A filtered fetch examines at most this many records, so a rare match cannot stall the request
+    private static final int MAX_FILTER_SCAN_RECORDS = 50000;
+    // Records read per step of a filtered fetch
+    private static final int FILTER_SCAN_CHUNK = 1000;
+
+    // How often the produce and consume rates of partitions are recomputed
+    private static final long STATS_SAMPLE_INTERVAL_MS = 10000;
+    // How long a partition handoff waits for the writes already accepted to be confirmed
+    private static final long HANDOFF_DRAIN_TIMEOUT_MS = 30000;
+    // How long a stopping server lets in-flight requests finish
+    private static final long SHUTDOWN_DRAIN_TIMEOUT_MS = 30000;
+
+    // Settings of topics created on first use, or by a CreateTopic request that leaves them unset
+    private static final int DEFAULT_TOPIC_PARTITIONS = 3;
+    private static final int DEFAULT_RETENTION_MS = 30 * 60 * 1000; // 30 mins retention
+    private static final int DEFAULT_REPLICATION_FACTOR = 3;
+
     private final ZooKeeperClient zkClient;
     private final BookKeeperClient bkClient;
     private final Map<String, Map<Integer, Partition>> topicPartitions;
     private final String brokerId;
     private final String brokerAddress;
+    private final ScheduledExecutorService checkpointScheduler;
+    private final FetchSessionCache fetchSessions = new FetchSessionCache();
     private Server server;
 
     public MessageQueueServer(String zkServers, String brokerId, String brokerAddress) {
@@ -32,12 +65,21 @@ public class MessageQueueServer extends MessageQueueGrpc.MessageQueueImplBase {
             throw new RuntimeException("Failed to initialize MessageQueueServer", e);
         }
 
+        // Drop local partition state as soon as ownership moves so it is recovered afresh if it returns
+        zkClient.setPartitionBrokerListener(this::onPartitionBrokerChanged);
+
         try {
             registerBroker();
             initializeAssignedPartitions();
         } catch (Exception e) {
             throw new RuntimeException("Failed to register broker or initialize partitions", e);
         }
+
+        this.checkpointScheduler = Executors.newSingleThreadScheduledExecutor();
+        checkpointScheduler.scheduleAtFixedRate(this::checkpointPartitions,
+                OFFSET_CHECKPOINT_INTERVAL_MS, OFFSET_CHECKPOINT_INTERVAL_MS, TimeUnit.MILLISECONDS);
+        checkpointScheduler.scheduleAtFixedRate(this::samplePartitionStats,
+                STATS_SAMPLE_INTERVAL_MS, STATS_SAMPLE_INTERVAL_MS, TimeUnit.MILLISECONDS);
     }
     
     /**
@@ -67,6 +109,7 @@ public class MessageQueueServer extends MessageQueueGrpc.MessageQueueImplBase {
 
     @Override
     public void produceMessages(ProduceMessagesRequest request, StreamObserver<ProduceMessagesResponse> responseObserver) {
+        long receiveTimeUs = nowMicros();
         List<Message> messages = request.getMessagesList();
 
         // Group messages by topic and partition
@@ -78,42 +121,125 @@ public class MessageQueueServer extends MessageQueueGrpc.MessageQueueImplBase {
                 .add(message);
         }
 
+        // Validate every batch before writing any, so a corrupt request has no effect
+        List<byte[]> batches = new ArrayList<>();
+        for (ByteString encodedBatch : request.getRecordBatchesList()) {
+            byte[] batch = encodedBatch.toByteArray();
+            // The broker assigns a produced batch one offset per record, so its offset deltas must be contiguous
+            if (!RecordBatch.isValid(batch) || RecordBatch.getLastOffsetDelta(batch) != RecordBatch.getRecordCount(batch) - 1) {
+                respondToProduce(responseObserver, List.of(), new IllegalArgumentException(
+                        "Corrupt record batch from producer " + request.getProducerId()));
+                return;
+            }
+            batches.add(batch);
+        }
+
+        // One result per topic-partition group of legacy messages, then one per record batch
+        List<CompletableFuture<PartitionProduceResult>> results = new ArrayList<>();
+        for (Map.Entry<String, Map<Integer, List<Message>>> topicEntry : groupedMessages.entrySet()) {
+            for (Map.Entry<Integer, List<Message>> partitionEntry : topicEntry.getValue().entrySet()) {
+                byte[] batch = RecordBatch.fromMessages(topicEntry.getKey(), partitionEntry.getKey(), partitionEntry.getValue());
+                results.add(appendBatch(topicEntry.getKey(), partitionEntry.getKey(), batch, request, receiveTimeUs));
+            }
+        }
+
+        // Record batches already carry their topic and partition
+        for (byte[] batch : batches) {
+            results.add(appendBatch(RecordBatch.getTopic(batch), RecordBatch.getPartition(batch), batch, request, receiveTimeUs));
+        }
+
+        // With quorum acks this answers from the BookKeeper callback instead of blocking the gRPC thread
+        CompletableFuture.allOf(results.toArray(new CompletableFuture[0]))
+                .whenComplete((ignored, error) -> {
+                    List<PartitionProduceResult> done = new ArrayList<>();
+                    for (CompletableFuture<PartitionProduceResult> result : results) {
+                        done.add(result.join());
+                    }
+                    respondToProduce(responseObserver, done, null);
+                });
+    }
+
+    /**
+     * Appends one batch to its partition. The returned future never fails; errors
+     * are reported in the result. Unless the request asks for quorum acks, it
+     * completes once the partition has queued the batch: a batch the partition
+     * rejects because it failed a write or moved to another broker is reported
+     * as failed, with the new leader if there is one, and a batch held back
+     * during a handoff is answered when the handoff completes or is abandoned.
+     * A queued batch whose BookKeeper write later fails is lost, since it was
+     * already acknowledged; the partition then rejects further writes.
+     */
+    private CompletableFuture<PartitionProduceResult> appendBatch(String topic, int partition, byte[] batch,
+                                                                  ProduceMessagesRequest request, long receiveTimeUs) {
         try {
-            // Process each group of messages for the same topic and partition
-            for (Map.Entry<String, Map<Integer, List<Message>>> topicEntry : groupedMessages.entrySet()) {
-                String topic = topicEntry.getKey();
-
-                for (Map.Entry<Integer, List<Message>> partitionEntry : topicEntry.getValue().entrySet()) {
-                    int partition = partitionEntry.getKey();
-                    List<Message> partitionMessages = partitionEntry.getValue();
-
-                    // Validate if this broker is responsible for the partition
-                    String assignedBroker = zkClient.getPartitionBroker(topic, partition);
-                    if (!assignedBroker.equals(brokerId)) {
-                        throw new IllegalArgumentException(
-                                "Partition " + partition + " is not assigned to this broker.");
+            Partition partitionInstance = getOwnedPartition(topic, partition);
+            CompletableFuture<Long> queued = new CompletableFuture<>();
+            CompletableFuture<Long> appended = partitionInstance.appendRecordBatch(batch, queued);
+
+            if (request.getAcks() != AckMode.ACKS_QUORUM) {
+                appended.whenComplete((ignored, error) -> {
+                    // Rejected batches are reported in the result instead
+                    if (error != null && !queued.isCompletedExceptionally()) {
+                        System.out.println("Unacknowledged write from producer " + request.getProducerId()
+                                + " failed: " + error.getMessage());
                     }
+                });
+                return queued.handle((baseOffset, error) ->
+                        produceResult(topic, partition, baseOffset, error, receiveTimeUs, 0));
+            }
 
-                    Partition partitionInstance = getOrCreatePartition(topic, partition);
-                    partitionInstance.appendMessagesBatch(partitionMessages);
-                }
-                
-                ProduceMessagesResponse response = ProduceMessagesResponse.newBuilder()
-                        .setSuccess(true)
-                        .build();
-                responseObserver.onNext(response);
-            }            
+            return appended.handle((baseOffset, error) ->
+                    produceResult(topic, partition, baseOffset, error, receiveTimeUs, nowMicros()));
         } catch (Exception e) {
-            ProduceMessagesResponse response = ProduceMessagesResponse.newBuilder()
-                    .setSuccess(false)
-                    .setErrorMessage(e.getMessage())
-                    .build();
-            responseObserver.onNext(response);
-        } finally {
-            responseObserver.onCompleted();
+            return CompletableFuture.completedFuture(produceResult(topic, partition, -1, e, receiveTimeUs, 0));
         }
     }
 
+    private PartitionProduceResult produceResult(String topic, int partition, Long baseOffset, Throwable error,
+                                                 long receiveTimeUs, long confirmTimeUs) {
+        if (error instanceof CompletionException && error.getCause() != null) {
+            error = error.getCause();
+        }
+
+        PartitionProduceResult.Builder result = PartitionProduceResult.newBuilder()
+                .setTopic(topic)
+                .setPartition(partition)
+                .setSuccess(error == null)
+                .setReceiveTimeUs(receiveTimeUs)
+                .setConfirmTimeUs(confirmTimeUs);
+        if (error instanceof NotLeaderException) {
+            result.setLeaderAddress(((NotLeaderException) error).getLeaderAddress());
+        }
+        if (error instanceof UnknownWriteOutcomeException) {
+            result.setOutcomeUnknown(true);
+        }
+        if (error != null) {
+            result.setErrorMessage(String.valueOf(error.getMessage()));
+        } else if (baseOffset != null) {
+            result.setBaseOffset(baseOffset);
+        }
+        return result.build();
+    }
+
+    private void respondToProduce(StreamObserver<ProduceMessagesResponse> responseObserver,
+                                  List<PartitionProduceResult> results, Throwable error) {
+        ProduceMessagesResponse.Builder response = ProduceMessagesResponse.newBuilder()
+                .setSuccess(error == null)
+                .addAllResults(results);
+        if (error != null) {
+            response.setErrorMessage(String.valueOf(error.getMessage()));
+        }
+
+        // Report the first failed partition, if any
+        for (PartitionProduceResult result : results) {
+            if (!result.getSuccess() && response.getSuccess()) {
+                response.setSuccess(false).setErrorMessage(result.getErrorMessage());
+            }
+        }
+        responseObserver.onNext(response.build());
+        responseObserver.onCompleted();
+    }
+
     @Override
     public void consumeMessages(ConsumeMessagesRequest request, StreamObserver<ConsumeMessagesResponse> responseObserver) {
         String groupId = request.getGroupId();
@@ -135,37 +261,218 @@ public class MessageQueueServer extends MessageQueueGrpc.MessageQueueImplBase {
             }
 
             // Validate if this broker is responsible for the partition
-            String assignedBroker = zkClient.getPartitionBroker(topic, partition);
-            if (!assignedBroker.equals(brokerId)) {
-                throw new IllegalArgumentException("Partition " + partition + " is not assigned to this broker.");
-            }
-
-            Partition partitionInstance = getPartition(topic, partition);
-            if (partitionInstance == null) {
-                throw new IllegalArgumentException(
-                        "Partition not found for topic " + topic + " and partition " + partition);
+            checkLeader(topic, partition);
+
+            Partition partitionInstance = getOrCreatePartition(topic, partition);
+
+            RecordMatcher matcher = request.hasFilter() ? RecordMatcher.of(request.getFilter()) : null;
+            List<byte[]> batches;
+            long newOffset;
+            long delivered;
+            if (matcher == null) {
+                batches = partitionInstance.fetchRecordBatches(startOffset, maxMessages);
+                newOffset = startOffset + Math.min(countDelivered(batches, startOffset), maxMessages);
+                delivered = newOffset - startOffset;
+            } else {
+                batches = new ArrayList<>();
+                newOffset = fetchFiltered(partitionInstance, startOffset, maxMessages, matcher, batches);
+                delivered = 0;
+                for (byte[] batch : batches) {
+                    delivered += RecordBatch.getRecordCount(batch);
+                }
             }
-
-            List<Message> messages = partitionInstance.fetchMessages(startOffset, maxMessages);
+            partitionInstance.getStats().recordConsume(delivered, totalBytes(batches));
+            // Read after the fetch so it never trails the records returned
+            long highWatermark = partitionInstance.getLogicalOffset();
 
             // Update consumer offset for the group
-            long newOffset = startOffset + messages.size();
             zkClient.updateConsumerOffset(groupId, topic, partition, newOffset);
 
             ConsumeMessagesResponse.Builder responseBuilder = ConsumeMessagesResponse.newBuilder()
                     .setSuccess(true)
-                    .addAllMessages(messages);
+                    .setHighWatermark(highWatermark)
+                    .setNextOffset(newOffset)
+                    .setServeTimeUs(nowMicros());
+            for (byte[] batch : batches) {
+                responseBuilder.addRecordBatches(UnsafeByteOperations.unsafeWrap(batch));
+            }
 
             responseObserver.onNext(responseBuilder.build());
         } catch (Exception e) {
-            ConsumeMessagesResponse response = ConsumeMessagesResponse.newBuilder()
+            ConsumeMessagesResponse.Builder response = ConsumeMessagesResponse.newBuilder()
                     .setSuccess(false)
-                    .setErrorMessage(e.getMessage())
+                    .setErrorMessage(e.getMessage());
+            if (e instanceof NotLeaderException) {
+                response.setLeaderAddress(((NotLeaderException) e).getLeaderAddress());
+            }
+            responseObserver.onNext(response.build());
+        } finally {
+            responseObserver.onCompleted();
+        }
+    }
+
+    @Override
+    public void fetchMultiple(FetchMultipleRequest request, StreamObserver<FetchMultipleResponse> responseObserver) {
+        boolean newSession = request.getSessionId() == 0;
+        FetchSessionCache.FetchSession session = newSession
+                ? fetchSessions.create()
+                : fetchSessions.get(request.getSessionId());
+        if (session == null || (!newSession && !session.advanceEpoch(request.getSessionEpoch()))) {
+            FetchMultipleResponse response = FetchMultipleResponse.newBuilder()
+                    .setSuccess(false)
+                    .setErrorMessage("Fetch session " + request.getSessionId() + " is unknown or out of step")
                     .build();
             responseObserver.onNext(response);
-        } finally {
             responseObserver.onCompleted();
+            return;
+        }
+
+        for (FetchPartition partition : request.getPartitionsList()) {
+            session.update(partition.getTopic(), partition.getPartition(), partition.getFetchOffset(),
+                    partition.getMaxBytes(), partition.getMaxMessages(), partition.getRemove());
+        }
+
+        int maxMessages = request.getMaxMessages() > 0 ? request.getMaxMessages() : DEFAULT_FETCH_MAX_MESSAGES;
+        FetchMultipleResponse.Builder responseBuilder = FetchMultipleResponse.newBuilder()
+                .setSuccess(true)
+                .setSessionId(session.getId())
+                .setSessionEpoch(session.getEpoch());
+        for (FetchSessionCache.PartitionState state : session.getPartitions()) {
+            FetchPartitionData data = fetchSessionPartition(request.getGroupId(), state, maxMessages);
+            // Follow-up responses leave out partitions with nothing new
+            if (newSession || !data.getSuccess() || data.getRecordBatchesCount() > 0) {
+                responseBuilder.addPartitions(data);
+            }
         }
+
+        responseObserver.onNext(responseBuilder.build());
+        responseObserver.onCompleted();
+    }
+
+    /**
+     * Fetches one partition of a fetch session and advances the session's fetch
+     * offset past the records served.
+     */
+    private FetchPartitionData fetchSessionPartition(String groupId, FetchSessionCache.PartitionState state, int maxMessages) {
+        FetchPartitionData.Builder data = FetchPartitionData.newBuilder()
+                .setTopic(state.topic)
+                .setPartition(state.partition);
+        try {
+            checkLeader(state.topic, state.partition);
+
+            if (state.maxMessages > 0) {
+                maxMessages = state.maxMessages;
+            }
+            long startOffset = state.fetchOffset;
+            Partition partitionInstance = getOrCreatePartition(state.topic, state.partition);
+            List<byte[]> batches = partitionInstance.fetchRecordBatches(startOffset, maxMessages);
+            // Read after the fetch so it never trails the records returned
+            data.setHighWatermark(partitionInstance.getLogicalOffset())
+                    .setServeTimeUs(nowMicros());
+
+            List<byte[]> kept = state.serve(batches, startOffset, maxMessages);
+            for (byte[] batch : kept) {
+                data.addRecordBatches(UnsafeByteOperations.unsafeWrap(batch));
+            }
+
+            long delivered = state.fetchOffset - startOffset;
+            partitionInstance.getStats().recordConsume(delivered, totalBytes(kept));
+            if (delivered > 0 && !groupId.isEmpty()) {
+                zkClient.updateConsumerOffset(groupId, state.topic, state.partition, state.fetchOffset);
+            }
+            data.setSuccess(true);
+        } catch (NotLeaderException e) {
+            data.setSuccess(false).setErrorMessage(e.getMessage()).setLeaderAddress(e.getLeaderAddress());
+        } catch (Exception e) {
+            data.setSuccess(false).setErrorMessage(String.valueOf(e.getMessage()));
+        }
+        return data.setNextOffset(state.fetchOffset).build();
+    }
+
+    @Override
+    public void offsetsForTimes(OffsetsForTimesRequest request, StreamObserver<OffsetsForTimesResponse> responseObserver) {
+        OffsetsForTimesResponse.Builder responseBuilder = OffsetsForTimesResponse.newBuilder();
+        for (PartitionTimestamp query : request.getPartitionsList()) {
+            PartitionTimeOffset.Builder result = PartitionTimeOffset.newBuilder()
+                    .setTopic(query.getTopic())
+                    .setPartition(query.getPartition());
+            try {
+                Partition partitionInstance = getOwnedPartition(query.getTopic(), query.getPartition());
+                result.setSuccess(true).setOffset(partitionInstance.offsetForTime(query.getTimestamp()));
+            } catch (Exception e) {
+                result.setSuccess(false).setErrorMessage(String.valueOf(e.getMessage()));
+            }
+            responseBuilder.addPartitions(result);
+        }
+
+        responseObserver.onNext(responseBuilder.build());
+        responseObserver.onCompleted();
+    }
+
+    /**
+     * Reads records from startOffset on and keeps those the matcher accepts,
+     * until maxMessages matched, the end of the partition is reached or
+     * {@link #MAX_FILTER_SCAN_RECORDS} were examined.
+     *
+     * @param partitionInstance The partition to read.
+     * @param startOffset       The offset to start reading from.
+     * @param maxMessages       The most records to return.
+     * @param matcher           The filter to apply.
+     * @param matched           Receives the matching records as batches.
+     * @return The offset after the last record examined, where the next fetch continues.
+     * @throws Exception If reading the partition fails.
+     */
+    private static long fetchFiltered(Partition partitionInstance, long startOffset, int maxMessages, RecordMatcher matcher,
+            List<byte[]> matched) throws Exception {
+        long offset = startOffset;
+        int remaining = maxMessages;
+        while (remaining > 0 && offset - startOffset < MAX_FILTER_SCAN_RECORDS) {
+            List<byte[]> batches = partitionInstance.fetchRecordBatches(offset, FILTER_SCAN_CHUNK);
+            long scannedFrom = offset;
+            for (byte[] batch : batches) {
+                RecordBatch.FilterResult result = RecordBatch.filter(batch, offset, remaining, matcher);
+                offset = Math.max(offset, result.nextOffset);
+                if (result.batch != null) {
+                    matched.add(result.batch);
+                    remaining -= RecordBatch.getRecordCount(result.batch);
+                }
+                if (remaining == 0) {
+                    break;
+                }
+            }
+            if (offset == scannedFrom) {
+                break; // Nothing more to read
+            }
+        }
+        return offset;
+    }
+
+    /**
+     * Wall-clock time for the trace timestamps reported to clients.
+     */
+    private static long nowMicros() {
+        Instant now = Instant.now();
+        return now.getEpochSecond() * 1_000_000L + now.getNano() / 1000;
+    }
+
+    private static long totalBytes(List<byte[]> batches) {
+        long bytes = 0;
+        for (byte[] batch : batches) {
+            bytes += batch.length;
+        }
+        return bytes;
+    }
+
+    /**
+     * Counts the records a consumer will keep from fetched batches: those at or
+     * after startOffset. The first batch may begin before it.
+     */
+    private static long countDelivered(List<byte[]> batches, long startOffset) {
+        long delivered = 0;
+        for (byte[] batch : batches) {
+            delivered += RecordBatch.getEndOffset(batch) - Math.max(startOffset, RecordBatch.getBaseOffset(batch));
+        }
+        return delivered;
     }
 
     @Override
@@ -175,13 +482,8 @@ public class MessageQueueServer extends MessageQueueGrpc.MessageQueueImplBase {
         try {
             // Create topic and partitions if the topic does not exist
             if (!zkClient.topicExists(topic)) {
-                // Initialize topic metadata (e.g., partitions, retention, replicas)
-                int numPartitions = 3;
-                int retentionMs = 30 * 60 * 1000; // 30 mins retention
-                int replicationFactor = 3;
-
-                // Create the topic in ZooKeeper
-                zkClient.createTopic(topic, numPartitions, retentionMs, replicationFactor);
+                // Create the topic in ZooKeeper with the default partitions, retention and replicas
+                zkClient.createTopic(topic, DEFAULT_TOPIC_PARTITIONS, DEFAULT_RETENTION_MS, DEFAULT_REPLICATION_FACTOR);
                 System.out.println("Topic created dynamically: " + topic);
             }
 
@@ -214,6 +516,76 @@ public class MessageQueueServer extends MessageQueueGrpc.MessageQueueImplBase {
         }
     }
 
+    @Override
+    public void createTopic(CreateTopicRequest request, StreamObserver<CreateTopicResponse> responseObserver) {
+        String topic = request.getTopic();
+        try {
+            if (topic.isEmpty() || topic.contains("/")) {
+                throw new IllegalArgumentException("Invalid topic name: " + topic);
+            }
+            if (request.getNumPartitions() <= 0) {
+                throw new IllegalArgumentException("A topic needs at least one partition.");
+            }
+            if (zkClient.topicExists(topic)) {
+                throw new IllegalArgumentException("Topic " + topic + " already exists.");
+            }
+
+            int retentionMs = request.getRetentionMs() > 0 ? request.getRetentionMs() : DEFAULT_RETENTION_MS;
+            int replicationFactor = request.getReplicationFactor() > 0
+                    ? request.getReplicationFactor() : DEFAULT_REPLICATION_FACTOR;
+            zkClient.createTopic(topic, request.getNumPartitions(), retentionMs, replicationFactor,
+                    request.getWriteQuorum(), request.getAckQuorum());
+
+            responseObserver.onNext(CreateTopicResponse.newBuilder().setSuccess(true).build());
+        } catch (Exception e) {
+            CreateTopicResponse response = CreateTopicResponse.newBuilder()
+                    .setSuccess(false)
+                    .setErrorMessage(String.valueOf(e.getMessage()))
+                    .build();
+            responseObserver.onNext(response);
+        } finally {
+            responseObserver.onCompleted();
+        }
+    }
+
+    @Override
+    public void addPartitions(AddPartitionsRequest request, StreamObserver<AddPartitionsResponse> responseObserver) {
+        try {
+            zkClient.addPartitions(request.getTopic(), request.getTotalPartitions());
+
+            AddPartitionsResponse response = AddPartitionsResponse.newBuilder()
+                    .setSuccess(true)
+                    .setNumPartitions(zkClient.getPartitions(request.getTopic()).size())
+                    .build();
+            responseObserver.onNext(response);
+        } catch (Exception e) {
+            AddPartitionsResponse response = AddPartitionsResponse.newBuilder()
+                    .setSuccess(false)
+                    .setErrorMessage(String.valueOf(e.getMessage()))
+                    .build();
+            responseObserver.onNext(response);
+        } finally {
+            responseObserver.onCompleted();
+        }
+    }
+
+    @Override
+    public void commitOffsets(CommitOffsetsRequest request, StreamObserver<CommitOffsetsResponse> responseObserver) {
+        CommitOffsetsResponse.Builder response = CommitOffsetsResponse.newBuilder().setSuccess(true);
+        // One failed commit does not hold back the others
+        for (OffsetCommit commit : request.getOffsetsList()) {
+            try {
+                zkClient.updateConsumerOffset(commit.getGroupId(), commit.getTopic(), commit.getPartition(), commit.getOffset());
+            } catch (Exception e) {
+                if (response.getSuccess()) {
+                    response.setSuccess(false).setErrorMessage(String.valueOf(e.getMessage()));
+                }
+            }
+        }
+        responseObserver.onNext(response.build());
+        responseObserver.onCompleted();
+    }
+
     @Override
     public void getBrokerAddress(BrokerAddressRequest request, StreamObserver<BrokerAddressResponse> responseObserver) {
         try {
@@ -253,14 +625,21 @@ public class MessageQueueServer extends MessageQueueGrpc.MessageQueueImplBase {
                 responseObserver.onCompleted();
                 return;
             } else {
-                // Stop the server
-                stopServer();
+                if (request.getControlled()) {
+                    // Clients are redirected to the new leaders while this broker still answers
+                    handOffAllPartitions();
+                    zkClient.unregisterBroker(brokerId);
+                }
+
                 // Return success
                 ShutdownResponse response = ShutdownResponse.newBuilder()
                         .setSuccess(true)
                         .build();
                 responseObserver.onNext(response);
                 responseObserver.onCompleted();
+
+                // Stopping waits for in-flight requests, this one included, so it cannot run on this thread
+                new Thread(this::stopServer, "broker-shutdown").start();
             }
         } catch (Exception e) {
             ShutdownResponse response = ShutdownResponse.newBuilder()
@@ -272,10 +651,181 @@ public class MessageQueueServer extends MessageQueueGrpc.MessageQueueImplBase {
         }
     }
 
+    @Override
+    public void listBrokers(ListBrokersRequest request, StreamObserver<ListBrokersResponse> responseObserver) {
+        try {
+            ListBrokersResponse.Builder responseBuilder = ListBrokersResponse.newBuilder()
+                    .setSuccess(true);
+            for (String id : zkClient.getActiveBrokers()) {
+                responseBuilder.addBrokers(BrokerInfo.newBuilder()
+                        .setBrokerId(id)
+                        .setBrokerAddress(zkClient.getBrokerAddress(id)));
+            }
+            responseObserver.onNext(responseBuilder.build());
+        } catch (Exception e) {
+            ListBrokersResponse response = ListBrokersResponse.newBuilder()
+                    .setSuccess(false)
+                    .setErrorMessage(e.getMessage())
+                    .build();
+            responseObserver.onNext(response);
+        } finally {
+            responseObserver.onCompleted();
+        }
+    }
+
+    @Override
+    public void getPartitionStats(PartitionStatsRequest request, StreamObserver<PartitionStatsResponse> responseObserver) {
+        PartitionStatsResponse.Builder responseBuilder = PartitionStatsResponse.newBuilder()
+                .setSuccess(true);
+        synchronized (topicPartitions) {
+            for (Map.Entry<String, Map<Integer, Partition>> topicEntry : topicPartitions.entrySet()) {
+                for (Map.Entry<Integer, Partition> partitionEntry : topicEntry.getValue().entrySet()) {
+                    Partition partitionInstance = partitionEntry.getValue();
+                    PartitionStats stats = partitionInstance.getStats();
+                    responseBuilder.addPartitions(PartitionLoad.newBuilder()
+                            .setTopic(topicEntry.getKey())
+                            .setPartition(partitionEntry.getKey())
+                            .setLeaderBrokerId(brokerId)
+                            .setLeaderAddress(brokerAddress)
+                            .setProduceRecordsPerSec(stats.getProduceRecordsPerSec())
+                            .setProduceBytesPerSec(stats.getProduceBytesPerSec())
+                            .setConsumeRecordsPerSec(stats.getConsumeRecordsPerSec())
+                            .setConsumeBytesPerSec(stats.getConsumeBytesPerSec())
+                            .setProducedBytes(stats.getProducedBytes())
+                            .setConsumedBytes(stats.getConsumedBytes())
+                            .setHighWatermark(partitionInstance.getLogicalOffset()));
+                }
+            }
+        }
+        responseObserver.onNext(responseBuilder.build());
+        responseObserver.onCompleted();
+    }
+
+    @Override
+    public void reassignPartition(ReassignPartitionRequest request, StreamObserver<ReassignPartitionResponse> responseObserver) {
+        String topic = request.getTopic();
+        int partition = request.getPartition();
+        String targetBrokerId = request.getTargetBrokerId();
+
+        try {
+            // Only the leader can hand the partition over; point the caller at it otherwise
+            String assignedBroker = zkClient.getPartitionBroker(topic, partition);
+            if (!assignedBroker.equals(brokerId)) {
+                ReassignPartitionResponse response = ReassignPartitionResponse.newBuilder()
+                        .setSuccess(false)
+                        .setErrorMessage("Partition " + partition + " is not assigned to this broker.")
+                        .setBrokerAddress(zkClient.getBrokerAddress(assignedBroker))
+                        .build();
+                responseObserver.onNext(response);
+                return;
+            }
+            if (targetBrokerId.equals(brokerId)) {
+                responseObserver.onNext(ReassignPartitionResponse.newBuilder().setSuccess(true).build());
+                return;
+            }
+            // Fails if the target is not registered
+            zkClient.getBrokerAddress(targetBrokerId);
+
+            handOffPartition(topic, partition, targetBrokerId);
+            responseObserver.onNext(ReassignPartitionResponse.newBuilder().setSuccess(true).build());
+        } catch (Exception e) {
+            ReassignPartitionResponse response = ReassignPartitionResponse.newBuilder()
+                    .setSuccess(false)
+                    .setErrorMessage(String.valueOf(e.getMessage()))
+                    .build();
+            responseObserver.onNext(response);
+        } finally {
+            responseObserver.onCompleted();
+        }
+    }
+
+    /**
+     * Moves a partition this broker leads to another broker. Writes are refused
+     * from the start of the handoff; the new leader recovers the partition from
+     * BookKeeper, resuming from the checkpointed high watermark.
+     *
+     * @param topic          The topic name.
+     * @param partition      The partition number.
+     * @param targetBrokerId The broker to take over the partition.
+     * @throws Exception If the partition could not be drained or ZooKeeper not updated.
+     */
+    private void handOffPartition(String topic, int partition, String targetBrokerId) throws Exception {
+        String targetAddress = zkClient.getBrokerAddress(targetBrokerId);
+        Partition partitionInstance = getPartition(topic, partition);
+        if (partitionInstance == null) {
+            // Never opened here, so there is nothing to drain
+            zkClient.movePartition(topic, partition, brokerId, targetBrokerId);
+            System.out.println("Partition " + partition + " of topic " + topic + " handed off to broker " + targetBrokerId);
+            return;
+        }
+
+        try {
+            partitionInstance.sealAndDrain(HANDOFF_DRAIN_TIMEOUT_MS);
+            zkClient.movePartition(topic, partition, brokerId, targetBrokerId);
+        } catch (Exception e) {
+            partitionInstance.unseal();
+            throw e;
+        }
+        partitionInstance.handOff(targetAddress);
+
+        // The ownership watch does the same, but release the ledger before answering
+        synchronized (topicPartitions) {
+            retirePartition(topic, partition);
+        }
+        System.out.println("Partition " + partition + " of topic " + topic + " handed off to broker " + targetBrokerId);
+    }
+
+    /**
+     * Hands every partition this broker leads to the other brokers, spreading
+     * them round-robin, ahead of a controlled shutdown.
+     *
+     * @throws Exception If there is no other broker or a handoff failed.
+     */
+    private void handOffAllPartitions() throws Exception {
+        List<String> peers = new ArrayList<>(zkClient.getActiveBrokers());
+        peers.remove(brokerId);
+        if (peers.isEmpty()) {
+            throw new IllegalStateException("No other broker to hand partitions to.");
+        }
+
+        int next = 0;
+        for (String topic : zkClient.getTopics()) {
+            for (String partitionStr : zkClient.getPartitions(topic)) {
+                int partition = Integer.parseInt(partitionStr);
+                if (brokerId.equals(zkClient.getPartitionBroker(topic, partition))) {
+                    handOffPartition(topic, partition, peers.get(next++ % peers.size()));
+                }
+            }
+        }
+    }
+
+    /**
+     * Throws unless this broker leads the partition. The exception carries the
+     * leader's address so clients can go there without refreshing metadata.
+     */
+    private void checkLeader(String topic, int partition) throws Exception {
+        String assignedBroker = zkClient.getPartitionBrokerCached(topic, partition);
+        if (!assignedBroker.equals(brokerId)) {
+            String leaderAddress;
+            try {
+                leaderAddress = zkClient.getBrokerAddress(assignedBroker);
+            } catch (Exception e) {
+                leaderAddress = "";
+            }
+            throw new NotLeaderException("Partition " + partition + " is not assigned to this broker.", leaderAddress);
+        }
+    }
+
     private Partition getOrCreatePartition(String topic, int partition) throws Exception {
         synchronized (topicPartitions) {
             topicPartitions.computeIfAbsent(topic, k -> new HashMap<>());
 
+            // A failed write leaves the ledger unusable, so recover the partition from BookKeeper
+            Partition existing = topicPartitions.get(topic).get(partition);
+            if (existing != null && existing.isFailed()) {
+                retirePartition(topic, partition);
+            }
+
             return topicPartitions.get(topic).computeIfAbsent(partition, p -> {
                 try {
                     return new Partition(zkClient, bkClient, topic, partition);
@@ -286,6 +836,14 @@ public class MessageQueueServer extends MessageQueueGrpc.MessageQueueImplBase {
         }
     }
 
+    /**
+     * Returns the partition after validating that this broker is responsible for it.
+     */
+    private Partition getOwnedPartition(String topic, int partition) throws Exception {
+        checkLeader(topic, partition);
+        return getOrCreatePartition(topic, partition);
+    }
+
     private Partition getPartition(String topic, int partition) {
         synchronized (topicPartitions) {
             if (!topicPartitions.containsKey(topic)) {
@@ -309,9 +867,102 @@ public class MessageQueueServer extends MessageQueueGrpc.MessageQueueImplBase {
         }
     }
 
+    /**
+     * Handles a change of partition ownership reported by ZooKeeper.
+     *
+     * @param path The partition broker path, or null if every assignment may have changed.
+     */
+    private void onPartitionBrokerChanged(String path) {
+        synchronized (topicPartitions) {
+            if (path == null) {
+                for (Map.Entry<String, Map<Integer, Partition>> topicEntry : topicPartitions.entrySet()) {
+                    for (Partition partition : topicEntry.getValue().values()) {
+                        partition.fence();
+                    }
+                    for (Integer partition : topicEntry.getValue().keySet()) {
+                        bkClient.releaseActiveLedger(topicEntry.getKey(), partition);
+                    }
+                }
+                topicPartitions.clear();
+                return;
+            }
+
+            // Path layout: /topics/<topic>/partitions/<partition>/broker
+            String[] parts = path.split("/");
+            if (parts.length != 6) {
+                return;
+            }
+            retirePartition(parts[2], Integer.parseInt(parts[4]));
+        }
+    }
+
+    /**
+     * Drops a partition instance, fencing it before its ledger is released so
+     * batches it still holds can never open a ledger of their own. Must be called
+     * holding the topicPartitions lock.
+     */
+    private void retirePartition(String topic, int partition) {
+        Map<Integer, Partition> partitions = topicPartitions.get(topic);
+        Partition removed = partitions == null ? null : partitions.remove(partition);
+        if (removed != null) {
+            removed.fence();
+            bkClient.releaseActiveLedger(topic, partition);
+        }
+    }
+
+    /**
+     * Lazily persists the in-memory high watermarks of the partitions this broker owns.
+     */
+    private void checkpointPartitions() {
+        List<Partition> partitions = new ArrayList<>();
+        synchronized (topicPartitions) {
+            for (Map<Integer, Partition> topicEntry : topicPartitions.values()) {
+                partitions.addAll(topicEntry.values());
+            }
+        }
+
+        for (Partition partition : partitions) {
+            try {
+                partition.checkpointLogicalOffset();
+            } catch (Exception e) {
+                System.out.println("Failed to checkpoint logical offset: " + e.getMessage());
+            }
+        }
+    }
+
+    private void samplePartitionStats() {
+        synchronized (topicPartitions) {
+            for (Map<Integer, Partition> topicEntry : topicPartitions.values()) {
+                for (Partition partition : topicEntry.values()) {
+                    partition.getStats().sample();
+                }
+            }
+        }
+    }
+
     public void stopServer() {
+        checkpointScheduler.shutdown();
+        checkpointPartitions();
         if (server != null) {
+            // Stop taking requests and give the in-flight ones time to finish
             server.shutdown();
+            try {
+                if (!server.awaitTermination(SHUTDOWN_DRAIN_TIMEOUT_MS, TimeUnit.MILLISECONDS)) {
+                    server.shutdownNow();
+                }
+            } catch (InterruptedException e) {
+                server.shutdownNow();
+                Thread.currentThread().interrupt();
+            }
+        }
+    }
+
+    /**
+     * Blocks until the server has stopped.
+     */
+    public void blockUntilShutdown() throws InterruptedException {
+        if (server != null) {
+            server.awaitTermination();
         }
     }
 
@@ -325,12 +976,9 @@ public class MessageQueueServer extends MessageQueueGrpc.MessageQueueImplBase {
         String brokerId = args[1];
         String brokerAddress = args[2];
     
-        Server server = ServerBuilder.forPort(Integer.parseInt(brokerAddress.split(":")[1]))
-                .addService(new MessageQueueServer(zkServers, brokerId, brokerAddress))
-                .build()
-                .start();
-    
-        System.out.println("Message Queue Server started with Broker ID: " + brokerId + " at address: " + brokerAddress);
-        server.awaitTermination();
+        // Started through the instance so a Shutdown request can stop it
+        MessageQueueServer server = new MessageQueueServer(zkServers, brokerId, brokerAddress);
+        server.startServer();
+        server.blockUntilShutdown();
     }
 }
\ No newline at end of file
@@ -0,0 +1,25 @@
+package com.clustercrew.messagequeue;
+
+/**
+ * Thrown when a request reaches a broker that does not lead the partition.
+ * Carries the leader's address so the response can redirect the client.
+ */
+public class NotLeaderException extends IllegalArgumentException {
+    private final String leaderAddress;
+
+    /**
+     * @param message       The error message.
+     * @param leaderAddress The address of the partition's leader, or empty if unknown.
+     */
+    public NotLeaderException(String message, String leaderAddress) {
+        super(message);
+        this.leaderAddress = leaderAddress;
+    }
+
+    /**
+     * @return The address of the partition's leader, or empty if unknown.
+     */
+    public String getLeaderAddress() {
+        return leaderAddress;
+    }
+}
@@ -1,79 +1,407 @@
 package com.clustercrew.messagequeue;
 
 import com.clustercrew.messagequeue.MessageQueueOuterClass.Message;
+import java.util.ArrayDeque;
+import java.util.ArrayList;
 import java.util.List;
+import java.util.concurrent.CompletableFuture;
+import java.util.concurrent.TimeoutException;
 
 public class Partition {
+    // Ledger entries written but not yet confirmed by BookKeeper
+    private static final int MAX_OUTSTANDING_ENTRIES = 8;
+    // Batches waiting for a free slot are group-committed into entries of at most this size
+    private static final int MAX_ENTRY_BYTES = 1024 * 1024;
+    // Recently confirmed batches kept in memory to serve tail fetches
+    private static final long TAIL_CACHE_BYTES = 8L * 1024 * 1024;
+
     private final ZooKeeperClient zkClient;
     private final BookKeeperClient bkClient;
     private final String topic;
     private final int partition;
 
+    // Next offset to assign; guarded by this
+    private long nextOffset;
+    // Offset after the last record confirmed by BookKeeper
+    private volatile long highWatermark;
+    // Last logical offset written to ZooKeeper
+    private volatile long checkpointedOffset;
+
+    // Stamped batches waiting for an entry slot; guarded by this
+    private final ArrayDeque<PendingBatch> pendingBatches = new ArrayDeque<>();
+    // Entries handed to BookKeeper and not yet confirmed; guarded by this
+    private int outstandingEntries = 0;
+    // Set once a write fails; the partition must then be recovered afresh
+    private volatile Throwable writeFailure;
+    // Set while the partition is handed to another broker; new writes are held back
+    private volatile boolean sealed = false;
+    // Writes that arrived while sealed, redirected to the new leader once the handoff completes; guarded by this
+    private final List<PendingBatch> heldBatches = new ArrayList<>();
+    // Address of the broker the partition was handed to; guarded by this
+    private String newLeaderAddress = null;
+
+    private final PartitionTailCache tailCache;
+    private final PartitionStats stats = new PartitionStats();
+
     public Partition(ZooKeeperClient zkClient, BookKeeperClient bkClient, String topic, int partition) throws Exception {
         this.zkClient = zkClient;
         this.bkClient = bkClient;
         this.topic = topic;
         this.partition = partition;
 
+        // Recover the high watermark from the ledgers before opening a ledger of our own.
+        // The ZooKeeper checkpoint is only a lower bound since it is written lazily.
+        this.checkpointedOffset = zkClient.getPartitionLogicalOffset(topic, partition);
+        this.nextOffset = Math.max(checkpointedOffset, bkClient.recoverEndOffset(topic, partition));
+        this.highWatermark = nextOffset;
+        this.tailCache = new PartitionTailCache(TAIL_CACHE_BYTES, nextOffset);
+
         // Ensure an active ledger exists
-        bkClient.getOrCreateActiveLedger(topic, partition);
+        bkClient.getOrCreateActiveLedger(topic, partition, nextOffset);
 
-        // Initialize logical offset if not already done
-        if (zkClient.getPartitionLogicalOffset(topic, partition) == 0) {
-            zkClient.setPartitionLogicalOffset(topic, partition, 0);
-        }
+        checkpointLogicalOffset();
     }
 
     /**
      * Append a message to the partition.
      *
      * @param message The message to append.
-     * @throws Exception If an error occurs while appending.
+     * @return A future completed with the message offset once it is confirmed.
      */
-    public void appendMessage(Message message) throws Exception {
-       // Write the message to the active ledger
-        bkClient.writeMessage(topic, partition, message);
+    public CompletableFuture<Long> appendMessage(Message message) {
+        return appendMessagesBatch(List.of(message));
+    }
 
-        // Increment the logical offset after appending
-        long currentOffset = zkClient.getPartitionLogicalOffset(topic, partition);
-        zkClient.setPartitionLogicalOffset(topic, partition, currentOffset + 1);
+    public CompletableFuture<Long> appendMessagesBatch(List<Message> messages) {
+        if (messages.isEmpty())
+            return CompletableFuture.completedFuture(getLogicalOffset());
 
-        System.out.println("Message appended to partition: " + topic + " - " + partition);
+        return appendRecordBatch(RecordBatch.fromMessages(topic, partition, messages));
     }
 
-    public void appendMessagesBatch(List<Message> messages) throws Exception {
-        if (messages.isEmpty())
-            return;
+    /**
+     * Append an encoded record batch to the partition. The batch is stamped with
+     * the partition's next logical offset and queued for the write pipeline, which
+     * group-commits batches from concurrent producers into shared ledger entries.
+     *
+     * @param batch The encoded record batch.
+     * @return A future completed with the offset assigned to the first record once
+     *         the batch is confirmed by BookKeeper.
+     */
+    public CompletableFuture<Long> appendRecordBatch(byte[] batch) {
+        return appendRecordBatch(batch, new CompletableFuture<>());
+    }
+
+    /**
+     * Append an encoded record batch, also reporting when it is queued.
+     *
+     * @param batch  The encoded record batch.
+     * @param queued Completed with the offset assigned to the first record once the
+     *               batch is stamped and queued for BookKeeper, or exceptionally if
+     *               the partition rejects it. A batch held back during a handoff is
+     *               queued only if the handoff is abandoned.
+     * @return A future completed with the offset assigned to the first record once
+     *         the batch is confirmed by BookKeeper.
+     */
+    public CompletableFuture<Long> appendRecordBatch(byte[] batch, CompletableFuture<Long> queued) {
+        CompletableFuture<Long> confirmed = new CompletableFuture<>();
+        int recordCount = RecordBatch.getRecordCount(batch);
+
+        synchronized (this) {
+            if (writeFailure != null) {
+                queued.completeExceptionally(writeFailure);
+                confirmed.completeExceptionally(writeFailure);
+                return confirmed;
+            }
+            if (newLeaderAddress != null) {
+                NotLeaderException moved = movedException();
+                queued.completeExceptionally(moved);
+                confirmed.completeExceptionally(moved);
+                return confirmed;
+            }
+            if (sealed) {
+                // Not stamped: the batch is either redirected or appended afresh if the handoff is abandoned
+                heldBatches.add(new PendingBatch(batch, -1, confirmed, queued));
+                return confirmed;
+            }
+            if (recordCount == 0) {
+                queued.complete(nextOffset);
+                confirmed.complete(nextOffset);
+                return confirmed;
+            }
+
+            long baseOffset = nextOffset;
+            RecordBatch.setBaseOffset(batch, baseOffset);
+            nextOffset = baseOffset + recordCount;
+
+            pendingBatches.add(new PendingBatch(batch, baseOffset, confirmed, queued));
+            writePendingBatches();
+        }
+        queued.complete(RecordBatch.getBaseOffset(batch));
+        return confirmed;
+    }
+
+    /**
+     * Returns true once a write has failed. The broker replaces a failed partition
+     * so it is recovered from BookKeeper.
+     */
+    public boolean isFailed() {
+        return writeFailure != null;
+    }
+
+    /**
+     * Holds back further writes and waits until every accepted batch is confirmed,
+     * then checkpoints the high watermark so the next leader resumes from it.
+     *
+     * @param timeoutMs How long to wait for the pipeline to drain.
+     * @throws Exception If a write failed or the pipeline did not drain in time.
+     *                   The partition stays sealed.
+     */
+    public void sealAndDrain(long timeoutMs) throws Exception {
+        long deadline = System.currentTimeMillis() + timeoutMs;
+        synchronized (this) {
+            sealed = true;
+            while (writeFailure == null && (outstandingEntries > 0 || !pendingBatches.isEmpty())) {
+                long remaining = deadline - System.currentTimeMillis();
+                if (remaining <= 0) {
+                    throw new TimeoutException("Partition " + partition + " of topic " + topic
+                            + " still has unconfirmed writes.");
+                }
+                wait(remaining);
+            }
+            if (writeFailure != null) {
+                throw new IllegalStateException("Partition " + partition + " of topic " + topic + " failed a write.",
+                        writeFailure);
+            }
+        }
+        checkpointLogicalOffset();
+    }
+
+    /**
+     * Completes a handoff: writes held back while sealed, and any arriving later,
+     * fail with a redirect to the new leader.
+     *
+     * @param leaderAddress The address of the broker now leading the partition.
+     */
+    public void handOff(String leaderAddress) {
+        List<PendingBatch> held;
+        synchronized (this) {
+            newLeaderAddress = leaderAddress;
+            held = new ArrayList<>(heldBatches);
+            heldBatches.clear();
+        }
+        for (PendingBatch pending : held) {
+            NotLeaderException moved = movedException();
+            pending.queued.completeExceptionally(moved);
+            pending.confirmed.completeExceptionally(moved);
+        }
+    }
+
+    /**
+     * Stops the partition for good once this broker no longer owns it. Queued,
+     * held and later writes fail with a redirect, and entries already handed to
+     * BookKeeper complete as of unknown outcome, so the partition never writes
+     * again and the next owner recovers a stable end offset.
+     */
+    public void fence() {
+        List<PendingBatch> failed;
+        NotLeaderException moved;
+        synchronized (this) {
+            sealed = true;
+            moved = newLeaderAddress != null ? movedException()
+                    : new NotLeaderException("Partition " + partition + " of topic " + topic
+                            + " is no longer owned by this broker.", "");
+            if (writeFailure == null) {
+                writeFailure = moved;
+            }
+            failed = new ArrayList<>(pendingBatches);
+            failed.addAll(heldBatches);
+            pendingBatches.clear();
+            heldBatches.clear();
+            // Wakes a handoff waiting for the pipeline to drain
+            notifyAll();
+        }
+        // None of these batches reached BookKeeper, so the client may safely retry them
+        for (PendingBatch pending : failed) {
+            pending.queued.completeExceptionally(moved);
+            pending.confirmed.completeExceptionally(moved);
+        }
+    }
 
-        // Write the batch of messages to the active ledger
-        bkClient.writeMessagesBatch(topic, partition, messages);
+    private synchronized NotLeaderException movedException() {
+        return new NotLeaderException("Partition " + partition + " of topic " + topic + " moved to another broker.",
+                newLeaderAddress);
+    }
 
-        // Increment the logical offset after appending
-        long currentOffset = zkClient.getPartitionLogicalOffset(topic, partition);
-        zkClient.setPartitionLogicalOffset(topic, partition, currentOffset + messages.size());
+    /**
+     * Accepts writes again after a handoff was abandoned, appending the ones held back.
+     */
+    public void unseal() {
+        List<PendingBatch> held;
+        synchronized (this) {
+            sealed = false;
+            held = new ArrayList<>(heldBatches);
+            heldBatches.clear();
+        }
+        for (PendingBatch pending : held) {
+            appendRecordBatch(pending.batch, pending.queued).whenComplete((baseOffset, error) -> {
+                if (error != null) {
+                    pending.confirmed.completeExceptionally(error);
+                } else {
+                    pending.confirmed.complete(baseOffset);
+                }
+            });
+        }
+    }
+
+    /**
+     * Packs pending batches into entries while there is room in the pipeline.
+     * Must be called holding the partition lock.
+     */
+    private void writePendingBatches() {
+        while (outstandingEntries < MAX_OUTSTANDING_ENTRIES && !pendingBatches.isEmpty()) {
+            List<PendingBatch> group = new ArrayList<>();
+            List<byte[]> batches = new ArrayList<>();
+            int entryBytes = 0;
+            while (!pendingBatches.isEmpty()
+                    && (group.isEmpty() || entryBytes + pendingBatches.peek().batch.length <= MAX_ENTRY_BYTES)) {
+                PendingBatch pending = pendingBatches.poll();
+                group.add(pending);
+                batches.add(pending.batch);
+                entryBytes += pending.batch.length;
+            }
 
-        System.out.println("Batch of messages appended to partition: " + topic + " - " + partition);
+            long endOffset = RecordBatch.getEndOffset(batches.get(batches.size() - 1));
+            outstandingEntries++;
+            bkClient.appendEntryAsync(topic, partition, RecordBatch.toEntry(batches), group.get(0).baseOffset,
+                            RecordBatch.getMaxBaseTimestamp(batches))
+                    .whenComplete((ignored, error) -> onEntryConfirmed(group, endOffset, error));
+        }
     }
 
     /**
-     * Fetch messages from the partition starting from the given offset.
+     * Advances the high watermark past a confirmed entry and acknowledges its
+     * batches. BookKeeper confirms the entries of a ledger in order.
+     * <p>
+     * Once an entry fails, it and every entry in flight behind it, confirmed or
+     * not, complete with an {@link UnknownWriteOutcomeException}: only recovering
+     * the ledger tells which of them were kept. Batches not yet handed to
+     * BookKeeper fail with the original error, as they were certainly not written.
+     */
+    private void onEntryConfirmed(List<PendingBatch> group, long endOffset, Throwable error) {
+        List<PendingBatch> failed = new ArrayList<>();
+        UnknownWriteOutcomeException unknown = null;
+        synchronized (this) {
+            outstandingEntries--;
+            if (error != null && writeFailure == null) {
+                writeFailure = error;
+            }
+
+            if (writeFailure != null) {
+                unknown = new UnknownWriteOutcomeException("Partition " + partition + " of topic " + topic
+                        + " failed a write; records from offset " + group.get(0).baseOffset
+                        + " may or may not have been persisted.", writeFailure);
+                // Offsets after the failed entry can no longer be assigned in order
+                failed.addAll(pendingBatches);
+                pendingBatches.clear();
+            } else {
+                // The entry is confirmed, so the records become visible. ZooKeeper is updated lazily.
+                for (PendingBatch pending : group) {
+                    tailCache.append(pending.batch);
+                }
+                highWatermark = endOffset;
+                writePendingBatches();
+            }
+            // Wakes a handoff waiting for the pipeline to drain
+            notifyAll();
+        }
+
+        // Acknowledge outside the lock so responses never hold up the pipeline
+        if (unknown != null) {
+            for (PendingBatch pending : group) {
+                pending.confirmed.completeExceptionally(unknown);
+            }
+            for (PendingBatch pending : failed) {
+                pending.confirmed.completeExceptionally(writeFailure);
+            }
+            return;
+        }
+        for (PendingBatch pending : group) {
+            stats.recordProduce(RecordBatch.getRecordCount(pending.batch), pending.batch.length);
+            pending.confirmed.complete(pending.baseOffset);
+        }
+    }
+
+    /**
+     * Fetch record batches from the partition starting from the batch that
+     * contains the given offset. Recent offsets are served from the tail cache;
+     * older ones are read from BookKeeper.
      *
      * @param startOffset The offset to start fetching from.
      * @param maxMessages The maximum number of messages to fetch.
-     * @return A list of messages.
+     * @return A list of encoded record batches.
      * @throws Exception If an error occurs while fetching.
      */
-    public List<Message> fetchMessages(long startOffset, int maxMessages) throws Exception {
-        return bkClient.readMessages(topic, partition, startOffset, maxMessages);
+    public List<byte[]> fetchRecordBatches(long startOffset, int maxMessages) throws Exception {
+        List<byte[]> cached = tailCache.read(startOffset, maxMessages);
+        if (cached != null) {
+            return cached;
+        }
+        return bkClient.readRecordBatches(topic, partition, startOffset, maxMessages);
     }
 
     /**
-     * Retrieves the current logical offset for this partition.
+     * Finds the earliest offset whose record timestamp is at or after the given time.
      *
-     * @return The current logical offset.
-     * @throws Exception If an error occurs while retrieving the offset.
+     * @param timestamp The time in milliseconds since the epoch.
+     * @return The offset, or the high watermark if no record is that recent.
+     * @throws Exception If an error occurs while reading the ledgers.
+     */
+    public long offsetForTime(long timestamp) throws Exception {
+        long offset = bkClient.findOffsetForTime(topic, partition, timestamp);
+        return offset < 0 ? highWatermark : Math.min(offset, highWatermark);
+    }
+
+    /**
+     * Retrieves the current logical offset (high watermark) for this partition.
+     *
+     * @return The offset after the last confirmed record.
+     */
+    public long getLogicalOffset() {
+        return highWatermark;
+    }
+
+    /**
+     * @return The produce and consume counters of this partition.
      */
-    public long getLogicalOffset() throws Exception {
-        return zkClient.getPartitionLogicalOffset(topic, partition);
+    public PartitionStats getStats() {
+        return stats;
+    }
+
+    /**
+     * Writes the high watermark to ZooKeeper if it moved since the last checkpoint.
+     *
+     * @throws Exception If an error occurs while updating ZooKeeper.
+     */
+    public void checkpointLogicalOffset() throws Exception {
+        long offset = highWatermark;
+        if (offset != checkpointedOffset) {
+            zkClient.setPartitionLogicalOffset(topic, partition, offset);
+            checkpointedOffset = offset;
+        }
+    }
+
+    private static class PendingBatch {
+        final byte[] batch;
+        final long baseOffset;
+        final CompletableFuture<Long> confirmed;
+        final CompletableFuture<Long> queued;
+
+        PendingBatch(byte[] batch, long baseOffset, CompletableFuture<Long> confirmed, CompletableFuture<Long> queued) {
+            this.batch = batch;
+            this.baseOffset = baseOffset;
+            this.confirmed = confirmed;
+            this.queued = queued;
+        }
     }
 }
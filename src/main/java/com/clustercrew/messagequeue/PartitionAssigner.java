@@ -19,12 +19,44 @@ public class PartitionAssigner {
      * @throws Exception If an error occurs during assignment.
      */
     public void assignPartitions(String topic, int numPartitions, List<String> brokerIds) throws Exception {
+        assignPartitions(topic, 0, numPartitions, brokerIds);
+    }
+
+    /**
+     * Assigns the partitions of a topic from firstPartition up to numPartitions,
+     * favouring the least loaded brokers.
+     *
+     * @param topic          The topic name.
+     * @param firstPartition The first partition to assign.
+     * @param numPartitions  The total number of partitions for the topic.
+     * @param brokerIds      List of active broker IDs.
+     * @throws Exception If an error occurs during assignment.
+     */
+    public void assignPartitions(String topic, int firstPartition, int numPartitions, List<String> brokerIds) throws Exception {
+        System.out.println("Assigning " + (numPartitions - firstPartition) + " partitions for topic: " + topic);
+
+        for (Map.Entry<Integer, String> assignment : planAssignments(firstPartition, numPartitions, brokerIds).entrySet()) {
+            zkClient.assignPartitionToBroker(topic, assignment.getKey(), assignment.getValue());
+            System.out.println("Partition " + assignment.getKey() + " assigned to broker " + assignment.getValue());
+        }
+    }
+
+    /**
+     * Picks a broker for each partition from firstPartition up to numPartitions,
+     * e.g. those added to an existing topic, without writing the assignments.
+     * Uses the least loaded brokers first.
+     *
+     * @param firstPartition The first partition to assign.
+     * @param numPartitions  The total number of partitions for the topic.
+     * @param brokerIds      List of active broker IDs.
+     * @return Partition IDs mapped to broker IDs, in partition order.
+     * @throws Exception If there are no brokers or their load could not be read.
+     */
+    public Map<Integer, String> planAssignments(int firstPartition, int numPartitions, List<String> brokerIds) throws Exception {
         if (brokerIds.isEmpty()) {
             throw new Exception("No active brokers available for partition assignment");
         }
 
-        System.out.println("Assigning " + numPartitions + " partitions for topic: " + topic);
-
         // Calculate current load on each broker
         Map<String, Integer> brokerLoad = calculateBrokerLoad(brokerIds);
 
@@ -32,17 +64,17 @@ public class PartitionAssigner {
         PriorityQueue<String> brokerQueue = new PriorityQueue<>(Comparator.comparingInt(brokerLoad::get));
         brokerQueue.addAll(brokerIds);
 
-        for (int partition = 0; partition < numPartitions; partition++) {
+        Map<Integer, String> assignments = new LinkedHashMap<>();
+        for (int partition = firstPartition; partition < numPartitions; partition++) {
             // Pick the broker with the least load
             String brokerId = brokerQueue.poll();
-            zkClient.assignPartitionToBroker(topic, partition, brokerId);
+            assignments.put(partition, brokerId);
 
             // Update the broker's load and reinsert into the queue
             brokerLoad.put(brokerId, brokerLoad.get(brokerId) + 1);
             brokerQueue.offer(brokerId);
-
-            System.out.println("Partition " + partition + " assigned to broker " + brokerId);
         }
+        return assignments;
     }
 
     /**
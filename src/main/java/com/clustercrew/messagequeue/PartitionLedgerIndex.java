@@ -0,0 +1,346 @@
+package com.clustercrew.messagequeue;
+
+import java.util.ArrayList;
+import java.util.Arrays;
+import java.util.HashMap;
+import java.util.List;
+import java.util.Map;
+import java.util.TreeMap;
+
+/**
+ * In-memory index of a topic partition's ledgers. It maps the base offset of
+ * every ledger to its ID and, per ledger, the base offset of every entry, so a
+ * fetch locates its first entry with two binary searches instead of walking the
+ * ledger history. Each entry also records the highest batch timestamp seen up to
+ * it, which serves as a sparse time index. Sealed ledgers carry their lowest and
+ * highest entry timestamps, so a time lookup picks its ledger without reading any.
+ */
+public class PartitionLedgerIndex {
+    // Base offset -> ledger ID. An empty ledger shares its base offset with its successor,
+    // which replaces it here since only the successor can hold records at that offset.
+    private final TreeMap<Long, Long> ledgersByBaseOffset = new TreeMap<>();
+    private final Map<Long, EntryIndex> entryIndexes = new HashMap<>();
+    // Ledger ID -> {lowest, highest} entry timestamp, known for sealed ledgers
+    private final Map<Long, long[]> ledgerTimestamps = new HashMap<>();
+    // Running maximum of the highest timestamps in ledgersAscending order; rebuilt after a change
+    private long[] maxTimestampPrefix;
+    // Ledger ID -> base offset of ledgers written with one Message per entry, before record batches
+    private final Map<Long, Long> legacyLedgers = new HashMap<>();
+
+    /**
+     * Records a ledger and the offset of its first record.
+     *
+     * @param ledgerId   The ledger ID.
+     * @param baseOffset The logical offset of the first record the ledger holds.
+     */
+    public synchronized void addLedger(long ledgerId, long baseOffset) {
+        ledgersByBaseOffset.put(baseOffset, ledgerId);
+        maxTimestampPrefix = null;
+    }
+
+    /**
+     * Records a ledger written before record batches, which holds one serialized
+     * Message per entry. Its entries hold consecutive offsets from baseOffset.
+     *
+     * @param ledgerId   The ledger ID.
+     * @param baseOffset The logical offset of the ledger's first entry.
+     */
+    public synchronized void addLegacyLedger(long ledgerId, long baseOffset) {
+        addLedger(ledgerId, baseOffset);
+        legacyLedgers.put(ledgerId, baseOffset);
+    }
+
+    /**
+     * Returns the base offset of a ledger recorded with addLegacyLedger, or -1 if
+     * the ledger holds record batches.
+     */
+    public synchronized long getLegacyBaseOffset(long ledgerId) {
+        return legacyLedgers.getOrDefault(ledgerId, -1L);
+    }
+
+    /**
+     * Records the lowest and highest entry timestamps of a sealed ledger (see
+     * EntryIndex#minTimestamp and EntryIndex#maxTimestamp).
+     */
+    public synchronized void setLedgerTimestamps(long ledgerId, long minTimestamp, long maxTimestamp) {
+        ledgerTimestamps.put(ledgerId, new long[] {minTimestamp, maxTimestamp});
+        maxTimestampPrefix = null;
+    }
+
+    /**
+     * Returns the lowest entry timestamp of a ledger, or Long.MIN_VALUE if unknown.
+     */
+    public synchronized long getMinTimestamp(long ledgerId) {
+        long[] timestamps = ledgerTimestamps.get(ledgerId);
+        return timestamps == null ? Long.MIN_VALUE : timestamps[0];
+    }
+
+    /**
+     * Returns the highest entry timestamp of a ledger, or Long.MAX_VALUE if unknown.
+     */
+    public synchronized long getMaxTimestamp(long ledgerId) {
+        long[] timestamps = ledgerTimestamps.get(ledgerId);
+        return timestamps == null ? Long.MAX_VALUE : timestamps[1];
+    }
+
+    /**
+     * Returns the position in ledgersAscending of the first ledger whose entry
+     * timestamps may reach the given time, or the number of ledgers if none can.
+     * Ledgers with unknown timestamps may reach any time.
+     */
+    public synchronized int firstLedgerReaching(long timestamp) {
+        if (maxTimestampPrefix == null) {
+            maxTimestampPrefix = new long[ledgersByBaseOffset.size()];
+            int i = 0;
+            for (long ledgerId : ledgersByBaseOffset.values()) {
+                long max = getMaxTimestamp(ledgerId);
+                maxTimestampPrefix[i] = i == 0 ? max : Math.max(maxTimestampPrefix[i - 1], max);
+                i++;
+            }
+        }
+
+        int low = 0;
+        int high = maxTimestampPrefix.length;
+        while (low < high) {
+            int mid = (low + high) >>> 1;
+            if (maxTimestampPrefix[mid] >= timestamp) {
+                high = mid;
+            } else {
+                low = mid + 1;
+            }
+        }
+        return low;
+    }
+
+    /**
+     * Returns the ledger that contains the given offset followed by every later
+     * ledger, in offset order. If the offset precedes all ledgers, all are returned.
+     *
+     * @param offset The logical offset.
+     * @return Ledger IDs in offset order.
+     */
+    public synchronized List<Long> ledgersFrom(long offset) {
+        Long from = ledgersByBaseOffset.floorKey(offset);
+        if (from == null) {
+            return new ArrayList<>(ledgersByBaseOffset.values());
+        }
+        return new ArrayList<>(ledgersByBaseOffset.tailMap(from, true).values());
+    }
+
+    /**
+     * Returns every ledger, oldest first.
+     */
+    public synchronized List<Long> ledgersAscending() {
+        return new ArrayList<>(ledgersByBaseOffset.values());
+    }
+
+    /**
+     * Returns every ledger, newest first.
+     */
+    public synchronized List<Long> ledgersDescending() {
+        return new ArrayList<>(ledgersByBaseOffset.descendingMap().values());
+    }
+
+    public synchronized EntryIndex getEntryIndex(long ledgerId) {
+        return entryIndexes.get(ledgerId);
+    }
+
+    /**
+     * Stores the entry index of a ledger unless one is already present.
+     *
+     * @return The entry index now associated with the ledger.
+     */
+    public synchronized EntryIndex putEntryIndexIfAbsent(long ledgerId, EntryIndex entryIndex) {
+        EntryIndex existing = entryIndexes.putIfAbsent(ledgerId, entryIndex);
+        return existing != null ? existing : entryIndex;
+    }
+
+    /**
+     * Base offsets of the entries of one ledger, indexed by entry ID, and the
+     * running maximum of their batch timestamps. A ledger indexed as it is
+     * written holds a point per entry. A sealed ledger's index is persisted with
+     * a point every stride entries (see toSparse), so lookups in it return the
+     * first entry of the block that holds the answer.
+     */
+    public static class EntryIndex {
+        private long[] baseOffsets;
+        private long[] maxTimestamps;
+        private int points = 0;
+        // Entries between consecutive points
+        private final int stride;
+        // Entries covered by the index
+        private long entryCount = 0;
+        // Lowest timestamp appended
+        private long minTimestamp = Long.MAX_VALUE;
+
+        public EntryIndex() {
+            this(1, 64);
+        }
+
+        private EntryIndex(int stride, int capacity) {
+            this.stride = stride;
+            this.baseOffsets = new long[Math.max(capacity, 1)];
+            this.maxTimestamps = new long[Math.max(capacity, 1)];
+        }
+
+        /**
+         * Appends the next entry. Entries must be added in entry ID order, and
+         * only to an index with a point per entry.
+         *
+         * @param entryId      The entry ID.
+         * @param baseOffset   The base offset of the first batch in the entry.
+         * @param maxTimestamp The highest base timestamp of the batches in the entry.
+         */
+        public synchronized void append(long entryId, long baseOffset, long maxTimestamp) {
+            if (stride != 1) {
+                throw new IllegalStateException("Cannot append to a sparse entry index");
+            }
+            if (entryId != entryCount) {
+                throw new IllegalStateException("Entry " + entryId + " indexed out of order, expected " + entryCount);
+            }
+            addPoint(baseOffset, maxTimestamp);
+            minTimestamp = Math.min(minTimestamp, maxTimestamp);
+            entryCount++;
+        }
+
+        private void addPoint(long baseOffset, long maxTimestamp) {
+            if (points == baseOffsets.length) {
+                baseOffsets = Arrays.copyOf(baseOffsets, points * 2);
+                maxTimestamps = Arrays.copyOf(maxTimestamps, points * 2);
+            }
+            baseOffsets[points] = baseOffset;
+            maxTimestamps[points] = points == 0 ? maxTimestamp : Math.max(maxTimestamps[points - 1], maxTimestamp);
+            points++;
+        }
+
+        /**
+         * Returns the number of entries the index covers.
+         */
+        public synchronized long size() {
+            return entryCount;
+        }
+
+        public int stride() {
+            return stride;
+        }
+
+        /**
+         * Returns the lowest entry timestamp, each entry's being the highest base
+         * timestamp of its batches, or Long.MAX_VALUE if the index is empty.
+         */
+        public synchronized long minTimestamp() {
+            return minTimestamp;
+        }
+
+        /**
+         * Returns the highest entry timestamp, or Long.MIN_VALUE if the index is empty.
+         */
+        public synchronized long maxTimestamp() {
+            return points == 0 ? Long.MIN_VALUE : maxTimestamps[points - 1];
+        }
+
+        /**
+         * Returns the last entry of the block that starts at or contains the given
+         * entry: the entry itself in an index with a point per entry.
+         */
+        public synchronized long blockEnd(long entryId) {
+            return Math.min(entryId - entryId % stride + stride, entryCount) - 1;
+        }
+
+        /**
+         * Returns the first entry of the block holding the last entry whose base
+         * offset is not after the given offset, or 0 if the offset precedes every entry.
+         */
+        public synchronized long floorEntry(long offset) {
+            int low = 0;
+            int high = points - 1;
+            while (low < high) {
+                int mid = (low + high + 1) >>> 1;
+                if (baseOffsets[mid] <= offset) {
+                    low = mid;
+                } else {
+                    high = mid - 1;
+                }
+            }
+            return (long) Math.max(low, 0) * stride;
+        }
+
+        /**
+         * Returns the first entry of the block in which a batch timestamp first
+         * reached the given time, or size() if none did.
+         */
+        public synchronized long firstEntryReaching(long timestamp) {
+            int low = 0;
+            int high = points;
+            while (low < high) {
+                int mid = (low + high) >>> 1;
+                if (maxTimestamps[mid] >= timestamp) {
+                    high = mid;
+                } else {
+                    low = mid + 1;
+                }
+            }
+            return low == points ? entryCount : (long) low * stride;
+        }
+
+        /**
+         * Returns an index of the same entries with at most maxPoints points, one
+         * every stride entries, whose timestamps cover each whole block.
+         */
+        public synchronized EntryIndex toSparse(int maxPoints) {
+            int newStride = (int) Math.max(1, (entryCount + maxPoints - 1) / maxPoints) * stride;
+            int step = newStride / stride;
+            EntryIndex sparse = new EntryIndex(newStride, (points + step - 1) / step);
+            for (int i = 0; i < points; i += step) {
+                // The running maximum at a block's last point covers the whole block
+                sparse.baseOffsets[sparse.points] = baseOffsets[i];
+                sparse.maxTimestamps[sparse.points] = maxTimestamps[Math.min(i + step, points) - 1];
+                sparse.points++;
+            }
+            sparse.entryCount = entryCount;
+            sparse.minTimestamp = minTimestamp;
+            return sparse;
+        }
+
+        /**
+         * Encodes the index as "stride:entryCount:minTimestamp" followed by
+         * ",baseOffset:maxTimestamp" per point.
+         */
+        public synchronized String encode() {
+            StringBuilder encoded = new StringBuilder().append(stride).append(':').append(entryCount)
+                    .append(':').append(minTimestamp);
+            for (int i = 0; i < points; i++) {
+                encoded.append(',').append(baseOffsets[i]).append(':').append(maxTimestamps[i]);
+            }
+            return encoded.toString();
+        }
+
+        /**
+         * Decodes an index written by encode.
+         *
+         * @return The index, or null if the text is not a valid encoding.
+         */
+        public static EntryIndex decode(String encoded) {
+            try {
+                String[] fields = encoded.split(",");
+                String[] header = fields[0].split(":");
+                int stride = Integer.parseInt(header[0]);
+                long entryCount = Long.parseLong(header[1]);
+                long minTimestamp = Long.parseLong(header[2]);
+                if (stride < 1 || fields.length - 1 != (entryCount + stride - 1) / stride) {
+                    return null;
+                }
+                EntryIndex index = new EntryIndex(stride, fields.length - 1);
+                for (int i = 1; i < fields.length; i++) {
+                    String[] point = fields[i].split(":");
+                    index.addPoint(Long.parseLong(point[0]), Long.parseLong(point[1]));
+                }
+                index.entryCount = entryCount;
+                index.minTimestamp = minTimestamp;
+                return index;
+            } catch (RuntimeException e) {
+                return null;
+            }
+        }
+    }
+}
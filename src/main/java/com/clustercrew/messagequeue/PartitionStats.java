@@ -0,0 +1,85 @@
+package com.clustercrew.messagequeue;
+
+import java.util.concurrent.atomic.AtomicLong;
+
+/**
+ * Produce and consume counters of a partition on its leader. Totals are kept
+ * since the partition was opened on this broker; rates are computed over the
+ * interval between the two most recent calls to {@link #sample()}.
+ */
+public class PartitionStats {
+    private final AtomicLong producedRecords = new AtomicLong();
+    private final AtomicLong producedBytes = new AtomicLong();
+    private final AtomicLong consumedRecords = new AtomicLong();
+    private final AtomicLong consumedBytes = new AtomicLong();
+
+    // Totals and time at the last sample; guarded by this
+    private long sampledAtMs = System.currentTimeMillis();
+    private long sampledProducedRecords = 0;
+    private long sampledProducedBytes = 0;
+    private long sampledConsumedRecords = 0;
+    private long sampledConsumedBytes = 0;
+
+    private volatile double produceRecordsPerSec = 0;
+    private volatile double produceBytesPerSec = 0;
+    private volatile double consumeRecordsPerSec = 0;
+    private volatile double consumeBytesPerSec = 0;
+
+    public void recordProduce(long records, long bytes) {
+        producedRecords.addAndGet(records);
+        producedBytes.addAndGet(bytes);
+    }
+
+    public void recordConsume(long records, long bytes) {
+        consumedRecords.addAndGet(records);
+        consumedBytes.addAndGet(bytes);
+    }
+
+    /**
+     * Recomputes the rates from the counts since the previous sample.
+     */
+    public synchronized void sample() {
+        long now = System.currentTimeMillis();
+        double seconds = Math.max(now - sampledAtMs, 1) / 1000.0;
+
+        long records = producedRecords.get();
+        long bytes = producedBytes.get();
+        produceRecordsPerSec = (records - sampledProducedRecords) / seconds;
+        produceBytesPerSec = (bytes - sampledProducedBytes) / seconds;
+        sampledProducedRecords = records;
+        sampledProducedBytes = bytes;
+
+        records = consumedRecords.get();
+        bytes = consumedBytes.get();
+        consumeRecordsPerSec = (records - sampledConsumedRecords) / seconds;
+        consumeBytesPerSec = (bytes - sampledConsumedBytes) / seconds;
+        sampledConsumedRecords = records;
+        sampledConsumedBytes = bytes;
+
+        sampledAtMs = now;
+    }
+
+    public long getProducedBytes() {
+        return producedBytes.get();
+    }
+
+    public long getConsumedBytes() {
+        return consumedBytes.get();
+    }
+
+    public double getProduceRecordsPerSec() {
+        return produceRecordsPerSec;
+    }
+
+    public double getProduceBytesPerSec() {
+        return produceBytesPerSec;
+    }
+
+    public double getConsumeRecordsPerSec() {
+        return consumeRecordsPerSec;
+    }
+
+    public double getConsumeBytesPerSec() {
+        return consumeBytesPerSec;
+    }
+}
@@ -0,0 +1,91 @@
+package com.clustercrew.messagequeue;
+
+import java.util.ArrayDeque;
+import java.util.ArrayList;
+import java.util.Iterator;
+import java.util.List;
+
+/**
+ * Ring buffer of the most recently confirmed record batches of a partition,
+ * bounded by bytes. Consumers that keep up with producers are served from here
+ * without a bookie read; older offsets fall back to BookKeeper.
+ */
+public class PartitionTailCache {
+    private final long capacityBytes;
+    private final ArrayDeque<byte[]> batches = new ArrayDeque<>();
+    private long sizeBytes = 0;
+    // Every record from this offset up to endOffset is cached
+    private long startOffset;
+    private long endOffset;
+
+    /**
+     * @param capacityBytes The maximum total size of the cached batches.
+     * @param endOffset     The offset the first appended batch will start at.
+     */
+    public PartitionTailCache(long capacityBytes, long endOffset) {
+        this.capacityBytes = capacityBytes;
+        this.startOffset = endOffset;
+        this.endOffset = endOffset;
+    }
+
+    /**
+     * Appends a confirmed batch. Batches must be appended in offset order, so
+     * oldest batches are evicted first.
+     *
+     * @param batch The encoded batch with its base offset assigned.
+     */
+    public synchronized void append(byte[] batch) {
+        if (batch.length > capacityBytes) {
+            // Too large to keep: drop everything so the cached range stays contiguous
+            batches.clear();
+            sizeBytes = 0;
+            startOffset = endOffset = RecordBatch.getEndOffset(batch);
+            return;
+        }
+
+        batches.addLast(batch);
+        sizeBytes += batch.length;
+        endOffset = RecordBatch.getEndOffset(batch);
+        while (sizeBytes > capacityBytes) {
+            sizeBytes -= batches.removeFirst().length;
+        }
+        startOffset = batches.isEmpty() ? endOffset : RecordBatch.getBaseOffset(batches.peekFirst());
+    }
+
+    /**
+     * Returns the cached batches from the one containing fromOffset onwards,
+     * enough to cover maxMessages records, or null if fromOffset is older than
+     * the cache. An offset at or past the end yields an empty list.
+     *
+     * @param fromOffset  The logical offset to start reading from.
+     * @param maxMessages The maximum number of messages at or after fromOffset to return.
+     * @return The batches in offset order, or null on a miss.
+     */
+    public synchronized List<byte[]> read(long fromOffset, int maxMessages) {
+        if (fromOffset < startOffset) {
+            return null;
+        }
+
+        // Tail readers start near the newest batch, so search backwards
+        ArrayDeque<byte[]> matched = new ArrayDeque<>();
+        Iterator<byte[]> newestFirst = batches.descendingIterator();
+        while (newestFirst.hasNext()) {
+            byte[] batch = newestFirst.next();
+            if (RecordBatch.getEndOffset(batch) <= fromOffset) {
+                break;
+            }
+            matched.addFirst(batch);
+        }
+
+        List<byte[]> result = new ArrayList<>();
+        long fetched = 0;
+        for (byte[] batch : matched) {
+            if (fetched >= maxMessages) {
+                break;
+            }
+            result.add(batch);
+            fetched += RecordBatch.getEndOffset(batch) - Math.max(fromOffset, RecordBatch.getBaseOffset(batch));
+        }
+        return result;
+    }
+}
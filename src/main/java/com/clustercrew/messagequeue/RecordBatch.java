@@ -0,0 +1,377 @@
+package com.clustercrew.messagequeue;
+
+import com.clustercrew.messagequeue.MessageQueueOuterClass.Message;
+import com.clustercrew.messagequeue.MessageQueueOuterClass.MessageHeader;
+import com.google.protobuf.ByteString;
+
+import java.io.ByteArrayOutputStream;
+import java.nio.ByteBuffer;
+import java.nio.charset.StandardCharsets;
+import java.util.ArrayList;
+import java.util.List;
+import java.util.zip.CRC32C;
+
+/**
+ * Codec for the RecordBatch format shared with the C++ clients (see
+ * common/record_batch.h). A batch holds the records of one topic partition with
+ * the topic and partition stated once, a base offset and base timestamp, and
+ * varint deltas per record. The header also carries the offset delta of the last
+ * record, so a batch whose records are not contiguous, such as a filtered one,
+ * still states where it ends. The broker stores each batch as one ledger entry.
+ */
+public final class RecordBatch {
+    public static final byte MAGIC = 2;
+
+    // First byte of a ledger entry that group-commits several batches, each preceded by its int32 length
+    public static final byte MULTI_BATCH_MAGIC = -1;
+
+    private static final int BASE_OFFSET_POS = 1;
+    private static final int CRC_POS = 9;
+    private static final int BASE_TIMESTAMP_POS = 13;
+    private static final int RECORD_COUNT_POS = 21;
+    private static final int LAST_OFFSET_DELTA_POS = 25;
+    private static final int FIXED_HEADER_SIZE = 29;
+
+    private RecordBatch() {
+    }
+
+    /**
+     * Checks the magic byte, header bounds and CRC of a batch.
+     *
+     * @param batch The encoded batch.
+     * @return True if the batch is well formed.
+     */
+    public static boolean isValid(byte[] batch) {
+        if (batch.length < FIXED_HEADER_SIZE || batch[0] != MAGIC || getRecordCount(batch) < 0
+                || getLastOffsetDelta(batch) < getRecordCount(batch) - 1) {
+            return false;
+        }
+        CRC32C crc = new CRC32C();
+        crc.update(batch, BASE_TIMESTAMP_POS, batch.length - BASE_TIMESTAMP_POS);
+        return (int) crc.getValue() == ByteBuffer.wrap(batch).getInt(CRC_POS);
+    }
+
+    public static long getBaseOffset(byte[] batch) {
+        return ByteBuffer.wrap(batch).getLong(BASE_OFFSET_POS);
+    }
+
+    /**
+     * Stamps the offset of the first record. The base offset is not covered by
+     * the CRC, so this does not invalidate the batch.
+     */
+    public static void setBaseOffset(byte[] batch, long baseOffset) {
+        ByteBuffer.wrap(batch).putLong(BASE_OFFSET_POS, baseOffset);
+    }
+
+    public static long getBaseTimestamp(byte[] batch) {
+        return ByteBuffer.wrap(batch).getLong(BASE_TIMESTAMP_POS);
+    }
+
+    /**
+     * Returns the highest base timestamp of the given batches, used to index
+     * ledger entries by time.
+     */
+    public static long getMaxBaseTimestamp(List<byte[]> batches) {
+        long max = Long.MIN_VALUE;
+        for (byte[] batch : batches) {
+            max = Math.max(max, getBaseTimestamp(batch));
+        }
+        return max;
+    }
+
+    public static int getRecordCount(byte[] batch) {
+        return ByteBuffer.wrap(batch).getInt(RECORD_COUNT_POS);
+    }
+
+    /**
+     * Returns the offset delta of the last record, or -1 if the batch is empty.
+     */
+    public static int getLastOffsetDelta(byte[] batch) {
+        return ByteBuffer.wrap(batch).getInt(LAST_OFFSET_DELTA_POS);
+    }
+
+    /**
+     * Returns the offset one past the last record of the batch.
+     */
+    public static long getEndOffset(byte[] batch) {
+        return getBaseOffset(batch) + getLastOffsetDelta(batch) + 1;
+    }
+
+    public static String getTopic(byte[] batch) {
+        ByteBuffer buffer = ByteBuffer.wrap(batch);
+        buffer.position(FIXED_HEADER_SIZE);
+        return new String(readBytes(buffer), StandardCharsets.UTF_8);
+    }
+
+    public static int getPartition(byte[] batch) {
+        ByteBuffer buffer = ByteBuffer.wrap(batch);
+        buffer.position(FIXED_HEADER_SIZE);
+        readBytes(buffer);
+        return (int) readVarint(buffer);
+    }
+
+    /**
+     * Encodes messages of a single topic partition as a batch.
+     *
+     * @param topic     The topic name.
+     * @param partition The partition number.
+     * @param messages  The messages to encode, in order.
+     * @return The encoded batch with a base offset of 0.
+     */
+    public static byte[] fromMessages(String topic, int partition, List<Message> messages) {
+        long baseTimestamp = messages.isEmpty() ? 0 : messages.get(0).getTimestamp();
+
+        ByteArrayOutputStream out = new ByteArrayOutputStream();
+        out.write(new byte[FIXED_HEADER_SIZE], 0, FIXED_HEADER_SIZE);
+        writeBytes(out, topic.getBytes(StandardCharsets.UTF_8));
+        writeVarint(out, partition);
+        for (int i = 0; i < messages.size(); i++) {
+            Message message = messages.get(i);
+            writeVarint(out, i);
+            writeVarint(out, zigZag(message.getTimestamp() - baseTimestamp));
+            writeBytes(out, message.getKey().toByteArray());
+            writeBytes(out, message.getValue().toByteArray());
+            writeVarint(out, message.getHeadersCount());
+            for (MessageHeader header : message.getHeadersList()) {
+                writeBytes(out, header.getKey().getBytes(StandardCharsets.UTF_8));
+                writeBytes(out, header.getValue().toByteArray());
+            }
+        }
+
+        byte[] batch = out.toByteArray();
+        ByteBuffer buffer = ByteBuffer.wrap(batch);
+        buffer.put(0, MAGIC);
+        buffer.putLong(BASE_TIMESTAMP_POS, baseTimestamp);
+        buffer.putInt(RECORD_COUNT_POS, messages.size());
+        buffer.putInt(LAST_OFFSET_DELTA_POS, messages.size() - 1);
+
+        CRC32C crc = new CRC32C();
+        crc.update(batch, BASE_TIMESTAMP_POS, batch.length - BASE_TIMESTAMP_POS);
+        buffer.putInt(CRC_POS, (int) crc.getValue());
+        return batch;
+    }
+
+    /**
+     * Decodes every record of a batch into messages.
+     *
+     * @param batch The encoded batch.
+     * @return The decoded messages with offsets and timestamps resolved.
+     */
+    public static List<Message> toMessages(byte[] batch) {
+        ByteBuffer buffer = ByteBuffer.wrap(batch);
+        long baseOffset = buffer.getLong(BASE_OFFSET_POS);
+        long baseTimestamp = buffer.getLong(BASE_TIMESTAMP_POS);
+        int recordCount = buffer.getInt(RECORD_COUNT_POS);
+
+        buffer.position(FIXED_HEADER_SIZE);
+        String topic = new String(readBytes(buffer), StandardCharsets.UTF_8);
+        int partition = (int) readVarint(buffer);
+
+        List<Message> messages = new ArrayList<>(recordCount);
+        for (int i = 0; i < recordCount; i++) {
+            Message.Builder message = Message.newBuilder()
+                    .setTopic(topic)
+                    .setPartition(partition)
+                    .setOffset(baseOffset + readVarint(buffer))
+                    .setTimestamp(baseTimestamp + unZigZag(readVarint(buffer)))
+                    .setKey(ByteString.copyFrom(readBytes(buffer)))
+                    .setValue(ByteString.copyFrom(readBytes(buffer)));
+            long headerCount = readVarint(buffer);
+            for (long h = 0; h < headerCount; h++) {
+                message.addHeaders(MessageHeader.newBuilder()
+                        .setKey(new String(readBytes(buffer), StandardCharsets.UTF_8))
+                        .setValue(ByteString.copyFrom(readBytes(buffer))));
+            }
+            messages.add(message.build());
+        }
+        return messages;
+    }
+
+    /**
+     * Records of a batch that passed a filter, and how far the filter got.
+     */
+    public static final class FilterResult {
+        // The matching records as a batch, or null if none matched
+        public final byte[] batch;
+        // The offset after the last record examined
+        public final long nextOffset;
+
+        FilterResult(byte[] batch, long nextOffset) {
+            this.batch = batch;
+            this.nextOffset = nextOffset;
+        }
+    }
+
+    /**
+     * Keeps the records at or after fromOffset that the matcher accepts, up to
+     * maxRecords of them. Kept records are copied unchanged, so they keep their
+     * offsets and timestamps. The resulting batch's record count is the number
+     * kept and its last offset delta the last kept record's, so it ends right
+     * after that record.
+     *
+     * @param batch      The encoded batch.
+     * @param fromOffset The first offset to examine.
+     * @param maxRecords The most records to keep.
+     * @param matcher    The filter to apply.
+     * @return The kept records and the offset to continue from.
+     */
+    public static FilterResult filter(byte[] batch, long fromOffset, int maxRecords, RecordMatcher matcher) {
+        ByteBuffer buffer = ByteBuffer.wrap(batch);
+        long baseOffset = buffer.getLong(BASE_OFFSET_POS);
+        long baseTimestamp = buffer.getLong(BASE_TIMESTAMP_POS);
+        int recordCount = buffer.getInt(RECORD_COUNT_POS);
+
+        buffer.position(FIXED_HEADER_SIZE);
+        readBytes(buffer);
+        readVarint(buffer);
+        int recordsStart = buffer.position();
+
+        ByteArrayOutputStream kept = new ByteArrayOutputStream();
+        kept.write(batch, 0, recordsStart);
+        int keptCount = 0;
+        int lastKeptDelta = -1;
+        long nextOffset = fromOffset;
+        List<ByteBuffer> headers = new ArrayList<>();
+        for (int i = 0; i < recordCount && keptCount < maxRecords; i++) {
+            int recordStart = buffer.position();
+            int offsetDelta = (int) readVarint(buffer);
+            long offset = baseOffset + offsetDelta;
+            long timestamp = baseTimestamp + unZigZag(readVarint(buffer));
+            ByteBuffer key = readSlice(buffer);
+            readSlice(buffer);
+            long headerCount = readVarint(buffer);
+            headers.clear();
+            for (long h = 0; h < headerCount; h++) {
+                headers.add(readSlice(buffer));
+                headers.add(readSlice(buffer));
+            }
+
+            if (offset < fromOffset) {
+                continue;
+            }
+            nextOffset = offset + 1;
+            if (matcher.matches(key, timestamp, headers)) {
+                kept.write(batch, recordStart, buffer.position() - recordStart);
+                keptCount++;
+                lastKeptDelta = offsetDelta;
+            }
+        }
+        if (keptCount == 0) {
+            return new FilterResult(null, nextOffset);
+        }
+
+        byte[] filtered = kept.toByteArray();
+        ByteBuffer out = ByteBuffer.wrap(filtered);
+        out.putInt(RECORD_COUNT_POS, keptCount);
+        out.putInt(LAST_OFFSET_DELTA_POS, lastKeptDelta);
+        CRC32C crc = new CRC32C();
+        crc.update(filtered, BASE_TIMESTAMP_POS, filtered.length - BASE_TIMESTAMP_POS);
+        out.putInt(CRC_POS, (int) crc.getValue());
+        return new FilterResult(filtered, nextOffset);
+    }
+
+    /**
+     * Packs batches into one ledger entry. A single batch is stored as is.
+     *
+     * @param batches The encoded batches, in offset order.
+     * @return The ledger entry.
+     */
+    public static byte[] toEntry(List<byte[]> batches) {
+        if (batches.size() == 1) {
+            return batches.get(0);
+        }
+
+        int size = 1;
+        for (byte[] batch : batches) {
+            size += 4 + batch.length;
+        }
+        ByteBuffer entry = ByteBuffer.allocate(size);
+        entry.put(MULTI_BATCH_MAGIC);
+        for (byte[] batch : batches) {
+            entry.putInt(batch.length);
+            entry.put(batch);
+        }
+        return entry.array();
+    }
+
+    /**
+     * Unpacks the batches of a ledger entry written by {@link #toEntry}.
+     *
+     * @param entry The ledger entry.
+     * @return The encoded batches, in offset order.
+     */
+    public static List<byte[]> fromEntry(byte[] entry) {
+        if (entry.length == 0 || entry[0] != MULTI_BATCH_MAGIC) {
+            return List.of(entry);
+        }
+
+        List<byte[]> batches = new ArrayList<>();
+        ByteBuffer buffer = ByteBuffer.wrap(entry);
+        buffer.position(1);
+        while (buffer.hasRemaining()) {
+            int length = buffer.getInt();
+            if (length < 0 || length > buffer.remaining()) {
+                throw new IllegalArgumentException("Record batch length exceeds ledger entry size");
+            }
+            byte[] batch = new byte[length];
+            buffer.get(batch);
+            batches.add(batch);
+        }
+        return batches;
+    }
+
+    private static void writeVarint(ByteArrayOutputStream out, long value) {
+        while ((value & ~0x7FL) != 0) {
+            out.write((int) ((value & 0x7F) | 0x80));
+            value >>>= 7;
+        }
+        out.write((int) value);
+    }
+
+    private static void writeBytes(ByteArrayOutputStream out, byte[] bytes) {
+        writeVarint(out, bytes.length);
+        out.write(bytes, 0, bytes.length);
+    }
+
+    private static long readVarint(ByteBuffer buffer) {
+        long value = 0;
+        for (int shift = 0; shift < 64; shift += 7) {
+            byte b = buffer.get();
+            value |= (long) (b & 0x7F) << shift;
+            if ((b & 0x80) == 0) {
+                return value;
+            }
+        }
+        throw new IllegalArgumentException("Malformed varint in record batch");
+    }
+
+    private static byte[] readBytes(ByteBuffer buffer) {
+        long length = readVarint(buffer);
+        if (length > buffer.remaining()) {
+            throw new IllegalArgumentException("Record batch field exceeds batch size");
+        }
+        byte[] bytes = new byte[(int) length];
+        buffer.get(bytes);
+        return bytes;
+    }
+
+    // A view of the next length-prefixed field, without copying it
+    private static ByteBuffer readSlice(ByteBuffer buffer) {
+        long length = readVarint(buffer);
+        if (length > buffer.remaining()) {
+            throw new IllegalArgumentException("Record batch field exceeds batch size");
+        }
+        ByteBuffer slice = buffer.slice();
+        slice.limit((int) length);
+        buffer.position(buffer.position() + (int) length);
+        return slice;
+    }
+
+    private static long zigZag(long value) {
+        return (value << 1) ^ (value >> 63);
+    }
+
+    private static long unZigZag(long value) {
+        return (value >>> 1) ^ -(value & 1);
+    }
+}
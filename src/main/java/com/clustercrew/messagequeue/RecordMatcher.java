@@ -0,0 +1,93 @@
+package com.clustercrew.messagequeue;
+
+import com.clustercrew.messagequeue.MessageQueueOuterClass.MessageHeader;
+import com.clustercrew.messagequeue.MessageQueueOuterClass.RecordFilter;
+import com.google.protobuf.ByteString;
+
+import java.nio.ByteBuffer;
+import java.nio.charset.StandardCharsets;
+import java.util.ArrayList;
+import java.util.HashSet;
+import java.util.List;
+import java.util.Set;
+
+/**
+ * Evaluates a fetch's {@link RecordFilter} against records as they are read
+ * from a batch. Keys and header values are compared in place, without copying
+ * them out of the batch.
+ */
+public final class RecordMatcher {
+    private final ByteBuffer keyPrefix;       // Null if any key prefix matches
+    private final Set<ByteBuffer> keys;       // Empty if any key matches
+    private final List<ByteBuffer> headers;   // Name and value pairs that must all be present
+    private final long minTimestamp;
+    private final long maxTimestamp;
+
+    private RecordMatcher(RecordFilter filter) {
+        this.keyPrefix = filter.getKeyPrefix().isEmpty() ? null : filter.getKeyPrefix().asReadOnlyByteBuffer();
+        this.keys = new HashSet<>();
+        for (ByteString key : filter.getKeysList()) {
+            keys.add(key.asReadOnlyByteBuffer());
+        }
+        this.headers = new ArrayList<>();
+        for (MessageHeader header : filter.getHeadersList()) {
+            headers.add(ByteBuffer.wrap(header.getKey().getBytes(StandardCharsets.UTF_8)));
+            headers.add(header.getValue().asReadOnlyByteBuffer());
+        }
+        this.minTimestamp = filter.hasMinTimestamp() ? filter.getMinTimestamp() : Long.MIN_VALUE;
+        this.maxTimestamp = filter.hasMaxTimestamp() ? filter.getMaxTimestamp() : Long.MAX_VALUE;
+    }
+
+    /**
+     * @param filter The filter of a fetch request.
+     * @return A matcher for the filter, or null if the filter sets no criterion.
+     */
+    public static RecordMatcher of(RecordFilter filter) {
+        RecordMatcher matcher = new RecordMatcher(filter);
+        boolean matchesAll = matcher.keyPrefix == null && matcher.keys.isEmpty() && matcher.headers.isEmpty()
+                && !filter.hasMinTimestamp() && !filter.hasMaxTimestamp();
+        return matchesAll ? null : matcher;
+    }
+
+    /**
+     * @param key          The record key.
+     * @param timestamp    The record time in milliseconds since the epoch.
+     * @param headerSlices The record headers as alternating name and value buffers.
+     * @return True if the record matches every criterion.
+     */
+    public boolean matches(ByteBuffer key, long timestamp, List<ByteBuffer> headerSlices) {
+        if (timestamp < minTimestamp || timestamp > maxTimestamp) {
+            return false;
+        }
+        if (keyPrefix != null && !startsWith(key, keyPrefix)) {
+            return false;
+        }
+        if (!keys.isEmpty() && !keys.contains(key)) {
+            return false;
+        }
+        for (int i = 0; i < headers.size(); i += 2) {
+            if (!hasHeader(headerSlices, headers.get(i), headers.get(i + 1))) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    private static boolean startsWith(ByteBuffer bytes, ByteBuffer prefix) {
+        if (bytes.remaining() < prefix.remaining()) {
+            return false;
+        }
+        ByteBuffer head = bytes.duplicate();
+        head.limit(head.position() + prefix.remaining());
+        return head.equals(prefix);
+    }
+
+    private static boolean hasHeader(List<ByteBuffer> headerSlices, ByteBuffer name, ByteBuffer value) {
+        for (int i = 0; i + 1 < headerSlices.size(); i += 2) {
+            if (headerSlices.get(i).equals(name) && headerSlices.get(i + 1).equals(value)) {
+                return true;
+            }
+        }
+        return false;
+    }
+}
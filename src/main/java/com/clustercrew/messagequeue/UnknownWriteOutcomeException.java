@@ -0,0 +1,18 @@
+package com.clustercrew.messagequeue;
+
+/**
+ * Thrown for a write whose ledger entry may or may not have been persisted.
+ * Once an entry of a ledger fails, whether it and the entries after it survive
+ * depends on how the ledger is recovered: a failed add may have reached enough
+ * bookies to be kept, and a confirmed one behind it may be cut off. Retrying
+ * such a write may duplicate its records.
+ */
+public class UnknownWriteOutcomeException extends IllegalStateException {
+    /**
+     * @param message The error message.
+     * @param cause   The failure of the ledger the write was in.
+     */
+    public UnknownWriteOutcomeException(String message, Throwable cause) {
+        super(message, cause);
+    }
+}
@@ -5,16 +5,29 @@ import org.apache.zookeeper.data.Stat;
 
 import java.nio.charset.StandardCharsets;
 import java.util.*;
+import java.util.concurrent.ConcurrentHashMap;
+import java.util.function.Consumer;
 
 public class ZooKeeperClient {
     private final ZooKeeper zk;
     private final PartitionAssigner partitionAssigner;
 
+    // Partition broker path -> broker ID, kept current by ZooKeeper watches
+    private final Map<String, String> partitionBrokerCache = new ConcurrentHashMap<>();
+    // Bumped on every invalidation so a read racing with a watch never caches stale data
+    private long partitionBrokerCacheEpoch = 0;
+    private final Watcher partitionBrokerWatcher = this::invalidatePartitionBroker;
+    // Notified with the changed partition broker path, or null when every assignment may have changed
+    private volatile Consumer<String> partitionBrokerListener = path -> {};
+
     public ZooKeeperClient(String zkServers) throws Exception {
         this.zk = new ZooKeeper(zkServers, 3000, event -> {
             if (event.getState() == Watcher.Event.KeeperState.SyncConnected) {
                 System.out.println("Connected to ZooKeeper");
                 
+            } else if (event.getState() == Watcher.Event.KeeperState.Expired) {
+                // Watches are lost with the session, so cached ownership can no longer be trusted
+                invalidatePartitionBroker(event);
             } else if (event.getType() == Watcher.Event.EventType.NodeChildrenChanged
                     && event.getPath().equals("/brokers")) {
                 try {
@@ -52,7 +65,8 @@ public class ZooKeeperClient {
 
     // ---------------------------------- Topic Management ----------------------------------
     /**
-     * Creates a new topic in ZooKeeper with the specified metadata.
+     * Creates a new topic in ZooKeeper with the specified metadata. Ledgers of
+     * the topic use the BookKeeper default quorums.
      *
      * @param topic            The name of the topic.
      * @param numPartitions    The number of partitions.
@@ -61,11 +75,30 @@ public class ZooKeeperClient {
      * @throws Exception If an error occurs while creating the topic.
      */
     public void createTopic(String topic, int numPartitions, int retentionMs, int replicationFactor) throws Exception {
+        createTopic(topic, numPartitions, retentionMs, replicationFactor, 0, 0);
+    }
+
+    /**
+     * Creates a new topic in ZooKeeper with the specified metadata.
+     *
+     * @param topic            The name of the topic.
+     * @param numPartitions    The number of partitions.
+     * @param retentionMs      The retention period in milliseconds.
+     * @param replicationFactor The replication factor, used as the ledger ensemble size.
+     * @param writeQuorum      Bookies each entry is written to, or 0 for the BookKeeper default.
+     * @param ackQuorum        Bookies that must confirm an entry, or 0 for the BookKeeper default.
+     * @throws Exception If an error occurs while creating the topic.
+     */
+    public void createTopic(String topic, int numPartitions, int retentionMs, int replicationFactor,
+                            int writeQuorum, int ackQuorum) throws Exception {
         String topicPath = "/topics/" + topic;
         ensurePathExists(topicPath);
 
         // Save metadata
         String metadata = String.format("partitions=%d,retention=%d,replicas=%d", numPartitions, retentionMs, replicationFactor);
+        if (writeQuorum > 0 && ackQuorum > 0) {
+            metadata += String.format(",writeQuorum=%d,ackQuorum=%d", writeQuorum, ackQuorum);
+        }
         zk.setData(topicPath, metadata.getBytes(StandardCharsets.UTF_8), -1);
 
         // Create partitions
@@ -79,6 +112,92 @@ public class ZooKeeperClient {
         partitionAssigner.assignPartitions(topic, numPartitions, activeBrokers);
     }
 
+    /**
+     * Grows a topic to the given number of partitions and assigns the new ones
+     * to the active brokers. The partitions, their assignments and the recorded
+     * partition count are written in one transaction conditional on the topic's
+     * version, so brokers growing the topic concurrently never both add the same
+     * partitions and no partition is visible before it has a broker.
+     *
+     * @param topic           The topic name.
+     * @param totalPartitions The number of partitions the topic should have.
+     * @throws Exception If the topic does not exist, already has at least that
+     *                   many partitions, or ZooKeeper could not be updated.
+     */
+    public void addPartitions(String topic, int totalPartitions) throws Exception {
+        if (!topicExists(topic)) {
+            throw new IllegalArgumentException("Topic " + topic + " does not exist.");
+        }
+
+        String topicPath = "/topics/" + topic;
+        while (true) {
+            // Read the version first: any later change to the partitions also bumps it
+            Stat stat = new Stat();
+            byte[] data = zk.getData(topicPath, false, stat);
+            int numPartitions = getPartitions(topic).size();
+            if (totalPartitions <= numPartitions) {
+                throw new IllegalArgumentException("Topic " + topic + " already has " + numPartitions + " partitions.");
+            }
+
+            // Keep the recorded partition count in step
+            String metadata = data == null || data.length == 0
+                    ? "partitions=" + totalPartitions
+                    : new String(data, StandardCharsets.UTF_8).replaceFirst("partitions=\\d+", "partitions=" + totalPartitions);
+
+            List<Op> ops = new ArrayList<>();
+            ops.add(Op.setData(topicPath, metadata.getBytes(StandardCharsets.UTF_8), stat.getVersion()));
+            Map<Integer, String> assignments =
+                    partitionAssigner.planAssignments(numPartitions, totalPartitions, getActiveBrokers());
+            for (Map.Entry<Integer, String> assignment : assignments.entrySet()) {
+                int partition = assignment.getKey();
+                String brokerId = assignment.getValue();
+                String partitionPath = topicPath + "/partitions/" + partition;
+                ensurePathExists("/brokers/" + brokerId + "/topics/" + topic + "/partitions");
+
+                ops.add(Op.create(partitionPath, new byte[0], ZooDefs.Ids.OPEN_ACL_UNSAFE, CreateMode.PERSISTENT));
+                ops.add(Op.create(partitionPath + "/broker", brokerId.getBytes(StandardCharsets.UTF_8),
+                        ZooDefs.Ids.OPEN_ACL_UNSAFE, CreateMode.PERSISTENT));
+                ops.add(Op.create("/brokers/" + brokerId + "/topics/" + topic + "/partitions/" + partition,
+                        String.valueOf(partition).getBytes(StandardCharsets.UTF_8), ZooDefs.Ids.OPEN_ACL_UNSAFE,
+                        CreateMode.PERSISTENT));
+            }
+
+            try {
+                zk.multi(ops);
+            } catch (KeeperException.BadVersionException e) {
+                // Another broker changed the topic first; plan again from its partitions
+                continue;
+            }
+            System.out.println("Topic " + topic + " grown from " + numPartitions + " to " + totalPartitions
+                    + " partitions: " + assignments);
+            return;
+        }
+    }
+
+    /**
+     * Retrieves the metadata of a topic as key/value pairs, e.g. "partitions" or
+     * "writeQuorum".
+     *
+     * @param topic The topic name.
+     * @return The topic metadata, empty if the topic has none.
+     * @throws Exception If an error occurs while fetching the metadata.
+     */
+    public Map<String, String> getTopicConfig(String topic) throws Exception {
+        Map<String, String> config = new HashMap<>();
+        byte[] data = zk.getData("/topics/" + topic, false, null);
+        if (data == null) {
+            return config;
+        }
+
+        for (String setting : new String(data, StandardCharsets.UTF_8).split(",")) {
+            int separator = setting.indexOf('=');
+            if (separator > 0) {
+                config.put(setting.substring(0, separator), setting.substring(separator + 1));
+            }
+        }
+        return config;
+    }
+
     /**
      * Retrieves the list of all topics stored in ZooKeeper.
      *
@@ -169,6 +288,28 @@ public class ZooKeeperClient {
         System.out.println("Broker registered: " + brokerId + " with address: " + brokerAddress);
     }
 
+    /**
+     * Removes a broker's registration and its now empty list of partitions, so
+     * that it is assigned partitions afresh when it registers again.
+     *
+     * @param brokerId The ID of the broker.
+     * @throws Exception If an error occurs while deleting the broker.
+     */
+    public void unregisterBroker(String brokerId) throws Exception {
+        deleteRecursive("/brokers/" + brokerId);
+        System.out.println("Broker unregistered: " + brokerId);
+    }
+
+    private void deleteRecursive(String path) throws Exception {
+        if (zk.exists(path, false) == null) {
+            return;
+        }
+        for (String child : zk.getChildren(path, false)) {
+            deleteRecursive(path + "/" + child);
+        }
+        zk.delete(path, -1);
+    }
+
     /**
      * Retrieves a list of active brokers from ZooKeeper.
      *
@@ -233,6 +374,24 @@ public class ZooKeeperClient {
         System.out.println("Partition " + partition + " of topic " + topic + " reassigned to broker " + newBrokerId);
     }
 
+    /**
+     * Moves a partition from one broker to another, updating both the broker's
+     * list of partitions and the partition's owner.
+     *
+     * @param topic        The topic name.
+     * @param partition    The partition number.
+     * @param fromBrokerId The broker currently responsible for the partition.
+     * @param toBrokerId   The broker to take over the partition.
+     * @throws Exception If an error occurs while updating ZooKeeper.
+     */
+    public void movePartition(String topic, int partition, String fromBrokerId, String toBrokerId) throws Exception {
+        String oldBrokerPartitionPath = "/brokers/" + fromBrokerId + "/topics/" + topic + "/partitions/" + partition;
+        if (zk.exists(oldBrokerPartitionPath, false) != null) {
+            zk.delete(oldBrokerPartitionPath, -1);
+        }
+        assignPartitionToBroker(topic, partition, toBrokerId);
+    }
+
     /**
      * Retrieves the broker responsible for a partition.
      *
@@ -251,6 +410,74 @@ public class ZooKeeperClient {
         return new String(data, StandardCharsets.UTF_8);
     }
 
+    /**
+     * Retrieves the broker responsible for a partition from a local cache. The
+     * first lookup reads ZooKeeper and sets a watch; the entry is dropped as soon
+     * as the assignment changes, so steady-state lookups need no ZooKeeper round trip.
+     *
+     * @param topic     The topic name.
+     * @param partition The partition number.
+     * @return The broker ID.
+     * @throws Exception If an error occurs while fetching the broker.
+     */
+    public String getPartitionBrokerCached(String topic, int partition) throws Exception {
+        String path = "/topics/" + topic + "/partitions/" + partition + "/broker";
+        String cached = partitionBrokerCache.get(path);
+        if (cached != null) {
+            return cached;
+        }
+
+        long epoch;
+        synchronized (partitionBrokerCache) {
+            epoch = partitionBrokerCacheEpoch;
+        }
+
+        Stat stat = zk.exists(path, partitionBrokerWatcher);
+        if (stat == null) {
+            throw new Exception("No broker assigned for topic: " + topic + ", partition: " + partition);
+        }
+        String brokerId = new String(zk.getData(path, partitionBrokerWatcher, null), StandardCharsets.UTF_8);
+
+        synchronized (partitionBrokerCache) {
+            if (epoch == partitionBrokerCacheEpoch) {
+                partitionBrokerCache.put(path, brokerId);
+            }
+        }
+        return brokerId;
+    }
+
+    /**
+     * Registers a callback invoked when a cached partition assignment changes.
+     * It runs on the ZooKeeper event thread and must not block.
+     *
+     * @param listener Receives the partition broker path, or null if all assignments were invalidated.
+     */
+    public void setPartitionBrokerListener(Consumer<String> listener) {
+        this.partitionBrokerListener = listener;
+    }
+
+    private void invalidatePartitionBroker(WatchedEvent event) {
+        String path = null;
+        if (event.getType() == Watcher.Event.EventType.None) {
+            // Data watches also see Disconnected and SyncConnected; they survive a
+            // reconnect, so only an expired session loses track of the assignments
+            if (event.getState() != Watcher.Event.KeeperState.Expired) {
+                return;
+            }
+        } else {
+            path = event.getPath();
+        }
+        synchronized (partitionBrokerCache) {
+            partitionBrokerCacheEpoch++;
+            if (path == null) {
+                partitionBrokerCache.clear();
+            } else {
+                partitionBrokerCache.remove(path);
+            }
+        }
+        partitionBrokerListener.accept(path);
+    }
+
     /**
      * Retrieves the list of partitions assigned to a broker.
      *
@@ -281,52 +508,160 @@ public class ZooKeeperClient {
     // ---------------------------------- Ledger Management ----------------------------------
 
     /**
-     * Adds a new ledger ID to the list of ledgers for a topic partition.
+     * Adds a new ledger to the list of ledgers for a topic partition. Ledgers are
+     * stored as "ledgerId:baseOffset" so a broker can rebuild the partition's
+     * offset index without reading the ledgers. Sealing a ledger appends its
+     * timestamps (see setLedgerTimestamps).
      *
-     * @param topic     The topic name.
-     * @param partition The partition number.
-     * @param ledgerId  The ledger ID to add.
+     * @param topic      The topic name.
+     * @param partition  The partition number.
+     * @param ledgerId   The ledger ID to add.
+     * @param baseOffset The logical offset of the first record the ledger holds.
      * @throws Exception If an error occurs while updating the ledger list.
      */
-    public void addLedgerToPartition(String topic, int partition, long ledgerId) throws Exception {
+    public void addLedgerToPartition(String topic, int partition, long ledgerId, long baseOffset) throws Exception {
+        updateLedgerList(topic, partition, ledgerList -> ledgerList.add(ledgerId + ":" + baseOffset));
+    }
+
+    /**
+     * Records the lowest and highest entry timestamps of a sealed ledger,
+     * storing it as "ledgerId:baseOffset:minTimestamp:maxTimestamp".
+     *
+     * @param topic        The topic name.
+     * @param partition    The partition number.
+     * @param ledgerId     The ledger ID.
+     * @param minTimestamp The lowest entry timestamp of the ledger.
+     * @param maxTimestamp The highest entry timestamp of the ledger.
+     * @throws Exception If an error occurs while updating the ledger list.
+     */
+    public void setLedgerTimestamps(String topic, int partition, long ledgerId, long minTimestamp, long maxTimestamp)
+            throws Exception {
+        updateLedgerList(topic, partition, ledgerList -> {
+            for (int i = 0; i < ledgerList.size(); i++) {
+                String[] fields = ledgerList.get(i).split(":");
+                if (Long.parseLong(fields[0]) == ledgerId) {
+                    String baseOffset = fields.length > 1 ? fields[1] : "-1";
+                    ledgerList.set(i, ledgerId + ":" + baseOffset + ":" + minTimestamp + ":" + maxTimestamp);
+                }
+            }
+        });
+    }
+
+    /**
+     * Applies a change to the ledger list of a topic partition. Brokers handing a
+     * partition over update the list concurrently, so the write is conditional on
+     * the version read and retried if another write came first.
+     */
+    private void updateLedgerList(String topic, int partition, Consumer<List<String>> update) throws Exception {
         String path = "/topics/" + topic + "/partitions/" + partition + "/ledgers";
         ensurePathExists(path);
 
-        // Fetch existing ledgers
-        byte[] data = zk.getData(path, false, null);
-        String currentLedgers = (data != null) ? new String(data, StandardCharsets.UTF_8) : "";
-        List<String> ledgerList = new ArrayList<>(Arrays.asList(currentLedgers.split(",")));
+        while (true) {
+            Stat stat = new Stat();
+            List<String> ledgerList = readLedgerList(zk.getData(path, false, stat));
+            update.accept(ledgerList);
+            try {
+                zk.setData(path, String.join(",", ledgerList).getBytes(StandardCharsets.UTF_8), stat.getVersion());
+                return;
+            } catch (KeeperException.BadVersionException e) {
+                // Another broker changed the list; apply the change to its version
+            }
+        }
+    }
 
-        // Add new ledger and update ZooKeeper
-        ledgerList.add(String.valueOf(ledgerId));
-        zk.setData(path, String.join(",", ledgerList).getBytes(StandardCharsets.UTF_8), -1);
+    private static List<String> readLedgerList(byte[] data) {
+        List<String> ledgerList = new ArrayList<>();
+        if (data == null) {
+            return ledgerList;
+        }
+        for (String ledger : new String(data, StandardCharsets.UTF_8).split(",")) {
+            if (!ledger.isEmpty()) {
+                ledgerList.add(ledger);
+            }
+        }
+        return ledgerList;
     }
 
     /**
-     * Retrieves the list of ledger IDs for a topic partition.
+     * Retrieves the ledgers of a topic partition with the base offset of each.
+     * Ledgers recorded before base offsets were stored map to -1.
      *
      * @param topic     The topic name.
      * @param partition The partition number.
-     * @return A list of ledger IDs.
+     * @return Ledger IDs mapped to base offsets, in creation order.
      * @throws Exception If an error occurs while fetching the ledgers.
      */
-    public List<Long> getPartitionLedgers(String topic, int partition) throws Exception {
+    public LinkedHashMap<Long, Long> getPartitionLedgerBaseOffsets(String topic, int partition) throws Exception {
+        LinkedHashMap<Long, Long> ledgers = new LinkedHashMap<>();
+        for (String[] fields : getPartitionLedgerFields(topic, partition)) {
+            ledgers.put(Long.parseLong(fields[0]), fields.length > 1 ? Long.parseLong(fields[1]) : -1L);
+        }
+        return ledgers;
+    }
+
+    /**
+     * Retrieves the lowest and highest entry timestamps of the sealed ledgers of
+     * a topic partition. Ledgers sealed before timestamps were stored, and the
+     * active ledger, are missing.
+     *
+     * @param topic     The topic name.
+     * @param partition The partition number.
+     * @return Ledger IDs mapped to {minTimestamp, maxTimestamp}.
+     * @throws Exception If an error occurs while fetching the ledgers.
+     */
+    public Map<Long, long[]> getPartitionLedgerTimestamps(String topic, int partition) throws Exception {
+        Map<Long, long[]> timestamps = new HashMap<>();
+        for (String[] fields : getPartitionLedgerFields(topic, partition)) {
+            if (fields.length == 4) {
+                timestamps.put(Long.parseLong(fields[0]), new long[] {Long.parseLong(fields[2]), Long.parseLong(fields[3])});
+            }
+        }
+        return timestamps;
+    }
+
+    private List<String[]> getPartitionLedgerFields(String topic, int partition) throws Exception {
         String path = "/topics/" + topic + "/partitions/" + partition + "/ledgers";
         ensurePathExists(path);
 
-        byte[] data = zk.getData(path, false, null);
-        if (data == null || data.length == 0) {
-            return new ArrayList<>();
+        List<String[]> ledgers = new ArrayList<>();
+        for (String ledger : readLedgerList(zk.getData(path, false, null))) {
+            ledgers.add(ledger.split(":"));
         }
+        return ledgers;
+    }
 
-        String ledgers = new String(data, StandardCharsets.UTF_8);
-        List<Long> ledgerIds = new ArrayList<>();
-        for (String ledgerId : ledgers.split(",")) {
-            if (!ledgerId.isEmpty()) {
-                ledgerIds.add(Long.parseLong(ledgerId));
-            }
+    /**
+     * Stores the entry index of a sealed ledger, as encoded by
+     * PartitionLedgerIndex.EntryIndex, so other brokers need not scan the ledger.
+     *
+     * @param topic      The topic name.
+     * @param partition  The partition number.
+     * @param ledgerId   The ledger ID.
+     * @param entryIndex The encoded entry index.
+     * @throws Exception If an error occurs while storing the index.
+     */
+    public void setLedgerEntryIndex(String topic, int partition, long ledgerId, String entryIndex) throws Exception {
+        String path = "/topics/" + topic + "/partitions/" + partition + "/ledger_indexes/" + ledgerId;
+        ensurePathExists(path);
+        zk.setData(path, entryIndex.getBytes(StandardCharsets.UTF_8), -1);
+    }
+
+    /**
+     * Retrieves the stored entry index of a ledger.
+     *
+     * @param topic     The topic name.
+     * @param partition The partition number.
+     * @param ledgerId  The ledger ID.
+     * @return The encoded entry index, or null if none was stored.
+     * @throws Exception If an error occurs while fetching the index.
+     */
+    public String getLedgerEntryIndex(String topic, int partition, long ledgerId) throws Exception {
+        String path = "/topics/" + topic + "/partitions/" + partition + "/ledger_indexes/" + ledgerId;
+        if (zk.exists(path, false) == null) {
+            return null;
         }
-        return ledgerIds;
+        byte[] data = zk.getData(path, false, null);
+        return (data == null || data.length == 0) ? null : new String(data, StandardCharsets.UTF_8);
     }
 
     // ---------------------------------- Logical Offset Management ---------------------------------- //
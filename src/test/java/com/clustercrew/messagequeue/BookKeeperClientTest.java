@@ -0,0 +1,96 @@
+package com.clustercrew.messagequeue;
+
+import com.clustercrew.messagequeue.MessageQueueOuterClass.Message;
+import com.google.protobuf.ByteString;
+
+import org.junit.Test;
+
+import static org.junit.Assert.*;
+
+import java.util.ArrayList;
+import java.util.List;
+
+public class BookKeeperClientTest {
+
+    private static byte[] batch(long baseOffset, String... values) {
+        List<Message> messages = new ArrayList<>();
+        for (String value : values) {
+            messages.add(Message.newBuilder().setValue(ByteString.copyFromUtf8(value)).setTimestamp(1000).build());
+        }
+        byte[] batch = RecordBatch.fromMessages("orders", 0, messages);
+        RecordBatch.setBaseOffset(batch, baseOffset);
+        return batch;
+    }
+
+    @Test
+    public void testToRecordBatchesReadsSingleAndMultiBatchEntries() {
+        byte[] first = batch(0, "a", "b");
+        byte[] second = batch(2, "c");
+
+        List<byte[]> single = BookKeeperClient.toRecordBatches(RecordBatch.toEntry(List.of(first)));
+        assertEquals(1, single.size());
+        assertArrayEquals(first, single.get(0));
+
+        List<byte[]> multi = BookKeeperClient.toRecordBatches(RecordBatch.toEntry(List.of(first, second)));
+        assertEquals(2, multi.size());
+        assertArrayEquals(second, multi.get(1));
+    }
+
+    @Test
+    public void testToRecordBatchesRejectsLegacyMessageEntry() {
+        // Ledgers written before record batches hold one serialized Message per entry
+        byte[] legacy = Message.newBuilder()
+                .setKey(ByteString.copyFromUtf8("key"))
+                .setValue(ByteString.copyFromUtf8("value"))
+                .setTopic("orders")
+                .setOffset(42)
+                .setTimestamp(1000)
+                .build()
+                .toByteArray();
+
+        assertNull(BookKeeperClient.toRecordBatches(legacy));
+        assertNull(BookKeeperClient.toRecordBatches(new byte[0]));
+    }
+
+    @Test
+    public void testFromLegacyEntryReadsMessageAtItsOffset() {
+        byte[] legacy = Message.newBuilder()
+                .setKey(ByteString.copyFromUtf8("key"))
+                .setValue(ByteString.copyFromUtf8("value"))
+                .setTopic("orders")
+                .setOffset(42)
+                .setTimestamp(1000)
+                .build()
+                .toByteArray();
+
+        // The offset comes from the entry's position, not the one stored in the message
+        byte[] batch = BookKeeperClient.fromLegacyEntry("orders", 0, legacy, 7);
+        assertTrue(RecordBatch.isValid(batch));
+        assertEquals(7, RecordBatch.getBaseOffset(batch));
+        assertEquals(8, RecordBatch.getEndOffset(batch));
+
+        List<Message> messages = RecordBatch.toMessages(batch);
+        assertEquals(1, messages.size());
+        assertEquals(7, messages.get(0).getOffset());
+        assertEquals(1000, messages.get(0).getTimestamp());
+        assertEquals("key", messages.get(0).getKey().toStringUtf8());
+        assertEquals("value", messages.get(0).getValue().toStringUtf8());
+    }
+
+    @Test
+    public void testToRecordBatchesRejectsCorruptBatch() {
+        byte[] first = batch(0, "a");
+        byte[] second = batch(1, "b");
+        second[second.length - 1] ^= 0x01;
+
+        assertNull(BookKeeperClient.toRecordBatches(RecordBatch.toEntry(List.of(first, second))));
+    }
+
+    @Test
+    public void testToRecordBatchesRejectsBadBatchLength() {
+        byte[] entry = RecordBatch.toEntry(List.of(batch(0, "a"), batch(1, "b")));
+        entry[1] = 0x7f;
+
+        assertNull(BookKeeperClient.toRecordBatches(entry));
+    }
+}
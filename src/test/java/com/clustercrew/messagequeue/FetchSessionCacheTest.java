@@ -0,0 +1,162 @@
+package com.clustercrew.messagequeue;
+
+import com.clustercrew.messagequeue.MessageQueueOuterClass.Message;
+import com.google.protobuf.ByteString;
+
+import org.junit.Test;
+
+import static org.junit.Assert.*;
+
+import java.util.ArrayList;
+import java.util.List;
+import java.util.concurrent.atomic.AtomicLong;
+
+public class FetchSessionCacheTest {
+
+    private static byte[] batch(long baseOffset, int records) {
+        List<Message> messages = new ArrayList<>();
+        for (int i = 0; i < records; i++) {
+            messages.add(Message.newBuilder().setValue(ByteString.copyFromUtf8("v" + i)).setTimestamp(1000).build());
+        }
+        byte[] batch = RecordBatch.fromMessages("orders", 0, messages);
+        RecordBatch.setBaseOffset(batch, baseOffset);
+        return batch;
+    }
+
+    private static FetchSessionCache.PartitionState state(long fetchOffset, int maxBytes) {
+        return new FetchSessionCache.PartitionState("orders", 0, fetchOffset, maxBytes, 0);
+    }
+
+    @Test
+    public void testCreateAndGet() {
+        FetchSessionCache cache = new FetchSessionCache();
+        FetchSessionCache.FetchSession first = cache.create();
+        FetchSessionCache.FetchSession second = cache.create();
+
+        assertNotEquals(first.getId(), second.getId());
+        assertEquals(0, first.getEpoch());
+        assertSame(first, cache.get(first.getId()));
+        assertNull(cache.get(12345));
+    }
+
+    @Test
+    public void testEpochMustAdvanceByOne() {
+        FetchSessionCache.FetchSession session = new FetchSessionCache().create();
+
+        assertTrue(session.advanceEpoch(1));
+        assertEquals(1, session.getEpoch());
+        // A replayed or skipped request is out of step and leaves the epoch alone
+        assertFalse(session.advanceEpoch(1));
+        assertFalse(session.advanceEpoch(3));
+        assertEquals(1, session.getEpoch());
+        assertTrue(session.advanceEpoch(2));
+    }
+
+    @Test
+    public void testIdleSessionIsEvicted() {
+        AtomicLong now = new AtomicLong(0);
+        FetchSessionCache cache = new FetchSessionCache(now::get, 1000, 10);
+        FetchSessionCache.FetchSession idle = cache.create();
+
+        now.set(2000);
+        FetchSessionCache.FetchSession fresh = cache.create();
+
+        assertNull(cache.get(idle.getId()));
+        assertSame(fresh, cache.get(fresh.getId()));
+    }
+
+    @Test
+    public void testUsedSessionIsNotIdle() {
+        AtomicLong now = new AtomicLong(0);
+        FetchSessionCache cache = new FetchSessionCache(now::get, 1000, 10);
+        FetchSessionCache.FetchSession session = cache.create();
+
+        now.set(900);
+        cache.get(session.getId());
+        now.set(1500);
+        cache.create();
+
+        assertSame(session, cache.get(session.getId()));
+    }
+
+    @Test
+    public void testLeastRecentlyUsedSessionIsEvictedWhenFull() {
+        FetchSessionCache cache = new FetchSessionCache(() -> 0, 1000, 2);
+        FetchSessionCache.FetchSession first = cache.create();
+        FetchSessionCache.FetchSession second = cache.create();
+        cache.get(first.getId());
+
+        cache.create();
+
+        assertNull(cache.get(second.getId()));
+        assertSame(first, cache.get(first.getId()));
+    }
+
+    @Test
+    public void testUpdateAddsReplacesAndRemovesPartitions() {
+        FetchSessionCache.FetchSession session = new FetchSessionCache().create();
+        session.update("orders", 0, 10, 0, 0, false);
+        session.update("orders", 1, 20, 0, 0, false);
+        session.update("payments", 0, 30, 0, 0, false);
+
+        // A repositioned partition keeps its place
+        session.update("orders", 0, 15, 0, 0, false);
+        session.update("orders", 1, 0, 0, 0, true);
+        // Removing a partition the session does not hold is harmless
+        session.update("orders", 7, 0, 0, 0, true);
+
+        List<FetchSessionCache.PartitionState> partitions = session.getPartitions();
+        assertEquals(2, partitions.size());
+        assertEquals("orders", partitions.get(0).topic);
+        assertEquals(15, partitions.get(0).fetchOffset);
+        assertEquals("payments", partitions.get(1).topic);
+        assertEquals(30, partitions.get(1).fetchOffset);
+    }
+
+    @Test
+    public void testServeAdvancesFetchOffsetPastDeliveredRecords() {
+        FetchSessionCache.PartitionState state = state(3, 0);
+
+        // The first batch begins before the fetch offset; its earlier records are not delivered
+        List<byte[]> kept = state.serve(List.of(batch(0, 5), batch(5, 5)), 3, 100);
+
+        assertEquals(2, kept.size());
+        assertEquals(10, state.fetchOffset);
+    }
+
+    @Test
+    public void testServeCapsDeliveredRecords() {
+        FetchSessionCache.PartitionState state = state(3, 0);
+        state.serve(List.of(batch(0, 5), batch(5, 5)), 3, 4);
+        assertEquals(7, state.fetchOffset);
+    }
+
+    @Test
+    public void testServeStopsAtByteLimit() {
+        byte[] first = batch(0, 5);
+        FetchSessionCache.PartitionState state = state(0, first.length);
+
+        List<byte[]> kept = state.serve(List.of(first, batch(5, 5)), 0, 100);
+
+        assertEquals(1, kept.size());
+        assertEquals(5, state.fetchOffset);
+    }
+
+    @Test
+    public void testServeAlwaysReturnsFirstBatch() {
+        FetchSessionCache.PartitionState state = state(0, 1);
+
+        List<byte[]> kept = state.serve(List.of(batch(0, 5)), 0, 100);
+
+        assertEquals(1, kept.size());
+        assertEquals(5, state.fetchOffset);
+    }
+
+    @Test
+    public void testServeWithoutDataKeepsFetchOffset() {
+        FetchSessionCache.PartitionState state = state(42, 0);
+
+        assertTrue(state.serve(List.of(), 42, 100).isEmpty());
+        assertEquals(42, state.fetchOffset);
+    }
+}
@@ -0,0 +1,255 @@
+package com.clustercrew.messagequeue;
+
+import org.junit.Test;
+
+import static org.junit.Assert.*;
+
+import java.util.List;
+
+public class PartitionLedgerIndexTest {
+
+    private static PartitionLedgerIndex.EntryIndex entryIndex(long[] baseOffsets, long[] maxTimestamps) {
+        PartitionLedgerIndex.EntryIndex index = new PartitionLedgerIndex.EntryIndex();
+        for (int i = 0; i < baseOffsets.length; i++) {
+            index.append(i, baseOffsets[i], maxTimestamps[i]);
+        }
+        return index;
+    }
+
+    @Test
+    public void testLedgersFromOffset() {
+        PartitionLedgerIndex index = new PartitionLedgerIndex();
+        index.addLedger(10, 0);
+        index.addLedger(11, 100);
+        index.addLedger(12, 250);
+
+        assertEquals(List.of(10L, 11L, 12L), index.ledgersFrom(0));
+        assertEquals(List.of(10L, 11L, 12L), index.ledgersFrom(99));
+        assertEquals(List.of(11L, 12L), index.ledgersFrom(100));
+        assertEquals(List.of(12L), index.ledgersFrom(1000));
+    }
+
+    @Test
+    public void testOffsetBeforeFirstLedgerReturnsAll() {
+        PartitionLedgerIndex index = new PartitionLedgerIndex();
+        index.addLedger(11, 100);
+        index.addLedger(12, 250);
+
+        assertEquals(List.of(11L, 12L), index.ledgersFrom(5));
+    }
+
+    @Test
+    public void testEmptyLedgerIsReplacedBySuccessor() {
+        PartitionLedgerIndex index = new PartitionLedgerIndex();
+        index.addLedger(10, 0);
+        index.addLedger(11, 100);
+        // Ledger 11 was rolled before it took any record
+        index.addLedger(12, 100);
+
+        assertEquals(List.of(10L, 12L), index.ledgersAscending());
+        assertEquals(List.of(12L, 10L), index.ledgersDescending());
+        assertEquals(List.of(12L), index.ledgersFrom(100));
+    }
+
+    @Test
+    public void testLegacyLedgersPrecedeBatchLedgers() {
+        PartitionLedgerIndex index = new PartitionLedgerIndex();
+        index.addLegacyLedger(10, 0);
+        index.addLegacyLedger(11, 40);
+        index.addLedger(12, 55);
+
+        assertEquals(List.of(10L, 11L, 12L), index.ledgersAscending());
+        assertEquals(List.of(11L, 12L), index.ledgersFrom(50));
+        assertEquals(0, index.getLegacyBaseOffset(10));
+        assertEquals(40, index.getLegacyBaseOffset(11));
+        assertEquals(-1, index.getLegacyBaseOffset(12));
+    }
+
+    @Test
+    public void testEmptyIndex() {
+        PartitionLedgerIndex index = new PartitionLedgerIndex();
+        assertTrue(index.ledgersFrom(0).isEmpty());
+        assertTrue(index.ledgersAscending().isEmpty());
+        assertNull(index.getEntryIndex(10));
+    }
+
+    @Test
+    public void testPutEntryIndexIfAbsentKeepsFirst() {
+        PartitionLedgerIndex index = new PartitionLedgerIndex();
+        PartitionLedgerIndex.EntryIndex first = new PartitionLedgerIndex.EntryIndex();
+        PartitionLedgerIndex.EntryIndex second = new PartitionLedgerIndex.EntryIndex();
+
+        assertSame(first, index.putEntryIndexIfAbsent(10, first));
+        assertSame(first, index.putEntryIndexIfAbsent(10, second));
+        assertSame(first, index.getEntryIndex(10));
+    }
+
+    @Test
+    public void testFloorEntry() {
+        PartitionLedgerIndex.EntryIndex index = entryIndex(new long[] {100, 110, 110, 140}, new long[] {1, 2, 3, 4});
+
+        assertEquals(0, index.floorEntry(50));
+        assertEquals(0, index.floorEntry(100));
+        assertEquals(0, index.floorEntry(109));
+        assertEquals(2, index.floorEntry(110));
+        assertEquals(2, index.floorEntry(139));
+        assertEquals(3, index.floorEntry(1000));
+    }
+
+    @Test
+    public void testFloorEntryOfEmptyIndex() {
+        assertEquals(0, new PartitionLedgerIndex.EntryIndex().floorEntry(100));
+    }
+
+    @Test
+    public void testFirstEntryReachingUsesRunningMaximum() {
+        // The third entry's timestamp is lower than the second's, so the running maximum holds at 500
+        PartitionLedgerIndex.EntryIndex index = entryIndex(new long[] {0, 10, 20, 30}, new long[] {100, 500, 200, 700});
+
+        assertEquals(0, index.firstEntryReaching(50));
+        assertEquals(0, index.firstEntryReaching(100));
+        assertEquals(1, index.firstEntryReaching(150));
+        assertEquals(1, index.firstEntryReaching(500));
+        assertEquals(3, index.firstEntryReaching(600));
+        assertEquals(4, index.firstEntryReaching(701));
+    }
+
+    @Test
+    public void testEntryIndexGrowsPastInitialCapacity() {
+        PartitionLedgerIndex.EntryIndex index = new PartitionLedgerIndex.EntryIndex();
+        for (int i = 0; i < 1000; i++) {
+            index.append(i, 10L * i, i);
+        }
+
+        assertEquals(1000, index.size());
+        assertEquals(500, index.floorEntry(5005));
+        assertEquals(999, index.firstEntryReaching(999));
+    }
+
+    private static PartitionLedgerIndex.EntryIndex tenEntries() {
+        // Entry i starts at offset 10 * i with timestamp 100 * i
+        PartitionLedgerIndex.EntryIndex index = new PartitionLedgerIndex.EntryIndex();
+        for (int i = 0; i < 10; i++) {
+            index.append(i, 10L * i, 100L * i);
+        }
+        return index;
+    }
+
+    @Test
+    public void testSparseIndexReturnsBlockStarts() {
+        PartitionLedgerIndex.EntryIndex sparse = tenEntries().toSparse(4);
+
+        assertEquals(3, sparse.stride());
+        assertEquals(10, sparse.size());
+        assertEquals(0, sparse.floorEntry(0));
+        assertEquals(0, sparse.floorEntry(29));
+        assertEquals(3, sparse.floorEntry(45));
+        assertEquals(9, sparse.floorEntry(1000));
+        assertEquals(5, sparse.blockEnd(3));
+        assertEquals(5, sparse.blockEnd(4));
+        assertEquals(9, sparse.blockEnd(9));
+    }
+
+    @Test
+    public void testSparseIndexTimestampsCoverWholeBlocks() {
+        PartitionLedgerIndex.EntryIndex sparse = tenEntries().toSparse(4);
+
+        assertEquals(0, sparse.firstEntryReaching(50));
+        assertEquals(0, sparse.firstEntryReaching(200));
+        // Entry 3 first reaches 250; its block starts at entry 3
+        assertEquals(3, sparse.firstEntryReaching(250));
+        assertEquals(9, sparse.firstEntryReaching(900));
+        assertEquals(10, sparse.firstEntryReaching(901));
+    }
+
+    @Test
+    public void testSmallIndexStaysDense() {
+        PartitionLedgerIndex.EntryIndex sparse = tenEntries().toSparse(4096);
+
+        assertEquals(1, sparse.stride());
+        assertEquals(4, sparse.floorEntry(45));
+        assertEquals(4, sparse.blockEnd(4));
+    }
+
+    @Test
+    public void testEncodeDecodeRoundTrip() {
+        PartitionLedgerIndex.EntryIndex sparse = tenEntries().toSparse(4);
+        assertEquals("3:10:0,0:200,30:500,60:800,90:900", sparse.encode());
+
+        PartitionLedgerIndex.EntryIndex decoded = PartitionLedgerIndex.EntryIndex.decode(sparse.encode());
+        assertNotNull(decoded);
+        assertEquals(sparse.encode(), decoded.encode());
+        assertEquals(3, decoded.floorEntry(45));
+        assertEquals(3, decoded.firstEntryReaching(250));
+        assertEquals(0, decoded.minTimestamp());
+        assertEquals(900, decoded.maxTimestamp());
+
+        String empty = new PartitionLedgerIndex.EntryIndex().encode();
+        assertEquals(0, PartitionLedgerIndex.EntryIndex.decode(empty).size());
+    }
+
+    @Test
+    public void testDecodeRejectsMalformedIndex() {
+        assertNull(PartitionLedgerIndex.EntryIndex.decode(""));
+        assertNull(PartitionLedgerIndex.EntryIndex.decode("3:10"));
+        assertNull(PartitionLedgerIndex.EntryIndex.decode("0:0:0"));
+        // Points do not match the entry count
+        assertNull(PartitionLedgerIndex.EntryIndex.decode("3:11:0,0:200"));
+        assertNull(PartitionLedgerIndex.EntryIndex.decode("1:1:0,x:200"));
+    }
+
+    @Test
+    public void testEntryTimestampBounds() {
+        PartitionLedgerIndex.EntryIndex index = entryIndex(new long[] {0, 10, 20}, new long[] {300, 100, 200});
+
+        assertEquals(100, index.minTimestamp());
+        assertEquals(300, index.maxTimestamp());
+        assertEquals(Long.MAX_VALUE, new PartitionLedgerIndex.EntryIndex().minTimestamp());
+        assertEquals(Long.MIN_VALUE, new PartitionLedgerIndex.EntryIndex().maxTimestamp());
+    }
+
+    @Test
+    public void testFirstLedgerReachingSearchesSealedLedgerTimestamps() {
+        PartitionLedgerIndex index = new PartitionLedgerIndex();
+        index.addLedger(10, 0);
+        index.addLedger(11, 100);
+        index.addLedger(12, 200);
+        index.setLedgerTimestamps(10, 1000, 2000);
+        // Out of order: ledger 11 holds nothing later than ledger 10
+        index.setLedgerTimestamps(11, 1500, 1800);
+        index.setLedgerTimestamps(12, 2500, 3000);
+
+        assertEquals(0, index.firstLedgerReaching(500));
+        assertEquals(0, index.firstLedgerReaching(2000));
+        assertEquals(2, index.firstLedgerReaching(2001));
+        assertEquals(3, index.firstLedgerReaching(3001));
+    }
+
+    @Test
+    public void testLedgerWithUnknownTimestampsMayReachAnyTime() {
+        PartitionLedgerIndex index = new PartitionLedgerIndex();
+        index.addLedger(10, 0);
+        index.setLedgerTimestamps(10, 1000, 2000);
+        // The active ledger has no timestamps yet
+        index.addLedger(11, 100);
+
+        assertEquals(Long.MAX_VALUE, index.getMaxTimestamp(11));
+        assertEquals(Long.MIN_VALUE, index.getMinTimestamp(11));
+        assertEquals(1, index.firstLedgerReaching(5000));
+
+        index.setLedgerTimestamps(11, 2100, 2200);
+        assertEquals(2, index.firstLedgerReaching(5000));
+    }
+
+    @Test(expected = IllegalStateException.class)
+    public void testAppendToSparseIndexThrows() {
+        tenEntries().toSparse(4).append(10, 100, 1000);
+    }
+
+    @Test(expected = IllegalStateException.class)
+    public void testAppendOutOfOrderThrows() {
+        PartitionLedgerIndex.EntryIndex index = new PartitionLedgerIndex.EntryIndex();
+        index.append(0, 0, 0);
+        index.append(2, 10, 0);
+    }
+}
@@ -0,0 +1,106 @@
+package com.clustercrew.messagequeue;
+
+import com.clustercrew.messagequeue.MessageQueueOuterClass.Message;
+import com.google.protobuf.ByteString;
+
+import org.junit.Test;
+
+import static org.junit.Assert.*;
+
+import java.util.ArrayList;
+import java.util.List;
+
+public class PartitionTailCacheTest {
+
+    private static byte[] batch(long baseOffset, int records, int valueBytes) {
+        List<Message> messages = new ArrayList<>();
+        for (int i = 0; i < records; i++) {
+            messages.add(Message.newBuilder()
+                    .setValue(ByteString.copyFrom(new byte[valueBytes]))
+                    .setTimestamp(1000 + i)
+                    .build());
+        }
+        byte[] batch = RecordBatch.fromMessages("orders", 0, messages);
+        RecordBatch.setBaseOffset(batch, baseOffset);
+        return batch;
+    }
+
+    private static List<Long> baseOffsets(List<byte[]> batches) {
+        List<Long> offsets = new ArrayList<>();
+        for (byte[] batch : batches) {
+            offsets.add(RecordBatch.getBaseOffset(batch));
+        }
+        return offsets;
+    }
+
+    @Test
+    public void testReadsFromBatchContainingOffset() {
+        PartitionTailCache cache = new PartitionTailCache(1 << 20, 100);
+        cache.append(batch(100, 5, 10));
+        cache.append(batch(105, 5, 10));
+        cache.append(batch(110, 5, 10));
+
+        assertEquals(List.of(100L, 105L, 110L), baseOffsets(cache.read(100, 100)));
+        assertEquals(List.of(105L, 110L), baseOffsets(cache.read(107, 100)));
+        assertEquals(List.of(110L), baseOffsets(cache.read(114, 100)));
+    }
+
+    @Test
+    public void testReadAtOrPastEndIsEmpty() {
+        PartitionTailCache cache = new PartitionTailCache(1 << 20, 100);
+        assertTrue(cache.read(100, 10).isEmpty());
+
+        cache.append(batch(100, 5, 10));
+        assertTrue(cache.read(105, 10).isEmpty());
+        assertTrue(cache.read(200, 10).isEmpty());
+    }
+
+    @Test
+    public void testReadBeforeStartMisses() {
+        PartitionTailCache cache = new PartitionTailCache(1 << 20, 100);
+        cache.append(batch(100, 5, 10));
+
+        assertNull(cache.read(99, 10));
+    }
+
+    @Test
+    public void testReadStopsOnceMaxMessagesAreCovered() {
+        PartitionTailCache cache = new PartitionTailCache(1 << 20, 100);
+        cache.append(batch(100, 5, 10));
+        cache.append(batch(105, 5, 10));
+        cache.append(batch(110, 5, 10));
+
+        // Records 103-104 of the first batch and 105-107 of the second
+        assertEquals(List.of(100L, 105L), baseOffsets(cache.read(103, 5)));
+        assertEquals(List.of(100L, 105L), baseOffsets(cache.read(103, 7)));
+        assertEquals(List.of(100L, 105L, 110L), baseOffsets(cache.read(103, 8)));
+    }
+
+    @Test
+    public void testEvictsOldestBatchesByBytes() {
+        byte[] first = batch(100, 5, 100);
+        PartitionTailCache cache = new PartitionTailCache(2L * first.length, 100);
+        cache.append(first);
+        cache.append(batch(105, 5, 100));
+        cache.append(batch(110, 5, 100));
+
+        assertNull(cache.read(104, 10));
+        assertEquals(List.of(105L, 110L), baseOffsets(cache.read(105, 10)));
+    }
+
+    @Test
+    public void testOversizedBatchEmptiesCache() {
+        byte[] small = batch(100, 1, 10);
+        PartitionTailCache cache = new PartitionTailCache(small.length * 2L, 100);
+        cache.append(small);
+        cache.append(batch(101, 5, 1000));
+
+        // Nothing before the oversized batch's end is cached any more
+        assertNull(cache.read(100, 10));
+        assertNull(cache.read(101, 10));
+        assertTrue(cache.read(106, 10).isEmpty());
+
+        cache.append(batch(106, 1, 10));
+        assertEquals(List.of(106L), baseOffsets(cache.read(106, 10)));
+    }
+}
@@ -0,0 +1,268 @@
+package com.clustercrew.messagequeue;
+
+import com.clustercrew.messagequeue.MessageQueueOuterClass.Message;
+import com.clustercrew.messagequeue.MessageQueueOuterClass.MessageHeader;
+import com.clustercrew.messagequeue.MessageQueueOuterClass.RecordFilter;
+import com.google.protobuf.ByteString;
+
+import org.junit.Test;
+
+import static org.junit.Assert.*;
+
+import java.io.IOException;
+import java.nio.charset.StandardCharsets;
+import java.nio.file.Files;
+import java.nio.file.Paths;
+import java.util.Arrays;
+import java.util.List;
+
+public class RecordBatchTest {
+
+    // Shared with the C++ record_batch_test, so both codecs are held to the same bytes
+    private static final String FIXTURE = "test/fixtures/record_batch.hex";
+
+    private static byte[] readFixture() throws IOException {
+        String hex = new String(Files.readAllBytes(Paths.get(FIXTURE)), StandardCharsets.US_ASCII).trim();
+        byte[] bytes = new byte[hex.length() / 2];
+        for (int i = 0; i < bytes.length; i++) {
+            bytes[i] = (byte) Integer.parseInt(hex.substring(2 * i, 2 * i + 2), 16);
+        }
+        return bytes;
+    }
+
+    private static Message message(byte[] key, byte[] value, long timestamp, String... headers) {
+        Message.Builder message = Message.newBuilder()
+                .setKey(ByteString.copyFrom(key))
+                .setValue(ByteString.copyFrom(value))
+                .setTimestamp(timestamp);
+        for (int i = 0; i < headers.length; i += 2) {
+            message.addHeaders(MessageHeader.newBuilder()
+                    .setKey(headers[i])
+                    .setValue(ByteString.copyFrom(headers[i + 1], StandardCharsets.ISO_8859_1)));
+        }
+        return message.build();
+    }
+
+    private static byte[] bytes(String s) {
+        return s.getBytes(StandardCharsets.ISO_8859_1);
+    }
+
+    // The records of the fixture: binary keys and values, headers, a multi-byte partition varint,
+    // a negative timestamp delta and a value with a two-byte length
+    private static List<Message> fixtureMessages() {
+        byte[] large = new byte[200];
+        Arrays.fill(large, (byte) 'z');
+        return List.of(
+                message(bytes("k1"), new byte[] {0x00, (byte) 0xff, 0x7f}, 1700000000000L, "trace", "\u0001\u0002"),
+                message(new byte[0], bytes("v2"), 1699999999000L),
+                message(bytes("k3"), large, 1700000005000L, "a", "", "b", "bee"));
+    }
+
+    @Test
+    public void testFromMessagesMatchesFixture() throws IOException {
+        assertArrayEquals(readFixture(), RecordBatch.fromMessages("orders", 300, fixtureMessages()));
+    }
+
+    @Test
+    public void testFixtureHeader() throws IOException {
+        byte[] batch = readFixture();
+        assertTrue(RecordBatch.isValid(batch));
+        assertEquals(0, RecordBatch.getBaseOffset(batch));
+        assertEquals(1700000000000L, RecordBatch.getBaseTimestamp(batch));
+        assertEquals(3, RecordBatch.getRecordCount(batch));
+        assertEquals(2, RecordBatch.getLastOffsetDelta(batch));
+        assertEquals("orders", RecordBatch.getTopic(batch));
+        assertEquals(300, RecordBatch.getPartition(batch));
+    }
+
+    @Test
+    public void testToMessagesDecodesFixture() throws IOException {
+        byte[] batch = readFixture();
+        RecordBatch.setBaseOffset(batch, 1000);
+
+        List<Message> expected = fixtureMessages();
+        List<Message> messages = RecordBatch.toMessages(batch);
+        assertEquals(expected.size(), messages.size());
+        for (int i = 0; i < messages.size(); i++) {
+            Message message = messages.get(i);
+            assertEquals("orders", message.getTopic());
+            assertEquals(300, message.getPartition());
+            assertEquals(1000 + i, message.getOffset());
+            assertEquals(expected.get(i).getTimestamp(), message.getTimestamp());
+            assertEquals(expected.get(i).getKey(), message.getKey());
+            assertEquals(expected.get(i).getValue(), message.getValue());
+            assertEquals(expected.get(i).getHeadersList(), message.getHeadersList());
+        }
+    }
+
+    @Test
+    public void testSetBaseOffsetKeepsCrcValid() throws IOException {
+        byte[] batch = readFixture();
+        RecordBatch.setBaseOffset(batch, 0x0102030405060708L);
+
+        assertTrue(RecordBatch.isValid(batch));
+        assertEquals(0x0102030405060708L, RecordBatch.getBaseOffset(batch));
+        assertEquals(0x0102030405060708L + 3, RecordBatch.getEndOffset(batch));
+    }
+
+    @Test
+    public void testCorruptByteFailsCrc() throws IOException {
+        byte[] batch = readFixture();
+        // Every byte from the base timestamp on is covered by the CRC
+        for (int pos = 9; pos < batch.length; pos++) {
+            byte[] corrupt = batch.clone();
+            corrupt[pos] ^= 0x01;
+            assertFalse("byte " + pos, RecordBatch.isValid(corrupt));
+        }
+    }
+
+    @Test
+    public void testRejectsWrongMagicAndShortBatch() throws IOException {
+        byte[] batch = readFixture();
+        assertFalse(RecordBatch.isValid(Arrays.copyOf(batch, 28)));
+        batch[0] = RecordBatch.MULTI_BATCH_MAGIC;
+        assertFalse(RecordBatch.isValid(batch));
+    }
+
+    @Test
+    public void testEmptyBatchRoundTrips() {
+        byte[] batch = RecordBatch.fromMessages("orders", 0, List.of());
+        assertTrue(RecordBatch.isValid(batch));
+        assertEquals(0, RecordBatch.getRecordCount(batch));
+        assertEquals(-1, RecordBatch.getLastOffsetDelta(batch));
+        assertEquals(RecordBatch.getBaseOffset(batch), RecordBatch.getEndOffset(batch));
+        assertTrue(RecordBatch.toMessages(batch).isEmpty());
+    }
+
+    @Test
+    public void testSingleBatchEntryIsStoredAsIs() throws IOException {
+        byte[] batch = readFixture();
+        byte[] entry = RecordBatch.toEntry(List.of(batch));
+
+        assertArrayEquals(batch, entry);
+        List<byte[]> batches = RecordBatch.fromEntry(entry);
+        assertEquals(1, batches.size());
+        assertArrayEquals(batch, batches.get(0));
+    }
+
+    @Test
+    public void testMultiBatchEntryRoundTrips() throws IOException {
+        byte[] first = readFixture();
+        byte[] second = RecordBatch.fromMessages("orders", 300, fixtureMessages().subList(0, 1));
+        RecordBatch.setBaseOffset(second, 3);
+
+        byte[] entry = RecordBatch.toEntry(List.of(first, second));
+        assertEquals(RecordBatch.MULTI_BATCH_MAGIC, entry[0]);
+        assertEquals(1 + 4 + first.length + 4 + second.length, entry.length);
+
+        List<byte[]> batches = RecordBatch.fromEntry(entry);
+        assertEquals(2, batches.size());
+        assertArrayEquals(first, batches.get(0));
+        assertArrayEquals(second, batches.get(1));
+        assertEquals(1700000000000L, RecordBatch.getMaxBaseTimestamp(batches));
+    }
+
+    @Test(expected = IllegalArgumentException.class)
+    public void testMultiBatchEntryWithBadLengthThrows() throws IOException {
+        byte[] batch = readFixture();
+        byte[] entry = RecordBatch.toEntry(List.of(batch, batch));
+        // Claim more bytes for the second batch than the entry holds
+        int second = 1 + 4 + batch.length;
+        entry[second] = 0x00;
+        entry[second + 1] = 0x10;
+        RecordBatch.fromEntry(entry);
+    }
+
+    @Test(expected = IllegalArgumentException.class)
+    public void testMultiBatchEntryWithNegativeLengthThrows() throws IOException {
+        byte[] entry = RecordBatch.toEntry(List.of(readFixture(), readFixture()));
+        entry[1] = (byte) 0x80;
+        RecordBatch.fromEntry(entry);
+    }
+
+    private static RecordMatcher keyMatcher(String... keys) {
+        RecordFilter.Builder filter = RecordFilter.newBuilder();
+        for (String key : keys) {
+            filter.addKeys(ByteString.copyFrom(bytes(key)));
+        }
+        return RecordMatcher.of(filter.build());
+    }
+
+    @Test
+    public void testFilterKeepsMatchingRecords() throws IOException {
+        byte[] batch = readFixture();
+        RecordBatch.setBaseOffset(batch, 1000);
+
+        RecordBatch.FilterResult result = RecordBatch.filter(batch, 1000, 10, keyMatcher("k1", "k3"));
+        assertEquals(1003, result.nextOffset);
+        assertTrue(RecordBatch.isValid(result.batch));
+        assertEquals(2, RecordBatch.getRecordCount(result.batch));
+        assertEquals(1000, RecordBatch.getBaseOffset(result.batch));
+        assertEquals(RecordBatch.getBaseTimestamp(batch), RecordBatch.getBaseTimestamp(result.batch));
+
+        // Kept records keep their offsets and timestamps
+        List<Message> expected = fixtureMessages();
+        List<Message> kept = RecordBatch.toMessages(result.batch);
+        assertEquals(2, kept.size());
+        assertEquals(1000, kept.get(0).getOffset());
+        assertEquals(expected.get(0).getValue(), kept.get(0).getValue());
+        assertEquals(1002, kept.get(1).getOffset());
+        assertEquals(expected.get(2).getTimestamp(), kept.get(1).getTimestamp());
+        assertEquals(expected.get(2).getHeadersList(), kept.get(1).getHeadersList());
+    }
+
+    @Test
+    public void testFilterSkipsRecordsBeforeFromOffset() throws IOException {
+        byte[] batch = readFixture();
+        RecordBatch.setBaseOffset(batch, 1000);
+
+        RecordBatch.FilterResult result = RecordBatch.filter(batch, 1001, 10, keyMatcher("k1", "k3"));
+        List<Message> kept = RecordBatch.toMessages(result.batch);
+        assertEquals(1, kept.size());
+        assertEquals(1002, kept.get(0).getOffset());
+        assertEquals(1003, result.nextOffset);
+    }
+
+    @Test
+    public void testFilterStopsAtMaxRecords() throws IOException {
+        byte[] batch = readFixture();
+        RecordBatch.setBaseOffset(batch, 1000);
+
+        RecordBatch.FilterResult result = RecordBatch.filter(batch, 1000, 1, keyMatcher("k1", "k3"));
+        assertEquals(1, RecordBatch.getRecordCount(result.batch));
+        assertTrue(RecordBatch.isValid(result.batch));
+        // The next fetch resumes after the last record examined
+        assertEquals(1001, result.nextOffset);
+    }
+
+    @Test
+    public void testFilteredBatchEndsAfterLastKeptRecord() throws IOException {
+        byte[] batch = readFixture();
+        RecordBatch.setBaseOffset(batch, 1000);
+
+        // Only the first of three records is kept, so the batch ends at 1001, not base + record count
+        RecordBatch.FilterResult first = RecordBatch.filter(batch, 1000, 10, keyMatcher("k1"));
+        assertEquals(1, RecordBatch.getRecordCount(first.batch));
+        assertEquals(0, RecordBatch.getLastOffsetDelta(first.batch));
+        assertEquals(1001, RecordBatch.getEndOffset(first.batch));
+        assertEquals(1003, first.nextOffset);
+
+        // Two records with a gap between them end after the later one
+        RecordBatch.FilterResult sparse = RecordBatch.filter(batch, 1000, 10, keyMatcher("k1", "k3"));
+        assertEquals(2, RecordBatch.getRecordCount(sparse.batch));
+        assertEquals(1003, RecordBatch.getEndOffset(sparse.batch));
+
+        // The original batch still ends after all of its records
+        assertEquals(1003, RecordBatch.getEndOffset(batch));
+    }
+
+    @Test
+    public void testFilterWithNoMatchAdvancesPastBatch() throws IOException {
+        byte[] batch = readFixture();
+        RecordBatch.setBaseOffset(batch, 1000);
+
+        RecordBatch.FilterResult result = RecordBatch.filter(batch, 1000, 10, keyMatcher("missing"));
+        assertNull(result.batch);
+        assertEquals(1003, result.nextOffset);
+    }
+}
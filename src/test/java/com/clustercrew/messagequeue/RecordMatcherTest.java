@@ -0,0 +1,135 @@
+package com.clustercrew.messagequeue;
+
+import com.clustercrew.messagequeue.MessageQueueOuterClass.MessageHeader;
+import com.clustercrew.messagequeue.MessageQueueOuterClass.RecordFilter;
+import com.google.protobuf.ByteString;
+
+import org.junit.Test;
+
+import static org.junit.Assert.*;
+
+import java.nio.ByteBuffer;
+import java.nio.charset.StandardCharsets;
+import java.util.ArrayList;
+import java.util.List;
+
+public class RecordMatcherTest {
+
+    private static ByteBuffer buffer(String s) {
+        return ByteBuffer.wrap(s.getBytes(StandardCharsets.UTF_8));
+    }
+
+    // A view into a larger buffer, as RecordBatch.filter passes keys and headers
+    private static ByteBuffer slice(String s) {
+        ByteBuffer padded = buffer("##" + s + "##");
+        padded.position(2);
+        ByteBuffer slice = padded.slice();
+        slice.limit(s.length());
+        return slice;
+    }
+
+    private static List<ByteBuffer> headers(String... namesAndValues) {
+        List<ByteBuffer> headers = new ArrayList<>();
+        for (String s : namesAndValues) {
+            headers.add(slice(s));
+        }
+        return headers;
+    }
+
+    private static MessageHeader header(String name, String value) {
+        return MessageHeader.newBuilder().setKey(name).setValue(ByteString.copyFromUtf8(value)).build();
+    }
+
+    @Test
+    public void testEmptyFilterMatchesAll() {
+        assertNull(RecordMatcher.of(RecordFilter.getDefaultInstance()));
+    }
+
+    @Test
+    public void testKeyPrefix() {
+        RecordMatcher matcher = RecordMatcher.of(RecordFilter.newBuilder()
+                .setKeyPrefix(ByteString.copyFromUtf8("user-"))
+                .build());
+
+        assertTrue(matcher.matches(slice("user-42"), 0, headers()));
+        assertTrue(matcher.matches(slice("user-"), 0, headers()));
+        assertFalse(matcher.matches(slice("user"), 0, headers()));
+        assertFalse(matcher.matches(slice("order-1"), 0, headers()));
+    }
+
+    @Test
+    public void testKeySet() {
+        RecordMatcher matcher = RecordMatcher.of(RecordFilter.newBuilder()
+                .addKeys(ByteString.copyFromUtf8("a"))
+                .addKeys(ByteString.copyFromUtf8("b"))
+                .build());
+
+        assertTrue(matcher.matches(slice("a"), 0, headers()));
+        assertTrue(matcher.matches(slice("b"), 0, headers()));
+        assertFalse(matcher.matches(slice("ab"), 0, headers()));
+        assertFalse(matcher.matches(slice(""), 0, headers()));
+    }
+
+    @Test
+    public void testTimestampBoundsAreInclusive() {
+        RecordMatcher matcher = RecordMatcher.of(RecordFilter.newBuilder()
+                .setMinTimestamp(100)
+                .setMaxTimestamp(200)
+                .build());
+
+        assertFalse(matcher.matches(slice("k"), 99, headers()));
+        assertTrue(matcher.matches(slice("k"), 100, headers()));
+        assertTrue(matcher.matches(slice("k"), 200, headers()));
+        assertFalse(matcher.matches(slice("k"), 201, headers()));
+    }
+
+    @Test
+    public void testZeroMinTimestampIsACriterion() {
+        RecordMatcher matcher = RecordMatcher.of(RecordFilter.newBuilder().setMinTimestamp(0).build());
+
+        assertNotNull(matcher);
+        assertFalse(matcher.matches(slice("k"), -1, headers()));
+        assertTrue(matcher.matches(slice("k"), 0, headers()));
+    }
+
+    @Test
+    public void testEveryHeaderMustBePresent() {
+        RecordMatcher matcher = RecordMatcher.of(RecordFilter.newBuilder()
+                .addHeaders(header("region", "eu"))
+                .addHeaders(header("tier", "gold"))
+                .build());
+
+        assertTrue(matcher.matches(slice("k"), 0, headers("tier", "gold", "region", "eu")));
+        assertTrue(matcher.matches(slice("k"), 0, headers("region", "us", "region", "eu", "tier", "gold")));
+        assertFalse(matcher.matches(slice("k"), 0, headers("region", "eu")));
+        assertFalse(matcher.matches(slice("k"), 0, headers("region", "eu", "tier", "silver")));
+        // A name and value from different headers do not make a match
+        assertFalse(matcher.matches(slice("k"), 0, headers("region", "gold", "tier", "eu")));
+    }
+
+    @Test
+    public void testCriteriaCombine() {
+        RecordMatcher matcher = RecordMatcher.of(RecordFilter.newBuilder()
+                .setKeyPrefix(ByteString.copyFromUtf8("user-"))
+                .addHeaders(header("region", "eu"))
+                .setMinTimestamp(100)
+                .build());
+
+        assertTrue(matcher.matches(slice("user-1"), 100, headers("region", "eu")));
+        assertFalse(matcher.matches(slice("user-1"), 99, headers("region", "eu")));
+        assertFalse(matcher.matches(slice("order-1"), 100, headers("region", "eu")));
+        assertFalse(matcher.matches(slice("user-1"), 100, headers()));
+    }
+
+    @Test
+    public void testMatchingDoesNotMoveBuffers() {
+        RecordMatcher matcher = RecordMatcher.of(RecordFilter.newBuilder()
+                .setKeyPrefix(ByteString.copyFromUtf8("user-"))
+                .build());
+        ByteBuffer key = slice("user-1");
+
+        assertTrue(matcher.matches(key, 0, headers()));
+        assertEquals(0, key.position());
+        assertEquals(6, key.remaining());
+    }
+}
@@ -1,5 +1,8 @@
 #include "sys_admin.h"
 #include "router.h"
+#include <algorithm>
+#include <map>
+#include <set>
 #include <vector>
 #include <thread>
 #include <mutex>
@@ -11,8 +14,6 @@
 #include <grpcpp/grpcpp.h>
 #include "message_queue.grpc.pb.h"
 
-int total_partitions = 3;
-
 class SysAdmin::Impl {
 public:
     Impl(const std::vector<std::string>& bootstrap_servers)
@@ -20,7 +21,7 @@ public:
 
     ~Impl() = default;
 
-    bool shutdown(const std::string &broker_id) {
+    bool shutdown(const std::string &broker_id, bool controlled) {
         if(broker_info_.find(broker_id) != broker_info_.end()) {
             std::string broker_ip = broker_info_[broker_id];
             auto channel = grpc::CreateChannel(broker_ip, grpc::InsecureChannelCredentials());
@@ -28,6 +29,7 @@ public:
 
             message_queue::ShutdownRequest request;
             request.set_broker_id(broker_id);
+            request.set_controlled(controlled);
             message_queue::ShutdownResponse response;
 
             grpc::ClientContext context;
@@ -48,6 +50,7 @@ public:
                 auto new_stub = message_queue::MessageQueue::NewStub(new_channel);
                 message_queue::ShutdownRequest new_request;
                 new_request.set_broker_id(broker_id);
+                new_request.set_controlled(controlled);
                 message_queue::ShutdownResponse new_response;
 
                 grpc::ClientContext new_context;
@@ -78,6 +81,7 @@ public:
 
         message_queue::ShutdownRequest request;
         request.set_broker_id(broker_id);
+        request.set_controlled(controlled);
         message_queue::ShutdownResponse response;
 
         grpc::ClientContext context;
@@ -91,7 +95,212 @@ public:
         return false;
     }
 
+    // Collects the load of every partition; responding, if given, receives the IDs of the brokers that answered
+    std::vector<PartitionLoad> GetPartitionStats(std::set<std::string> *responding = nullptr) {
+        std::vector<PartitionLoad> loads;
+        for (const auto &broker : router_->ListBrokers()) {
+            auto channel = grpc::CreateChannel(broker.second, grpc::InsecureChannelCredentials());
+            auto stub = message_queue::MessageQueue::NewStub(channel);
+
+            message_queue::PartitionStatsRequest request;
+            message_queue::PartitionStatsResponse response;
+            grpc::ClientContext context;
+            grpc::Status status = stub->GetPartitionStats(&context, request, &response);
+            if (!status.ok() || !response.success()) {
+                std::cerr << "Failed to get partition stats from broker " << broker.first << ": "
+                          << (status.ok() ? response.error_message() : status.error_message()) << std::endl;
+                continue;
+            }
+            if (responding) {
+                responding->insert(broker.first);
+            }
+
+            for (const auto &partition : response.partitions()) {
+                loads.push_back({partition.topic(), partition.partition(), partition.leader_broker_id(), partition.leader_address(),
+                                 partition.produce_records_per_sec(), partition.produce_bytes_per_sec(),
+                                 partition.consume_records_per_sec(), partition.consume_bytes_per_sec(),
+                                 partition.produced_bytes(), partition.consumed_bytes(), partition.high_watermark()});
+            }
+        }
+        return loads;
+    }
+
+    bool ReassignPartition(const std::string &topic, int partition, const std::string &target_broker_id) {
+        std::string leader_address;
+        try {
+            leader_address = router_->GetBrokerIP(topic, partition);
+        } catch (const std::exception &e) {
+            std::cerr << "Failed to find the leader of topic " << topic << " partition " << partition << ": " << e.what() << std::endl;
+            return false;
+        }
+        return ReassignPartition(leader_address, topic, partition, target_broker_id);
+    }
+
+    bool ReassignPartitions(const ReassignmentOptions &options) {
+        std::unordered_map<std::string, std::string> brokers = router_->ListBrokers();
+        std::set<std::string> responding;
+        std::vector<PartitionLoad> loads = GetPartitionStats(&responding);
+        if (responding.size() < 2) {
+            std::cerr << "Reassignment needs at least two brokers reporting their load" << std::endl;
+            return false;
+        }
+
+        // Bytes per second each broker serves, counting idle brokers as well. A broker that did not
+        // report its load is neither a source nor a target, as it would otherwise look idle.
+        std::map<std::string, double> broker_load;
+        std::map<std::string, std::vector<PartitionLoad>> broker_partitions;
+        for (const auto &broker_id : responding) {
+            broker_load[broker_id] = 0;
+        }
+        double total_load = 0;
+        for (auto &partition : loads) {
+            if (!responding.count(partition.leader_broker_id) || !brokers.count(partition.leader_broker_id)) {
+                continue;
+            }
+            double load = Load(partition);
+            broker_load[partition.leader_broker_id] += load;
+            total_load += load;
+            broker_partitions[partition.leader_broker_id].push_back(std::move(partition));
+        }
+        double mean_load = total_load / broker_load.size();
+
+        for (int moves = 0; moves < options.max_moves; ++moves) {
+            auto by_load = [](const auto &a, const auto &b) { return a.second < b.second; };
+            auto source = std::max_element(broker_load.begin(), broker_load.end(), by_load);
+            auto target = std::min_element(broker_load.begin(), broker_load.end(), by_load);
+            if (source->second <= mean_load * options.overload_factor || source == target) {
+                break;
+            }
+
+            // The hottest partition whose move narrows the gap between the two brokers
+            std::vector<PartitionLoad> &candidates = broker_partitions[source->first];
+            auto hottest = candidates.end();
+            for (auto it = candidates.begin(); it != candidates.end(); ++it) {
+                double load = Load(*it);
+                if (load > 0 && load < source->second - target->second && (hottest == candidates.end() || load > Load(*hottest))) {
+                    hottest = it;
+                }
+            }
+            if (hottest == candidates.end()) {
+                break;
+            }
+
+            if (moves > 0) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(options.move_interval_ms));
+            }
+            std::cout << "Moving topic " << hottest->topic << " partition " << hottest->partition << " from broker "
+                      << source->first << " to broker " << target->first << std::endl;
+            if (!ReassignPartition(hottest->leader_address, hottest->topic, hottest->partition, target->first)) {
+                return false;
+            }
+
+            double load = Load(*hottest);
+            source->second -= load;
+            target->second += load;
+            hottest->leader_broker_id = target->first;
+            hottest->leader_address = brokers[target->first];
+            broker_partitions[target->first].push_back(std::move(*hottest));
+            candidates.erase(hottest);
+        }
+        return true;
+    }
+
+    bool CreateTopic(const std::string &topic, int num_partitions, const TopicOptions &options) {
+        auto stub = AnyBrokerStub();
+        if (!stub) {
+            return false;
+        }
+
+        message_queue::CreateTopicRequest request;
+        request.set_topic(topic);
+        request.set_num_partitions(num_partitions);
+        request.set_retention_ms(options.retention_ms);
+        request.set_replication_factor(options.replication_factor);
+        request.set_write_quorum(options.write_quorum);
+        request.set_ack_quorum(options.ack_quorum);
+        message_queue::CreateTopicResponse response;
+
+        grpc::ClientContext context;
+        grpc::Status status = stub->CreateTopic(&context, request, &response);
+        if (status.ok() && response.success()) {
+            std::cout << "Created topic " << topic << " with " << num_partitions << " partitions" << std::endl;
+            return true;
+        }
+        std::cerr << "Failed to create topic " << topic << ": " << (status.ok() ? response.error_message() : status.error_message()) << std::endl;
+        return false;
+    }
+
+    bool AddPartitions(const std::string &topic, int total_partitions) {
+        auto stub = AnyBrokerStub();
+        if (!stub) {
+            return false;
+        }
+
+        message_queue::AddPartitionsRequest request;
+        request.set_topic(topic);
+        request.set_total_partitions(total_partitions);
+        message_queue::AddPartitionsResponse response;
+
+        grpc::ClientContext context;
+        grpc::Status status = stub->AddPartitions(&context, request, &response);
+        if (status.ok() && response.success()) {
+            std::cout << "Topic " << topic << " now has " << response.num_partitions() << " partitions" << std::endl;
+            return true;
+        }
+        std::cerr << "Failed to add partitions to topic " << topic << ": " << (status.ok() ? response.error_message() : status.error_message()) << std::endl;
+        return false;
+    }
+
 private:
+    // Topic changes are written to ZooKeeper by whichever broker receives them
+    std::unique_ptr<message_queue::MessageQueue::Stub> AnyBrokerStub() {
+        std::unordered_map<std::string, std::string> brokers = router_->ListBrokers();
+        if (brokers.empty()) {
+            std::cerr << "No broker available" << std::endl;
+            return nullptr;
+        }
+        auto channel = grpc::CreateChannel(brokers.begin()->second, grpc::InsecureChannelCredentials());
+        return message_queue::MessageQueue::NewStub(channel);
+    }
+
+    static double Load(const PartitionLoad &partition) {
+        return partition.produce_bytes_per_sec + partition.consume_bytes_per_sec;
+    }
+
+    // Sends the reassignment to the broker believed to lead the partition, following one redirect
+    bool ReassignPartition(const std::string &leader_address, const std::string &topic, int partition, const std::string &target_broker_id) {
+        std::string address = leader_address;
+        for (int attempt = 0; attempt < 2 && !address.empty(); ++attempt) {
+            auto channel = grpc::CreateChannel(address, grpc::InsecureChannelCredentials());
+            auto stub = message_queue::MessageQueue::NewStub(channel);
+
+            message_queue::ReassignPartitionRequest request;
+            request.set_topic(topic);
+            request.set_partition(partition);
+            request.set_target_broker_id(target_broker_id);
+            message_queue::ReassignPartitionResponse response;
+
+            grpc::ClientContext context;
+            grpc::Status status = stub->ReassignPartition(&context, request, &response);
+            if (status.ok() && response.success()) {
+                std::cout << "Moved topic " << topic << " partition " << partition << " to broker " << target_broker_id << std::endl;
+                try {
+                    router_->RefreshMetadata(topic);
+                } catch (const std::exception &e) {
+                    std::cerr << "Failed to refresh metadata for topic " << topic << ": " << e.what() << std::endl;
+                }
+                return true;
+            }
+            if (!status.ok()) {
+                std::cerr << "Failed to reassign topic " << topic << " partition " << partition << ": " << status.error_message() << std::endl;
+                return false;
+            }
+            std::cerr << "Failed to reassign topic " << topic << " partition " << partition << ": " << response.error_message() << std::endl;
+            address = response.broker_address();
+        }
+        return false;
+    }
+
     std::unique_ptr<Router> router_;
     std::unordered_map<std::string, std::string> broker_info_;
 };
@@ -102,6 +311,26 @@ SysAdmin::SysAdmin(const std::vector<std::string>& bootstrap_servers)
 
 SysAdmin::~SysAdmin() = default; // Defaulted destructor
 
-bool SysAdmin::shutdown(const std::string &broker_id) {
-    return impl_->shutdown(broker_id);
+bool SysAdmin::shutdown(const std::string &broker_id, bool controlled) {
+    return impl_->shutdown(broker_id, controlled);
+}
+
+std::vector<PartitionLoad> SysAdmin::GetPartitionStats() {
+    return impl_->GetPartitionStats();
+}
+
+bool SysAdmin::ReassignPartition(const std::string &topic, int partition, const std::string &target_broker_id) {
+    return impl_->ReassignPartition(topic, partition, target_broker_id);
+}
+
+bool SysAdmin::ReassignPartitions(const ReassignmentOptions &options) {
+    return impl_->ReassignPartitions(options);
+}
+
+bool SysAdmin::CreateTopic(const std::string &topic, int num_partitions, const TopicOptions &options) {
+    return impl_->CreateTopic(topic, num_partitions, options);
+}
+
+bool SysAdmin::AddPartitions(const std::string &topic, int total_partitions) {
+    return impl_->AddPartitions(topic, total_partitions);
 }
\ No newline at end of file
@@ -1,10 +1,44 @@
 #ifndef MESSAGE_QUEUE_SYS_ADMIN_H
 #define MESSAGE_QUEUE_SYS_ADMIN_H
 
+#include <cstdint>
 #include <string>
 #include <vector>
 #include <memory>
 
+// Load of one partition as reported by its leader
+struct PartitionLoad {
+    std::string topic;
+    int partition;
+    std::string leader_broker_id;
+    std::string leader_address;
+    double produce_records_per_sec; // Rates over the leader's last sampling interval
+    double produce_bytes_per_sec;
+    double consume_records_per_sec;
+    double consume_bytes_per_sec;
+    int64_t produced_bytes;         // Totals since the leader opened the partition
+    int64_t consumed_bytes;
+    int64_t high_watermark;
+};
+
+// How far ReassignPartitions goes in one call
+struct ReassignmentOptions {
+    // A broker is overloaded once its produce plus consume bytes per second exceed the cluster mean by this factor
+    double overload_factor = 1.25;
+    // Most partitions moved per call
+    int max_moves = 4;
+    // Pause after each move so clients re-route and the new leader recovers before the next one
+    int move_interval_ms = 5000;
+};
+
+// Settings of a new topic; 0 keeps the broker or BookKeeper default
+struct TopicOptions {
+    int retention_ms = 0;
+    int replication_factor = 0;
+    int write_quorum = 0;
+    int ack_quorum = 0;
+};
+
 class SysAdmin {
 public:
     // Constructor to initialize producer with bootstrap servers
@@ -12,7 +46,27 @@ public:
 
     ~SysAdmin(); // Declare the destructor
     
-    bool shutdown(const std::string &broker_id);
+    // Stops a broker. A controlled shutdown first hands every partition of the broker to its peers and
+    // waits for the writes it accepted, so clients are redirected instead of finding the partitions leaderless.
+    bool shutdown(const std::string &broker_id, bool controlled = false);
+
+    // Load of every partition, collected from each broker
+    std::vector<PartitionLoad> GetPartitionStats();
+
+    // Hands a partition to another broker. Its leader stops accepting writes, waits for the accepted
+    // ones to be confirmed and then gives up the partition.
+    bool ReassignPartition(const std::string &topic, int partition, const std::string &target_broker_id);
+
+    // Moves the hottest partitions off overloaded brokers to the least loaded ones, one at a time.
+    // Returns false if a move failed; moves made before it stand.
+    bool ReassignPartitions(const ReassignmentOptions &options = ReassignmentOptions());
+
+    // Creates a topic with its partitions spread over the brokers. Fails if the topic exists.
+    bool CreateTopic(const std::string &topic, int num_partitions, const TopicOptions &options = TopicOptions());
+
+    // Grows a topic to total_partitions, assigning the new partitions to the least loaded brokers.
+    // Producers pick the new count up within ProducerOptions::metadata_max_age_ms.
+    bool AddPartitions(const std::string &topic, int total_partitions);
 
 private:
     class Impl; // Forward declaration of the implementation class
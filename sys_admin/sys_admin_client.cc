@@ -1,25 +1,116 @@
 #include "sys_admin.h"
+#include <iomanip>
 #include <iostream>
+#include <sstream>
 #include <string>
 #include <vector>
 
+void PrintPartitionStats(SysAdmin& sys_admin) {
+    std::vector<PartitionLoad> loads = sys_admin.GetPartitionStats();
+    if (loads.empty()) {
+        std::cout << "No partition stats available." << std::endl;
+        return;
+    }
+
+    std::cout << std::left << std::setw(20) << "TOPIC" << std::setw(10) << "PARTITION" << std::setw(12) << "LEADER"
+              << std::setw(14) << "PRODUCE/S" << std::setw(14) << "PRODUCE B/S" << std::setw(14) << "CONSUME/S"
+              << std::setw(14) << "CONSUME B/S" << "HIGH WATERMARK" << std::endl;
+    std::cout << std::fixed << std::setprecision(1);
+    for (const auto& load : loads) {
+        std::cout << std::setw(20) << load.topic << std::setw(10) << load.partition << std::setw(12) << load.leader_broker_id
+                  << std::setw(14) << load.produce_records_per_sec << std::setw(14) << load.produce_bytes_per_sec
+                  << std::setw(14) << load.consume_records_per_sec << std::setw(14) << load.consume_bytes_per_sec
+                  << load.high_watermark << std::endl;
+    }
+}
+
 void RunSysAdminClient(const std::vector<std::string>& bootstrap_servers) {
     SysAdmin sys_admin(bootstrap_servers);
-    
-    while(true) {
-        std::string broker_id;
-        std::cout << "Enter Broker ID to shutdown or type 'exit' to quit: ";
-        std::getline(std::cin, broker_id);
 
-        if(broker_id == "exit") {
+    while(true) {
+        std::string line;
+        std::cout << "Enter a command or type 'exit' to quit:" << std::endl
+                  << "  shutdown <broker_id> [controlled]" << std::endl
+                  << "  stats" << std::endl
+                  << "  reassign <topic> <partition> <broker_id>" << std::endl
+                  << "  rebalance [max_moves] [move_interval_ms]" << std::endl
+                  << "  create-topic <topic> <partitions>" << std::endl
+                  << "  add-partitions <topic> <total_partitions>" << std::endl
+                  << "> ";
+        if (!std::getline(std::cin, line)) {
             break;
         }
 
-        bool success = sys_admin.shutdown(broker_id);
-        if(success) {
-            std::cout << "Broker shutdown successfully." << std::endl;
-        } else {
-            std::cout << "Failed to shutdown broker." << std::endl;
+        std::istringstream args(line);
+        std::string command;
+        args >> command;
+
+        if(command == "exit") {
+            break;
+        } else if(command == "shutdown") {
+            std::string broker_id, mode;
+            args >> broker_id >> mode;
+            bool success = sys_admin.shutdown(broker_id, mode == "controlled");
+            if(success) {
+                std::cout << "Broker shutdown successfully." << std::endl;
+            } else {
+                std::cout << "Failed to shutdown broker." << std::endl;
+            }
+        } else if(command == "stats") {
+            PrintPartitionStats(sys_admin);
+        } else if(command == "reassign") {
+            std::string topic, broker_id;
+            int partition = -1;
+            if(!(args >> topic >> partition >> broker_id)) {
+                std::cout << "Usage: reassign <topic> <partition> <broker_id>" << std::endl;
+                continue;
+            }
+            if(sys_admin.ReassignPartition(topic, partition, broker_id)) {
+                std::cout << "Partition reassigned successfully." << std::endl;
+            } else {
+                std::cout << "Failed to reassign partition." << std::endl;
+            }
+        } else if(command == "rebalance") {
+            // A failed read zeroes its target, so read into locals first
+            ReassignmentOptions options;
+            int max_moves, move_interval_ms;
+            if(args >> max_moves) {
+                options.max_moves = max_moves;
+                if(args >> move_interval_ms) {
+                    options.move_interval_ms = move_interval_ms;
+                }
+            }
+            if(sys_admin.ReassignPartitions(options)) {
+                std::cout << "Rebalance finished." << std::endl;
+            } else {
+                std::cout << "Rebalance stopped after a failed move." << std::endl;
+            }
+        } else if(command == "create-topic") {
+            std::string topic;
+            int partitions = 0;
+            if(!(args >> topic >> partitions)) {
+                std::cout << "Usage: create-topic <topic> <partitions>" << std::endl;
+                continue;
+            }
+            if(sys_admin.CreateTopic(topic, partitions)) {
+                std::cout << "Topic created successfully." << std::endl;
+            } else {
+                std::cout << "Failed to create topic." << std::endl;
+            }
+        } else if(command == "add-partitions") {
+            std::string topic;
+            int total_partitions = 0;
+            if(!(args >> topic >> total_partitions)) {
+                std::cout << "Usage: add-partitions <topic> <total_partitions>" << std::endl;
+                continue;
+            }
+            if(sys_admin.AddPartitions(topic, total_partitions)) {
+                std::cout << "Partitions added successfully." << std::endl;
+            } else {
+                std::cout << "Failed to add partitions." << std::endl;
+            }
+        } else if(!command.empty()) {
+            std::cout << "Unknown command: " << command << std::endl;
         }
     }
 }
@@ -0,0 +1,139 @@
+#include "batch_controller.h"
+#include <gtest/gtest.h>
+#include <chrono>
+#include <string>
+#include <thread>
+
+namespace {
+
+const std::string kKey = "orders-0";
+
+// Batch bounds of 1..321 give an additive step of 10 records
+ProducerOptions Options() {
+    ProducerOptions options;
+    options.target_latency_ms = 50;
+    options.min_batch_records = 1;
+    options.max_batch_records = 321;
+    options.min_linger_ms = 0;
+    options.max_linger_ms = 100;
+    return options;
+}
+
+// Lets the next SampleArrivalRates take a sample
+void WaitForSampleInterval() {
+    std::this_thread::sleep_for(std::chrono::milliseconds(110));
+}
+
+TEST(BatchControllerTest, InitialSettingsAreClampedToBounds) {
+    ProducerOptions options = Options();
+    options.min_batch_records = 4;
+    options.min_linger_ms = 5;
+
+    BatchController low(0, 0, options);
+    EXPECT_EQ(low.BatchRecords(kKey), 4);
+    EXPECT_EQ(low.LingerMs(kKey), 5);
+
+    BatchController high(100000, 1000, options);
+    EXPECT_EQ(high.BatchRecords(kKey), 321);
+    EXPECT_EQ(high.LingerMs(kKey), 100);
+}
+
+TEST(BatchControllerTest, ResponsesForUnknownPartitionsAreIgnored) {
+    BatchController controller(100, 0, Options());
+    controller.OnSendCompleted(kKey, 1);
+
+    EXPECT_EQ(controller.BatchRecords(kKey), 100);
+    EXPECT_TRUE(controller.Metrics().empty());
+}
+
+TEST(BatchControllerTest, GrowsAdditivelyWithinTarget) {
+    BatchController controller(100, 0, Options());
+    controller.OnAppend(kKey, "orders", 0);
+
+    controller.OnSendCompleted(kKey, 10);
+    EXPECT_EQ(controller.BatchRecords(kKey), 110);
+    // No arrival rate yet, so the linger is what the target leaves after the round trip
+    EXPECT_EQ(controller.LingerMs(kKey), 40);
+
+    // Latency plus linger exactly at the target still grows
+    controller.OnSendCompleted(kKey, 10);
+    EXPECT_EQ(controller.BatchRecords(kKey), 120);
+}
+
+TEST(BatchControllerTest, GrowthStopsAtUpperBound) {
+    BatchController controller(300, 0, Options());
+    controller.OnAppend(kKey, "orders", 0);
+
+    for (int i = 0; i < 5; ++i) {
+        controller.OnSendCompleted(kKey, 1);
+    }
+    EXPECT_EQ(controller.BatchRecords(kKey), 321);
+}
+
+TEST(BatchControllerTest, HalvesAboveTarget) {
+    BatchController controller(100, 0, Options());
+    controller.OnAppend(kKey, "orders", 0);
+
+    controller.OnSendCompleted(kKey, 200);
+    EXPECT_EQ(controller.BatchRecords(kKey), 50);
+    // Nothing is left of the target, so batches go out at once
+    EXPECT_EQ(controller.LingerMs(kKey), 0);
+
+    controller.OnSendCompleted(kKey, 200);
+    EXPECT_EQ(controller.BatchRecords(kKey), 25);
+}
+
+TEST(BatchControllerTest, HalvingStopsAtLowerBound) {
+    ProducerOptions options = Options();
+    options.min_batch_records = 8;
+    BatchController controller(20, 0, options);
+    controller.OnAppend(kKey, "orders", 0);
+
+    for (int i = 0; i < 5; ++i) {
+        controller.OnSendCompleted(kKey, 500);
+    }
+    EXPECT_EQ(controller.BatchRecords(kKey), 8);
+}
+
+TEST(BatchControllerTest, SlowPartitionLingerIsClampedToRemainingBudget) {
+    BatchController controller(100, 0, Options());
+    controller.OnAppend(kKey, "orders", 0);
+    WaitForSampleInterval();
+
+    // One record per sample fills a batch only after seconds; the target caps the wait
+    controller.SampleArrivalRates();
+    EXPECT_EQ(controller.LingerMs(kKey), 50);
+
+    // A 30 ms round trip leaves 20 ms of the target to linger
+    controller.OnSendCompleted(kKey, 30);
+    EXPECT_EQ(controller.LingerMs(kKey), 20);
+}
+
+TEST(BatchControllerTest, LingerIsClampedToMaximum) {
+    ProducerOptions options = Options();
+    options.target_latency_ms = 1000;
+    BatchController controller(100, 0, options);
+    controller.OnAppend(kKey, "orders", 0);
+    WaitForSampleInterval();
+
+    controller.SampleArrivalRates();
+    EXPECT_EQ(controller.LingerMs(kKey), 100);
+}
+
+TEST(BatchControllerTest, BusyPartitionLingersOnlyToFillBatch) {
+    BatchController controller(100, 0, Options());
+    for (int i = 0; i < 100000; ++i) {
+        controller.OnAppend(kKey, "orders", 0);
+    }
+    WaitForSampleInterval();
+
+    controller.SampleArrivalRates();
+    EXPECT_LT(controller.LingerMs(kKey), 50);
+
+    auto metrics = controller.Metrics();
+    ASSERT_EQ(metrics.size(), 1u);
+    EXPECT_EQ(metrics[0].topic, "orders");
+    EXPECT_GT(metrics[0].arrival_rate, 0);
+}
+
+} // namespace
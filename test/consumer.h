@@ -1,15 +1,81 @@
 #ifndef CONSUMER_H
 #define CONSUMER_H
 
+#include <cstdint>
+#include <functional>
 #include <memory>
 #include <string>
+#include <unordered_map>
 #include <vector>
+#include "record_header.h"
 
+// Key, value and header values hold the raw bytes written by the producer
 struct MessageResponse {
     std::string key;
     std::string value;
     std::string topic;
-    int timestamp;
+    int64_t timestamp; // Milliseconds since the epoch
+    std::vector<RecordHeader> headers;
+    int partition;
+    int64_t offset;
+};
+
+// A partition and a wall-clock time to look up its offset for
+struct TimestampQuery {
+    std::string topic;
+    int partition;
+    int64_t timestamp_ms; // Milliseconds since the epoch
+};
+
+// Position of one partition in a multi-partition fetch
+struct FetchPosition {
+    std::string topic;
+    int partition;
+    int64_t offset;
+    int max_bytes = 1024 * 1024; // Soft cap on the bytes fetched for the partition
+    int max_messages = 0;        // Overrides the fetch's max_messages when set
+};
+
+// Records a fetch should return, evaluated by the broker. A record must match every criterion that is set.
+struct RecordFilter {
+    std::string key_prefix;             // Key starts with these bytes
+    std::vector<std::string> keys;      // Key is one of these
+    std::vector<RecordHeader> headers;  // Record has a header with this name and value, for each
+    int64_t min_timestamp_ms = -1;      // Earliest record time, inclusive; -1 for no bound
+    int64_t max_timestamp_ms = -1;      // Latest record time, inclusive; -1 for no bound
+
+    bool empty() const {
+        return key_prefix.empty() && keys.empty() && headers.empty() && min_timestamp_ms < 0 && max_timestamp_ms < 0;
+    }
+};
+
+// Messages of a fetch and how far each fetched partition extended at the time
+struct FetchResult {
+    std::vector<MessageResponse> messages;
+    // Offset after the last confirmed record, by "topic-partition". Missing if the broker did not report it.
+    std::unordered_map<std::string, int64_t> high_watermarks;
+    // Offset the next fetch of each partition continues from, by "topic-partition". With a filter
+    // this is past records the broker skipped. Missing if the broker did not report it.
+    std::unordered_map<std::string, int64_t> next_offsets;
+};
+
+// Encoded record batches fetched from one partition, for decoding in place
+struct FetchedPartition {
+    std::string topic;
+    int partition;
+    int64_t fetch_offset; // Records before it in the first batch were delivered before
+    int max_messages;     // Records at or after fetch_offset to deliver
+    std::vector<std::string> record_batches;
+    int64_t serve_time_us = 0; // When the broker served the fetch, microseconds since the epoch; 0 if unreported
+};
+
+// An undecoded multi-partition fetch
+struct RawFetchResult {
+    std::vector<FetchedPartition> partitions;
+    // Offset after the last confirmed record, by "topic-partition"
+    std::unordered_map<std::string, int64_t> high_watermarks;
+    // Offset the next fetch of each partition continues from, by "topic-partition"
+    std::unordered_map<std::string, int64_t> next_offsets;
 };
 
 class Consumer {
@@ -22,6 +88,22 @@ public:
     Consumer(const std::vector<std::string> &bootstrap_servers, std::string consumer_id);
     ~Consumer();
     std::vector<MessageResponse> ConsumeMessage(std::string group_id, std::string topic, int partition, int offset, int max_messages);
+    // Like ConsumeMessage, also reporting the partition's high watermark
+    FetchResult Fetch(std::string group_id, std::string topic, int partition, int64_t offset, int max_messages);
+    // Fetches only the records matching filter; the broker skips the rest
+    FetchResult Fetch(std::string group_id, std::string topic, int partition, int64_t offset, int max_messages, const RecordFilter& filter);
+    // Fetches every partition in one request per leader broker, keeping an incremental fetch session with each
+    FetchResult FetchMultiple(const std::string& group_id, const std::vector<FetchPosition>& positions, int max_messages);
+    // FetchMultiple without decoding the records. Partitions whose next records are in the process-wide
+    // fetch cache are served from it; the rest come from their leader brokers.
+    RawFetchResult FetchMultipleRaw(const std::string& group_id, const std::vector<FetchPosition>& positions, int max_messages);
+    // FetchMultiple on the gRPC callback API. done runs on a gRPC thread once every broker answered and
+    // must not block. Only one fetch of a consumer may be in flight at a time.
+    void FetchMultipleAsync(const std::string& group_id, const std::vector<FetchPosition>& positions, int max_messages,
+                            std::function<void(FetchResult)> done);
+    // For each query, the earliest offset whose timestamp is at or after the given time,
+    // the end of the partition if there is none, or -1 if the lookup failed
+    std::vector<int64_t> OffsetsForTimes(const std::vector<TimestampQuery>& queries);
     std::string get_consumer_id();
 };
 
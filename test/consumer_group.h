@@ -1,18 +1,24 @@
 #ifndef CONSUMER_GROUP_H
 #define CONSUMER_GROUP_H
 
+#include <coroutine>
+#include <functional>
 #include <memory>
 #include <string>
 #include <vector>
 #include <unordered_map>
 #include "consumer.h"
+#include "executor.h"
 
 struct topic_state {
     std::string topic;
     int partition;
-    int offset;
+    int64_t offset;
+    int64_t high_watermark = -1; // As of the last fetch; -1 until a broker reported it
 };
 
+class PollAwaitable;
+
 class ConsumerGroup {
 private:
     std::string tag;
@@ -21,16 +27,63 @@ private:
     std::unordered_map<std::string, 
     std::unordered_map<std::string, std::vector<topic_state>>> consumer_topic_state_;
     std::unordered_map<std::string, std::string> topic_partition_consumer_;
+    Executor executor_ = InlineExecutor;
 
     bool IsTopicConsumed(std::string topic, int partition);
+    // Records the high watermarks a fetch reported for a consumer's partitions
+    void UpdateHighWatermarks(const std::string& consumer_id, const FetchResult& result);
+    // Positions of a consumer's partitions for a multi-partition fetch, each sized by its lag
+    std::vector<FetchPosition> FetchPositions(const std::string& consumer_id, int max_messages);
+    // Moves each of a consumer's partitions past the last record the fetch returned
+    void ApplyFetch(const std::string& consumer_id, const FetchResult& result);
 
 public:
     ConsumerGroup(std::string tag, std::string group_id);
     ~ConsumerGroup();
-    bool AddConsumer(const std::vector<std::string>& bootstrap_servers, std::string consumer_id, std::vector<std::string> topics, std::vector<int> partitions, std::vector<int> offsets);
+    // Assigns the listed partitions to a new consumer. Assignment is static: partitions added to a
+    // topic later, e.g. with SysAdmin::AddPartitions, are not consumed until a consumer is added for them.
+    bool AddConsumer(const std::vector<std::string>& bootstrap_servers, std::string consumer_id, std::vector<std::string> topics, std::vector<int> partitions, std::vector<int64_t> offsets);
     bool RemoveConsumer(std::string consumer_id);
+    // Fetches up to max_messages from a partition. Near the head of the partition fewer are
+    // requested so new records are returned sooner; a lagging partition gets the full batch.
     std::vector<MessageResponse> ConsumeMessage(std::string topic, int partition, int max_messages);
+    // Like ConsumeMessage, returning only the records matching filter. The position advances
+    // past the records the broker skipped.
+    std::vector<MessageResponse> ConsumeMessage(std::string topic, int partition, int max_messages, const RecordFilter& filter);
+    // Pulls every assigned partition, one multi-partition fetch per consumer and leader broker,
+    // each sized by the partition's lag like ConsumeMessage
+    std::vector<MessageResponse> ConsumeAll(int max_messages);
+    // ConsumeAll on the gRPC callback API. done runs on a gRPC thread and must not block. Only one
+    // poll may be in flight, and not alongside the blocking calls.
+    void PollAsync(int max_messages, std::function<void(std::vector<MessageResponse>)> done);
+    // Awaitable poll: co_await group.Poll(n) yields the batch ConsumeAll would return without
+    // blocking the awaiting thread. The coroutine is resumed through the group's executor.
+    PollAwaitable Poll(int max_messages);
+    // Executor that resumes coroutines awaiting Poll; by default they resume inline on a gRPC thread
+    void SetExecutor(Executor executor);
+    const Executor& executor() const;
+    // Records between a partition's position and its high watermark, or -1 if not known yet
+    int64_t GetLag(std::string topic, int partition);
+    // Moves a partition to the first record at or after a wall-clock time, in milliseconds since the epoch
+    bool SeekToTime(std::string topic, int partition, int64_t timestamp_ms);
+    // Moves every assigned partition to the first record at or after a wall-clock time
+    bool SeekAllToTime(int64_t timestamp_ms);
     void PrintConsumerGroup();
 };
 
+// Awaiter returned by ConsumerGroup::Poll
+class PollAwaitable {
+public:
+    PollAwaitable(ConsumerGroup* group, int max_messages) : group_(group), max_messages_(max_messages) {}
+
+    bool await_ready() const noexcept { return false; }
+    void await_suspend(std::coroutine_handle<> handle);
+    std::vector<MessageResponse> await_resume() { return std::move(messages_); }
+
+private:
+    ConsumerGroup* group_;
+    int max_messages_;
+    std::vector<MessageResponse> messages_;
+};
+
 #endif // CONSUMER_GROUP_H
\ No newline at end of file
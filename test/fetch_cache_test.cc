@@ -0,0 +1,163 @@
+#include "fetch_cache.h"
+#include "record_batch.h"
+#include <gtest/gtest.h>
+#include <string>
+#include <vector>
+
+namespace {
+
+// A batch of count records starting at base_offset, stamped as the broker would
+std::string MakeBatch(const std::string& topic, int partition, int64_t base_offset, int count, size_t value_bytes = 8) {
+    RecordBatchBuilder builder(topic, partition);
+    for (int i = 0; i < count; ++i) {
+        builder.Append("key-" + std::to_string(base_offset + i), std::string(value_bytes, 'v'), 1000 + base_offset + i, {});
+    }
+    std::string batch = builder.Build();
+    for (int i = 0; i < 8; ++i) {
+        batch[1 + i] = static_cast<char>(static_cast<uint64_t>(base_offset) >> (56 - 8 * i));
+    }
+    return batch;
+}
+
+// Batches of batch_size records covering [start, start + batches * batch_size)
+std::vector<std::string> MakeBatches(const std::string& topic, int partition, int64_t start, int batches, int batch_size,
+                                     size_t value_bytes = 8) {
+    std::vector<std::string> result;
+    for (int i = 0; i < batches; ++i) {
+        result.push_back(MakeBatch(topic, partition, start + i * batch_size, batch_size, value_bytes));
+    }
+    return result;
+}
+
+std::vector<int64_t> BaseOffsets(const CachedFetch& fetch) {
+    std::vector<int64_t> offsets;
+    for (const auto& batch : fetch.record_batches) {
+        RecordBatchHeader header;
+        EXPECT_TRUE(ReadRecordBatchHeader(batch, &header));
+        offsets.push_back(header.base_offset);
+    }
+    return offsets;
+}
+
+class FetchCacheTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        // The cache is process-wide, so start every test from an empty one
+        cache_.SetCapacity(0);
+        cache_.SetCapacity(1 << 20);
+    }
+
+    bool Lookup(const std::string& topic, int partition, int64_t offset, int max_messages, size_t max_bytes = 0) {
+        return cache_.Lookup(topic, partition, offset, max_messages, max_bytes, &fetch_);
+    }
+
+    FetchCache& cache_ = FetchCache::Instance();
+    CachedFetch fetch_;
+};
+
+TEST_F(FetchCacheTest, ReturnsInsertedBatchesAndWatermark) {
+    auto batches = MakeBatches("orders", 0, 100, 2, 5);
+    cache_.Insert("orders", 0, batches, 140);
+
+    ASSERT_TRUE(Lookup("orders", 0, 100, 100));
+    EXPECT_EQ(fetch_.record_batches, batches);
+    EXPECT_EQ(fetch_.next_offset, 110);
+    EXPECT_EQ(fetch_.high_watermark, 140);
+}
+
+TEST_F(FetchCacheTest, MissesOutsideCachedRanges) {
+    cache_.Insert("orders", 0, MakeBatches("orders", 0, 100, 1, 5), 105);
+
+    EXPECT_FALSE(Lookup("orders", 0, 99, 10));
+    EXPECT_FALSE(Lookup("orders", 0, 105, 10));
+    EXPECT_FALSE(Lookup("orders", 1, 100, 10));
+    EXPECT_FALSE(Lookup("payments", 0, 100, 10));
+    EXPECT_FALSE(Lookup("orders", 0, 100, 0));
+}
+
+TEST_F(FetchCacheTest, LookupStartsAtTheBatchHoldingTheOffset) {
+    cache_.Insert("orders", 0, MakeBatches("orders", 0, 100, 3, 5), 115);
+
+    ASSERT_TRUE(Lookup("orders", 0, 107, 100));
+    EXPECT_EQ(BaseOffsets(fetch_), (std::vector<int64_t>{105, 110}));
+    EXPECT_EQ(fetch_.next_offset, 115);
+}
+
+TEST_F(FetchCacheTest, LookupHonoursMaxMessagesAndMaxBytes) {
+    auto batches = MakeBatches("orders", 0, 100, 3, 5);
+    cache_.Insert("orders", 0, batches, 115);
+
+    ASSERT_TRUE(Lookup("orders", 0, 102, 4));
+    EXPECT_EQ(BaseOffsets(fetch_), (std::vector<int64_t>{100, 105}));
+    EXPECT_EQ(fetch_.next_offset, 106);
+
+    // At least one batch is served however small the cap
+    ASSERT_TRUE(Lookup("orders", 0, 100, 100, 1));
+    EXPECT_EQ(BaseOffsets(fetch_), (std::vector<int64_t>{100}));
+    EXPECT_EQ(fetch_.next_offset, 105);
+
+    ASSERT_TRUE(Lookup("orders", 0, 100, 100, batches[0].size() + 1));
+    EXPECT_EQ(BaseOffsets(fetch_), (std::vector<int64_t>{100, 105}));
+}
+
+TEST_F(FetchCacheTest, StopsCachingAtAGap) {
+    std::vector<std::string> batches{MakeBatch("orders", 0, 100, 5), MakeBatch("orders", 0, 110, 5)};
+    cache_.Insert("orders", 0, batches, 115);
+
+    ASSERT_TRUE(Lookup("orders", 0, 100, 100));
+    EXPECT_EQ(BaseOffsets(fetch_), (std::vector<int64_t>{100}));
+    EXPECT_FALSE(Lookup("orders", 0, 110, 100));
+}
+
+TEST_F(FetchCacheTest, OverlappingInsertKeepsRangesDisjoint) {
+    cache_.Insert("orders", 0, MakeBatches("orders", 0, 100, 2, 5), 110);
+    cache_.Insert("orders", 0, MakeBatches("orders", 0, 105, 3, 5), 120);
+
+    ASSERT_TRUE(Lookup("orders", 0, 100, 100));
+    EXPECT_EQ(BaseOffsets(fetch_), (std::vector<int64_t>{100, 105}));
+    ASSERT_TRUE(Lookup("orders", 0, 110, 100));
+    EXPECT_EQ(BaseOffsets(fetch_), (std::vector<int64_t>{110, 115}));
+    // Every range of the partition reports its latest watermark
+    EXPECT_EQ(fetch_.high_watermark, 120);
+}
+
+TEST_F(FetchCacheTest, InsertCoveringARangeReplacesIt) {
+    cache_.Insert("orders", 0, MakeBatches("orders", 0, 105, 1, 5), 110);
+    cache_.Insert("orders", 0, MakeBatches("orders", 0, 100, 3, 5), 115);
+
+    ASSERT_TRUE(Lookup("orders", 0, 100, 100));
+    EXPECT_EQ(BaseOffsets(fetch_), (std::vector<int64_t>{100, 105, 110}));
+}
+
+TEST_F(FetchCacheTest, EvictsLeastRecentlyUsedRange) {
+    auto first = MakeBatches("orders", 0, 0, 1, 4, 1024);
+    auto second = MakeBatches("orders", 0, 100, 1, 4, 1024);
+    auto third = MakeBatches("orders", 0, 200, 1, 4, 1024);
+
+    // Room for two of the three ranges
+    cache_.SetCapacity(2 * (first[0].size() + 256));
+    cache_.Insert("orders", 0, first, 4);
+    cache_.Insert("orders", 0, second, 104);
+    ASSERT_TRUE(Lookup("orders", 0, 0, 1));
+    cache_.Insert("orders", 0, third, 204);
+
+    EXPECT_TRUE(Lookup("orders", 0, 0, 1));
+    EXPECT_FALSE(Lookup("orders", 0, 100, 1));
+    EXPECT_TRUE(Lookup("orders", 0, 200, 1));
+}
+
+TEST_F(FetchCacheTest, ShrinkingCapacityEvicts) {
+    cache_.Insert("orders", 0, MakeBatches("orders", 0, 0, 1, 4, 1024), 4);
+    cache_.SetCapacity(1024);
+
+    EXPECT_FALSE(Lookup("orders", 0, 0, 1));
+}
+
+TEST_F(FetchCacheTest, ZeroCapacityDisablesCache) {
+    cache_.SetCapacity(0);
+    cache_.Insert("orders", 0, MakeBatches("orders", 0, 0, 1, 4), 4);
+
+    EXPECT_FALSE(Lookup("orders", 0, 0, 4));
+}
+
+}
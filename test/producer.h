@@ -1,23 +1,159 @@
 #ifndef MESSAGE_QUEUE_PRODUCER_H
 #define MESSAGE_QUEUE_PRODUCER_H
 
+#include <coroutine>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
 #include <string>
+#include <string_view>
+#include <unordered_map>
 #include <vector>
 #include <memory>
+#include "executor.h"
+#include "record_header.h"
+
+// When a produce request counts as delivered
+enum class AckMode {
+    kNone,   // Fire-and-forget: sent without waiting for the broker
+    kLeader, // Acknowledged once the broker has queued the batch
+    kQuorum, // Acknowledged after the BookKeeper ack quorum confirmed the batch
+};
+
+// Optional producer settings
+struct ProducerOptions {
+    // Directory of the local write-ahead spool. Batches that cannot be delivered are
+    // appended here and replayed in order once a leader is reachable. Empty disables spooling.
+    std::string spool_dir;
+
+    // Size of each memory-mapped spool segment
+    size_t spool_segment_bytes = 64 * 1024 * 1024;
+
+    // Cap on the encoded bytes of open batches. Past it a batch spills to the spool, or without
+    // one further messages are rejected until the sender drains the batches. 0 is unbounded.
+    size_t buffer_bytes = 0;
+
+    // Deadline for a produce request before the batch is treated as failed. 0 waits indefinitely.
+    int send_timeout_ms = 0;
+
+    // Age at which a topic's partition count is fetched again, so that partitions added to the
+    // topic start receiving records. Keys then map to different partitions. The sender thread
+    // refreshes it in the background; sends keep using the known count meanwhile.
+    int metadata_max_age_ms = 30000;
+
+    // Acknowledgement mode for every topic, unless overridden in topic_acks
+    AckMode acks = AckMode::kQuorum;
+    std::unordered_map<std::string, AckMode> topic_acks;
+
+    // Adaptive batching. flush_threshold and flush_interval_ms then only set the starting
+    // point; each partition's batch size and linger are tuned within the bounds below so
+    // that linger plus the observed produce latency stays within target_latency_ms.
+    bool adaptive_batching = false;
+    int target_latency_ms = 50;
+    int min_batch_records = 1;
+    int max_batch_records = 10000;
+    int min_linger_ms = 0;
+    int max_linger_ms = 100;
+
+    // Per-key conflation for every topic, unless overridden in topic_conflate_keys. Within an open
+    // batch a record replaces the earlier one with the same non-empty key, so only the latest value
+    // per key in each linger window is sent. Sends of a replaced record complete with the offset of
+    // the record that replaced it.
+    bool conflate_keys = false;
+    std::unordered_map<std::string, bool> topic_conflate_keys;
+
+    // Resumes coroutines awaiting Producer::Send. Unset resumes them inline on the producer's
+    // sender thread, which then must not be blocked.
+    Executor executor;
+};
+
+// Current adaptive batching decisions for a topic-partition
+struct PartitionBatchingMetrics {
+    std::string topic;
+    int partition;
+    int batch_records;         // Records at which a batch is sent
+    int linger_ms;             // Age at which a partly filled batch is sent
+    double arrival_rate;       // Records appended per second, smoothed
+    double produce_latency_ms; // Smoothed ProduceMessages round trip, -1 before the first response
+};
+
+// Outcome of an asynchronous send. A send whose batch was spooled completes once the replay is
+// acknowledged. Delivery is at-least-once: a failed send may still have been written, when
+// outcome_unknown is set, and a batch with an unknown outcome is spooled and replayed like any
+// other failure, so a record may reach the partition more than once.
+struct SendResult {
+    bool success = false;
+    int64_t offset = -1;       // Offset assigned to the record; -1 if unknown, e.g. with AckMode::kNone
+    std::string error_message;
+    bool outcome_unknown = false; // The broker failed the write after it may have reached BookKeeper
+};
+
+// Called on a producer thread once a send is acknowledged or has failed. Must not block.
+using SendCallback = std::function<void(const SendResult&)>;
+
+// Encodes a value of a size known in advance straight into the batch buffer at dest
+using ValueWriter = std::function<void(char* dest)>;
+
+class SendAwaitable;
 
 class Producer {
 public:
     // Constructor to initialize producer with bootstrap servers
     Producer(const std::vector<std::string>& bootstrap_servers, int flush_threshold, int flush_interval_ms, const std::string& producer_id);
 
+    Producer(const std::vector<std::string>& bootstrap_servers, int flush_threshold, int flush_interval_ms, const std::string& producer_id, const ProducerOptions& options);
+
     ~Producer(); // Declare the destructor
 
-    // Produces a message to the message queue
-    bool ProduceMessage(const std::string& key, const std::string& value, const std::string& topic);
+    // Produces a message to the message queue. Key, value and header values are copied as raw bytes.
+    bool ProduceMessage(std::string_view key, std::string_view value, const std::string& topic, const std::vector<RecordHeader>& headers = {});
+
+    // Queues a message like ProduceMessage and calls done once its batch was acknowledged or failed.
+    // Returns false, without calling done, if the message could not be queued.
+    bool ProduceMessageAsync(std::string_view key, std::string_view value, const std::string& topic,
+                             const std::vector<RecordHeader>& headers, SendCallback done);
+
+    // Produces a message whose value write_value encodes in place, writing exactly value_size bytes.
+    // done, if set, is called as for ProduceMessageAsync.
+    bool ProduceMessageInPlace(std::string_view key, size_t value_size, const ValueWriter& write_value, const std::string& topic,
+                               const std::vector<RecordHeader>& headers = {}, SendCallback done = nullptr);
+
+    // Awaitable send: co_await producer.Send(...) yields the SendResult without blocking the
+    // awaiting thread. The coroutine is resumed through ProducerOptions::executor.
+    SendAwaitable Send(std::string_view key, std::string_view value, const std::string& topic, const std::vector<RecordHeader>& headers = {});
+
+    const Executor& executor() const;
+
+    // Batching decisions per partition written so far. Empty unless adaptive batching is enabled.
+    std::vector<PartitionBatchingMetrics> GetBatchingMetrics() const;
+
+    // Records dropped from sent batches because a later record had the same key
+    uint64_t GetConflatedRecordCount() const;
 
 private:
     class Impl; // Forward declaration of the implementation class
     std::unique_ptr<Impl> impl_; // Pointer to the implementation class
 };
 
+// Awaiter returned by Producer::Send. The message is queued when the coroutine suspends, so the
+// key and value only need to live until the co_await completes. The topic and headers are copied,
+// as they are often temporaries that end before an awaiter stored for later is awaited.
+class SendAwaitable {
+public:
+    SendAwaitable(Producer* producer, std::string_view key, std::string_view value, const std::string& topic, const std::vector<RecordHeader>& headers)
+        : producer_(producer), key_(key), value_(value), topic_(topic), headers_(headers) {}
+
+    bool await_ready() const noexcept { return false; }
+    bool await_suspend(std::coroutine_handle<> handle);
+    SendResult await_resume() { return std::move(result_); }
+
+private:
+    Producer* producer_;
+    std::string_view key_;
+    std::string_view value_;
+    std::string topic_;
+    std::vector<RecordHeader> headers_;
+    SendResult result_;
+};
+
 #endif // MESSAGE_QUEUE_PRODUCER_H
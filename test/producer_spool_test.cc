@@ -0,0 +1,200 @@
+#include "producer_spool.h"
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <sys/wait.h>
+#include <unistd.h>
+
+namespace {
+
+class ProducerSpoolTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        dir_ = std::filesystem::temp_directory_path() / ("spool-test-" + std::to_string(::getpid()) + "-"
+                                                         + ::testing::UnitTest::GetInstance()->current_test_info()->name());
+        std::filesystem::remove_all(dir_);
+    }
+
+    void TearDown() override {
+        std::filesystem::remove_all(dir_);
+    }
+
+    std::vector<std::string> Drain(ProducerSpool& spool) {
+        std::vector<std::string> records;
+        std::string record;
+        while (spool.Peek(&record)) {
+            records.push_back(record);
+            spool.Pop();
+        }
+        return records;
+    }
+
+    size_t SegmentCount() const {
+        size_t count = 0;
+        for (const auto& entry : std::filesystem::directory_iterator(dir_)) {
+            count += entry.path().extension() == ".log";
+        }
+        return count;
+    }
+
+    std::filesystem::path dir_;
+};
+
+TEST_F(ProducerSpoolTest, ReplaysRecordsInAppendOrder) {
+    ProducerSpool spool(dir_.string(), 4096);
+    EXPECT_TRUE(spool.Empty());
+
+    ASSERT_TRUE(spool.Append("first"));
+    ASSERT_TRUE(spool.Append(std::string("sec\0ond", 7)));
+    ASSERT_TRUE(spool.Append(""));
+    EXPECT_FALSE(spool.Empty());
+
+    EXPECT_EQ(Drain(spool), (std::vector<std::string>{"first", std::string("sec\0ond", 7), ""}));
+    EXPECT_TRUE(spool.Empty());
+}
+
+TEST_F(ProducerSpoolTest, IdsMatchBetweenAppendAndPeek) {
+    ProducerSpool spool(dir_.string(), 128);
+    std::vector<uint64_t> appended;
+    for (int i = 0; i < 10; ++i) {
+        uint64_t id;
+        ASSERT_TRUE(spool.Append("record-" + std::to_string(i), &id));
+        appended.push_back(id);
+    }
+
+    std::string record;
+    for (uint64_t expected : appended) {
+        uint64_t id;
+        ASSERT_TRUE(spool.Peek(&record, &id));
+        EXPECT_EQ(id, expected);
+        spool.Pop();
+    }
+    // Ids of undelivered records never repeat
+    std::sort(appended.begin(), appended.end());
+    EXPECT_EQ(std::adjacent_find(appended.begin(), appended.end()), appended.end());
+}
+
+TEST_F(ProducerSpoolTest, RollsSegmentsAndRemovesReplayedOnes) {
+    ProducerSpool spool(dir_.string(), 128);
+    std::vector<std::string> expected;
+    for (int i = 0; i < 20; ++i) {
+        expected.push_back(std::string(30, static_cast<char>('a' + i)));
+        ASSERT_TRUE(spool.Append(expected.back()));
+    }
+    EXPECT_GT(SegmentCount(), 1u);
+
+    EXPECT_EQ(Drain(spool), expected);
+    EXPECT_EQ(SegmentCount(), 1u);
+}
+
+TEST_F(ProducerSpoolTest, RecordLargerThanSegmentGetsItsOwnSegment) {
+    ProducerSpool spool(dir_.string(), 128);
+    std::string large(1000, 'x');
+    ASSERT_TRUE(spool.Append("small"));
+    ASSERT_TRUE(spool.Append(large));
+    ASSERT_TRUE(spool.Append("after"));
+
+    EXPECT_EQ(Drain(spool), (std::vector<std::string>{"small", large, "after"}));
+}
+
+TEST_F(ProducerSpoolTest, ReusesDrainedActiveSegment) {
+    ProducerSpool spool(dir_.string(), 128);
+    for (int round = 0; round < 10; ++round) {
+        ASSERT_TRUE(spool.Append(std::string(40, 'r')));
+        ASSERT_TRUE(spool.Append(std::string(40, 's')));
+        EXPECT_EQ(Drain(spool).size(), 2u);
+    }
+    // Wrapping back to the start of the drained segment never needs a new file
+    EXPECT_EQ(SegmentCount(), 1u);
+}
+
+TEST_F(ProducerSpoolTest, RecoversUndeliveredRecordsAfterRestart) {
+    {
+        ProducerSpool spool(dir_.string(), 128);
+        for (int i = 0; i < 8; ++i) {
+            ASSERT_TRUE(spool.Append("record-" + std::to_string(i)));
+        }
+        std::string record;
+        ASSERT_TRUE(spool.Peek(&record));
+        spool.Pop();
+        ASSERT_TRUE(spool.Peek(&record));
+        spool.Pop();
+    }
+
+    ProducerSpool reopened(dir_.string(), 128);
+    std::vector<std::string> expected;
+    for (int i = 2; i < 8; ++i) {
+        expected.push_back("record-" + std::to_string(i));
+    }
+    EXPECT_EQ(Drain(reopened), expected);
+}
+
+TEST_F(ProducerSpoolTest, RecoversRecordsOfAProcessThatCrashed) {
+    {
+        // Create the directory before forking so both processes agree on it
+        ProducerSpool spool(dir_.string(), 256);
+    }
+
+    pid_t child = ::fork();
+    ASSERT_GE(child, 0);
+    if (child == 0) {
+        ProducerSpool spool(dir_.string(), 256);
+        for (int i = 0; i < 50; ++i) {
+            spool.Append("crash-" + std::to_string(i));
+        }
+        std::string record;
+        spool.Peek(&record);
+        spool.Pop();
+        // Exit without destructors, as a crash would; the mapped pages reach the file regardless
+        ::_exit(0);
+    }
+    int status = 0;
+    ASSERT_EQ(::waitpid(child, &status, 0), child);
+    ASSERT_TRUE(WIFEXITED(status));
+
+    ProducerSpool recovered(dir_.string(), 256);
+    std::vector<std::string> records = Drain(recovered);
+    ASSERT_EQ(records.size(), 49u);
+    for (int i = 1; i < 50; ++i) {
+        EXPECT_EQ(records[i - 1], "crash-" + std::to_string(i));
+    }
+}
+
+TEST_F(ProducerSpoolTest, IgnoresBytesPastTheLastPublishedRecord) {
+    {
+        ProducerSpool spool(dir_.string(), 4096);
+        ASSERT_TRUE(spool.Append("complete"));
+    }
+
+    // A crash during an append leaves bytes after write_pos that were never published
+    std::filesystem::path segment;
+    for (const auto& entry : std::filesystem::directory_iterator(dir_)) {
+        segment = entry.path();
+    }
+    {
+        std::fstream file(segment, std::ios::in | std::ios::out | std::ios::binary);
+        file.seekp(64 + 4 + 8);
+        file.write("\x10\x00\x00\x00torn", 8);
+    }
+
+    ProducerSpool recovered(dir_.string(), 4096);
+    EXPECT_EQ(Drain(recovered), (std::vector<std::string>{"complete"}));
+}
+
+TEST_F(ProducerSpoolTest, RejectsSegmentWithCorruptHeader) {
+    {
+        ProducerSpool spool(dir_.string(), 4096);
+        ASSERT_TRUE(spool.Append("record"));
+    }
+    for (const auto& entry : std::filesystem::directory_iterator(dir_)) {
+        std::fstream file(entry.path(), std::ios::in | std::ios::out | std::ios::binary);
+        file.write("XXXX", 4);
+    }
+
+    EXPECT_THROW(ProducerSpool(dir_.string(), 4096), std::runtime_error);
+}
+
+}
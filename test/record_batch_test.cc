@@ -0,0 +1,321 @@
+#include "record_batch.h"
+#include <gtest/gtest.h>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+
+namespace {
+
+// The fixture is shared with the Java RecordBatchTest, so both codecs are held to the same bytes
+std::string ReadFixture(const std::string& name) {
+    std::ifstream file(std::string(RECORD_BATCH_FIXTURE_DIR) + "/" + name);
+    std::string hex;
+    file >> hex;
+    std::string bytes;
+    for (size_t i = 0; i + 1 < hex.size(); i += 2) {
+        bytes.push_back(static_cast<char>(std::stoi(hex.substr(i, 2), nullptr, 16)));
+    }
+    return bytes;
+}
+
+// The records of fixtures/record_batch.hex: binary keys and values, headers, a multi-byte
+// partition varint, a negative timestamp delta and a value with a two-byte length
+RecordBatchBuilder FixtureBuilder() {
+    RecordBatchBuilder builder("orders", 300);
+    builder.Append("k1", std::string("\x00\xff\x7f", 3), 1700000000000, {{"trace", std::string("\x01\x02", 2)}});
+    builder.Append("", "v2", 1699999999000, {});
+    builder.Append("k3", std::string(200, 'z'), 1700000005000, {{"a", ""}, {"b", "bee"}});
+    return builder;
+}
+
+void SetBaseOffset(std::string* batch, int64_t base_offset) {
+    for (int i = 0; i < 8; ++i) {
+        (*batch)[1 + i] = static_cast<char>(base_offset >> (56 - 8 * i));
+    }
+}
+
+TEST(RecordBatchTest, BuildMatchesFixture) {
+    std::string fixture = ReadFixture("record_batch.hex");
+    ASSERT_FALSE(fixture.empty());
+
+    RecordBatchBuilder builder = FixtureBuilder();
+    EXPECT_EQ(builder.Build(), fixture);
+    EXPECT_EQ(builder.size_bytes(), fixture.size());
+    EXPECT_EQ(builder.record_count(), 3);
+    EXPECT_EQ(builder.base_timestamp(), 1700000000000);
+}
+
+TEST(RecordBatchTest, DecodesFixture) {
+    std::string batch = ReadFixture("record_batch.hex");
+    SetBaseOffset(&batch, 1000);
+
+    RecordBatchHeader header;
+    std::vector<Record> records;
+    ASSERT_TRUE(DecodeRecordBatch(batch, &header, &records));
+    EXPECT_EQ(header.base_offset, 1000);
+    EXPECT_EQ(header.base_timestamp, 1700000000000);
+    EXPECT_EQ(header.record_count, 3);
+    EXPECT_EQ(header.last_offset_delta, 2);
+    EXPECT_EQ(header.topic, "orders");
+    EXPECT_EQ(header.partition, 300);
+
+    ASSERT_EQ(records.size(), 3u);
+    EXPECT_EQ(records[0].offset, 1000);
+    EXPECT_EQ(records[0].timestamp, 1700000000000);
+    EXPECT_EQ(records[0].key, "k1");
+    EXPECT_EQ(records[0].value, std::string("\x00\xff\x7f", 3));
+    ASSERT_EQ(records[0].headers.size(), 1u);
+    EXPECT_EQ(records[0].headers[0].key, "trace");
+    EXPECT_EQ(records[0].headers[0].value, std::string("\x01\x02", 2));
+
+    EXPECT_EQ(records[1].offset, 1001);
+    EXPECT_EQ(records[1].timestamp, 1699999999000);
+    EXPECT_EQ(records[1].key, "");
+    EXPECT_EQ(records[1].value, "v2");
+    EXPECT_TRUE(records[1].headers.empty());
+
+    EXPECT_EQ(records[2].offset, 1002);
+    EXPECT_EQ(records[2].timestamp, 1700000005000);
+    EXPECT_EQ(records[2].value, std::string(200, 'z'));
+    ASSERT_EQ(records[2].headers.size(), 2u);
+    EXPECT_EQ(records[2].headers[1].key, "b");
+    EXPECT_EQ(records[2].headers[1].value, "bee");
+}
+
+TEST(RecordBatchTest, ViewsMatchCopiedRecords) {
+    std::string batch = ReadFixture("record_batch.hex");
+
+    RecordBatchHeader header;
+    std::vector<Record> records;
+    std::vector<RecordView> views;
+    ASSERT_TRUE(DecodeRecordBatch(batch, &header, &records));
+    ASSERT_TRUE(DecodeRecordBatchViews(batch, &header, &views));
+
+    ASSERT_EQ(views.size(), records.size());
+    for (size_t i = 0; i < views.size(); ++i) {
+        EXPECT_EQ(views[i].offset, records[i].offset);
+        EXPECT_EQ(views[i].timestamp, records[i].timestamp);
+        EXPECT_EQ(views[i].key, records[i].key);
+        EXPECT_EQ(views[i].value, records[i].value);
+        ASSERT_EQ(views[i].headers.size(), records[i].headers.size());
+        for (size_t h = 0; h < views[i].headers.size(); ++h) {
+            EXPECT_EQ(views[i].headers[h].key, records[i].headers[h].key);
+            EXPECT_EQ(views[i].headers[h].value, records[i].headers[h].value);
+        }
+    }
+}
+
+TEST(RecordBatchTest, BaseOffsetIsOutsideCrc) {
+    std::string batch = ReadFixture("record_batch.hex");
+    SetBaseOffset(&batch, 0x0102030405060708);
+
+    RecordBatchHeader header;
+    std::vector<Record> records;
+    EXPECT_TRUE(DecodeRecordBatch(batch, &header, &records));
+    EXPECT_EQ(header.base_offset, 0x0102030405060708);
+}
+
+TEST(RecordBatchTest, CorruptByteFailsCrc) {
+    const std::string batch = ReadFixture("record_batch.hex");
+
+    // Every byte from the base timestamp on is covered by the CRC
+    for (size_t pos = 9; pos < batch.size(); ++pos) {
+        std::string corrupt = batch;
+        corrupt[pos] ^= 0x01;
+        RecordBatchHeader header;
+        std::vector<Record> records;
+        std::vector<RecordView> views;
+        EXPECT_FALSE(DecodeRecordBatch(corrupt, &header, &records)) << "byte " << pos;
+        EXPECT_FALSE(DecodeRecordBatchViews(corrupt, &header, &views)) << "byte " << pos;
+    }
+}
+
+TEST(RecordBatchTest, RejectsTruncatedBatch) {
+    const std::string batch = ReadFixture("record_batch.hex");
+
+    for (size_t size = 0; size < batch.size(); ++size) {
+        RecordBatchHeader header;
+        std::vector<Record> records;
+        EXPECT_FALSE(DecodeRecordBatch(std::string_view(batch).substr(0, size), &header, &records)) << "size " << size;
+    }
+}
+
+TEST(RecordBatchTest, RejectsWrongMagic) {
+    std::string batch = ReadFixture("record_batch.hex");
+    batch[0] = static_cast<char>(0xff);
+
+    RecordBatchHeader header;
+    EXPECT_FALSE(ReadRecordBatchHeader(batch, &header));
+}
+
+TEST(RecordBatchTest, EmptyBatchRoundTrips) {
+    RecordBatchBuilder builder("orders", 0);
+    std::string batch = builder.Build();
+
+    RecordBatchHeader header;
+    std::vector<Record> records;
+    ASSERT_TRUE(DecodeRecordBatch(batch, &header, &records));
+    EXPECT_EQ(header.record_count, 0);
+    EXPECT_EQ(header.last_offset_delta, -1);
+    EXPECT_TRUE(records.empty());
+}
+
+TEST(RecordBatchTest, RejectsLastOffsetDeltaBeforeLastRecord) {
+    std::string batch = ReadFixture("record_batch.hex");
+    // Three records cannot end at delta 1
+    batch[28] = 1;
+
+    RecordBatchHeader header;
+    EXPECT_FALSE(ReadRecordBatchHeader(batch, &header));
+}
+
+TEST(RecordBatchTest, ClearStartsANewBatch) {
+    RecordBatchBuilder builder = FixtureBuilder();
+    builder.Clear();
+    EXPECT_EQ(builder.record_count(), 0);
+
+    builder.Append("k", "v", 5, {});
+    RecordBatchHeader header;
+    std::vector<Record> records;
+    ASSERT_TRUE(DecodeRecordBatch(builder.Build(), &header, &records));
+    EXPECT_EQ(header.base_timestamp, 5);
+    ASSERT_EQ(records.size(), 1u);
+    EXPECT_EQ(records[0].offset, 0);
+}
+
+TEST(RecordBatchTest, ValueWriterMatchesCopiedValue) {
+    RecordBatchBuilder copied("orders", 1);
+    RecordBatchBuilder written("orders", 1);
+    copied.Append("key", "value", 10, {{"h", "v"}});
+    written.Append("key", 5, [](char* dest) { std::memcpy(dest, "value", 5); }, 10, {{"h", "v"}});
+
+    EXPECT_EQ(written.Build(), copied.Build());
+}
+
+std::vector<Record> Decode(const RecordBatchBuilder& builder) {
+    RecordBatchHeader header;
+    std::vector<Record> records;
+    EXPECT_TRUE(DecodeRecordBatch(builder.Build(), &header, &records));
+    EXPECT_EQ(header.record_count, builder.record_count());
+    // Replaced records keep their slot, so offset deltas stay contiguous
+    EXPECT_EQ(header.last_offset_delta, builder.record_count() - 1);
+    return records;
+}
+
+TEST(RecordBatchConflationTest, SameKeyReplacesRecordInItsSlot) {
+    RecordBatchBuilder builder("prices", 0, true);
+    builder.Append("a", "a1", 100, {});
+    builder.Append("b", "b1", 101, {});
+    builder.Append("c", "c1", 102, {});
+    EXPECT_EQ(builder.NextIndex("b"), 1);
+    EXPECT_EQ(builder.NextIndex("d"), 3);
+
+    // A longer value, so the records after the slot shift
+    builder.Append("b", "b2-longer-value", 105, {{"h", "v"}});
+    EXPECT_EQ(builder.record_count(), 3);
+    EXPECT_EQ(builder.conflated_count(), 1);
+    EXPECT_EQ(builder.size_bytes(), builder.Build().size());
+
+    std::vector<Record> records = Decode(builder);
+    ASSERT_EQ(records.size(), 3u);
+    EXPECT_EQ(records[0].key, "a");
+    EXPECT_EQ(records[0].value, "a1");
+    EXPECT_EQ(records[1].offset, 1);
+    EXPECT_EQ(records[1].key, "b");
+    EXPECT_EQ(records[1].value, "b2-longer-value");
+    EXPECT_EQ(records[1].timestamp, 105);
+    ASSERT_EQ(records[1].headers.size(), 1u);
+    EXPECT_EQ(records[1].headers[0].value, "v");
+    EXPECT_EQ(records[2].offset, 2);
+    EXPECT_EQ(records[2].value, "c1");
+}
+
+TEST(RecordBatchConflationTest, ShorterReplacementKeepsLaterSlotsIntact) {
+    RecordBatchBuilder builder("prices", 0, true);
+    builder.Append("a", std::string(200, 'a'), 100, {});
+    builder.Append("b", "b1", 101, {});
+    builder.Append("a", "a2", 102, {});
+    // The slot of b moved back; replacing it must still find it
+    builder.Append("b", "b2", 103, {});
+    builder.Append("c", "c1", 104, {});
+
+    EXPECT_EQ(builder.conflated_count(), 2);
+    std::vector<Record> records = Decode(builder);
+    ASSERT_EQ(records.size(), 3u);
+    EXPECT_EQ(records[0].value, "a2");
+    EXPECT_EQ(records[1].value, "b2");
+    EXPECT_EQ(records[2].key, "c");
+    EXPECT_EQ(records[2].offset, 2);
+}
+
+TEST(RecordBatchConflationTest, ReplacingLastRecord) {
+    RecordBatchBuilder builder("prices", 0, true);
+    builder.Append("a", "a1", 100, {});
+    builder.Append("b", "b1", 101, {});
+    builder.Append("b", "b2", 102, {});
+    builder.Append("b", "b3", 103, {});
+
+    EXPECT_EQ(builder.conflated_count(), 2);
+    std::vector<Record> records = Decode(builder);
+    ASSERT_EQ(records.size(), 2u);
+    EXPECT_EQ(records[1].value, "b3");
+    EXPECT_EQ(records[1].timestamp, 103);
+}
+
+TEST(RecordBatchConflationTest, EmptyKeysNeverConflate) {
+    RecordBatchBuilder builder("prices", 0, true);
+    builder.Append("", "first", 100, {});
+    EXPECT_EQ(builder.NextIndex(""), 1);
+    builder.Append("", "second", 101, {});
+
+    EXPECT_EQ(builder.record_count(), 2);
+    EXPECT_EQ(builder.conflated_count(), 0);
+    std::vector<Record> records = Decode(builder);
+    ASSERT_EQ(records.size(), 2u);
+    EXPECT_EQ(records[0].value, "first");
+    EXPECT_EQ(records[1].value, "second");
+}
+
+TEST(RecordBatchConflationTest, NonConflatingBuilderKeepsEveryRecord) {
+    RecordBatchBuilder builder("prices", 0);
+    builder.Append("a", "a1", 100, {});
+    EXPECT_EQ(builder.NextIndex("a"), 1);
+    builder.Append("a", "a2", 101, {});
+
+    EXPECT_EQ(builder.record_count(), 2);
+    EXPECT_EQ(builder.conflated_count(), 0);
+    EXPECT_EQ(Decode(builder).size(), 2u);
+}
+
+TEST(RecordBatchConflationTest, ValueWriterReplacesInPlace) {
+    RecordBatchBuilder builder("prices", 0, true);
+    builder.Append("a", "a1", 100, {});
+    builder.Append("b", "b1", 101, {});
+    builder.Append("a", 3, [](char* dest) { std::memcpy(dest, "a22", 3); }, 102, {});
+
+    std::vector<Record> records = Decode(builder);
+    ASSERT_EQ(records.size(), 2u);
+    EXPECT_EQ(records[0].value, "a22");
+    EXPECT_EQ(records[1].value, "b1");
+}
+
+TEST(RecordBatchConflationTest, ClearResetsConflationState) {
+    RecordBatchBuilder builder("prices", 0, true);
+    builder.Append("a", "a1", 100, {});
+    builder.Append("a", "a2", 101, {});
+    builder.Clear();
+
+    EXPECT_EQ(builder.conflated_count(), 0);
+    EXPECT_EQ(builder.NextIndex("a"), 0);
+    builder.Append("b", "b1", 200, {});
+    builder.Append("a", "a3", 201, {});
+
+    std::vector<Record> records = Decode(builder);
+    ASSERT_EQ(records.size(), 2u);
+    EXPECT_EQ(records[0].key, "b");
+    EXPECT_EQ(records[1].key, "a");
+    EXPECT_EQ(records[1].value, "a3");
+}
+
+}
@@ -0,0 +1,101 @@
+#include "table_snapshot.h"
+#include <gtest/gtest.h>
+#include <cstring>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace {
+
+std::string BuildSnapshot(const std::string& topic, const std::map<std::string, std::string>& entries) {
+    TableSnapshotWriter writer(topic, {{0, 0, 42}, {3, 0, 7}});
+    for (const auto& entry : entries) {
+        writer.Add(entry.first, entry.second);
+    }
+    return writer.Finish();
+}
+
+const std::map<std::string, std::string> kEntries = {
+    {"alpha", "1"},
+    {"", "empty key"},
+    {"binary", std::string("\x00\x01\x02", 3)},
+    {"long", std::string(300, 'l')},
+};
+
+TEST(TableSnapshotTest, RoundTrips) {
+    std::string data = BuildSnapshot("prices", kEntries);
+    EXPECT_EQ(data.size() % 8, 0u);
+
+    std::vector<SnapshotPartition> partitions;
+    std::map<std::string, std::string> applied;
+    ASSERT_TRUE(ReadTableSnapshot(data, "prices", &partitions, [&](std::string_view key, std::string_view value) {
+        applied.emplace(key, value);
+    }));
+
+    EXPECT_EQ(applied, kEntries);
+    ASSERT_EQ(partitions.size(), 2u);
+    EXPECT_EQ(partitions[0].partition, 0);
+    EXPECT_EQ(partitions[0].next_offset, 42);
+    EXPECT_EQ(partitions[1].partition, 3);
+    EXPECT_EQ(partitions[1].next_offset, 7);
+}
+
+TEST(TableSnapshotTest, EmptySnapshotRoundTrips) {
+    TableSnapshotWriter writer("prices", {});
+    EXPECT_EQ(writer.entry_count(), 0u);
+    std::string data = writer.Finish();
+
+    std::vector<SnapshotPartition> partitions = {{1, 0, 1}};
+    int applied = 0;
+    ASSERT_TRUE(ReadTableSnapshot(data, "prices", &partitions, [&](std::string_view, std::string_view) { ++applied; }));
+    EXPECT_EQ(applied, 0);
+    EXPECT_TRUE(partitions.empty());
+}
+
+TEST(TableSnapshotTest, RejectsEveryTornLengthWithoutApplying) {
+    std::string data = BuildSnapshot("prices", kEntries);
+
+    for (size_t size = 0; size < data.size(); ++size) {
+        std::vector<SnapshotPartition> partitions;
+        int applied = 0;
+        EXPECT_FALSE(ReadTableSnapshot(std::string_view(data).substr(0, size), "prices", &partitions,
+                                       [&](std::string_view, std::string_view) { ++applied; }))
+            << "size " << size;
+        EXPECT_EQ(applied, 0) << "size " << size;
+        EXPECT_TRUE(partitions.empty()) << "size " << size;
+    }
+}
+
+TEST(TableSnapshotTest, RejectsSnapshotOfAnotherTopic) {
+    std::string data = BuildSnapshot("prices", kEntries);
+
+    std::vector<SnapshotPartition> partitions;
+    int applied = 0;
+    auto apply = [&](std::string_view, std::string_view) { ++applied; };
+    EXPECT_FALSE(ReadTableSnapshot(data, "orders", &partitions, apply));
+    EXPECT_FALSE(ReadTableSnapshot(data, "price", &partitions, apply));
+    EXPECT_EQ(applied, 0);
+}
+
+TEST(TableSnapshotTest, RejectsBadMagic) {
+    std::string data = BuildSnapshot("prices", kEntries);
+    data[0] = 'X';
+
+    std::vector<SnapshotPartition> partitions;
+    EXPECT_FALSE(ReadTableSnapshot(data, "prices", &partitions, [](std::string_view, std::string_view) {}));
+}
+
+TEST(TableSnapshotTest, RejectsOversizedEntryLength) {
+    std::string data = BuildSnapshot("prices", {{"key", "value"}});
+    // The single entry starts after the 24-byte header, the padded topic and two partitions
+    size_t entry_pos = 24 + 8 + 2 * sizeof(SnapshotPartition);
+    uint32_t huge = 0xffffffff;
+    std::memcpy(&data[entry_pos + sizeof(uint32_t)], &huge, sizeof(huge));
+
+    std::vector<SnapshotPartition> partitions;
+    int applied = 0;
+    EXPECT_FALSE(ReadTableSnapshot(data, "prices", &partitions, [&](std::string_view, std::string_view) { ++applied; }));
+    EXPECT_EQ(applied, 0);
+}
+
+}
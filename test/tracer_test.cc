@@ -0,0 +1,108 @@
+#include "tracer.h"
+#include <gtest/gtest.h>
+#include <string>
+#include <vector>
+
+namespace {
+
+class TracerTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        Tracer::Instance().Reset();
+    }
+
+    void TearDown() override {
+        Tracer::Instance().Reset();
+    }
+
+    static StageLatency Latency(TraceStage stage) {
+        for (const auto& latency : Tracer::Instance().Snapshot()) {
+            if (latency.stage == stage) {
+                return latency;
+            }
+        }
+        return {stage, 0, 0, 0, 0};
+    }
+};
+
+TEST_F(TracerTest, StartTraceRoundTripsThroughParseTrace) {
+    uint64_t trace_id;
+    int64_t enqueue_us;
+    std::vector<RecordHeader> headers = Tracer::Instance().StartTrace({{"app", "value"}}, &trace_id, &enqueue_us);
+
+    // The application's headers are kept ahead of the trace header
+    ASSERT_EQ(headers.size(), 2u);
+    EXPECT_EQ(headers[0].key, "app");
+    EXPECT_EQ(headers[1].key, kTraceHeader);
+
+    uint64_t parsed_id = 0;
+    int64_t parsed_enqueue_us = 0;
+    ASSERT_TRUE(Tracer::ParseTrace(headers, &parsed_id, &parsed_enqueue_us));
+    EXPECT_EQ(parsed_id, trace_id);
+    EXPECT_EQ(parsed_enqueue_us, enqueue_us);
+}
+
+TEST_F(TracerTest, TraceIdsAreDistinct) {
+    uint64_t first, second;
+    int64_t enqueue_us;
+    Tracer::Instance().StartTrace({}, &first, &enqueue_us);
+    Tracer::Instance().StartTrace({}, &second, &enqueue_us);
+    EXPECT_NE(first, second);
+}
+
+TEST_F(TracerTest, ParseTraceRejectsMalformedHeaders) {
+    uint64_t trace_id;
+    int64_t enqueue_us;
+    std::string key(kTraceHeader);
+
+    EXPECT_FALSE(Tracer::ParseTrace({}, &trace_id, &enqueue_us));
+    EXPECT_FALSE(Tracer::ParseTrace({{"other", "1:2"}}, &trace_id, &enqueue_us));
+    EXPECT_FALSE(Tracer::ParseTrace({{key, "12345"}}, &trace_id, &enqueue_us));
+    EXPECT_FALSE(Tracer::ParseTrace({{key, "abc:123"}}, &trace_id, &enqueue_us));
+    EXPECT_FALSE(Tracer::ParseTrace({{key, "123:"}}, &trace_id, &enqueue_us));
+}
+
+TEST_F(TracerTest, PercentilesAreBucketUpperBounds) {
+    Tracer& tracer = Tracer::Instance();
+    for (int i = 0; i < 98; ++i) {
+        tracer.Record(TraceStage::kLinger, i, "orders", 0, 1000, 1100);
+    }
+    tracer.Record(TraceStage::kLinger, 98, "orders", 0, 1000, 6000);
+    tracer.Record(TraceStage::kLinger, 99, "orders", 0, 1000, 6000);
+
+    StageLatency latency = Latency(TraceStage::kLinger);
+    EXPECT_EQ(latency.count, 100u);
+    // 100 us falls in the bucket below 128 us
+    EXPECT_EQ(latency.p50_us, 127);
+    // 5000 us falls in the bucket below 8192 us, capped at the largest duration seen
+    EXPECT_EQ(latency.p99_us, 5000);
+    EXPECT_EQ(latency.max_us, 5000);
+}
+
+TEST_F(TracerTest, NegativeDurationsCountAsZero) {
+    // The end precedes the start when the hosts' clocks disagree
+    Tracer::Instance().Record(TraceStage::kProduceRequest, 1, "orders", 0, 2000, 1500);
+
+    StageLatency latency = Latency(TraceStage::kProduceRequest);
+    EXPECT_EQ(latency.count, 1u);
+    EXPECT_EQ(latency.p50_us, 0);
+    EXPECT_EQ(latency.p99_us, 0);
+    EXPECT_EQ(latency.max_us, 0);
+}
+
+TEST_F(TracerTest, EmptyStagesReportZero) {
+    Tracer::Instance().Record(TraceStage::kLinger, 1, "orders", 0, 0, 10);
+
+    StageLatency latency = Latency(TraceStage::kEndToEnd);
+    EXPECT_EQ(latency.count, 0u);
+    EXPECT_EQ(latency.p50_us, 0);
+    EXPECT_EQ(latency.p99_us, 0);
+}
+
+TEST_F(TracerTest, ResetClearsHistograms) {
+    Tracer::Instance().Record(TraceStage::kLinger, 1, "orders", 0, 0, 10);
+    Tracer::Instance().Reset();
+    EXPECT_EQ(Latency(TraceStage::kLinger).count, 0u);
+}
+
+} // namespace